@@ -15,7 +15,8 @@ int main(int argc, char** argv)
     if (argc < 11)
     {
         Logger::error << "Usage: " << std::endl;
-        Logger::error << "\t" << argv[0] << " dir formatIn start stop formatOut sigmaDer sigmaInt regularization iterations relaxation" << std::endl;
+        Logger::error << "\t" << argv[0] << " dir formatIn start stop formatOut sigmaDer sigmaInt regularization iterations relaxation [tolerance [local]]" << std::endl;
+        Logger::error << "\tlocal: 1 to start each solve from the local (Lucas-Kanade) flow; with 0 iterations, output it" << std::endl;
         exit(1);
     }
     
@@ -31,6 +32,8 @@ int main(int argc, char** argv)
     double regular          = atof(argv[8]);
     int iterations          = atoi(argv[9]);
     double relax            = atof(argv[10]);
+    double tolerance        = argc > 11 ? atof(argv[11]) : 0.0;
+    bool local              = argc > 12 ? atoi(argv[12]) != 0 : false;
     
     FileSet filesIn(FilePattern(dir, formatIn, start, stop));
     FileSet filesOut(FilePattern(dir, formatOut, start, stop-1));
@@ -53,6 +56,8 @@ int main(int argc, char** argv)
     flow->SetRegularization(regular);
     flow->SetRelaxation(relax);
     flow->SetIterations(iterations);
+    flow->SetRelativeTolerance(tolerance);
+    flow->SetInitializeLocally(local);
     
     // Compute optic flow for each image pair
     Logger::debug << "Computing optic flow." << std::endl;
@@ -62,6 +67,7 @@ int main(int argc, char** argv)
         flow->SetInput1(video[i]);
         flow->SetInput2(video[i+1]);
         flow->Update();
+        Logger::info << "CLG:\t" << (i+1) << ": " << flow->GetElapsedIterations() << " iterations" << std::endl;
         WriteImage< OutputImageType >(flow->GetOutput(), filesOut[i]);
     }
 
@@ -6,10 +6,10 @@
 #include "itkSquaredDifferenceImageFilter.h"
 #include "itkThresholdImageFilter.h"
 #include "itkVector.h"
-#include "itkWarpImageFilter.h"
 
 #include "FilePattern.h"
 #include "FileSet.h"
+#include "FlowWarpImageFilter.h"
 #include "ImageSetReader.h"
 #include "ImageUtils.h"
 #include "Logger.h"
@@ -43,8 +43,9 @@ int main(int argc, char** argv)
     typedef itk::Image< unsigned short, 2 > InputImageType;
     typedef itk::Image< float, 2 > InternalImageType;
     typedef itk::Image< itk::Vector< float, 2 >, 2 > FlowImageType;
-    typedef itk::WarpImageFilter< InternalImageType, InternalImageType, FlowImageType > WarpType;
+    typedef FlowWarpImageFilter< InternalImageType, InternalImageType, FlowImageType > WarpType;
     typedef itk::RegionOfInterestImageFilter< InternalImageType, InternalImageType > ROIType;
+    typedef ImageSetReader< InputImageType, InternalImageType > ReaderType;
     typedef itk::SquaredDifferenceImageFilter< InternalImageType, InternalImageType, InternalImageType > ErrorType;
     typedef NaryMeanImageFilter<InternalImageType, InternalImageType> MeanType;
     typedef itk::ThresholdImageFilter< InternalImageType > ThresholdType;
@@ -68,11 +69,10 @@ int main(int argc, char** argv)
     FileSet errorFiles(FilePattern(dir, errFormat, start, end-1));
     
     Logger::verbose << function << ": Setting up pipeline" << std::endl;
-    ImageSetReader<InputImageType, InternalImageType> images(imageFiles);
+    ReaderType images(imageFiles);
     ImageSetReader<FlowImageType, FlowImageType > flows(flowFiles);
     
     WarpType::Pointer warp = WarpType::New();
-    ROIType::Pointer roiOrig = ROIType::New();
     ROIType::Pointer roiWarp = ROIType::New();
     ErrorType::Pointer error = ErrorType::New();
     MeanType::Pointer mean = MeanType::New();
@@ -82,8 +82,12 @@ int main(int argc, char** argv)
     warp->SetOutputOrigin(images[0]->GetOrigin());
     warp->SetOutputSpacing(images[0]->GetSpacing());
     
-    roiOrig->SetRegionOfInterest(PadRegionByRadius(images[0]->GetLargestPossibleRegion(), radius));
-    roiWarp->SetRegionOfInterest(PadRegionByRadius(images[0]->GetLargestPossibleRegion(), radius));
+    // The warp needs whole moving images, but the images compared against
+    // them are only read within the region of interest
+    ReaderType::RegionType roi = PadRegionByRadius(images[0]->GetLargestPossibleRegion(), radius);
+    ReaderType originals(imageFiles);
+    originals.SetRegion(roi);
+    roiWarp->SetRegionOfInterest(roi);
     
     int cIdx = 0;
     
@@ -95,9 +99,8 @@ int main(int argc, char** argv)
         warp->SetInput(images[i+1]);
         warp->SetDeformationField(flows[i]);
         
-        roiOrig->SetInput(images[cIdx]);
         roiWarp->SetInput(warp->GetOutput());
-        error->SetInput1(roiOrig->GetOutput());
+        error->SetInput1(originals[cIdx]);
         error->SetInput2(roiWarp->GetOutput());
         WriteImage<InternalImageType, InputImageType>(warp->GetOutput(), warpFiles[i], false);
         WriteImage<InternalImageType, InternalImageType>(error->GetOutput(), errorFiles[i], false);
@@ -113,15 +116,13 @@ int main(int argc, char** argv)
         PrintImageInfo(error->GetOutput(), msg);
         
         // PSNR
-        psnr->SetSourceImage(roiOrig->GetOutput());
+        psnr->SetSourceImage(originals[cIdx]);
         psnr->SetReconstructImage(roiWarp->GetOutput());
         Logger::verbose << function << ": RMSE\tI(" << cIdx << ") - W(" << (i+1) << "):\t" << psnr->GetRMSE() << std::endl;
         Logger::verbose << function << ": PSNR\tI(" << cIdx << ") - W(" << (i+1) << "):\t" << psnr->GetPSNR() << std::endl;
         
         // What would happen if we didn't compute flow?  Hopefully, we've gotten some improvement, right?
-        roiWarp->SetInput(images[i+1]);
-        // Not sure why, but update needs to be called on both of these filters
-        roiWarp->Update(); 
+        psnr->SetReconstructImage(originals[i+1]);
         psnr->Update();
         Logger::verbose << function << ": RMSE\tI(" << cIdx << ") - I(" << (i+1) << "):\t" << psnr->GetRMSE() << std::endl;
         Logger::verbose << function << ": PSNR\tI(" << cIdx << ") - I(" << (i+1) << "):\t" << psnr->GetPSNR() << std::endl;
@@ -21,6 +21,12 @@
  *  - the order magnitued of the smoothness weighting parameter
  * A larger smoothness constraint leads to a slowly-evolving optical flow update, so more iterations are
  * needed to reach a stable solution.
+ *
+ * An optional relative tolerance stops iterating once the flow changes by less than that fraction
+ * of its first iteration's change; the iterations used are logged for each image pair.  An optional
+ * pair thread count computes that many image pairs at once.  An optional nonzero warm start damping
+ * starts each pair from the previous pair's flow times the damping (e.g. 1), which with a tolerance
+ * saves iterations on coherent motion; it computes one pair at a time.
  */
 int main(int argc, char** argv)
 {
@@ -29,7 +35,7 @@ int main(int argc, char** argv)
     Logger::debug << function << ": Parsing parameters" << std::endl;
     if (argc < 9)
     {
-        Logger::warning << "Usage:\n\t" << argv[0] << " dir formatIn start end formatOut sigma weight iterations" << std::endl;
+        Logger::warning << "Usage:\n\t" << argv[0] << " dir formatIn start end formatOut sigma weight iterations [tolerance] [pairThreads] [warmStart]" << std::endl;
         return 1;
     }
 
@@ -41,6 +47,9 @@ int main(int argc, char** argv)
     float sigma = atof(argv[6]);
     float weight = atof(argv[7]);
     int iterations = atoi(argv[8]);
+    double tolerance = argc > 9 ? atof(argv[9]) : 0.0;
+    int pairThreads = argc > 10 ? atoi(argv[10]) : 1;
+    double warmStart = argc > 11 ? atof(argv[11]) : 0.0;
     
     Logger::debug << function << ": Setting up image I/O" << std::endl;
     typedef itk::Image< unsigned short, 2 > InputImageType;
@@ -56,6 +65,10 @@ int main(int argc, char** argv)
     pipeline->SetSpatialSigma(sigma);
     pipeline->SetSmoothWeighting(weight);
     pipeline->SetIterations(iterations);
+    pipeline->SetRelativeTolerance(tolerance);
+    pipeline->SetPairThreads(pairThreads);
+    pipeline->SetWarmStart(warmStart > 0.0);
+    pipeline->SetWarmStartDamping(warmStart);
     
     TextPipelineObserver::Pointer observer = TextPipelineObserver::New();
     pipeline->AddObserver(observer.GetPointer());
@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "itkImage.h"
+
+#include "ImageIOPool.h"
+#include "ImageStack.h"
+#include "ImageStackUtils.h"
+#include "ImageUtils.h"
+#include "Logger.h"
+
+/**
+ * The stack pixel type ("char", "short", or "float") that holds the
+ * pixels of an image file without loss, from its header.  Returns "" if
+ * the header cannot be read.
+ */
+std::string NativeStackType(const std::string& file)
+{
+    PooledImageIO pooled(file);
+    itk::ImageIOBase* io = pooled.GetPointer();
+    if (io == NULL)
+        return "";
+
+    try
+    {
+        io->SetFileName(file.c_str());
+        io->ReadImageInformation();
+    }
+    catch (itk::ExceptionObject& e)
+    {
+        Logger::error << "Unable to read " << file << ": " << e.GetDescription() << std::endl;
+        return "";
+    }
+
+    switch (io->GetComponentType())
+    {
+    case itk::ImageIOBase::UCHAR:
+    case itk::ImageIOBase::CHAR:
+        return "char";
+    case itk::ImageIOBase::USHORT:
+    case itk::ImageIOBase::SHORT:
+        return "short";
+    default:
+        return "float";
+    }
+}
+
+/**
+ * Orders the stack pixel types by the values they hold; 0 if unknown.
+ */
+int StackTypeRank(const std::string& type)
+{
+    if (type == "char")
+        return 1;
+    else if (type == "short")
+        return 2;
+    else if (type == "float")
+        return 3;
+    return 0;
+}
+
+/**
+ * Writes the images named by patternIn, numbered start through end, to
+ * the image stack fileOut.
+ */
+template < class TImage >
+int ConvertToStack(const std::string& patternIn, int start, int end, const std::string& fileOut)
+{
+    char fileIn[256];
+    ImageStackWriter writer;
+    typename TImage::SizeType firstSize;
+
+    for (int i = start; i <= end; ++i)
+    {
+        sprintf(fileIn, patternIn.c_str(), i);
+        typename TImage::Pointer image = ReadImage< TImage >(fileIn);
+        typename TImage::SizeType size = image->GetLargestPossibleRegion().GetSize();
+
+        if (i == start)
+        {
+            // The first image sets the geometry of the whole stack
+            double spacing[2] = { image->GetSpacing()[0], image->GetSpacing()[1] };
+            double origin[2] = { image->GetOrigin()[0], image->GetOrigin()[1] };
+            firstSize = size;
+            if (!writer.Open(fileOut, StackPixelTraits< typename TImage::PixelType >::Type(),
+                    size[0], size[1], end - start + 1, spacing, origin))
+                return 1;
+        }
+        else if (size != firstSize)
+        {
+            Logger::error << fileIn << " is " << size[0] << "x" << size[1] << "; the stack is "
+                          << firstSize[0] << "x" << firstSize[1] << std::endl;
+            writer.Close();
+            return 1;
+        }
+
+        if (!writer.AppendFrame(image->GetBufferPointer()))
+            return 1;
+    }
+
+    return writer.Close() ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5)
+    {
+        Logger::error << "Usage:" << std::endl;
+        Logger::error << "\t" << argv[0] << " patternIn start end fileOut.its [char|short|float [narrow]]" << std::endl;
+        Logger::error << "\tThe pixel type defaults to that of the first input image; converting to a" << std::endl;
+        Logger::error << "\tnarrower type truncates pixel values, and is only done when narrow is given." << std::endl;
+        exit(1);
+    }
+
+    std::string patternIn(argv[1]);
+    int start = atoi(argv[2]);
+    int end = atoi(argv[3]);
+    std::string fileOut(argv[4]);
+    bool narrow = argc > 6 && std::string(argv[6]) == "narrow";
+
+    if (!ImageStack::IsStackFile(fileOut))
+    {
+        Logger::warning << "Image stack files should have the extension .its: " << fileOut << std::endl;
+    }
+
+    char firstFile[256];
+    sprintf(firstFile, patternIn.c_str(), start);
+    std::string native(NativeStackType(firstFile));
+    if (native == "")
+    {
+        Logger::error << "Unable to determine the pixel type of " << firstFile << std::endl;
+        return 1;
+    }
+
+    std::string type(argc > 5 ? argv[5] : native);
+    if (StackTypeRank(type) == 0)
+    {
+        Logger::error << "Unknown pixel type " << type << "; use char, short, or float" << std::endl;
+        return 1;
+    }
+    if (StackTypeRank(type) < StackTypeRank(native))
+    {
+        if (!narrow)
+        {
+            Logger::error << firstFile << " has " << native << " pixels; converting them to " << type
+                          << " would truncate them.  Add 'narrow' to convert anyway." << std::endl;
+            return 1;
+        }
+        Logger::warning << "Narrowing " << native << " pixels to " << type << std::endl;
+    }
+
+    if (type == "char")
+        return ConvertToStack< itk::Image< unsigned char, 2 > >(patternIn, start, end, fileOut);
+    else if (type == "short")
+        return ConvertToStack< itk::Image< unsigned short, 2 > >(patternIn, start, end, fileOut);
+    return ConvertToStack< itk::Image< float, 2 > >(patternIn, start, end, fileOut);
+}
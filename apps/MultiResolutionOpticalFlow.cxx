@@ -20,7 +20,7 @@ int main(int argc, char** argv)
     Logger::debug << function << ": Parsing parameters" << std::endl;
     if (argc < 6)
     {
-        Logger::warning << "Usage:\n\t" << argv[0] << " dir formatIn start count formatOut [sigmaD] [sigmaI] [regularization] [iterations] [levels]" << std::endl;
+        Logger::warning << "Usage:\n\t" << argv[0] << " dir formatIn start count formatOut [sigmaD] [sigmaI] [regularization] [iterations] [levels] [pairThreads]" << std::endl;
         return 1;
     }
 
@@ -34,6 +34,7 @@ int main(int argc, char** argv)
     float regularization = argc > 8 ? atof(argv[8]) : 10e4;
     int iterations = argc > 9 ? atoi(argv[9]) : 400;
     int levels = argc > 10 ? atoi(argv[10]) : 3;
+    int pairThreads = argc > 11 ? atoi(argv[11]) : 1;
     
     Logger::debug << function << ": Setting up image I/O" << std::endl;
     FileSet filesIn(FilePattern(dir, formatIn, start, start + count));
@@ -50,6 +51,7 @@ int main(int argc, char** argv)
     pipeline->SetRegularization(regularization);
     pipeline->SetIterations(iterations);
     pipeline->SetNumberOfLevels(levels);
+    pipeline->SetPairThreads(pairThreads);
     
     TextPipelineObserver::Pointer observer = TextPipelineObserver::New();
     pipeline->AddObserver(observer.GetPointer());
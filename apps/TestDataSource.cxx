@@ -56,6 +56,15 @@ int main(int argc, char** argv)
         WriteImage< InternalImageType, InputImageType >(filter->GetOutput(), filesOut[i], false);
     }
     
+    const SequenceManifest& manifest = data->GetManifest();
+    Logger::verbose << "Manifest:\n\tframes = " << manifest.size()
+            << "\n\tcomponent type = " << manifest.GetComponentType()
+            << "\n\tprobed = " << manifest.GetProbeCount() << std::endl;
+    
+    DataSource::Pointer detected = DataSource::New();
+    detected->SetFiles(filesIn);
+    Logger::verbose << "Detected pixel data type = " << detected->GetPixelDataType() << std::endl;
+    
     DataSource::Pointer empty = DataSource::New();
     Logger::verbose << "Empty data source:\n\tsize() = " << empty->size() << std::endl;
     Logger::verbose << "\tGetImage(0) = " << empty->GetImage(0) << std::endl;
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#include "itkImage.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkVector.h"
+
+#include "FileUtils.h"
+#include "FlowCodec.h"
+#include "FlowImageIO.h"
+#include "ImageUtils.h"
+#include "Logger.h"
+
+/**
+ * Writes a flow field as a flow file (.itf), reads it back, and reports
+ * the compression and the largest error introduced by quantization.
+ * Fails if the error exceeds the quantization's bound or the file is
+ * not at least minCompression times smaller than the raw floats.
+ */
+int main(int argc, char** argv)
+{
+    std::string function("TestFlowCodec");
+    if (argc < 3)
+    {
+        Logger::warning << "Usage:\n\t" << argv[0] << " flowIn flowOut.itf [errorBound] [fixed|half] [minCompression]"
+                << "\n\terrorBound - largest error allowed in a flow component, in pixels (fixed point only)"
+                << "\n\tminCompression - smallest ratio of raw float size to file size accepted (default 1)" << std::endl;
+        exit(1);
+    }
+
+    typedef itk::Image< itk::Vector< float, 2 >, 2 > FlowImageType;
+    typedef itk::ImageFileWriter< FlowImageType > WriterType;
+
+    std::string fileIn(argv[1]);
+    std::string fileOut(argv[2]);
+    if (!FlowCodec::IsFlowFile(fileOut))
+    {
+        Logger::error << function << ": output file should have the extension .itf: " << fileOut << std::endl;
+        exit(1);
+    }
+
+    FlowImageIO::Pointer io = FlowImageIO::New();
+    if (argc > 3)
+        io->SetErrorBound(atof(argv[3]));
+    if (argc > 4)
+        io->SetQuantization(std::string(argv[4]) == "half" ? FlowCodec::HalfFloat : FlowCodec::FixedPoint);
+    double minCompression = argc > 5 ? atof(argv[5]) : 1.0;
+
+    FlowImageType::Pointer flow = ReadImage< FlowImageType >(fileIn);
+
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetImageIO(io);
+    writer->SetInput(flow);
+    writer->SetFileName(fileOut.c_str());
+    writer->Update();
+
+    FlowImageType::Pointer decoded = ReadImage< FlowImageType >(fileOut);
+
+    FlowCodec::Header header;
+    if (!FlowCodec::ReadHeader(fileOut, header))
+        return 1;
+
+    // Fixed point rounds to the nearest step; half precision keeps 11
+    // significant bits, and 2^-25 absolute below its normal range.  The
+    // decoded values are floats, so allow their rounding too.
+    bool half = header.quantization == FlowCodec::HalfFloat;
+    typedef itk::ImageRegionConstIterator< FlowImageType > IteratorType;
+    IteratorType inIt(flow, flow->GetLargestPossibleRegion());
+    IteratorType outIt(decoded, decoded->GetLargestPossibleRegion());
+    double maxError = 0.0, maxExcess = 0.0;
+    for (inIt.GoToBegin(), outIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt, ++outIt)
+    {
+        for (unsigned int d = 0; d < 2; d++)
+        {
+            double value = inIt.Get()[d];
+            double error = std::fabs(value - outIt.Get()[d]);
+            double bound = half ? std::max(std::fabs(value) * std::ldexp(1.0, -11), std::ldexp(1.0, -25))
+                : header.step / 2;
+            bound += std::fabs(value) * std::ldexp(1.0, -23);
+            maxError = std::max(maxError, error);
+            maxExcess = std::max(maxExcess, error / bound);
+        }
+    }
+
+    long time, sizeIn, sizeOut;
+    FileStamp(fileIn, time, sizeIn);
+    FileStamp(fileOut, time, sizeOut);
+    double rawSize = 2.0 * sizeof(float) * flow->GetLargestPossibleRegion().GetNumberOfPixels();
+    double compression = sizeOut > 0 ? rawSize / sizeOut : 0.0;
+    Logger::info << function << ": " << fileIn << " (" << sizeIn << " bytes) -> "
+            << fileOut << " (" << sizeOut << " bytes)" << std::endl;
+    Logger::info << "\tCompression:\t" << compression << " (of " << rawSize << " bytes of floats)" << std::endl;
+    Logger::info << "\tMax error:  \t" << maxError << " (" << maxExcess << " of the bound)" << std::endl;
+
+    int result = 0;
+    if (maxExcess > 1.0)
+    {
+        Logger::error << function << ": error exceeds the " << (half ? "half precision" : "fixed point")
+                << " bound by a factor of " << maxExcess << std::endl;
+        result = 1;
+    }
+    if (compression < minCompression)
+    {
+        Logger::error << function << ": compression " << compression << " is below " << minCompression << std::endl;
+        result = 1;
+    }
+    return result;
+}
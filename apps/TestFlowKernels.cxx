@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "FlowKernels.h"
+#include "Logger.h"
+
+typedef std::vector< float > RowType;
+
+RowType RandomRow(long width, float scale, float offset = 0.0f)
+{
+    RowType row(width);
+    for (long x = 0; x < width; x++)
+        row[x] = offset + scale * (rand() / (float) RAND_MAX - 0.5f);
+    return row;
+}
+
+double MaxDifference(const RowType& a, const RowType& b)
+{
+    double diff = 0.0;
+    for (unsigned int i = 0; i < a.size(); i++)
+    {
+        double scale = std::max(1.0, (double) std::fabs(a[i]));
+        diff = std::max(diff, std::fabs(a[i] - b[i]) / scale);
+    }
+    return diff;
+}
+
+// A flow vector, indexed as FlowKernels::SplitRow and MergeRow expect
+struct FlowVector
+{
+    float value[2];
+    float& operator[](unsigned int i) { return value[i]; }
+    const float& operator[](unsigned int i) const { return value[i]; }
+};
+
+/**
+ * A flow field, row by row, read with zero-flux borders.
+ */
+struct FlowField
+{
+    long width, height;
+    std::vector< FlowVector > pixels;
+
+    FlowField(long width, long height, float scale) :
+        width(width), height(height), pixels(width * height)
+    {
+        for (unsigned int i = 0; i < pixels.size(); i++)
+        {
+            pixels[i][0] = scale * (rand() / (float) RAND_MAX - 0.5f);
+            pixels[i][1] = scale * (rand() / (float) RAND_MAX - 0.5f);
+        }
+    }
+
+    FlowVector* Row(long y) { return &pixels[std::max(0L, std::min(height - 1, y)) * width]; }
+
+    double At(long x, long y, unsigned int d)
+    {
+        return Row(y)[std::max(0L, std::min(width - 1, x))][d];
+    }
+
+    // The weighted average of the 8 neighbors, and the sum of the 4
+    // nearest, as the neighborhood-iterator step filters computed them
+    double Average(long x, long y, unsigned int d)
+    {
+        return (1.0 / 6.0) * (At(x, y-1, d) + At(x+1, y, d) + At(x, y+1, d) + At(x-1, y, d)) +
+            (1.0 / 12.0) * (At(x-1, y-1, d) + At(x+1, y-1, d) + At(x-1, y+1, d) + At(x+1, y+1, d));
+    }
+
+    double Sum(long x, long y, unsigned int d)
+    {
+        return At(x-1, y, d) + At(x+1, y, d) + At(x, y-1, d) + At(x, y+1, d);
+    }
+
+    // Planar rows y-1, y, and y+1 with one pixel of border
+    void SplitRows(long y, RowType* u, RowType* v)
+    {
+        for (int r = 0; r < 3; r++)
+        {
+            u[r].resize(width + 2);
+            v[r].resize(width + 2);
+            FlowKernels::SplitRow(Row(y - 1 + r), width, 0, width, 1, &u[r][0], &v[r][0]);
+        }
+    }
+};
+
+double MaxDifference(FlowField& a, FlowField& b)
+{
+    double diff = 0.0;
+    for (unsigned int i = 0; i < a.pixels.size(); i++)
+    {
+        for (unsigned int d = 0; d < 2; d++)
+        {
+            double scale = std::max(1.0, (double) std::fabs(a.pixels[i][d]));
+            diff = std::max(diff, std::fabs(a.pixels[i][d] - b.pixels[i][d]) / scale);
+        }
+    }
+    return diff;
+}
+
+/**
+ * Runs one step of each flow update the way it was made before the
+ * planar kernels, a pixel at a time in double precision over the
+ * neighborhood, and the way the step filters and RedBlackSORSolver now
+ * make it, on planar rows with precomputed coefficients; and compares
+ * them.  Returns the largest difference of the four.
+ */
+double CompareWithBaseline(long width, long height)
+{
+    FlowField flow(width, height, 4.0f), initial(width, height, 2.0f);
+    long pixels = width * height;
+    RowType t11 = RandomRow(pixels, 50.0f, 50.0f), t12 = RandomRow(pixels, 20.0f), t13 = RandomRow(pixels, 20.0f);
+    RowType t22 = RandomRow(pixels, 50.0f, 50.0f), t23 = RandomRow(pixels, 20.0f);
+    RowType ix = RandomRow(pixels, 20.0f), iy = RandomRow(pixels, 20.0f), it = RandomRow(pixels, 20.0f);
+    const double regularization = 10.0, alpha = regularization * regularization;
+    const double omega = 1.9;
+
+    RowType u[3], v[3];
+    RowType au(width), av(width), nextU(width), nextV(width);
+    RowType c[5];
+    for (int i = 0; i < 5; i++)
+        c[i].resize(width);
+    double worst = 0.0;
+
+    // GaussSeidelIterativeStepImageFilter
+    FlowField expected(flow), result(flow);
+    for (long y = 0; y < height; y++)
+    {
+        for (long x = 0; x < width; x++)
+        {
+            long p = y * width + x;
+            double lu = flow.Average(x, y, 0), lv = flow.Average(x, y, 1);
+            double denom = alpha + t11[p] + t22[p];
+            expected.Row(y)[x][0] = lu - (t11[p] * lu + t12[p] * lv + t13[p]) / denom;
+            expected.Row(y)[x][1] = lv - (t12[p] * lu + t22[p] * lv + t23[p]) / denom;
+        }
+
+        flow.SplitRows(y, u, v);
+        FlowKernels::NeighborAverage(&u[0][0], &u[1][0], &u[2][0], width, &au[0]);
+        FlowKernels::NeighborAverage(&v[0][0], &v[1][0], &v[2][0], width, &av[0]);
+        for (long x = 0; x < width; x++)
+        {
+            long p = y * width + x;
+            double denom = alpha + t11[p] + t22[p];
+            c[0][x] = t11[p] / denom;
+            c[1][x] = t12[p] / denom;
+            c[2][x] = t13[p] / denom;
+            c[3][x] = t22[p] / denom;
+            c[4][x] = t23[p] / denom;
+        }
+        FlowKernels::GaussSeidelUpdate(&au[0], &av[0], &c[0][0], &c[1][0], &c[2][0], &c[3][0], &c[4][0],
+            width, &nextU[0], &nextV[0]);
+        FlowKernels::MergeRow(&nextU[0], &nextV[0], width, result.Row(y));
+    }
+    worst = std::max(worst, MaxDifference(expected, result));
+
+    // CLGOpticalFlowIterativeStepImageFilter, with unit spacing
+    const double factor = 1.0 / regularization;
+    for (long y = 0; y < height; y++)
+    {
+        for (long x = 0; x < width; x++)
+        {
+            long p = y * width + x;
+            double cu = flow.At(x, y, 0), cv = flow.At(x, y, 1);
+            double nu = (1.0 - omega) * cu +
+                omega * (flow.Sum(x, y, 0) - factor * (t12[p] * cv + t13[p])) / (4 + factor * t11[p]);
+            expected.Row(y)[x][0] = nu;
+            expected.Row(y)[x][1] = (1.0 - omega) * cv +
+                omega * (flow.Sum(x, y, 1) - factor * (t12[p] * nu + t23[p])) / (4 + factor * t22[p]);
+        }
+
+        flow.SplitRows(y, u, v);
+        FlowKernels::NeighborSum(&u[0][0], &u[1][0], &u[2][0], width, &au[0]);
+        FlowKernels::NeighborSum(&v[0][0], &v[1][0], &v[2][0], width, &av[0]);
+        for (long x = 0; x < width; x++)
+        {
+            long p = y * width + x;
+            c[0][x] = omega / (4.0 + factor * t11[p]);
+            c[1][x] = factor * t12[p];
+            c[2][x] = factor * t13[p];
+            c[3][x] = omega / (4.0 + factor * t22[p]);
+            c[4][x] = factor * t23[p];
+        }
+        FlowKernels::CLGUpdate(&au[0], &av[0], &u[1][1], &v[1][1], &c[0][0], &c[1][0], &c[2][0], &c[3][0], &c[4][0],
+            omega, width, &nextU[0], &nextV[0]);
+        FlowKernels::MergeRow(&nextU[0], &nextV[0], width, result.Row(y));
+    }
+    worst = std::max(worst, MaxDifference(expected, result));
+
+    // HornOpticalFlowIterativeStepImageFilter, smoothing the total flow
+    FlowField total(flow);
+    for (long p = 0; p < pixels; p++)
+    {
+        total.pixels[p][0] += initial.pixels[p][0];
+        total.pixels[p][1] += initial.pixels[p][1];
+    }
+    for (long y = 0; y < height; y++)
+    {
+        for (long x = 0; x < width; x++)
+        {
+            long p = y * width + x;
+            double lu = total.Average(x, y, 0), lv = total.Average(x, y, 1);
+            double data = (ix[p] * lu + iy[p] * lv + it[p]) / (alpha + ix[p] * ix[p] + iy[p] * iy[p]);
+            expected.Row(y)[x][0] = lu - ix[p] * data - initial.At(x, y, 0);
+            expected.Row(y)[x][1] = lv - iy[p] * data - initial.At(x, y, 1);
+        }
+
+        total.SplitRows(y, u, v);
+        FlowKernels::NeighborAverage(&u[0][0], &u[1][0], &u[2][0], width, &au[0]);
+        FlowKernels::NeighborAverage(&v[0][0], &v[1][0], &v[2][0], width, &av[0]);
+        for (long x = 0; x < width; x++)
+        {
+            long p = y * width + x;
+            double scale = 1.0 / std::sqrt(alpha + ix[p] * ix[p] + iy[p] * iy[p]);
+            c[0][x] = ix[p] * scale;
+            c[1][x] = iy[p] * scale;
+            c[2][x] = it[p] * scale;
+        }
+        FlowKernels::SplitRow(initial.Row(y), width, 0, width, 0, &c[3][0], &c[4][0]);
+        FlowKernels::HornUpdate(&au[0], &av[0], &c[0][0], &c[1][0], &c[2][0], &c[3][0], &c[4][0],
+            width, &nextU[0], &nextV[0]);
+        FlowKernels::MergeRow(&nextU[0], &nextV[0], width, result.Row(y));
+    }
+    worst = std::max(worst, MaxDifference(expected, result));
+
+    // One iteration of RedBlackSORSolver, in place, color by color
+    expected = flow;
+    result = flow;
+    RowType weight(width);
+    for (unsigned int color = 0; color < 4; color++)
+    {
+        for (long y = color / 2; y < height; y += 2)
+        {
+            for (long x = color % 2; x < width; x += 2)
+            {
+                long p = y * width + x;
+                double a11 = alpha + t11[p], a12 = t12[p], a22 = alpha + t22[p];
+                double b1 = alpha * expected.Average(x, y, 0) - t13[p];
+                double b2 = alpha * expected.Average(x, y, 1) - t23[p];
+                double det = a11 * a22 - a12 * a12;
+                FlowVector& w = expected.Row(y)[x];
+                w[0] += omega * ((a22 * b1 - a12 * b2) / det - w[0]);
+                w[1] += omega * ((a11 * b2 - a12 * b1) / det - w[1]);
+            }
+
+            result.SplitRows(y, u, v);
+            FlowKernels::NeighborAverage(&u[0][0], &u[1][0], &u[2][0], width, &au[0]);
+            FlowKernels::NeighborAverage(&v[0][0], &v[1][0], &v[2][0], width, &av[0]);
+            for (long x = 0; x < width; x++)
+            {
+                long p = y * width + x;
+                double a11 = alpha + t11[p], a12 = t12[p], a22 = alpha + t22[p];
+                double det = a11 * a22 - a12 * a12;
+                c[0][x] = a22 / det;
+                c[1][x] = -a12 / det;
+                c[2][x] = a11 / det;
+                c[3][x] = -t13[p];
+                c[4][x] = -t23[p];
+                weight[x] = 1.0f;
+            }
+            FlowKernels::RedBlackUpdate(&au[0], &av[0], &u[1][1], &v[1][1], &c[0][0], &c[1][0], &c[2][0],
+                &c[3][0], &c[4][0], &weight[0], alpha, omega, width, &nextU[0], &nextV[0]);
+            for (long x = color % 2; x < width; x += 2)
+            {
+                result.Row(y)[x][0] = nextU[x];
+                result.Row(y)[x][1] = nextV[x];
+            }
+        }
+    }
+    worst = std::max(worst, MaxDifference(expected, result));
+    return worst;
+}
+
+/**
+ * Runs every flow row kernel with each instruction set the processor
+ * supports, and compares the results with the scalar kernels, and the
+ * updates made with them with the per-pixel updates they replaced.  Row
+ * widths are chosen to exercise the vector loops and their scalar
+ * tails.
+ */
+int main()
+{
+    std::string function("TestFlowKernels");
+    Logger::info << function << ": best supported instruction set is "
+        << FlowKernels::GetInstructionSetName(FlowKernels::GetSupportedInstructionSet()) << std::endl;
+
+    double tolerance = 1e-6;
+    double baselineTolerance = 1e-5;
+    bool ok = true;
+    long widths[] = { 1, 3, 4, 7, 8, 9, 17, 640 };
+    for (unsigned int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+        long width = widths[w];
+        RowType above = RandomRow(width + 2, 4.0f), row = RandomRow(width + 2, 4.0f), below = RandomRow(width + 2, 4.0f);
+        RowType au = RandomRow(width, 4.0f), av = RandomRow(width, 4.0f);
+        RowType t11 = RandomRow(width, 50.0f, 50.0f), t12 = RandomRow(width, 20.0f), t13 = RandomRow(width, 20.0f);
+        RowType t22 = RandomRow(width, 50.0f, 50.0f), t23 = RandomRow(width, 20.0f);
+
+        // Update coefficients, as the step filters compute them
+        RowType c11(width), c12(width), c13(width), c22(width), c23(width);
+        for (long x = 0; x < width; x++)
+        {
+            float denom = 100.0f + t11[x] + t22[x];
+            c11[x] = t11[x] / denom;
+            c12[x] = t12[x] / denom;
+            c13[x] = t13[x] / denom;
+            c22[x] = t22[x] / denom;
+            c23[x] = t23[x] / denom;
+        }
+
+        // A 16x16 image, sampled along a row with displacements large
+        // enough that some samples fall outside it
+        const long size = 16;
+        RowType image = RandomRow(size * size, 100.0f);
+        RowType bx(width), dx = RandomRow(width, 40.0f), dy = RandomRow(width, 20.0f);
+        for (long x = 0; x < width; x++)
+            bx[x] = 0.3f + 0.9f * (x % size);
+
+        RowType expected[9];
+        for (int set = FlowKernels::Scalar; set <= FlowKernels::GetSupportedInstructionSet(); set++)
+        {
+            FlowKernels::SetInstructionSet((FlowKernels::InstructionSet) set);
+            RowType result[9];
+            for (int i = 0; i < 9; i++)
+                result[i].assign(width, 0.0f);
+
+            FlowKernels::NeighborAverage(&above[0], &row[0], &below[0], width, &result[0][0]);
+            FlowKernels::NeighborSum(&above[0], &row[0], &below[0], width, &result[1][0]);
+            FlowKernels::GaussSeidelUpdate(&au[0], &av[0], &c11[0], &c12[0], &c13[0], &c22[0], &c23[0],
+                width, &result[2][0], &result[3][0]);
+            FlowKernels::CLGUpdate(&au[0], &av[0], &row[1], &below[1], &c11[0], &t12[0], &t13[0], &c22[0], &t23[0],
+                1.9f, width, &result[4][0], &result[5][0]);
+            FlowKernels::HornUpdate(&au[0], &av[0], &c12[0], &c13[0], &c23[0], &row[1], &below[1],
+                width, &result[6][0], &result[7][0]);
+            FlowKernels::WarpRow(&image[0], size, size, &bx[0], 7.5f, &dx[0], &dy[0], 0.5f, 1.0f, -1.0f,
+                width, &result[8][0]);
+
+            // Float rows against the double-precision neighborhood
+            // updates, on a field as wide as the rows
+            double baseline = CompareWithBaseline(width, 5);
+            if (baseline > baselineTolerance)
+            {
+                Logger::error << function << ": " << FlowKernels::GetInstructionSetName((FlowKernels::InstructionSet) set)
+                    << " planar update differs from the neighborhood update by " << baseline
+                    << " at width " << width << std::endl;
+                ok = false;
+            }
+
+            if (set == FlowKernels::Scalar)
+            {
+                for (int i = 0; i < 9; i++)
+                    expected[i] = result[i];
+                continue;
+            }
+            for (int i = 0; i < 9; i++)
+            {
+                double diff = MaxDifference(expected[i], result[i]);
+                if (diff > tolerance)
+                {
+                    Logger::error << function << ": " << FlowKernels::GetInstructionSetName((FlowKernels::InstructionSet) set)
+                        << " result " << i << " differs from scalar by " << diff << " at width " << width << std::endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    Logger::info << function << ": " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
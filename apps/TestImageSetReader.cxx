@@ -4,6 +4,8 @@
 
 #include "FilePattern.h"
 #include "FileSet.h"
+#include "FrameCache.h"
+#include "ImageIOPool.h"
 #include "ImageSetReader.h"
 #include "Logger.h"
 
@@ -61,6 +63,28 @@ int main(int argc, char** argv)
         reader[16];
     }
     
+    {
+        Logger::debug << "********** Testing reader with radius 1, prefetching, incremental access **********" << std::endl;
+        ReaderType reader(files);
+        reader.SetCacheRadius(1);
+        reader.SetPrefetch(true);
+        for (int i = 0; i < reader.size(); i++)
+            reader[i];
+        for (int i = reader.size()-1; i >= 0; i--)
+            reader[i];
+        
+        Logger::debug << "********** Testing reader with radius 0, prefetching, pairwise access **********" << std::endl;
+        reader.SetCacheRadius(0);
+        for (int i = 0; i < reader.size()-1; i++)
+        {
+            reader[i+1];
+            reader[i];
+        }
+        Logger::debug << "Prefetch hits: " << reader.GetPrefetchHitCount() 
+                << " misses: " << reader.GetPrefetchMissCount() << std::endl;
+        reader.GetTelemetry().Print(Logger::debug);
+    }
+    
     {
         Logger::debug << "********** Testing reader with radius 0 **********" << std::endl;
         ReaderType reader(files);
@@ -90,4 +114,56 @@ int main(int argc, char** argv)
         Logger::debug << "********** Requesting an invalid image index **********" << std::endl;
         reader[30];
     }
+    
+    {
+        Logger::debug << "********** Testing two readers sharing the frame cache **********" << std::endl;
+        FrameCache& cache = FrameCache::Instance();
+        cache.Clear();
+        ReaderType first(files);
+        ReaderType second(files);
+        for (int i = 0; i < first.size(); i++)
+        {
+            first[i];
+            second[i];
+        }
+        cache.LogStatistics();
+        ImageIOPool::Instance().LogStatistics();
+        
+        Logger::debug << "********** Shrinking the frame cache budget to one frame **********" << std::endl;
+        cache.SetMemoryBudget(FrameCache::ImageBytes(first[0].GetPointer()));
+        for (int i = 0; i < first.size(); i++)
+            first[i];
+        cache.LogStatistics();
+    }
+    
+    {
+        Logger::debug << "********** Testing reader with a region and halo **********" << std::endl;
+        FrameCache& cache = FrameCache::Instance();
+        cache.Clear();
+        ReaderType reader(files);
+        ReaderType::RegionType region = reader[0]->GetLargestPossibleRegion();
+        ReaderType::RegionType::IndexType index;
+        ReaderType::RegionType::SizeType size;
+        index[0] = region.GetSize()[0] / 4;
+        index[1] = region.GetSize()[1] / 4;
+        size[0] = region.GetSize()[0] / 2;
+        size[1] = region.GetSize()[1] / 2;
+        region.SetIndex(index);
+        region.SetSize(size);
+        
+        reader.SetRegion(region, 4);
+        reader.SetCacheRadius(1);
+        for (int i = 0; i < reader.size(); i++)
+            reader[i];
+        ReaderType::RegionType read = reader[0]->GetLargestPossibleRegion();
+        Logger::debug << "Read region " << read.GetSize()[0] << "x" << read.GetSize()[1]
+                << " for region " << size[0] << "x" << size[1] << " with halo 4" << std::endl;
+        cache.LogStatistics();
+        
+        Logger::debug << "********** Going back to whole images **********" << std::endl;
+        reader.ClearRegion();
+        for (int i = 0; i < reader.size(); i++)
+            reader[i];
+        cache.LogStatistics();
+    }
 }
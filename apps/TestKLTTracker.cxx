@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#include "itkImage.h"
+
+#include "FeatureTrackFile.h"
+#include "FramePyramidCache.h"
+#include "KLTFeatureTracker.h"
+#include "Logger.h"
+
+typedef itk::Image< float, 2 > ImageType;
+typedef KLTFeatureTracker< ImageType > TrackerType;
+typedef FramePyramidCache< ImageType > PyramidCacheType;
+
+/**
+ * A textured test frame: a field of Gaussian blobs, moved by (dx, dy).
+ */
+ImageType::Pointer MakeFrame(long width, long height, const std::vector< float >& blobs, double dx, double dy)
+{
+    ImageType::Pointer image = ImageType::New();
+    ImageType::RegionType region;
+    region.SetSize(0, width);
+    region.SetSize(1, height);
+    image->SetRegions(region);
+    image->Allocate();
+    image->FillBuffer(0);
+
+    float* pixels = image->GetBufferPointer();
+    for (unsigned int b = 0; b < blobs.size(); b += 4)
+    {
+        double cx = blobs[b] + dx, cy = blobs[b+1] + dy, sigma = blobs[b+2], weight = blobs[b+3];
+        long r = (long) std::ceil(3 * sigma);
+        for (long y = std::max(0L, (long) cy - r); y <= std::min(height - 1, (long) cy + r); y++)
+            for (long x = std::max(0L, (long) cx - r); x <= std::min(width - 1, (long) cx + r); x++)
+                pixels[y * width + x] += weight * std::exp(-0.5 * ((x - cx) * (x - cx) + (y - cy) * (y - cy)) / (sigma * sigma));
+    }
+    return image;
+}
+
+/**
+ * Tracks features through a synthetic sequence moving at a known
+ * velocity, and checks the tracks and their round trip through a track
+ * file.
+ */
+int main(int argc, char** argv)
+{
+    std::string function("TestKLTTracker");
+    std::string trackFile = argc > 1 ? argv[1] : "TestKLTTracker.itr";
+    double vx = argc > 2 ? atof(argv[2]) : 3.3;
+    double vy = argc > 3 ? atof(argv[3]) : -1.7;
+    const long width = 320, height = 240;
+    const unsigned int frames = 6, levels = 3;
+
+    srand(1);
+    std::vector< float > blobs;
+    for (int b = 0; b < 400; b++)
+    {
+        blobs.push_back(rand() % width);
+        blobs.push_back(rand() % height);
+        blobs.push_back(1.5 + 2.0 * rand() / RAND_MAX);
+        blobs.push_back(50 + rand() % 200);
+    }
+
+    TrackerType::Pointer tracker = TrackerType::New();
+    tracker->SetMaximumFeatures(200);
+    PyramidCacheType pyramids;
+    TrackerType::FeatureList features;
+
+    ImageType::Pointer frame = MakeFrame(width, height, blobs, 0, 0);
+    tracker->DetectFeatures(frame, features);
+    TrackerType::FeatureList seeds(features);
+    PyramidCacheType::PyramidType previous = pyramids.GetPyramid(0, levels, frame);
+    Logger::info << function << ": " << features.size() << " features detected" << std::endl;
+
+    FeatureTrackWriter writer;
+    FeatureTrackFile::PointList points;
+    std::vector< FeatureTrackFile::PointList > written;
+    writer.Open(trackFile);
+
+    bool ok = !features.empty();
+    double total = 0;
+    unsigned long matches = 0;
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        if (i > 0)
+        {
+            frame = MakeFrame(width, height, blobs, i * vx, i * vy);
+            PyramidCacheType::PyramidType current = pyramids.GetPyramid(i, levels, frame);
+            tracker->TrackFeatures(previous, current, features);
+            previous = current;
+        }
+
+        points.clear();
+        unsigned int active = 0;
+        for (unsigned int f = 0; f < features.size(); f++)
+        {
+            if (!features[f].active)
+                continue;
+            active++;
+            double ex = features[f].position[0] - (seeds[f].position[0] + i * vx);
+            double ey = features[f].position[1] - (seeds[f].position[1] + i * vy);
+            total += std::sqrt(ex * ex + ey * ey);
+            matches++;
+            FeatureTrackFile::Point point;
+            point.id = features[f].id;
+            point.x = features[f].position[0];
+            point.y = features[f].position[1];
+            points.push_back(point);
+        }
+        writer.AppendFrame(points);
+        written.push_back(points);
+        Logger::info << function << ": frame " << i << ": " << active << " of " << features.size()
+            << " features active, mean error so far " << (matches > 0 ? total / matches : 0) << " pixels" << std::endl;
+        if (active < features.size() / 2)
+            ok = false;
+    }
+    writer.Close();
+    // Blobs leaving the frame take a few features with them, so test the
+    // mean error
+    if (matches == 0 || total / matches > 0.05)
+        ok = false;
+
+    // Read the tracks back
+    FeatureTrackReader reader;
+    bool same = reader.Open(trackFile) && reader.GetFrameCount() == frames &&
+        reader.GetTrackCount() == tracker->GetNextFeatureId();
+    for (unsigned int i = 0; same && i < frames; i++)
+    {
+        same = reader.ReadFrame(points) && points.size() == written[i].size();
+        for (unsigned int p = 0; same && p < points.size(); p++)
+            same = points[p].id == written[i][p].id && points[p].x == written[i][p].x && points[p].y == written[i][p].y;
+    }
+    same = same && !reader.ReadFrame(points);
+    Logger::info << function << ": track file " << (same ? "matches" : "does not match") << std::endl;
+
+    ok = ok && same;
+    Logger::info << function << ": " << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include <string>
+
+#include "FeatureTrackFile.h"
+#include "FilePattern.h"
+#include "FileSet.h"
+#include "ImageFileSetReader.h"
+#include "KLTTrackerPipeline.h"
+#include "Logger.h"
+#include "TextPipelineObserver.h"
+
+/**
+ * \brief Track sparse features through an image sequence with the pyramidal KLT tracker.
+ *
+ * Writes the tracks as a feature track file (.itr); see FeatureTrackFile.
+ */
+int main(int argc, char** argv)
+{
+    std::string function("TrackFeatures");
+
+    Logger::debug << function << ": Parsing parameters" << std::endl;
+    if (argc < 6)
+    {
+        Logger::warning << "Usage:\n\t" << argv[0] << " dir formatIn start count tracks.itr [maxFeatures] [windowRadius] [levels] [reseedFrames] [minCorrelation]" << std::endl;
+        return 1;
+    }
+
+    std::string dir = argv[1];
+    std::string formatIn = argv[2];
+    int start = atoi(argv[3]);
+    int count = atoi(argv[4]);
+    std::string trackFile = argv[5];
+    int maxFeatures = argc > 6 ? atoi(argv[6]) : 500;
+    int windowRadius = argc > 7 ? atoi(argv[7]) : 3;
+    int levels = argc > 8 ? atoi(argv[8]) : 3;
+    int reseedFrames = argc > 9 ? atoi(argv[9]) : 5;
+    float minCorrelation = argc > 10 ? atof(argv[10]) : 0.65;
+
+    if (!FeatureTrackFile::IsTrackFile(trackFile))
+    {
+        Logger::warning << function << ": track file should have the extension .itr: " << trackFile << std::endl;
+    }
+
+    Logger::debug << function << ": Setting up image I/O" << std::endl;
+    FileSet filesIn(FilePattern(dir, formatIn, start, start + count));
+    ImageFileSetReader::Pointer images = ImageFileSetReader::New();
+    images->SetFileSet(filesIn);
+
+    Logger::debug << function << ": Setting up feature tracker" << std::endl;
+    KLTTrackerPipeline::Pointer pipeline = KLTTrackerPipeline::New();
+    pipeline->SetInput(images);
+    pipeline->SetTrackFile(trackFile);
+    pipeline->SetNumberOfLevels(levels);
+    pipeline->SetReseedFrames(reseedFrames);
+    pipeline->GetTracker()->SetMaximumFeatures(maxFeatures);
+    pipeline->GetTracker()->SetWindowRadius(windowRadius);
+    pipeline->GetTracker()->SetMinimumCorrelation(minCorrelation);
+
+    TextPipelineObserver::Pointer observer = TextPipelineObserver::New();
+    pipeline->AddObserver(observer.GetPointer());
+
+    Logger::debug << function << ": Tracking features" << std::endl;
+    pipeline->Update();
+    return pipeline->GetSuccess() ? 0 : 1;
+}
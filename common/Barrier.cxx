@@ -0,0 +1,31 @@
+#include "Barrier.h"
+
+#include "MutexLocker.h"
+
+Barrier::Barrier(unsigned int count) :
+    count(count > 0 ? count : 1),
+    waiting(0),
+    generation(0)
+{
+}
+
+Barrier::~Barrier()
+{
+}
+
+void Barrier::Wait()
+{
+    MutexLocker lock(this->mutex);
+    unsigned int arrival = this->generation;
+    if (++this->waiting == this->count)
+    {
+        // Last one in releases everyone and starts the next phase
+        this->waiting = 0;
+        this->generation++;
+        this->condition.Broadcast();
+        return;
+    }
+
+    while (arrival == this->generation)
+        this->condition.Wait(this->mutex);
+}
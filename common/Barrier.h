@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Condition.h"
+#include "Mutex.h"
+
+/**
+ * \class Barrier
+ * \brief Blocks a fixed number of threads until all of them arrive.
+ * Each of Count threads calls Wait(); none returns until the last one
+ * has called it.  The Barrier then resets itself, so the same threads
+ * can use it again for the next phase of their work.
+ */
+class Barrier
+{
+public:
+    Barrier(unsigned int count);
+    virtual ~Barrier();
+    void Wait();
+    unsigned int GetCount() const
+    { return this->count; }
+private:
+    // Not implemented on purpose.
+    Barrier(const Barrier& other);
+    void operator=(const Barrier& other);
+
+    Mutex mutex;
+    Condition condition;
+    unsigned int count;
+    unsigned int waiting;
+    unsigned int generation;
+};
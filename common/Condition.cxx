@@ -0,0 +1,54 @@
+#include "Condition.h"
+
+Condition::Condition()
+{
+#ifdef IT_USE_PTHREADS
+    pthread_cond_init(&this->condition, NULL);
+#endif
+    
+#ifdef IT_USE_WIN32_THREADS
+    InitializeConditionVariable(&this->condition);
+#endif
+}
+
+Condition::~Condition()
+{
+#ifdef IT_USE_PTHREADS
+    pthread_cond_destroy(&this->condition);
+#endif
+    
+    // Win32 condition variables need no cleanup.
+}
+
+void Condition::Wait(const Mutex& mutex) const
+{
+#ifdef IT_USE_PTHREADS
+    pthread_cond_wait(&this->condition, &mutex.lock);
+#endif
+    
+#ifdef IT_USE_WIN32_THREADS
+    SleepConditionVariableCS(&this->condition, &mutex.lock, INFINITE);
+#endif
+}
+
+void Condition::Signal() const
+{
+#ifdef IT_USE_PTHREADS
+    pthread_cond_signal(&this->condition);
+#endif
+    
+#ifdef IT_USE_WIN32_THREADS
+    WakeConditionVariable(&this->condition);
+#endif
+}
+
+void Condition::Broadcast() const
+{
+#ifdef IT_USE_PTHREADS
+    pthread_cond_broadcast(&this->condition);
+#endif
+    
+#ifdef IT_USE_WIN32_THREADS
+    WakeAllConditionVariable(&this->condition);
+#endif
+}
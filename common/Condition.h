@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Mutex.h"
+
+// Include platform-dependent thread libraries 
+// and define condition variable type.
+
+#ifdef IT_USE_PTHREADS
+#include <pthread.h>
+typedef pthread_cond_t ConditionType;
+#endif
+
+#ifdef IT_USE_WIN32_THREADS
+#include <windows.h>
+#include <winbase.h>
+typedef CONDITION_VARIABLE ConditionType;
+#endif
+
+/**
+ * \class Condition
+ * \brief Implements a condition variable.
+ * Basic platform-dependent condition variable, used together with
+ * a Mutex to let one thread sleep until another thread signals that
+ * some shared state has changed.  The Mutex must be locked when
+ * Wait() is called; it is released while waiting and locked again
+ * before Wait() returns.  As with all condition variables, waiters
+ * should re-check their condition in a loop.
+ */
+class Condition
+{
+public:
+    Condition();
+    virtual ~Condition();
+    void Wait(const Mutex& mutex) const;
+    void Signal() const;
+    void Broadcast() const;
+protected:
+    mutable ConditionType condition;
+private:
+    // Not implemented on purpose.
+    Condition(const Condition& other);
+    void operator=(const Condition& other);
+};
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <string>
 #include <cassert>
+#include <cstdio>
+#include <string>
 
 /**
  * Represents a naming pattern for a group of files. A pattern consists
@@ -1,6 +1,8 @@
 #include "FileUtils.h"
 
 #include <cstdlib>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #ifdef _WIN32
 extern const std::string PATH_DELIMITER("\\");
@@ -82,4 +84,15 @@ unsigned long NumberPart(const std::string& filename)
     firstNumber=filename.find_last_not_of("0123456789", lastNumber);
     firstNumber = firstNumber == std::string::npos ? 0 : firstNumber+1;
     return (unsigned long) atoi(&filename.c_str()[firstNumber]);
-}
\ No newline at end of file
+}
+
+bool FileStamp(const std::string& filename, long& time, long& size)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+        return false;
+
+    time = (long) info.st_mtime;
+    size = (long) info.st_size;
+    return true;
+}
@@ -43,3 +43,9 @@ unsigned long NumberPart(const std::string& filename);
  * delimiter. This modifies the input string.
  */
 void CapDirectory(std::string& directory);
+
+/**
+ * Gets the modification time and size of a file. Returns false if the
+ * file does not exist.
+ */
+bool FileStamp(const std::string& filename, long& time, long& size);
@@ -0,0 +1,620 @@
+#include "FlowKernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "Logger.h"
+
+// x86 vector versions.  Each is compiled for its own instruction set and
+// only called once the processor is known to support it.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define IT_FLOWKERNELS_X86
+#define IT_TARGET_SSE __attribute__((target("sse2")))
+#define IT_TARGET_AVX __attribute__((target("avx")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define IT_FLOWKERNELS_X86
+#define IT_TARGET_SSE
+#define IT_TARGET_AVX
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+//------------------------------------------------------------------------
+// Scalar kernels.  The vector kernels finish each row with these, and
+// add in the same order, so the results agree.
+//------------------------------------------------------------------------
+
+static const float SIXTH = 1.0f / 6.0f;
+static const float TWELFTH = 1.0f / 12.0f;
+
+static void NeighborAverageScalar(const float* above, const float* row, const float* below, long width, float* out)
+{
+    for (long x = 0; x < width; x++)
+    {
+        out[x] = SIXTH * (above[x+1] + row[x+2] + below[x+1] + row[x]) +
+            TWELFTH * (above[x] + above[x+2] + below[x] + below[x+2]);
+    }
+}
+
+static void NeighborSumScalar(const float* above, const float* row, const float* below, long width, float* out)
+{
+    for (long x = 0; x < width; x++)
+    {
+        out[x] = row[x] + row[x+2] + above[x+1] + below[x+1];
+    }
+}
+
+static void GaussSeidelUpdateScalar(const float* au, const float* av,
+    const float* c11, const float* c12, const float* c13, const float* c22, const float* c23,
+    long width, float* u, float* v)
+{
+    for (long x = 0; x < width; x++)
+    {
+        u[x] = au[x] - (c11[x] * au[x] + c12[x] * av[x] + c13[x]);
+        v[x] = av[x] - (c12[x] * au[x] + c22[x] * av[x] + c23[x]);
+    }
+}
+
+static void CLGUpdateScalar(const float* su, const float* sv, const float* cu, const float* cv,
+    const float* d11, const float* b12, const float* b13, const float* d22, const float* b23,
+    float omega, long width, float* u, float* v)
+{
+    float keep = 1.0f - omega;
+    for (long x = 0; x < width; x++)
+    {
+        float nu = keep * cu[x] + d11[x] * (su[x] - (b12[x] * cv[x] + b13[x]));
+        u[x] = nu;
+        v[x] = keep * cv[x] + d22[x] * (sv[x] - (b12[x] * nu + b23[x]));
+    }
+}
+
+static void RedBlackUpdateScalar(const float* au, const float* av, const float* cu, const float* cv,
+    const float* i11, const float* i12, const float* i22, const float* b1, const float* b2, const float* w,
+    float alpha, float omega, long width, float* u, float* v)
+{
+    for (long x = 0; x < width; x++)
+    {
+        float ru = alpha * au[x] + b1[x];
+        float rv = alpha * av[x] + b2[x];
+        float step = omega * w[x];
+        u[x] = cu[x] + step * ((i11[x] * ru + i12[x] * rv) - cu[x]);
+        v[x] = cv[x] + step * ((i12[x] * ru + i22[x] * rv) - cv[x]);
+    }
+}
+
+static void HornUpdateScalar(const float* au, const float* av,
+    const float* gx, const float* gy, const float* gt, const float* iu, const float* iv,
+    long width, float* u, float* v)
+{
+    for (long x = 0; x < width; x++)
+    {
+        float c = gx[x] * au[x] + gy[x] * av[x] + gt[x];
+        u[x] = au[x] - gx[x] * c - iu[x];
+        v[x] = av[x] - gy[x] * c - iv[x];
+    }
+}
+
+// The four pixels around (x0, y0), repeating the last row and column.
+static inline void GatherCorners(const float* image, long width, long height, long x0, long y0,
+    float& a, float& b, float& c, float& d)
+{
+    const float* top = image + y0 * width;
+    const float* bottom = y0 < height - 1 ? top + width : top;
+    long x1 = x0 < width - 1 ? x0 + 1 : x0;
+    a = top[x0];
+    b = top[x1];
+    c = bottom[x0];
+    d = bottom[x1];
+}
+
+static void WarpRowScalar(const float* image, long width, long height, const float* bx, float by,
+    const float* dx, const float* dy, float scaleX, float scaleY, float pad, long count, float* out)
+{
+    const float maxX = (float) (width - 1), maxY = (float) (height - 1);
+    for (long x = 0; x < count; x++)
+    {
+        float cx = bx[x] + dx[x] * scaleX;
+        float cy = by + dy[x] * scaleY;
+        if (!(cx >= 0.0f && cx <= maxX && cy >= 0.0f && cy <= maxY))
+        {
+            out[x] = pad;
+            continue;
+        }
+
+        long x0 = (long) cx, y0 = (long) cy;
+        float fx = cx - x0, fy = cy - y0;
+        float a, b, c, d;
+        GatherCorners(image, width, height, x0, y0, a, b, c, d);
+        float top = a + fx * (b - a);
+        float bottom = c + fx * (d - c);
+        out[x] = top + fy * (bottom - top);
+    }
+}
+
+#ifdef IT_FLOWKERNELS_X86
+
+//------------------------------------------------------------------------
+// SSE kernels, 4 pixels at a time
+//------------------------------------------------------------------------
+
+IT_TARGET_SSE
+static void NeighborAverageSSE(const float* above, const float* row, const float* below, long width, float* out)
+{
+    const __m128 sixth = _mm_set1_ps(SIXTH);
+    const __m128 twelfth = _mm_set1_ps(TWELFTH);
+    long x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 edges = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_loadu_ps(above + x + 1), _mm_loadu_ps(row + x + 2)),
+            _mm_loadu_ps(below + x + 1)), _mm_loadu_ps(row + x));
+        __m128 corners = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_loadu_ps(above + x), _mm_loadu_ps(above + x + 2)),
+            _mm_loadu_ps(below + x)), _mm_loadu_ps(below + x + 2));
+        _mm_storeu_ps(out + x, _mm_add_ps(_mm_mul_ps(sixth, edges), _mm_mul_ps(twelfth, corners)));
+    }
+    NeighborAverageScalar(above + x, row + x, below + x, width - x, out + x);
+}
+
+IT_TARGET_SSE
+static void NeighborSumSSE(const float* above, const float* row, const float* below, long width, float* out)
+{
+    long x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        _mm_storeu_ps(out + x, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_loadu_ps(row + x), _mm_loadu_ps(row + x + 2)),
+            _mm_loadu_ps(above + x + 1)), _mm_loadu_ps(below + x + 1)));
+    }
+    NeighborSumScalar(above + x, row + x, below + x, width - x, out + x);
+}
+
+IT_TARGET_SSE
+static void GaussSeidelUpdateSSE(const float* au, const float* av,
+    const float* c11, const float* c12, const float* c13, const float* c22, const float* c23,
+    long width, float* u, float* v)
+{
+    long x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 a = _mm_loadu_ps(au + x), b = _mm_loadu_ps(av + x);
+        __m128 k12 = _mm_loadu_ps(c12 + x);
+        __m128 ru = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c11 + x), a), _mm_mul_ps(k12, b)), _mm_loadu_ps(c13 + x));
+        __m128 rv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(k12, a), _mm_mul_ps(_mm_loadu_ps(c22 + x), b)), _mm_loadu_ps(c23 + x));
+        _mm_storeu_ps(u + x, _mm_sub_ps(a, ru));
+        _mm_storeu_ps(v + x, _mm_sub_ps(b, rv));
+    }
+    GaussSeidelUpdateScalar(au + x, av + x, c11 + x, c12 + x, c13 + x, c22 + x, c23 + x,
+        width - x, u + x, v + x);
+}
+
+IT_TARGET_SSE
+static void CLGUpdateSSE(const float* su, const float* sv, const float* cu, const float* cv,
+    const float* d11, const float* b12, const float* b13, const float* d22, const float* b23,
+    float omega, long width, float* u, float* v)
+{
+    const __m128 keep = _mm_set1_ps(1.0f - omega);
+    long x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 k12 = _mm_loadu_ps(b12 + x);
+        __m128 a = _mm_loadu_ps(cu + x), b = _mm_loadu_ps(cv + x);
+        __m128 nu = _mm_add_ps(_mm_mul_ps(keep, a), _mm_mul_ps(_mm_loadu_ps(d11 + x),
+            _mm_sub_ps(_mm_loadu_ps(su + x), _mm_add_ps(_mm_mul_ps(k12, b), _mm_loadu_ps(b13 + x)))));
+        __m128 nv = _mm_add_ps(_mm_mul_ps(keep, b), _mm_mul_ps(_mm_loadu_ps(d22 + x),
+            _mm_sub_ps(_mm_loadu_ps(sv + x), _mm_add_ps(_mm_mul_ps(k12, nu), _mm_loadu_ps(b23 + x)))));
+        _mm_storeu_ps(u + x, nu);
+        _mm_storeu_ps(v + x, nv);
+    }
+    CLGUpdateScalar(su + x, sv + x, cu + x, cv + x, d11 + x, b12 + x, b13 + x, d22 + x, b23 + x,
+        omega, width - x, u + x, v + x);
+}
+
+IT_TARGET_SSE
+static void RedBlackUpdateSSE(const float* au, const float* av, const float* cu, const float* cv,
+    const float* i11, const float* i12, const float* i22, const float* b1, const float* b2, const float* w,
+    float alpha, float omega, long width, float* u, float* v)
+{
+    const __m128 a = _mm_set1_ps(alpha);
+    const __m128 o = _mm_set1_ps(omega);
+    long x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 ru = _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(au + x)), _mm_loadu_ps(b1 + x));
+        __m128 rv = _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(av + x)), _mm_loadu_ps(b2 + x));
+        __m128 k12 = _mm_loadu_ps(i12 + x);
+        __m128 step = _mm_mul_ps(o, _mm_loadu_ps(w + x));
+        __m128 pu = _mm_loadu_ps(cu + x), pv = _mm_loadu_ps(cv + x);
+        __m128 tu = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(i11 + x), ru), _mm_mul_ps(k12, rv));
+        __m128 tv = _mm_add_ps(_mm_mul_ps(k12, ru), _mm_mul_ps(_mm_loadu_ps(i22 + x), rv));
+        _mm_storeu_ps(u + x, _mm_add_ps(pu, _mm_mul_ps(step, _mm_sub_ps(tu, pu))));
+        _mm_storeu_ps(v + x, _mm_add_ps(pv, _mm_mul_ps(step, _mm_sub_ps(tv, pv))));
+    }
+    RedBlackUpdateScalar(au + x, av + x, cu + x, cv + x, i11 + x, i12 + x, i22 + x, b1 + x, b2 + x, w + x,
+        alpha, omega, width - x, u + x, v + x);
+}
+
+IT_TARGET_SSE
+static void HornUpdateSSE(const float* au, const float* av,
+    const float* gx, const float* gy, const float* gt, const float* iu, const float* iv,
+    long width, float* u, float* v)
+{
+    long x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 a = _mm_loadu_ps(au + x), b = _mm_loadu_ps(av + x);
+        __m128 kx = _mm_loadu_ps(gx + x), ky = _mm_loadu_ps(gy + x);
+        __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(kx, a), _mm_mul_ps(ky, b)), _mm_loadu_ps(gt + x));
+        _mm_storeu_ps(u + x, _mm_sub_ps(_mm_sub_ps(a, _mm_mul_ps(kx, c)), _mm_loadu_ps(iu + x)));
+        _mm_storeu_ps(v + x, _mm_sub_ps(_mm_sub_ps(b, _mm_mul_ps(ky, c)), _mm_loadu_ps(iv + x)));
+    }
+    HornUpdateScalar(au + x, av + x, gx + x, gy + x, gt + x, iu + x, iv + x, width - x, u + x, v + x);
+}
+
+// The sample positions, weights, and blend are vector operations; the
+// corner pixels are loaded one lane at a time.
+IT_TARGET_SSE
+static void WarpRowSSE(const float* image, long width, long height, const float* bx, float by,
+    const float* dx, const float* dy, float scaleX, float scaleY, float pad, long count, float* out)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxX = _mm_set1_ps((float) (width - 1)), maxY = _mm_set1_ps((float) (height - 1));
+    const __m128 sx = _mm_set1_ps(scaleX), sy = _mm_set1_ps(scaleY);
+    const __m128 base = _mm_set1_ps(by), padding = _mm_set1_ps(pad);
+    int ix[4], iy[4];
+    float a[4], b[4], c[4], d[4];
+    long x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128 cx = _mm_add_ps(_mm_loadu_ps(bx + x), _mm_mul_ps(_mm_loadu_ps(dx + x), sx));
+        __m128 cy = _mm_add_ps(base, _mm_mul_ps(_mm_loadu_ps(dy + x), sy));
+        __m128 inside = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(cx, zero), _mm_cmple_ps(cx, maxX)),
+            _mm_and_ps(_mm_cmpge_ps(cy, zero), _mm_cmple_ps(cy, maxY)));
+
+        // Clamp, so that lanes outside the image still load from it
+        cx = _mm_min_ps(_mm_max_ps(cx, zero), maxX);
+        cy = _mm_min_ps(_mm_max_ps(cy, zero), maxY);
+        __m128i x0 = _mm_cvttps_epi32(cx), y0 = _mm_cvttps_epi32(cy);
+        __m128 fx = _mm_sub_ps(cx, _mm_cvtepi32_ps(x0)), fy = _mm_sub_ps(cy, _mm_cvtepi32_ps(y0));
+        _mm_storeu_si128((__m128i*) ix, x0);
+        _mm_storeu_si128((__m128i*) iy, y0);
+        for (int i = 0; i < 4; i++)
+            GatherCorners(image, width, height, ix[i], iy[i], a[i], b[i], c[i], d[i]);
+
+        __m128 va = _mm_loadu_ps(a), vb = _mm_loadu_ps(b), vc = _mm_loadu_ps(c), vd = _mm_loadu_ps(d);
+        __m128 top = _mm_add_ps(va, _mm_mul_ps(fx, _mm_sub_ps(vb, va)));
+        __m128 bottom = _mm_add_ps(vc, _mm_mul_ps(fx, _mm_sub_ps(vd, vc)));
+        __m128 value = _mm_add_ps(top, _mm_mul_ps(fy, _mm_sub_ps(bottom, top)));
+        _mm_storeu_ps(out + x, _mm_or_ps(_mm_and_ps(inside, value), _mm_andnot_ps(inside, padding)));
+    }
+    WarpRowScalar(image, width, height, bx + x, by, dx + x, dy + x, scaleX, scaleY, pad, count - x, out + x);
+}
+
+//------------------------------------------------------------------------
+// AVX kernels, 8 pixels at a time
+//------------------------------------------------------------------------
+
+IT_TARGET_AVX
+static void NeighborAverageAVX(const float* above, const float* row, const float* below, long width, float* out)
+{
+    const __m256 sixth = _mm256_set1_ps(SIXTH);
+    const __m256 twelfth = _mm256_set1_ps(TWELFTH);
+    long x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 edges = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_loadu_ps(above + x + 1), _mm256_loadu_ps(row + x + 2)),
+            _mm256_loadu_ps(below + x + 1)), _mm256_loadu_ps(row + x));
+        __m256 corners = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_loadu_ps(above + x), _mm256_loadu_ps(above + x + 2)),
+            _mm256_loadu_ps(below + x)), _mm256_loadu_ps(below + x + 2));
+        _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_mul_ps(sixth, edges), _mm256_mul_ps(twelfth, corners)));
+    }
+    NeighborAverageScalar(above + x, row + x, below + x, width - x, out + x);
+}
+
+IT_TARGET_AVX
+static void NeighborSumAVX(const float* above, const float* row, const float* below, long width, float* out)
+{
+    long x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_loadu_ps(row + x), _mm256_loadu_ps(row + x + 2)),
+            _mm256_loadu_ps(above + x + 1)), _mm256_loadu_ps(below + x + 1)));
+    }
+    NeighborSumScalar(above + x, row + x, below + x, width - x, out + x);
+}
+
+IT_TARGET_AVX
+static void GaussSeidelUpdateAVX(const float* au, const float* av,
+    const float* c11, const float* c12, const float* c13, const float* c22, const float* c23,
+    long width, float* u, float* v)
+{
+    long x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 a = _mm256_loadu_ps(au + x), b = _mm256_loadu_ps(av + x);
+        __m256 k12 = _mm256_loadu_ps(c12 + x);
+        __m256 ru = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(c11 + x), a), _mm256_mul_ps(k12, b)), _mm256_loadu_ps(c13 + x));
+        __m256 rv = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(k12, a), _mm256_mul_ps(_mm256_loadu_ps(c22 + x), b)), _mm256_loadu_ps(c23 + x));
+        _mm256_storeu_ps(u + x, _mm256_sub_ps(a, ru));
+        _mm256_storeu_ps(v + x, _mm256_sub_ps(b, rv));
+    }
+    GaussSeidelUpdateScalar(au + x, av + x, c11 + x, c12 + x, c13 + x, c22 + x, c23 + x,
+        width - x, u + x, v + x);
+}
+
+IT_TARGET_AVX
+static void CLGUpdateAVX(const float* su, const float* sv, const float* cu, const float* cv,
+    const float* d11, const float* b12, const float* b13, const float* d22, const float* b23,
+    float omega, long width, float* u, float* v)
+{
+    const __m256 keep = _mm256_set1_ps(1.0f - omega);
+    long x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 k12 = _mm256_loadu_ps(b12 + x);
+        __m256 a = _mm256_loadu_ps(cu + x), b = _mm256_loadu_ps(cv + x);
+        __m256 nu = _mm256_add_ps(_mm256_mul_ps(keep, a), _mm256_mul_ps(_mm256_loadu_ps(d11 + x),
+            _mm256_sub_ps(_mm256_loadu_ps(su + x), _mm256_add_ps(_mm256_mul_ps(k12, b), _mm256_loadu_ps(b13 + x)))));
+        __m256 nv = _mm256_add_ps(_mm256_mul_ps(keep, b), _mm256_mul_ps(_mm256_loadu_ps(d22 + x),
+            _mm256_sub_ps(_mm256_loadu_ps(sv + x), _mm256_add_ps(_mm256_mul_ps(k12, nu), _mm256_loadu_ps(b23 + x)))));
+        _mm256_storeu_ps(u + x, nu);
+        _mm256_storeu_ps(v + x, nv);
+    }
+    CLGUpdateScalar(su + x, sv + x, cu + x, cv + x, d11 + x, b12 + x, b13 + x, d22 + x, b23 + x,
+        omega, width - x, u + x, v + x);
+}
+
+IT_TARGET_AVX
+static void RedBlackUpdateAVX(const float* au, const float* av, const float* cu, const float* cv,
+    const float* i11, const float* i12, const float* i22, const float* b1, const float* b2, const float* w,
+    float alpha, float omega, long width, float* u, float* v)
+{
+    const __m256 a = _mm256_set1_ps(alpha);
+    const __m256 o = _mm256_set1_ps(omega);
+    long x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 ru = _mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(au + x)), _mm256_loadu_ps(b1 + x));
+        __m256 rv = _mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(av + x)), _mm256_loadu_ps(b2 + x));
+        __m256 k12 = _mm256_loadu_ps(i12 + x);
+        __m256 step = _mm256_mul_ps(o, _mm256_loadu_ps(w + x));
+        __m256 pu = _mm256_loadu_ps(cu + x), pv = _mm256_loadu_ps(cv + x);
+        __m256 tu = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(i11 + x), ru), _mm256_mul_ps(k12, rv));
+        __m256 tv = _mm256_add_ps(_mm256_mul_ps(k12, ru), _mm256_mul_ps(_mm256_loadu_ps(i22 + x), rv));
+        _mm256_storeu_ps(u + x, _mm256_add_ps(pu, _mm256_mul_ps(step, _mm256_sub_ps(tu, pu))));
+        _mm256_storeu_ps(v + x, _mm256_add_ps(pv, _mm256_mul_ps(step, _mm256_sub_ps(tv, pv))));
+    }
+    RedBlackUpdateScalar(au + x, av + x, cu + x, cv + x, i11 + x, i12 + x, i22 + x, b1 + x, b2 + x, w + x,
+        alpha, omega, width - x, u + x, v + x);
+}
+
+IT_TARGET_AVX
+static void HornUpdateAVX(const float* au, const float* av,
+    const float* gx, const float* gy, const float* gt, const float* iu, const float* iv,
+    long width, float* u, float* v)
+{
+    long x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 a = _mm256_loadu_ps(au + x), b = _mm256_loadu_ps(av + x);
+        __m256 kx = _mm256_loadu_ps(gx + x), ky = _mm256_loadu_ps(gy + x);
+        __m256 c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(kx, a), _mm256_mul_ps(ky, b)), _mm256_loadu_ps(gt + x));
+        _mm256_storeu_ps(u + x, _mm256_sub_ps(_mm256_sub_ps(a, _mm256_mul_ps(kx, c)), _mm256_loadu_ps(iu + x)));
+        _mm256_storeu_ps(v + x, _mm256_sub_ps(_mm256_sub_ps(b, _mm256_mul_ps(ky, c)), _mm256_loadu_ps(iv + x)));
+    }
+    HornUpdateScalar(au + x, av + x, gx + x, gy + x, gt + x, iu + x, iv + x, width - x, u + x, v + x);
+}
+
+IT_TARGET_AVX
+static void WarpRowAVX(const float* image, long width, long height, const float* bx, float by,
+    const float* dx, const float* dy, float scaleX, float scaleY, float pad, long count, float* out)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxX = _mm256_set1_ps((float) (width - 1)), maxY = _mm256_set1_ps((float) (height - 1));
+    const __m256 sx = _mm256_set1_ps(scaleX), sy = _mm256_set1_ps(scaleY);
+    const __m256 base = _mm256_set1_ps(by), padding = _mm256_set1_ps(pad);
+    int ix[8], iy[8];
+    float a[8], b[8], c[8], d[8];
+    long x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256 cx = _mm256_add_ps(_mm256_loadu_ps(bx + x), _mm256_mul_ps(_mm256_loadu_ps(dx + x), sx));
+        __m256 cy = _mm256_add_ps(base, _mm256_mul_ps(_mm256_loadu_ps(dy + x), sy));
+        __m256 inside = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(cx, zero, _CMP_GE_OQ), _mm256_cmp_ps(cx, maxX, _CMP_LE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(cy, zero, _CMP_GE_OQ), _mm256_cmp_ps(cy, maxY, _CMP_LE_OQ)));
+
+        cx = _mm256_min_ps(_mm256_max_ps(cx, zero), maxX);
+        cy = _mm256_min_ps(_mm256_max_ps(cy, zero), maxY);
+        __m256i x0 = _mm256_cvttps_epi32(cx), y0 = _mm256_cvttps_epi32(cy);
+        __m256 fx = _mm256_sub_ps(cx, _mm256_cvtepi32_ps(x0)), fy = _mm256_sub_ps(cy, _mm256_cvtepi32_ps(y0));
+        _mm256_storeu_si256((__m256i*) ix, x0);
+        _mm256_storeu_si256((__m256i*) iy, y0);
+        for (int i = 0; i < 8; i++)
+            GatherCorners(image, width, height, ix[i], iy[i], a[i], b[i], c[i], d[i]);
+
+        __m256 va = _mm256_loadu_ps(a), vb = _mm256_loadu_ps(b), vc = _mm256_loadu_ps(c), vd = _mm256_loadu_ps(d);
+        __m256 top = _mm256_add_ps(va, _mm256_mul_ps(fx, _mm256_sub_ps(vb, va)));
+        __m256 bottom = _mm256_add_ps(vc, _mm256_mul_ps(fx, _mm256_sub_ps(vd, vc)));
+        __m256 value = _mm256_add_ps(top, _mm256_mul_ps(fy, _mm256_sub_ps(bottom, top)));
+        _mm256_storeu_ps(out + x, _mm256_blendv_ps(padding, value, inside));
+    }
+    WarpRowScalar(image, width, height, bx + x, by, dx + x, dy + x, scaleX, scaleY, pad, count - x, out + x);
+}
+
+#endif // IT_FLOWKERNELS_X86
+
+//------------------------------------------------------------------------
+// Dispatch
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef void (*NeighborFunction)(const float*, const float*, const float*, long, float*);
+    typedef void (*GaussSeidelFunction)(const float*, const float*,
+        const float*, const float*, const float*, const float*, const float*, long, float*, float*);
+    typedef void (*CLGFunction)(const float*, const float*, const float*, const float*,
+        const float*, const float*, const float*, const float*, const float*, float, long, float*, float*);
+    typedef void (*RedBlackFunction)(const float*, const float*, const float*, const float*,
+        const float*, const float*, const float*, const float*, const float*, const float*,
+        float, float, long, float*, float*);
+    typedef void (*HornFunction)(const float*, const float*,
+        const float*, const float*, const float*, const float*, const float*, long, float*, float*);
+    typedef void (*WarpFunction)(const float*, long, long, const float*, float,
+        const float*, const float*, float, float, float, long, float*);
+
+    struct KernelTable
+    {
+        FlowKernels::InstructionSet set;
+        NeighborFunction neighborAverage;
+        NeighborFunction neighborSum;
+        GaussSeidelFunction gaussSeidel;
+        CLGFunction clg;
+        RedBlackFunction redBlack;
+        HornFunction horn;
+        WarpFunction warp;
+    };
+
+    const KernelTable s_tables[] =
+    {
+        { FlowKernels::Scalar, NeighborAverageScalar, NeighborSumScalar,
+          GaussSeidelUpdateScalar, CLGUpdateScalar, RedBlackUpdateScalar, HornUpdateScalar, WarpRowScalar },
+#ifdef IT_FLOWKERNELS_X86
+        { FlowKernels::SSE, NeighborAverageSSE, NeighborSumSSE,
+          GaussSeidelUpdateSSE, CLGUpdateSSE, RedBlackUpdateSSE, HornUpdateSSE, WarpRowSSE },
+        { FlowKernels::AVX, NeighborAverageAVX, NeighborSumAVX,
+          GaussSeidelUpdateAVX, CLGUpdateAVX, RedBlackUpdateAVX, HornUpdateAVX, WarpRowAVX },
+#endif
+    };
+
+    FlowKernels::InstructionSet DetectInstructionSet()
+    {
+#if defined(IT_FLOWKERNELS_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx"))
+            return FlowKernels::AVX;
+        if (__builtin_cpu_supports("sse2"))
+            return FlowKernels::SSE;
+#elif defined(IT_FLOWKERNELS_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+            return FlowKernels::AVX;
+        if (info[3] & (1 << 26))
+            return FlowKernels::SSE;
+#endif
+        return FlowKernels::Scalar;
+    }
+
+    FlowKernels::InstructionSet InitialInstructionSet()
+    {
+        FlowKernels::InstructionSet set = DetectInstructionSet();
+        const char* limit = getenv("IT_SIMD");
+        if (limit)
+        {
+            if (strcmp(limit, "scalar") == 0)
+                set = FlowKernels::Scalar;
+            else if (strcmp(limit, "sse") == 0 && set > FlowKernels::SSE)
+                set = FlowKernels::SSE;
+        }
+        return set;
+    }
+
+    // Chosen on first use rather than by a dynamic initializer, which code
+    // running during static initialization elsewhere could beat.  Threads
+    // racing here all store the same table.
+    const KernelTable* s_kernels = NULL;
+
+    const KernelTable* Kernels()
+    {
+        if (s_kernels == NULL)
+            s_kernels = &s_tables[InitialInstructionSet()];
+        return s_kernels;
+    }
+}
+
+FlowKernels::InstructionSet FlowKernels::GetInstructionSet()
+{
+    return Kernels()->set;
+}
+
+void FlowKernels::SetInstructionSet(InstructionSet set)
+{
+    InstructionSet supported = GetSupportedInstructionSet();
+    if (set > supported)
+    {
+        Logger::warning << "FlowKernels::SetInstructionSet: " << GetInstructionSetName(set)
+            << " is not supported; using " << GetInstructionSetName(supported) << std::endl;
+        set = supported;
+    }
+    s_kernels = &s_tables[set];
+}
+
+FlowKernels::InstructionSet FlowKernels::GetSupportedInstructionSet()
+{
+    return DetectInstructionSet();
+}
+
+std::string FlowKernels::GetInstructionSetName(InstructionSet set)
+{
+    switch (set)
+    {
+    case SSE:
+        return "SSE";
+    case AVX:
+        return "AVX";
+    default:
+        return "scalar";
+    }
+}
+
+void FlowKernels::NeighborAverage(const float* above, const float* row, const float* below, long width, float* out)
+{
+    Kernels()->neighborAverage(above, row, below, width, out);
+}
+
+void FlowKernels::NeighborSum(const float* above, const float* row, const float* below, long width, float* out)
+{
+    Kernels()->neighborSum(above, row, below, width, out);
+}
+
+void FlowKernels::GaussSeidelUpdate(const float* au, const float* av,
+    const float* c11, const float* c12, const float* c13, const float* c22, const float* c23,
+    long width, float* u, float* v)
+{
+    Kernels()->gaussSeidel(au, av, c11, c12, c13, c22, c23, width, u, v);
+}
+
+void FlowKernels::CLGUpdate(const float* su, const float* sv, const float* cu, const float* cv,
+    const float* d11, const float* b12, const float* b13, const float* d22, const float* b23,
+    float omega, long width, float* u, float* v)
+{
+    Kernels()->clg(su, sv, cu, cv, d11, b12, b13, d22, b23, omega, width, u, v);
+}
+
+void FlowKernels::RedBlackUpdate(const float* au, const float* av, const float* cu, const float* cv,
+    const float* i11, const float* i12, const float* i22, const float* b1, const float* b2, const float* w,
+    float alpha, float omega, long width, float* u, float* v)
+{
+    Kernels()->redBlack(au, av, cu, cv, i11, i12, i22, b1, b2, w, alpha, omega, width, u, v);
+}
+
+void FlowKernels::HornUpdate(const float* au, const float* av,
+    const float* gx, const float* gy, const float* gt, const float* iu, const float* iv,
+    long width, float* u, float* v)
+{
+    Kernels()->horn(au, av, gx, gy, gt, iu, iv, width, u, v);
+}
+
+void FlowKernels::WarpRow(const float* image, long width, long height, const float* bx, float by,
+    const float* dx, const float* dy, float scaleX, float scaleY, float pad, long count, float* out)
+{
+    Kernels()->warp(image, width, height, bx, by, dx, dy, scaleX, scaleY, pad, count, out);
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string>
+
+/**
+ * \class FlowKernels
+ * \brief Row kernels for the iterative optical flow solvers.
+ *
+ * RedBlackSORSolver (and so MultigridFlowSolver, which smooths with it)
+ * and the step filters (GaussSeidelIterativeStepImageFilter,
+ * CLGOpticalFlowIterativeStepImageFilter,
+ * HornOpticalFlowIterativeStepImageFilter) split each row of the flow
+ * field into u and v planes and hand whole rows to these kernels, so
+ * that each kernel runs over contiguous floats.  The update kernels take
+ * per-pixel coefficients that do not change from one iteration to the
+ * next (see FlowCoefficientImage), so the divisions are made once, when
+ * the coefficients are computed, rather than in every iteration.
+ * FlowWarpImageFilter warps images a row at a time with WarpRow.
+ *
+ * Each kernel has a scalar version and, on x86, SSE and AVX versions;
+ * the best one the processor supports is chosen when the program
+ * starts.  The vector versions give the scalar results to within float
+ * rounding.
+ *
+ * Neighbourhood kernels take three rows, above, at, and below the
+ * output row, each with one extra pixel at either end, so that the
+ * output pixel x sits over input pixel x+1.  Borders are the caller's
+ * business: repeat the edge pixels for zero-flux borders.
+ *
+ * Set IT_SIMD to "scalar", "sse", or "avx" in the environment to limit
+ * the instruction set, e.g. to compare results.
+ */
+class FlowKernels
+{
+public:
+    enum InstructionSet
+    {
+        Scalar = 0,
+        SSE,
+        AVX
+    };
+
+    /**
+     * Get/Set the instruction set the kernels use.  Setting one the
+     * processor does not support selects the best one it does.  Not
+     * thread safe; set it before any filter runs.
+     */
+    static InstructionSet GetInstructionSet();
+    static void SetInstructionSet(InstructionSet set);
+
+    /**
+     * The best instruction set the processor supports.
+     */
+    static InstructionSet GetSupportedInstructionSet();
+
+    static std::string GetInstructionSetName(InstructionSet set);
+
+    /**
+     * out = 1/6 (N + S + E + W) + 1/12 (NE + NW + SE + SW); the
+     * weighted average of the 8 neighbours.
+     */
+    static void NeighborAverage(const float* above, const float* row, const float* below, long width, float* out);
+
+    /**
+     * out = N + S + E + W
+     */
+    static void NeighborSum(const float* above, const float* row, const float* below, long width, float* out);
+
+    /**
+     * The Gauss-Seidel (Jacobi) update for the CLG system, given the
+     * neighbour averages (au, av) and the tensor terms divided by
+     * r^2 + T11 + T22, cij = Tij / (r^2 + T11 + T22):
+     *   u = au - (c11 au + c12 av + c13)
+     *   v = av - (c12 au + c22 av + c23)
+     */
+    static void GaussSeidelUpdate(const float* au, const float* av,
+        const float* c11, const float* c12, const float* c13, const float* c22, const float* c23,
+        long width, float* u, float* v);
+
+    /**
+     * The SOR update for the CLG system, given the neighbour sums
+     * (su, sv), the current flow (cu, cv), and the relaxation w.  With
+     * the tensor scale f (pixel area / regularization), the coefficients
+     * are d11 = w / (4 + f T11), d22 = w / (4 + f T22), and bij = f Tij:
+     *   u = (1-w) cu + d11 (su - (b12 cv + b13))
+     *   v = (1-w) cv + d22 (sv - (b12 u + b23))
+     */
+    static void CLGUpdate(const float* su, const float* sv, const float* cu, const float* cv,
+        const float* d11, const float* b12, const float* b13, const float* d22, const float* b23,
+        float omega, long width, float* u, float* v);
+
+    /**
+     * The over-relaxed update of RedBlackSORSolver, given the neighbour
+     * averages (au, av), the current flow (cu, cv), the inverse of the
+     * pixel's system matrix alpha + J, (i11, i12, i22), the right hand
+     * side (b1, b2) = -(J13, J23), and a weight w that is zero where the
+     * system is singular:
+     *   (tu, tv) = inverse (alpha (au, av) + (b1, b2))
+     *   u = cu + omega w (tu - cu)
+     *   v = cv + omega w (tv - cv)
+     */
+    static void RedBlackUpdate(const float* au, const float* av, const float* cu, const float* cv,
+        const float* i11, const float* i12, const float* i22, const float* b1, const float* b2, const float* w,
+        float alpha, float omega, long width, float* u, float* v);
+
+    /**
+     * The Horn and Schunck update, given the neighbour averages of the
+     * total flow (au, av), the image derivatives scaled by
+     * 1 / sqrt(alpha^2 + Ix^2 + Iy^2), (gx, gy, gt), and the initial flow
+     * (iu, iv), which is subtracted out:
+     *   c = gx au + gy av + gt
+     *   u = au - gx c - iu
+     *   v = av - gy c - iv
+     */
+    static void HornUpdate(const float* au, const float* av,
+        const float* gx, const float* gy, const float* gt, const float* iu, const float* iv,
+        long width, float* u, float* v);
+
+    /**
+     * Warp one row of an image by a flow field, bilinearly.  Pixel x of
+     * out samples image (width by height floats, row by row) at the
+     * continuous index (bx[x] + scaleX dx[x], by + scaleY dy[x]): the
+     * row's base positions plus the displacement (dx, dy) scaled to
+     * pixels.  Samples outside [0, width-1] x [0, height-1] are pad.
+     */
+    static void WarpRow(const float* image, long width, long height, const float* bx, float by,
+        const float* dx, const float* dy, float scaleX, float scaleY, float pad, long count, float* out);
+
+    /**
+     * Split count pixels of a row of 2-vectors, starting at start, into
+     * u and v planes, with pad extra pixels at either end.  Pixels
+     * beyond [0, rowWidth) repeat the row's end pixels.
+     */
+    template < class TVector >
+    static void SplitRow(const TVector* row, long rowWidth, long start, long count, long pad, float* u, float* v)
+    {
+        for (long i = 0; i < count + 2 * pad; i++)
+        {
+            long x = start - pad + i;
+            x = x < 0 ? 0 : (x >= rowWidth ? rowWidth - 1 : x);
+            u[i] = row[x][0];
+            v[i] = row[x][1];
+        }
+    }
+
+    /**
+     * Interleave u and v planes into a row of 2-vectors.
+     */
+    template < class TVector >
+    static void MergeRow(const float* u, const float* v, long count, TVector* row)
+    {
+        for (long x = 0; x < count; x++)
+        {
+            row[x][0] = u[x];
+            row[x][1] = v[x];
+        }
+    }
+
+    /**
+     * Copy a row of scalars into floats.
+     */
+    template < class TPixel >
+    static void CopyRow(const TPixel* row, long count, float* out)
+    {
+        for (long x = 0; x < count; x++)
+            out[x] = row[x];
+    }
+
+private:
+    FlowKernels();
+};
@@ -31,6 +31,9 @@ public:
     void Unlock() const;
 protected:
     mutable MutexType lock;
+    
+    // Condition variables wait on the platform mutex directly.
+    friend class Condition;
 private:
     // Not implemented on purpose.  We don't want any copies
     // of mutex created willy-nilly.
@@ -0,0 +1,73 @@
+#include "Thread.h"
+
+Thread::Thread() :
+    function(0),
+    data(0),
+    running(false)
+{
+}
+
+Thread::~Thread()
+{
+    this->Join();
+}
+
+bool Thread::Start(ThreadFunction function, void* data)
+{
+    if (this->running || function == 0)
+        return false;
+
+    this->function = function;
+    this->data = data;
+
+#ifdef IT_USE_PTHREADS
+    this->running = (pthread_create(&this->handle, NULL, &Thread::Run, this) == 0);
+#endif
+
+#ifdef IT_USE_WIN32_THREADS
+    this->handle = CreateThread(NULL, 0, &Thread::Run, this, 0, NULL);
+    this->running = (this->handle != NULL);
+#endif
+
+    return this->running;
+}
+
+void Thread::Join()
+{
+    if (!this->running)
+        return;
+
+#ifdef IT_USE_PTHREADS
+    pthread_join(this->handle, NULL);
+#endif
+
+#ifdef IT_USE_WIN32_THREADS
+    WaitForSingleObject(this->handle, INFINITE);
+    CloseHandle(this->handle);
+#endif
+
+    this->running = false;
+}
+
+bool Thread::IsRunning() const
+{
+    return this->running;
+}
+
+#ifdef IT_USE_PTHREADS
+void* Thread::Run(void* self)
+{
+    Thread* thread = static_cast<Thread*>(self);
+    thread->function(thread->data);
+    return NULL;
+}
+#endif
+
+#ifdef IT_USE_WIN32_THREADS
+DWORD WINAPI Thread::Run(LPVOID self)
+{
+    Thread* thread = static_cast<Thread*>(self);
+    thread->function(thread->data);
+    return 0;
+}
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+// Include platform-dependent thread libraries 
+// and define thread handle types.
+
+#ifdef IT_USE_PTHREADS
+#include <pthread.h>
+typedef pthread_t ThreadHandleType;
+#endif
+
+#ifdef IT_USE_WIN32_THREADS
+#include <windows.h>
+#include <winbase.h>
+typedef HANDLE ThreadHandleType;
+#endif
+
+/**
+ * \class Thread
+ * \brief Runs a function on a separate thread of execution.
+ * Basic platform-dependent thread class.  A Thread runs a single
+ * function with a single data argument; the function's return
+ * ends the thread.  Join() blocks until the function returns.
+ * A Thread that is still running when it is destroyed is joined
+ * first, so the owner of a Thread must make sure the thread
+ * function will return (e.g. by setting a stop flag).
+ */
+class Thread
+{
+public:
+    typedef void (*ThreadFunction)(void* data);
+
+    Thread();
+    virtual ~Thread();
+
+    /**
+     * Start running function(data) on a new thread.  Returns false
+     * if this Thread is already running or the thread could not be
+     * created.
+     */
+    bool Start(ThreadFunction function, void* data);
+
+    /**
+     * Block until the thread function returns.  Does nothing if
+     * this Thread was never started.
+     */
+    void Join();
+
+    /** Determine if this Thread has been started and not yet joined. */
+    bool IsRunning() const;
+
+private:
+    // Not implemented on purpose.  A running thread cannot be copied.
+    Thread(const Thread& other);
+    void operator=(const Thread& other);
+
+#ifdef IT_USE_PTHREADS
+    static void* Run(void* self);
+#endif
+
+#ifdef IT_USE_WIN32_THREADS
+    static DWORD WINAPI Run(LPVOID self);
+#endif
+
+    ThreadHandleType handle;
+    ThreadFunction function;
+    void* data;
+    bool running;
+};
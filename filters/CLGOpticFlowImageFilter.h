@@ -3,9 +3,10 @@
 #include "itkImage.h"
 #include "itkVector.h"
 
-#include "CLGOpticalFlowIterativeStepImageFilter.h"
-#include "GaussSeidelIterativeStepImageFilter.h"
 #include "OpticalFlowImageFilter.h"
+#include "LocalOpticalFlowImageFilter.h"
+#include "MultigridFlowSolver.h"
+#include "RedBlackSORSolver.h"
 #include "StructureTensorImageFilter.h"
 
 template <class TInputImage1, class TInputImage2, class TOutputValueType = float >
@@ -40,8 +41,10 @@ public:
     typedef float InternalValueType;
     typedef StructureTensorImageFilter< Input1ImageType > TensorFilterType;
     typedef typename TensorFilterType::TensorImageType TensorImageType;
-    // typedef CLGOpticalFlowIterativeStepImageFilter< OutputImageType > IterativeStepType;
-    typedef GaussSeidelIterativeStepImageFilter< OutputImageType > IterativeStepType;
+    typedef typename TensorFilterType::DerivativeImageType DerivativeImageType;
+    typedef RedBlackSORSolver< OutputImageType, TensorImageType > SolverType;
+    typedef MultigridFlowSolver< OutputImageType, TensorImageType > MultigridSolverType;
+    typedef LocalOpticalFlowImageFilter< Input1ImageType, Input2ImageType, OutputValueType > LocalFlowType;
 
     /** Standard itk class typedefs */
     typedef CLGOpticFlowImageFilter Self;
@@ -84,19 +87,117 @@ public:
     itkSetMacro(Relaxation, double);
 
     /**
-     * Get/Set the iteration count; the number of SOR iterations
+     * Get/Set the iteration count; the maximum number of SOR iterations
      * to use to compute the flow field.
      */
     itkGetMacro(Iterations, unsigned int);
     itkSetMacro(Iterations, unsigned int);
 
+    /**
+     * Get/Set the convergence tolerances.  Iteration stops once the root
+     * mean square change in the flow from one iteration to the next falls
+     * below AbsoluteTolerance (in pixels), or below RelativeTolerance
+     * times the first iteration's change.  Zero disables a test.
+     */
+    itkGetMacro(AbsoluteTolerance, double);
+    itkSetMacro(AbsoluteTolerance, double);
+    itkGetMacro(RelativeTolerance, double);
+    itkSetMacro(RelativeTolerance, double);
+
+    /**
+     * Get/Set the number of iterations to run before testing for
+     * convergence.
+     */
+    itkGetMacro(MinimumIterations, unsigned int);
+    itkSetMacro(MinimumIterations, unsigned int);
+
+    /**
+     * Get/Set the number of SOR iterations run on a band of TileRows rows
+     * before moving on to the next band; see RedBlackSORSolver.  The
+     * flow is the same; only the memory traffic changes.
+     */
+    itkGetMacro(TileIterations, unsigned int);
+    itkSetMacro(TileIterations, unsigned int);
+    itkGetMacro(TileRows, unsigned int);
+    itkSetMacro(TileRows, unsigned int);
+
+    /**
+     * Get/Set whether the solver starts from InitialFlow, when one is
+     * set, rather than from zero; the output is still the whole flow.
+     * Starting near the answer, e.g. from the previous frame pair's flow,
+     * saves iterations once a tolerance is set.  Off by default, because
+     * MultiResolutionOpticalFlowMethod sets InitialFlow to the flow it
+     * has already warped the second image by and wants the residual,
+     * for which zero is the right start.
+     */
+    itkGetMacro(UseInitialFlow, bool);
+    itkSetMacro(UseInitialFlow, bool);
+    itkBooleanMacro(UseInitialFlow);
+
+    /**
+     * Get/Set whether the solver starts from the local (Lucas-Kanade)
+     * flow, computed from the same structure tensor by
+     * LocalOpticalFlowImageFilter, when it does not start from
+     * InitialFlow.  The local flow is already close where the image has
+     * texture, so fewer iterations are needed; with zero Iterations (or
+     * MultigridCycles) the output is the local flow itself.  Off by
+     * default.
+     */
+    itkGetMacro(InitializeLocally, bool);
+    itkSetMacro(InitializeLocally, bool);
+    itkBooleanMacro(InitializeLocally);
+
+    /**
+     * Get/Set whether to solve by multigrid (MultigridFlowSolver) rather
+     * than SOR.  Multigrid needs a handful of cycles where SOR needs
+     * hundreds of iterations, and the gap grows with the frame size.
+     */
+    itkGetMacro(UseMultigrid, bool);
+    itkSetMacro(UseMultigrid, bool);
+    itkBooleanMacro(UseMultigrid);
+
+    /**
+     * Get/Set the maximum number of multigrid cycles; the first is a
+     * full multigrid cycle unless the solver starts from InitialFlow or
+     * the local flow.
+     * Used in place of Iterations with UseMultigrid.
+     */
+    itkGetMacro(MultigridCycles, unsigned int);
+    itkSetMacro(MultigridCycles, unsigned int);
+
+    /**
+     * Get/Set precomputed smoothed images and spatial derivatives of the
+     * two inputs, at SpatialSigma; see StructureTensorImageFilter.  Both
+     * or neither must be set.
+     */
+    itkGetConstObjectMacro(Derivatives1, DerivativeImageType);
+    itkSetConstObjectMacro(Derivatives1, DerivativeImageType);
+    itkGetConstObjectMacro(Derivatives2, DerivativeImageType);
+    itkSetConstObjectMacro(Derivatives2, DerivativeImageType);
+
+    /**
+     * Get the number of iterations (or multigrid cycles) used for the
+     * last flow field.
+     */
+    itkGetMacro(ElapsedIterations, unsigned int);
+
 protected:
     CLGOpticFlowImageFilter() :
         m_SpatialSigma(1.0),
         m_IntegrationSigma(4.0),
         m_Regularization(200),
         m_Relaxation(1.9),
-        m_Iterations(200)
+        m_Iterations(200),
+        m_AbsoluteTolerance(0.0),
+        m_RelativeTolerance(0.0),
+        m_MinimumIterations(1),
+        m_TileIterations(1),
+        m_TileRows(64),
+        m_UseInitialFlow(false),
+        m_InitializeLocally(false),
+        m_UseMultigrid(false),
+        m_MultigridCycles(4),
+        m_ElapsedIterations(0)
     {}
     
     virtual ~CLGOpticFlowImageFilter() {}
@@ -106,10 +207,10 @@ protected:
 
     /** 
      * Generate the data; construct a vector field representing the
-     * motion from Image1 to Image2. The CLGOpticFlowImageFilter cannot
-     * be threaded because the output flow field is calculated iteratively.
-     * In each iteration, a given pixel's value depends on the value of
-     * the surrounding pixels at the same or previous iteration step.
+     * motion from Image1 to Image2. The flow field is calculated
+     * iteratively, in place, by a RedBlackSORSolver or a
+     * MultigridFlowSolver; the solver does
+     * its own threading, so this filter is not threaded.
      */
     void GenerateData();
 
@@ -119,12 +220,6 @@ protected:
      */
     void AfterGenerateData();
 
-    /**
-     * Determines if the CLG optical flow computation has stopped making progress and
-     * should halt.
-     */
-    bool CheckForCompletion(OutputImagePointer prev, OutputImagePointer next);
-
 private:
     // Not implemented
     CLGOpticFlowImageFilter(const Self& other);
@@ -136,6 +231,18 @@ private:
     double m_Regularization;
     double m_Relaxation;
     unsigned int m_Iterations;
+    double m_AbsoluteTolerance;
+    double m_RelativeTolerance;
+    unsigned int m_MinimumIterations;
+    unsigned int m_TileIterations;
+    unsigned int m_TileRows;
+    bool m_UseInitialFlow;
+    bool m_InitializeLocally;
+    bool m_UseMultigrid;
+    unsigned int m_MultigridCycles;
+    unsigned int m_ElapsedIterations;
+    typename DerivativeImageType::ConstPointer m_Derivatives1;
+    typename DerivativeImageType::ConstPointer m_Derivatives2;
 };
 
 /************************************************************************/
@@ -143,6 +250,7 @@ private:
 /************************************************************************/
 
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
 
 #include <algorithm>
                  
@@ -168,58 +276,97 @@ void CLGOpticFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
     tensor->SetIntegrationSigma(this->GetIntegrationSigma());
     tensor->SetInput1(this->GetInput1());
     tensor->SetInput2(this->GetInput2());
+    tensor->SetDerivatives1(this->GetDerivatives1());
+    tensor->SetDerivatives2(this->GetDerivatives2());
+    tensor->SetNumberOfThreads(this->GetNumberOfThreads());
     tensor->Update();
     
-    // Set up the iterative step filter
-    Logger::debug << function << ": setting up interative step filter" << std::endl;
-    typename IterativeStepType::Pointer step = IterativeStepType::New();
-    step->SetStructureTensor(tensor->GetOutput());
-    step->SetRegularization(this->GetRegularization());
-    // step->SetRelaxation(this->GetRelaxation());
-    
-/*
-	// throttle number of threads to 6.
-    // the flow computation doesn't seem to benefit from much more than 6.
-    int threads = step->GetNumberOfThreads();
-    step->SetNumberOfThreads(std::min(4, threads));
-    Logger::debug << function << ": iterative step filter threads: " << step->GetNumberOfThreads() << std::endl;
-*/
-
-    // Initialize output to zero flow field	
+    // Initialize output to zero flow field, or the initial or local flow
+    // if asked; the solver works in this one buffer
     Logger::debug << function << ": initializing flow field" << std::endl;
     OutputImagePointer output = OutputImageType::New();
     output->SetRegions(this->GetOutput()->GetLargestPossibleRegion());
     output->SetSpacing(this->GetOutput()->GetSpacing());
     output->SetOrigin(this->GetOutput()->GetOrigin());
     output->Allocate();
-    OutputPixelType zero;
-    zero.Fill(0);
-    output->FillBuffer(zero);
-//     PrintImageInfo<OutputImageType>(output, "Initial flow");
+    const OutputImageType* initial = this->GetInitialFlow();
+    bool haveInit = this->m_UseInitialFlow && initial;
+    if (haveInit && initial->GetBufferedRegion() != output->GetBufferedRegion())
+    {
+        Logger::warning << function << ": initial flow does not cover the output; starting from zero" << std::endl;
+        haveInit = false;
+    }
+    if (haveInit)
+    {
+        typedef itk::ImageRegionConstIterator< OutputImageType > ConstFlowIterator;
+        typedef itk::ImageRegionIterator< OutputImageType > FlowIterator;
+        ConstFlowIterator initIt(initial, initial->GetBufferedRegion());
+        FlowIterator outIt(output, output->GetBufferedRegion());
+        for (initIt.GoToBegin(), outIt.GoToBegin(); !initIt.IsAtEnd(); ++initIt, ++outIt)
+            outIt.Set(initIt.Get());
+    }
+    else if (this->m_InitializeLocally)
+    {
+        Logger::debug << function << ": computing local flow" << std::endl;
+        typename LocalFlowType::Pointer local = LocalFlowType::New();
+        local->SetInput1(this->GetInput1());
+        local->SetInput2(this->GetInput2());
+        local->SetStructureTensor(tensor->GetOutput());
+        local->SetNumberOfThreads(this->GetNumberOfThreads());
+        local->Update();
+
+        typedef itk::ImageRegionConstIterator< OutputImageType > ConstFlowIterator;
+        typedef itk::ImageRegionIterator< OutputImageType > FlowIterator;
+        ConstFlowIterator localIt(local->GetOutput(), output->GetBufferedRegion());
+        FlowIterator outIt(output, output->GetBufferedRegion());
+        for (localIt.GoToBegin(), outIt.GoToBegin(); !localIt.IsAtEnd(); ++localIt, ++outIt)
+            outIt.Set(localIt.Get());
+        haveInit = true;
+    }
+    else
+    {
+        OutputPixelType zero;
+        zero.Fill(0);
+        output->FillBuffer(zero);
+    }
 
     // Iteratively calculate flow field
     Logger::debug << function << ": caluculating flow field" << std::endl;
-    OutputImagePointer prev, next;
-    bool terminate = false;
-    for (int i = 0; i < this->m_Iterations && !terminate; i++)
+    unsigned int iterations;
+    if (this->m_UseMultigrid)
+    {
+        typename MultigridSolverType::Pointer solver = MultigridSolverType::New();
+        solver->SetFlow(output);
+        solver->SetStructureTensor(tensor->GetOutput());
+        solver->SetRegularization(this->GetRegularization());
+        solver->SetNumberOfThreads(this->GetNumberOfThreads());
+        solver->SetAbsoluteTolerance(this->GetAbsoluteTolerance());
+        solver->SetRelativeTolerance(this->GetRelativeTolerance());
+        solver->SetMinimumIterations(this->GetMinimumIterations());
+        solver->SetFullMultigrid(!haveInit);
+        iterations = this->m_MultigridCycles;
+        solver->Iterate(iterations);
+        this->m_ElapsedIterations = solver->GetElapsedIterations();
+    }
+    else
     {
-        prev = output;
-        step->SetInput(output);
-        step->Update();
-        output = step->GetOutput();
-        output->DisconnectPipeline();
-        next = output;
-
-//         terminate = this->CheckForCompletion(prev, next);
-        if (terminate)
-            Logger::debug << function << ": stopping after " << i << " iterations." << std::endl;
-// 	char msg[80];
-// 	sprintf(msg, "Flow after step %d", i);
-// 	PrintImageInfo<OutputImageType>(output, std::string(msg));
+        typename SolverType::Pointer solver = SolverType::New();
+        solver->SetFlow(output);
+        solver->SetStructureTensor(tensor->GetOutput());
+        solver->SetRegularization(this->GetRegularization());
+        solver->SetRelaxation(this->GetRelaxation());
+        solver->SetNumberOfThreads(this->GetNumberOfThreads());
+        solver->SetAbsoluteTolerance(this->GetAbsoluteTolerance());
+        solver->SetRelativeTolerance(this->GetRelativeTolerance());
+        solver->SetMinimumIterations(this->GetMinimumIterations());
+        solver->SetTileIterations(this->GetTileIterations());
+        solver->SetTileRows(this->GetTileRows());
+        iterations = this->m_Iterations;
+        solver->Iterate(iterations);
+        this->m_ElapsedIterations = solver->GetElapsedIterations();
     }
-//     char msg[80];
-//     sprintf(msg, "Flow after step %d", this->m_Iterations);
-//     PrintImageInfo<OutputImageType>(output, std::string(msg));
+    if (this->m_ElapsedIterations < iterations)
+        Logger::debug << function << ": converged after " << this->m_ElapsedIterations << " iterations" << std::endl;
 
     // Call AfterGenerateData to calculate the confidence image.
     this->AfterGenerateData();
@@ -229,41 +376,6 @@ void CLGOpticFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
     Logger::debug << function << ": done" << std::endl;
 }
 
-template <class TInputImage1, class TInputImage2, class TOutputValueType>
-bool CLGOpticFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
-::CheckForCompletion(OutputImagePointer prev, OutputImagePointer next)
-{
-    bool complete = false;
-    std::string function("CLGOpticFlowImageFilter::CheckForCompletion");
-    
-    // Compute the sum squared difference between the previous and next computed flow field
-    typedef itk::ImageRegionConstIterator<OutputImageType> OutputIterator;
-    OutputIterator prevIt(prev, prev->GetLargestPossibleRegion());
-    OutputIterator nextIt(next, next->GetLargestPossibleRegion());
-
-    int pixCount = 0;
-    double ssd = 0;
-    OutputPixelType prevPix, nextPix;
-    for (prevIt.GoToBegin(), nextIt.GoToBegin();
-         !(prevIt.IsAtEnd() || nextIt.IsAtEnd());
-         ++prevIt, ++nextIt)
-    {
-        prevPix = prevIt.Get();
-        nextPix = nextIt.Get();
-        for (int d = 0; d < CLGOpticFlowImageFilter::ImageDimension; d++)
-        {
-            ssd += (prevPix[d] - nextPix[d])*(prevPix[d] - nextPix[d]);
-        }
-        pixCount += 1;
-    }
-
-    Logger::debug << function << ": Completion metric: " << (ssd/pixCount) << std::endl;
-    
-//     complete = (ssd/pixCount) < 4e-11;
-
-    return complete;
-}
-
 template <class TInputImage1, class TInputImage2, class TOutputValueType>
 void CLGOpticFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
 ::AfterGenerateData()
@@ -283,6 +395,15 @@ void CLGOpticFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
     os << indent << "Regularization: " << this->m_Regularization << std::endl;
     os << indent << "Relaxation: " << this->m_Relaxation << std::endl;
     os << indent << "Iterations: " << this->m_Iterations << std::endl;
+    os << indent << "AbsoluteTolerance: " << this->m_AbsoluteTolerance << std::endl;
+    os << indent << "RelativeTolerance: " << this->m_RelativeTolerance << std::endl;
+    os << indent << "MinimumIterations: " << this->m_MinimumIterations << std::endl;
+    os << indent << "TileIterations: " << this->m_TileIterations << std::endl;
+    os << indent << "TileRows: " << this->m_TileRows << std::endl;
+    os << indent << "UseInitialFlow: " << this->m_UseInitialFlow << std::endl;
+    os << indent << "InitializeLocally: " << this->m_InitializeLocally << std::endl;
+    os << indent << "UseMultigrid: " << this->m_UseMultigrid << std::endl;
+    os << indent << "MultigridCycles: " << this->m_MultigridCycles << std::endl;
 }
 
 template <class TInputImage1, class TInputImage2, class TOutputValueType>
@@ -300,4 +421,22 @@ void CLGOpticFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
     Logger::logInfo(text);
     sprintf(text, "Iterations:          %i", this->GetIterations());
     Logger::logInfo(text);
+    sprintf(text, "AbsoluteTolerance:   %g", this->GetAbsoluteTolerance());
+    Logger::logInfo(text);
+    sprintf(text, "RelativeTolerance:   %g", this->GetRelativeTolerance());
+    Logger::logInfo(text);
+    sprintf(text, "MinimumIterations:   %i", this->GetMinimumIterations());
+    Logger::logInfo(text);
+    sprintf(text, "TileIterations:      %i", this->GetTileIterations());
+    Logger::logInfo(text);
+    sprintf(text, "TileRows:            %i", this->GetTileRows());
+    Logger::logInfo(text);
+    sprintf(text, "UseInitialFlow:      %i", this->GetUseInitialFlow());
+    Logger::logInfo(text);
+    sprintf(text, "InitializeLocally:   %i", this->GetInitializeLocally());
+    Logger::logInfo(text);
+    sprintf(text, "UseMultigrid:        %i", this->GetUseMultigrid());
+    Logger::logInfo(text);
+    sprintf(text, "MultigridCycles:     %i", this->GetMultigridCycles());
+    Logger::logInfo(text);
 }
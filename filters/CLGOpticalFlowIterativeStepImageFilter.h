@@ -1,9 +1,12 @@
 #pragma once
 
+#include <vector>
+
 #include "itkImage.h"
 #include "itkImageToImageFilter.h"
 
 #include "CommonTypes.h"
+#include "FlowCoefficientImage.h"
 #include "StructureTensorImageFilter.h"
 
 /**
@@ -17,6 +20,12 @@
  * in one portion of the image could get ahead of the iterations in another part of the image,
  * corrupting the result.  The value at one location in an iteration depends on the neighboring
  * values from the previous iteration.
+ *
+ * Each thread works a row at a time: the flow rows are split into u and v planes, and the
+ * neighbour sums and update are computed by the vectorized FlowKernels.  The update's
+ * coefficients, the scaled tensor terms and the relaxed diagonal divisors, are computed
+ * once into a FlowCoefficientImage, when the tensor, regularization, or relaxation
+ * changes.
  */
 template < class TInputImage, class TOutputImage = TInputImage >
 class CLGOpticalFlowIterativeStepImageFilter :
@@ -71,6 +80,11 @@ public:
 protected:
     CLGOpticalFlowIterativeStepImageFilter();
     virtual ~CLGOpticalFlowIterativeStepImageFilter();
+
+    /**
+     * Computes the update coefficients, if the tensor or parameters have changed.
+     */
+    void BeforeThreadedGenerateData();
     
     /**
      * Generates new flow estimates within the requested output region.
@@ -85,16 +99,18 @@ private:
     typename TensorImageType::ConstPointer m_StructureTensor;
     double m_Regularization;
     double m_Relaxation;
+
+    // w / (4 + f T11), f T12, f T13, w / (4 + f T22), f T23
+    FlowCoefficientImage m_Coefficients;
 };
 
 //-------------------------------------
 // Implementation
 //-------------------------------------
 
-#include "itkConstNeighborhoodIterator.h"
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
+#include <algorithm>
 
+#include "FlowKernels.h"
 #include "Logger.h"
 
 template < class TInputImage, class TOutputImage >
@@ -158,10 +174,8 @@ void CLGOpticalFlowIterativeStepImageFilter< TInputImage, TOutputImage >
 
 template < class TInputImage, class TOutputImage >
 void CLGOpticalFlowIterativeStepImageFilter< TInputImage, TOutputImage >
-::ThreadedGenerateData(const OutputRegionType& outputRegion, int threadId)
+::BeforeThreadedGenerateData()
 {
-    std::string function("CLGOpticalFlowIterativeStepImageFilter::ThreadedGenerateData");
-    
     // Compute the scaling factor for the structure tensor.
     // pixel area / regularization
     typename InputImageType::SpacingType spacing = this->GetInput()->GetSpacing();
@@ -172,47 +186,95 @@ void CLGOpticalFlowIterativeStepImageFilter< TInputImage, TOutputImage >
     }
     const double factor = area / this->m_Regularization;
     const double w = this->m_Relaxation;
-    
-    typedef itk::ConstNeighborhoodIterator<InputImageType> InputIteratorType;
-    typedef itk::ImageRegionIterator<OutputImageType> OutputIteratorType;
-    typedef itk::ImageRegionConstIterator<TensorImageType> TensorIteratorType;
-    
-    // Set up input iterator (current flow field)
-    typename InputIteratorType::RadiusType radius;
-    radius.Fill(1);
-    InputIteratorType inIt(radius, this->GetInput(), outputRegion);
-    
-    typename InputIteratorType::OffsetType left  = {{-1, 0}};
-    typename InputIteratorType::OffsetType right = {{+1, 0}};
-    typename InputIteratorType::OffsetType above = {{0, -1}};
-    typename InputIteratorType::OffsetType below = {{0, +1}};
-    const unsigned int nCount = 4; // number of neighbors
-    
-    // Set up output iterator (next flow field)
-    OutputIteratorType outIt(this->GetOutput(), outputRegion);
-    
-    // Set up tensor iterator
-    TensorIteratorType jIt(this->GetStructureTensor(), outputRegion);
-
-    // Compute next flow
-    typename InputImageType::PixelType curr, next, sum;
-    typename TensorImageType::PixelType J;
-    for (inIt.GoToBegin(), outIt.GoToBegin(), jIt.GoToBegin();
-         !(inIt.IsAtEnd() || outIt.IsAtEnd() || jIt.IsAtEnd());
-         ++inIt, ++outIt, ++jIt)
+
+    const TensorImageType* tensor = this->GetStructureTensor();
+    if (this->m_Coefficients.IsCurrent(tensor, tensor->GetMTime(), factor, w))
+        return;
+
+    const long width = tensor->GetBufferedRegion().GetSize()[0];
+    const long height = tensor->GetBufferedRegion().GetSize()[1];
+    const typename TensorImageType::PixelType* J = tensor->GetBufferPointer();
+    this->m_Coefficients.Allocate(width, height, 5);
+    for (long y = 0; y < height; y++)
     {
-        J = jIt.Get();
-        
-        sum[0] = 
-            inIt.GetPixel(left)[0] + inIt.GetPixel(right)[0] +
-            inIt.GetPixel(above)[0] + inIt.GetPixel(below)[0];
-        sum[1] =
-            inIt.GetPixel(left)[1] + inIt.GetPixel(right)[1] +
-            inIt.GetPixel(above)[1] + inIt.GetPixel(below)[1];
-
-        curr = inIt.GetCenterPixel();
-        next[0] = (1.0 - w)*curr[0] + w * (sum[0] - factor*(J[TensorFilterType::T12]*curr[1] + J[TensorFilterType::T13]))/(nCount + factor*J[TensorFilterType::T11]);
-        next[1] = (1.0 - w)*curr[1] + w * (sum[1] - factor*(J[TensorFilterType::T21]*next[0] + J[TensorFilterType::T23]))/(nCount + factor*J[TensorFilterType::T22]);
-        outIt.Set(next);
+        float* d11 = this->m_Coefficients.GetPlane(y, 0);
+        float* b12 = this->m_Coefficients.GetPlane(y, 1);
+        float* b13 = this->m_Coefficients.GetPlane(y, 2);
+        float* d22 = this->m_Coefficients.GetPlane(y, 3);
+        float* b23 = this->m_Coefficients.GetPlane(y, 4);
+        for (long x = 0; x < width; x++, J++)
+        {
+            d11[x] = w / (4.0 + factor * (*J)[TensorFilterType::T11]);
+            b12[x] = factor * (*J)[TensorFilterType::T12];
+            b13[x] = factor * (*J)[TensorFilterType::T13];
+            d22[x] = w / (4.0 + factor * (*J)[TensorFilterType::T22]);
+            b23[x] = factor * (*J)[TensorFilterType::T23];
+        }
+    }
+    this->m_Coefficients.SetSource(tensor, tensor->GetMTime(), factor, w);
+}
+
+template < class TInputImage, class TOutputImage >
+void CLGOpticalFlowIterativeStepImageFilter< TInputImage, TOutputImage >
+::ThreadedGenerateData(const OutputRegionType& outputRegion, int threadId)
+{
+    std::string function("CLGOpticalFlowIterativeStepImageFilter::ThreadedGenerateData");
+
+    const InputImageType* input = this->GetInput();
+    OutputImageType* output = this->GetOutput();
+    const TensorImageType* tensor = this->GetStructureTensor();
+    typename InputImageType::RegionType inRegion = input->GetBufferedRegion();
+    typename OutputImageType::RegionType outRegion = output->GetBufferedRegion();
+    typename TensorImageType::RegionType tensorRegion = tensor->GetBufferedRegion();
+
+    // Geometry of this thread's region within each buffer
+    const long width = outputRegion.GetSize()[0];
+    const long rows = outputRegion.GetSize()[1];
+    const long inWidth = inRegion.GetSize()[0];
+    const long inHeight = inRegion.GetSize()[1];
+    const long inX = outputRegion.GetIndex()[0] - inRegion.GetIndex()[0];
+    const long inY = outputRegion.GetIndex()[1] - inRegion.GetIndex()[1];
+    const long outX = outputRegion.GetIndex()[0] - outRegion.GetIndex()[0];
+    const long outY = outputRegion.GetIndex()[1] - outRegion.GetIndex()[1];
+    const long tensorX = outputRegion.GetIndex()[0] - tensorRegion.GetIndex()[0];
+    const long tensorY = outputRegion.GetIndex()[1] - tensorRegion.GetIndex()[1];
+    if (width == 0 || rows == 0)
+        return;
+
+    const typename InputImageType::PixelType* in = input->GetBufferPointer();
+    typename OutputImageType::PixelType* out = output->GetBufferPointer();
+    const float w = this->m_Relaxation;
+
+    // Flow rows y-1, y, y+1, with one pixel of border, in u and v planes;
+    // input row r lives in slot r % 3.
+    const long padded = width + 2;
+    std::vector< float > ringU(3 * padded), ringV(3 * padded);
+    std::vector< float > sumU(width), sumV(width), nextU(width), nextV(width);
+
+    long next = std::max(0L, inY - 1);
+    for (long j = 0; j < rows; j++)
+    {
+        long y = inY + j;
+        for (; next <= std::min(inHeight - 1, y + 1); next++)
+        {
+            FlowKernels::SplitRow(in + next * inWidth, inWidth, inX, width, 1,
+                &ringU[(next % 3) * padded], &ringV[(next % 3) * padded]);
+        }
+        long above = (std::max(0L, y - 1) % 3) * padded;
+        long center = (y % 3) * padded;
+        long below = (std::min(inHeight - 1, y + 1) % 3) * padded;
+
+        FlowKernels::NeighborSum(&ringU[above], &ringU[center], &ringU[below], width, &sumU[0]);
+        FlowKernels::NeighborSum(&ringV[above], &ringV[center], &ringV[below], width, &sumV[0]);
+
+        // The coefficients cover the tensor's buffer
+        const FlowCoefficientImage& c = this->m_Coefficients;
+        long t = tensorY + j;
+        FlowKernels::CLGUpdate(&sumU[0], &sumV[0], &ringU[center + 1], &ringV[center + 1],
+            c.GetPlane(t, 0) + tensorX, c.GetPlane(t, 1) + tensorX, c.GetPlane(t, 2) + tensorX,
+            c.GetPlane(t, 3) + tensorX, c.GetPlane(t, 4) + tensorX,
+            w, width, &nextU[0], &nextV[0]);
+
+        FlowKernels::MergeRow(&nextU[0], &nextV[0], width, out + (outY + j) * outRegion.GetSize()[0] + outX);
     }
 }
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * \class FlowCoefficientImage
+ * \brief The per-pixel coefficients of an iterative flow step, packed row by row.
+ *
+ * The iterative flow filters take hundreds of steps over one frame pair,
+ * and the update at each pixel is a fixed function of a few coefficients
+ * that depend only on the frame pair (the structure tensor, or the image
+ * derivatives) and the filter's parameters.  The step filters compute
+ * those coefficients, divisions and all, once into a
+ * FlowCoefficientImage; each step then reads only it and the flow.
+ *
+ * The image holds Count coefficients for each of Width x Height pixels.
+ * Row y is Count planes of Width floats, one after the other, so a row's
+ * coefficients are one contiguous block, in the planar form the
+ * FlowKernels take.
+ *
+ * The image also remembers what it was computed from: a source object,
+ * its modified time, and up to two parameters.  IsCurrent() tells the
+ * step filter whether it must compute the coefficients again.
+ */
+class FlowCoefficientImage
+{
+public:
+    FlowCoefficientImage() :
+        width(0),
+        height(0),
+        count(0),
+        source(NULL),
+        time(0)
+    {
+        this->parameters[0] = this->parameters[1] = 0.0;
+    }
+
+    /**
+     * Size the image for count coefficients per pixel, and forget what
+     * it was computed from.
+     */
+    void Allocate(long width, long height, unsigned int count)
+    {
+        this->width = width;
+        this->height = height;
+        this->count = count;
+        this->data.resize(width * height * count);
+        this->source = NULL;
+    }
+
+    /**
+     * Get coefficient c of the pixels of row y; plane c of the row.
+     */
+    float* GetPlane(long y, unsigned int c)
+    {
+        return &this->data[(y * this->count + c) * this->width];
+    }
+
+    const float* GetPlane(long y, unsigned int c) const
+    {
+        return &this->data[(y * this->count + c) * this->width];
+    }
+
+    long GetWidth() const { return this->width; }
+    long GetHeight() const { return this->height; }
+    unsigned int GetCount() const { return this->count; }
+
+    /**
+     * Whether the coefficients were computed from the given source, at
+     * the given modified time, with the given parameters.
+     */
+    bool IsCurrent(const void* source, unsigned long time, double p0, double p1 = 0.0) const
+    {
+        return this->source != NULL && this->source == source && this->time == time &&
+            this->parameters[0] == p0 && this->parameters[1] == p1;
+    }
+
+    /**
+     * Record what the coefficients were computed from.
+     */
+    void SetSource(const void* source, unsigned long time, double p0, double p1 = 0.0)
+    {
+        this->source = source;
+        this->time = time;
+        this->parameters[0] = p0;
+        this->parameters[1] = p1;
+    }
+
+    /**
+     * Release the coefficients.
+     */
+    void Clear()
+    {
+        std::vector< float >().swap(this->data);
+        this->width = this->height = 0;
+        this->count = 0;
+        this->source = NULL;
+    }
+
+private:
+    // Not implemented
+    FlowCoefficientImage(const FlowCoefficientImage& other);
+    void operator=(const FlowCoefficientImage& other);
+
+    std::vector< float > data;
+    long width;
+    long height;
+    unsigned int count;
+
+    const void* source;
+    unsigned long time;
+    double parameters[2];
+};
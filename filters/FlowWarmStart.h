@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+
+#include "Logger.h"
+
+/**
+ * \class FlowWarmStart
+ * \brief Predicts a frame pair's flow from the previous pair's flow.
+ *
+ * Motion in a video is usually coherent from one frame to the next, so
+ * the flow of pair (i-1,i) is a far better start for pair (i,i+1) than a
+ * zero field; an iterative solver started there converges in fewer
+ * iterations.  After each pair the caller hands its flow to SetFlow(),
+ * and before the next asks GetInitialFlow() for the prediction.  There
+ * is only a prediction if the held flow is for the pair just before;
+ * otherwise GetInitialFlow() returns NULL and the caller starts from
+ * zero.
+ *
+ * The prediction is the previous flow times Damping (1 by default; less
+ * than 1 hedges against motion that stops).  With Warp on, the previous
+ * flow is first carried forward along itself, so that each pixel starts
+ * from the motion of whatever arrived there; this helps where objects
+ * move more than their own size between frames.  Flow vectors are in
+ * physical units, as for FlowWarpImageFilter.
+ */
+template < class TFlowImage >
+class FlowWarmStart
+{
+public:
+    typedef TFlowImage FlowImageType;
+    typedef typename FlowImageType::Pointer FlowPointer;
+    typedef typename FlowImageType::ConstPointer ConstFlowPointer;
+    typedef typename FlowImageType::PixelType FlowPixelType;
+
+    FlowWarmStart() :
+        pair(0),
+        damping(1.0),
+        warp(false),
+        hits(0),
+        misses(0)
+    {}
+
+    /**
+     * Get the predicted flow for the given pair, or NULL if the previous
+     * pair's flow is not held.
+     */
+    FlowPointer GetInitialFlow(unsigned int pair)
+    {
+        if (!this->flow || this->pair + 1 != pair)
+        {
+            this->misses++;
+            return NULL;
+        }
+
+        this->hits++;
+        FlowPointer initial = FlowImageType::New();
+        initial->SetRegions(this->flow->GetLargestPossibleRegion());
+        initial->SetSpacing(this->flow->GetSpacing());
+        initial->SetOrigin(this->flow->GetOrigin());
+        initial->Allocate();
+
+        if (this->warp)
+            this->Advect(initial);
+        else
+            this->Scale(initial);
+        return initial;
+    }
+
+    /**
+     * Hold the flow computed for the given pair.  The flow is not
+     * copied; the caller must not change it.
+     */
+    void SetFlow(unsigned int pair, const FlowImageType* flow)
+    {
+        this->pair = pair;
+        this->flow = flow;
+    }
+
+    /**
+     * Drop the held flow, e.g. when the sequence changes.
+     */
+    void Clear()
+    {
+        this->flow = NULL;
+    }
+
+    double GetDamping() const { return this->damping; }
+    void SetDamping(double damping) { this->damping = damping; }
+    bool GetWarp() const { return this->warp; }
+    void SetWarp(bool warp) { this->warp = warp; }
+
+    unsigned long GetHitCount() const { return this->hits; }
+    unsigned long GetMissCount() const { return this->misses; }
+
+    /**
+     * Log warm start statistics.
+     */
+    void LogStatistics() const
+    {
+        Logger::debug << "FlowWarmStart: " << this->hits << " pairs warm started, "
+            << this->misses << " started from zero" << std::endl;
+    }
+
+private:
+    // Not implemented
+    FlowWarmStart(const FlowWarmStart& other);
+    void operator=(const FlowWarmStart& other);
+
+    /**
+     * initial = damping * flow
+     */
+    void Scale(FlowImageType* initial)
+    {
+        typedef itk::ImageRegionConstIterator< FlowImageType > ConstIteratorType;
+        typedef itk::ImageRegionIterator< FlowImageType > IteratorType;
+        ConstIteratorType in(this->flow, this->flow->GetLargestPossibleRegion());
+        IteratorType out(initial, initial->GetLargestPossibleRegion());
+        for (in.GoToBegin(), out.GoToBegin(); !in.IsAtEnd(); ++in, ++out)
+            out.Set(in.Get() * this->damping);
+    }
+
+    /**
+     * Move each vector of the flow to where its pixel went, x + flow(x),
+     * spread bilinearly over the four nearest pixels; each pixel of
+     * initial gets damping times the weighted mean of what landed on it,
+     * or of its own flow if nothing did.
+     */
+    void Advect(FlowImageType* initial)
+    {
+        const FlowPixelType* in = this->flow->GetBufferPointer();
+        FlowPixelType* out = initial->GetBufferPointer();
+        const long width = this->flow->GetBufferedRegion().GetSize()[0];
+        const long height = this->flow->GetBufferedRegion().GetSize()[1];
+        const double sx = this->flow->GetSpacing()[0];
+        const double sy = this->flow->GetSpacing()[1];
+
+        std::vector< double > sumU(width * height, 0.0), sumV(width * height, 0.0), weights(width * height, 0.0);
+        for (long y = 0; y < height; y++)
+        {
+            for (long x = 0; x < width; x++)
+            {
+                const FlowPixelType& f = in[y * width + x];
+                double px = x + f[0] / sx;
+                double py = y + f[1] / sy;
+                if (!(px >= 0 && px <= width - 1 && py >= 0 && py <= height - 1))
+                    continue;
+
+                long x0 = std::min((long) px, width - 1), y0 = std::min((long) py, height - 1);
+                long x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+                double ax = px - x0, ay = py - y0;
+                long corners[4] = { y0 * width + x0, y0 * width + x1, y1 * width + x0, y1 * width + x1 };
+                double w[4] = { (1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay };
+                for (unsigned int i = 0; i < 4; i++)
+                {
+                    sumU[corners[i]] += w[i] * f[0];
+                    sumV[corners[i]] += w[i] * f[1];
+                    weights[corners[i]] += w[i];
+                }
+            }
+        }
+
+        // Too little weight is as good as none; keep the pixel's own flow
+        const double minimum = 1e-3;
+        for (long i = 0; i < width * height; i++)
+        {
+            if (weights[i] > minimum)
+            {
+                out[i][0] = this->damping * sumU[i] / weights[i];
+                out[i][1] = this->damping * sumV[i] / weights[i];
+            }
+            else
+            {
+                out[i][0] = this->damping * in[i][0];
+                out[i][1] = this->damping * in[i][1];
+            }
+        }
+    }
+
+    ConstFlowPointer flow;  // the last pair's flow
+    unsigned int pair;      // and its index
+    double damping;
+    bool warp;
+    unsigned long hits;
+    unsigned long misses;
+};
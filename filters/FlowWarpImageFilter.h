@@ -0,0 +1,275 @@
+#pragma once
+
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageToImageFilter.h"
+
+#include "FlowKernels.h"
+
+/**
+ * \class FlowWarpImageFilter
+ * \brief Warps a 2D image by an optical flow field, bilinearly.
+ *
+ * A stand-in for itk::WarpImageFilter with its default linear
+ * interpolator, and the same interface: output pixel p samples the input
+ * at the physical point p + field(p).  Samples that fall outside the
+ * input get EdgePaddingValue.  The output takes its region from the
+ * deformation field and its origin and spacing from OutputOrigin and
+ * OutputSpacing.
+ *
+ * itk::WarpImageFilter goes through a transform to physical space, an
+ * interpolator, and a bounds check for every pixel.  Here each thread
+ * works on whole rows: the sample positions of a row, in input pixels,
+ * are a per-column base plus the field scaled by the input spacing, and
+ * FlowKernels::WarpRow does the bilinear sampling straight from the
+ * input buffer, vectorized where the processor allows.  The whole input
+ * is requested, and direction cosines are ignored (taken as identity),
+ * as they are throughout this library.
+ */
+template < class TInputImage, class TOutputImage, class TDeformationField >
+class FlowWarpImageFilter :
+    public itk::ImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+    // Common ITK typedefs
+    typedef FlowWarpImageFilter Self;
+    typedef itk::ImageToImageFilter< TInputImage, TOutputImage > Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(FlowWarpImageFilter, itk::ImageToImageFilter);
+
+    // Convenient typedefs
+    typedef TInputImage InputImageType;
+    typedef typename InputImageType::PixelType InputPixelType;
+    typedef typename InputImageType::ConstPointer InputImageConstPointer;
+    typedef TOutputImage OutputImageType;
+    typedef typename OutputImageType::PixelType PixelType;
+    typedef typename OutputImageType::RegionType OutputImageRegionType;
+    typedef typename OutputImageType::SpacingType SpacingType;
+    typedef typename OutputImageType::PointType PointType;
+    typedef TDeformationField DeformationFieldType;
+    typedef typename DeformationFieldType::Pointer DeformationFieldPointer;
+
+    itkStaticConstMacro(ImageDimension, unsigned int, OutputImageType::ImageDimension);
+
+    /**
+     * Get/Set the deformation field, in physical units.
+     */
+    void SetDeformationField(const DeformationFieldType* field)
+    {
+        this->itk::ProcessObject::SetNthInput(1, const_cast< DeformationFieldType* >(field));
+    }
+
+    DeformationFieldType* GetDeformationField()
+    {
+        return static_cast< DeformationFieldType* >(this->itk::ProcessObject::GetInput(1));
+    }
+
+    /**
+     * Get/Set the value of samples outside the input.
+     */
+    itkSetMacro(EdgePaddingValue, PixelType);
+    itkGetConstMacro(EdgePaddingValue, PixelType);
+
+    /**
+     * Get/Set the output's origin and spacing.
+     */
+    itkSetMacro(OutputOrigin, PointType);
+    itkGetConstReferenceMacro(OutputOrigin, PointType);
+    itkSetMacro(OutputSpacing, SpacingType);
+    itkGetConstReferenceMacro(OutputSpacing, SpacingType);
+
+    /**
+     * The output covers the deformation field's largest region.
+     */
+    virtual void GenerateOutputInformation();
+
+    /**
+     * Requests all of the input, and the output's region of the field.
+     */
+    virtual void GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError);
+
+protected:
+    FlowWarpImageFilter()
+        : m_EdgePaddingValue(itk::NumericTraits< PixelType >::Zero),
+          m_Input(0)
+    {
+        this->SetNumberOfRequiredInputs(2);
+        this->m_OutputOrigin.Fill(0.0);
+        this->m_OutputSpacing.Fill(1.0);
+    }
+    virtual ~FlowWarpImageFilter() {}
+
+    /**
+     * Get the input as floats, copying it if it is of another type.
+     */
+    void BeforeThreadedGenerateData();
+    void AfterThreadedGenerateData();
+
+    void ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId);
+
+    void PrintSelf(std::ostream& os, itk::Indent indent) const;
+
+private:
+    // Not implemented
+    FlowWarpImageFilter(const Self& other);
+    void operator=(const Self& other);
+
+    PixelType m_EdgePaddingValue;
+    PointType m_OutputOrigin;
+    SpacingType m_OutputSpacing;
+
+    // The input's buffer as floats; m_Copy holds it if the input is not
+    // float
+    const float* m_Input;
+    std::vector< float > m_Copy;
+};
+
+/**----- Implementation -----**/
+
+namespace FlowWarp
+{
+    /**
+     * The pixels of an image buffer as floats; only images of another
+     * pixel type are copied.
+     */
+    template < class TPixel >
+    struct FloatBuffer
+    {
+        static const float* Get(const TPixel* pixels, unsigned long count, std::vector< float >& copy)
+        {
+            copy.resize(count);
+            FlowKernels::CopyRow(pixels, count, &copy[0]);
+            return &copy[0];
+        }
+    };
+
+    template <>
+    struct FloatBuffer< float >
+    {
+        static const float* Get(const float* pixels, unsigned long, std::vector< float >&)
+        {
+            return pixels;
+        }
+    };
+}
+
+template < class TInputImage, class TOutputImage, class TDeformationField >
+    void FlowWarpImageFilter< TInputImage, TOutputImage, TDeformationField >
+    ::GenerateOutputInformation()
+{
+    Superclass::GenerateOutputInformation();
+
+    OutputImageType* output = this->GetOutput();
+    output->SetOrigin(this->m_OutputOrigin);
+    output->SetSpacing(this->m_OutputSpacing);
+
+    DeformationFieldPointer field = this->GetDeformationField();
+    if (field)
+        output->SetLargestPossibleRegion(field->GetLargestPossibleRegion());
+}
+
+template < class TInputImage, class TOutputImage, class TDeformationField >
+    void FlowWarpImageFilter< TInputImage, TOutputImage, TDeformationField >
+    ::GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError)
+{
+    Superclass::GenerateInputRequestedRegion();
+
+    // Samples can land anywhere in the input
+    InputImageType* input = const_cast< InputImageType* >(this->GetInput());
+    if (input)
+        input->SetRequestedRegionToLargestPossibleRegion();
+
+    DeformationFieldPointer field = this->GetDeformationField();
+    if (field)
+        field->SetRequestedRegion(this->GetOutput()->GetRequestedRegion());
+}
+
+template < class TInputImage, class TOutputImage, class TDeformationField >
+    void FlowWarpImageFilter< TInputImage, TOutputImage, TDeformationField >
+    ::BeforeThreadedGenerateData()
+{
+    const InputImageType* input = this->GetInput();
+    this->m_Input = FlowWarp::FloatBuffer< InputPixelType >::Get(
+        input->GetBufferPointer(), input->GetBufferedRegion().GetNumberOfPixels(), this->m_Copy);
+}
+
+template < class TInputImage, class TOutputImage, class TDeformationField >
+    void FlowWarpImageFilter< TInputImage, TOutputImage, TDeformationField >
+    ::AfterThreadedGenerateData()
+{
+    this->m_Input = 0;
+    std::vector< float >().swap(this->m_Copy);
+}
+
+template < class TInputImage, class TOutputImage, class TDeformationField >
+    void FlowWarpImageFilter< TInputImage, TOutputImage, TDeformationField >
+    ::ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId)
+{
+    const InputImageType* input = this->GetInput();
+    const DeformationFieldType* field = this->GetDeformationField();
+    OutputImageType* output = this->GetOutput();
+
+    const typename InputImageType::RegionType inRegion = input->GetBufferedRegion();
+    const typename DeformationFieldType::RegionType fieldRegion = field->GetBufferedRegion();
+    const OutputImageRegionType outRegion = output->GetBufferedRegion();
+    const long width = outputRegion.GetSize()[0];
+    const long rows = outputRegion.GetSize()[1];
+    const long inWidth = inRegion.GetSize()[0];
+    const long inHeight = inRegion.GetSize()[1];
+    const long fieldWidth = fieldRegion.GetSize()[0];
+    const long fieldX = outputRegion.GetIndex()[0] - fieldRegion.GetIndex()[0];
+    const long fieldY = outputRegion.GetIndex()[1] - fieldRegion.GetIndex()[1];
+    const long outWidth = outRegion.GetSize()[0];
+    const long outX = outputRegion.GetIndex()[0] - outRegion.GetIndex()[0];
+    const long outY = outputRegion.GetIndex()[1] - outRegion.GetIndex()[1];
+    if (width == 0 || rows == 0 || inWidth == 0 || inHeight == 0)
+        return;
+
+    // Output index i maps to input buffer pixel
+    //   (origin + i spacing - input origin) / input spacing - buffer start,
+    // and the field moves it by field / input spacing.
+    const PointType& origin = output->GetOrigin();
+    const SpacingType& spacing = output->GetSpacing();
+    const typename InputImageType::PointType& inOrigin = input->GetOrigin();
+    const typename InputImageType::SpacingType& inSpacing = input->GetSpacing();
+    const float scaleX = 1.0 / inSpacing[0];
+    const float scaleY = 1.0 / inSpacing[1];
+
+    std::vector< float > bx(width), dx(width), dy(width), row(width);
+    for (long x = 0; x < width; x++)
+    {
+        double px = origin[0] + (outputRegion.GetIndex()[0] + x) * spacing[0];
+        bx[x] = (px - inOrigin[0]) / inSpacing[0] - inRegion.GetIndex()[0];
+    }
+
+    const typename DeformationFieldType::PixelType* flow = field->GetBufferPointer();
+    PixelType* out = output->GetBufferPointer();
+    const float pad = this->m_EdgePaddingValue;
+    for (long j = 0; j < rows; j++)
+    {
+        double py = origin[1] + (outputRegion.GetIndex()[1] + j) * spacing[1];
+        float by = (py - inOrigin[1]) / inSpacing[1] - inRegion.GetIndex()[1];
+
+        FlowKernels::SplitRow(flow + (fieldY + j) * fieldWidth, fieldWidth, fieldX, width, 0, &dx[0], &dy[0]);
+        FlowKernels::WarpRow(this->m_Input, inWidth, inHeight, &bx[0], by, &dx[0], &dy[0],
+            scaleX, scaleY, pad, width, &row[0]);
+
+        PixelType* outRow = out + (outY + j) * outWidth + outX;
+        for (long x = 0; x < width; x++)
+            outRow[x] = static_cast< PixelType >(row[x]);
+    }
+}
+
+template < class TInputImage, class TOutputImage, class TDeformationField >
+    void FlowWarpImageFilter< TInputImage, TOutputImage, TDeformationField >
+    ::PrintSelf(std::ostream& os, itk::Indent indent) const
+{
+    Superclass::PrintSelf(os, indent);
+    os << indent << "EdgePaddingValue: " << this->m_EdgePaddingValue << std::endl;
+    os << indent << "OutputOrigin: " << this->m_OutputOrigin << std::endl;
+    os << indent << "OutputSpacing: " << this->m_OutputSpacing << std::endl;
+}
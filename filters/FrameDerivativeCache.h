@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GaussianDerivativesImageFilter.h"
+#include "SlidingFrameCache.h"
+
+/**
+ * Computes a frame's smoothed image and spatial derivatives for FrameDerivativeCache.
+ */
+template < class TInputImage >
+struct FrameDerivativePolicy
+{
+    typedef TInputImage InputImageType;
+    typedef GaussianDerivativesImageFilter< InputImageType > FilterType;
+    typedef typename FilterType::DerivativeImageType DerivativeImageType;
+    typedef typename DerivativeImageType::Pointer ValueType;
+    typedef double ParameterType;       // sigma
+
+    static ValueType Compute(const InputImageType* image, double sigma, int threads)
+    {
+        typename FilterType::Pointer filter = FilterType::New();
+        filter->SetSigma(sigma);
+        if (threads > 0)
+            filter->SetNumberOfThreads(threads);
+        filter->SetInput(image);
+        filter->Update();
+
+        ValueType derivatives = filter->GetOutput();
+        derivatives->DisconnectPipeline();
+        return derivatives;
+    }
+
+    static const char* GetName() { return "FrameDerivativeCache"; }
+};
+
+/**
+ * \class FrameDerivativeCache
+ * \brief Holds the Gaussian derivatives of the last few frames of a sequence.
+ *
+ * The smoothed image and spatial derivatives of a frame do not depend on the pair it is in, so this cache computes
+ * them once (with GaussianDerivativesImageFilter) and hands them to both pairs' StructureTensorImageFilter.
+ * Entries are keyed by frame index and sigma, in a SlidingFrameCache.
+ */
+template < class TInputImage >
+class FrameDerivativeCache :
+    public SlidingFrameCache< FrameDerivativePolicy< TInputImage > >
+{
+public:
+    typedef SlidingFrameCache< FrameDerivativePolicy< TInputImage > > Superclass;
+    typedef TInputImage InputImageType;
+    typedef typename FrameDerivativePolicy< TInputImage >::FilterType FilterType;
+    typedef typename FilterType::DerivativeImageType DerivativeImageType;
+    typedef typename DerivativeImageType::Pointer DerivativePointer;
+
+    FrameDerivativeCache(unsigned int capacity = 2) :
+        Superclass(capacity)
+    {}
+
+    /**
+     * Get the smoothed image and derivatives of the given frame at the
+     * given scale, filtering image if they are not held.
+     */
+    DerivativePointer GetDerivatives(unsigned int frame, double sigma, const InputImageType* image)
+    {
+        return this->Get(frame, sigma, image);
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "itkRecursiveMultiResolutionPyramidImageFilter.h"
+
+#include "SlidingFrameCache.h"
+
+/**
+ * Builds a frame's multi-resolution pyramid for FramePyramidCache.
+ */
+template < class TInputImage, class TOutputImage >
+struct FramePyramidPolicy
+{
+    typedef TInputImage InputImageType;
+    typedef TOutputImage OutputImageType;
+    typedef itk::RecursiveMultiResolutionPyramidImageFilter< InputImageType, OutputImageType > FilterType;
+    typedef std::vector< typename OutputImageType::ConstPointer > ValueType;
+    typedef unsigned int ParameterType;     // number of levels
+
+    static ValueType Compute(const InputImageType* image, unsigned int levels, int threads)
+    {
+        typename FilterType::Pointer filter = FilterType::New();
+        filter->SetNumberOfLevels(levels);
+        if (threads > 0)
+            filter->SetNumberOfThreads(threads);
+        filter->SetInput(image);
+        filter->Update();
+
+        ValueType pyramid;
+        for (unsigned int level = 0; level < filter->GetNumberOfOutputs(); level++)
+        {
+            typename OutputImageType::Pointer output = filter->GetOutput(level);
+            output->DisconnectPipeline();
+            pyramid.push_back(output.GetPointer());
+        }
+        return pyramid;
+    }
+
+    static const char* GetName() { return "FramePyramidCache"; }
+};
+
+/**
+ * \class FramePyramidCache
+ * \brief Holds the multi-resolution pyramids of the last few frames of a sequence.
+ *
+ * MultiResolutionOpticalFlowMethod needs a pyramid of both frames of each pair.  A frame's pyramid does not depend
+ * on the pair, so this cache builds it once (with itk::RecursiveMultiResolutionPyramidImageFilter and its default
+ * schedule) and hands it to both pairs: as the second image of one and the first of the next.  Entries are keyed by
+ * frame index and number of levels, in a SlidingFrameCache.
+ */
+template < class TInputImage, class TOutputImage = TInputImage >
+class FramePyramidCache :
+    public SlidingFrameCache< FramePyramidPolicy< TInputImage, TOutputImage > >
+{
+public:
+    typedef SlidingFrameCache< FramePyramidPolicy< TInputImage, TOutputImage > > Superclass;
+    typedef TInputImage InputImageType;
+    typedef TOutputImage OutputImageType;
+    typedef typename FramePyramidPolicy< TInputImage, TOutputImage >::FilterType FilterType;
+
+    /**
+     * A pyramid's levels, coarsest first.
+     */
+    typedef typename Superclass::ValueType PyramidType;
+
+    FramePyramidCache(unsigned int capacity = 2) :
+        Superclass(capacity)
+    {}
+
+    /**
+     * Get the pyramid of the given frame with the given number of
+     * levels, filtering image if it is not held.
+     */
+    PyramidType GetPyramid(unsigned int frame, unsigned int levels, const InputImageType* image)
+    {
+        return this->Get(frame, levels, image);
+    }
+};
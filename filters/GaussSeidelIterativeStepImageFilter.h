@@ -1,9 +1,12 @@
 #pragma once
 
+#include <vector>
+
 #include "itkImage.h"
 #include "itkImageToImageFilter.h"
 
 #include "CommonTypes.h"
+#include "FlowCoefficientImage.h"
 #include "StructureTensorImageFilter.h"
 
 /**
@@ -17,6 +20,12 @@
  * in one portion of the image could get ahead of the iterations in another part of the image,
  * corrupting the result.  The value at one location in an iteration depends on the neighboring
  * values from the previous iteration.
+ *
+ * Each thread works a row at a time: the flow rows are split into u and v planes, and the
+ * neighbour average and update are computed by the vectorized FlowKernels.  The update's
+ * coefficients, the tensor terms divided by (r^2 + T11 + T22), are computed once into a
+ * FlowCoefficientImage, when the tensor or regularization changes, rather than in every
+ * step.
  */
 template < class TInputImage, class TOutputImage = TInputImage >
 class GaussSeidelIterativeStepImageFilter :
@@ -28,7 +37,6 @@ public:
     typedef TOutputImage OutputImageType;
     typedef StructureTensorImageFilter< CommonTypes::InternalImageType > TensorFilterType;
     typedef typename TensorFilterType::TensorImageType TensorImageType;
-    typedef CommonTypes::InternalImageType DenominatorImageType;
     
     typedef typename OutputImageType::RegionType OutputRegionType;
     
@@ -66,10 +74,10 @@ protected:
     virtual ~GaussSeidelIterativeStepImageFilter();
     
     /**
-     * Computes the denominator term in the Gauss-Seidel computation.  This depends on the regularization 
-     * and the structure image tensor.  Specifically: denom = (r^2 + Txx + Tyy)
+     * Computes the update coefficients, if the tensor or regularization have changed.  These
+     * are the structure tensor terms divided by the Gauss-Seidel denominator, (r^2 + T11 + T22).
      */
-    void ComputeDenominator();
+    void BeforeThreadedGenerateData();
 
     /**
      * Generates new flow estimates within the requested output region.
@@ -82,18 +90,19 @@ private:
     void operator=(const Self& other);
     
     typename TensorImageType::ConstPointer m_StructureTensor;
-    typename DenominatorImageType::Pointer m_Denominator;
     double m_Regularization;
+
+    // T11, T12, T13, T22, T23 over (r^2 + T11 + T22)
+    FlowCoefficientImage m_Coefficients;
 };
 
 //-------------------------------------
 // Implementation
 //-------------------------------------
 
-#include "itkConstNeighborhoodIterator.h"
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
+#include <algorithm>
 
+#include "FlowKernels.h"
 #include "Logger.h"
 
 template < class TInputImage, class TOutputImage >
@@ -107,49 +116,6 @@ GaussSeidelIterativeStepImageFilter<TInputImage, TOutputImage>
 ::~GaussSeidelIterativeStepImageFilter()
 {}
 
-template < class TInputImage, class TOutputImage >
-void GaussSeidelIterativeStepImageFilter< TInputImage, TOutputImage >
-::ComputeDenominator()
-{
-    std::string function("GaussSeidelIterativeStepImageFilter::ComputeDenominator");
-    // Get pointer to the input image:
-    typename InputImageType::Pointer input = const_cast<InputImageType*>(this->GetInput());
-
-    // Make sure we can procede
-    if (!input)
-    {
-        Logger::warning << function << ": input image was not set!" << std::endl;
-        return;
-    }
-
-    // Get a copy of the input requested region
-    typename InputImageType::RegionType region = input->GetLargestPossibleRegion();
-
-    // Create the denominator image
-    this->m_Denominator = DenominatorImageType::New();
-    this->m_Denominator->SetRegions(region);
-    this->m_Denominator->SetSpacing(input->GetSpacing());
-    this->m_Denominator->SetOrigin(input->GetOrigin());
-    this->m_Denominator->Allocate();
-
-    // Setup iterators for the structure tensor and denominator image
-    typedef itk::ImageRegionConstIterator<TensorImageType> TensorIteratorType;
-    typedef itk::ImageRegionIterator< DenominatorImageType > DenominatorIteratorType;
-    TensorIteratorType tensorIt(this->m_StructureTensor, region);
-    DenominatorIteratorType denomIt(this->m_Denominator, region);
-    typename TensorImageType::PixelType J;
-
-    // Compute the denominator image
-    double regSquared = this->GetRegularization()*this->GetRegularization();
-    for (tensorIt.GoToBegin(), denomIt.GoToBegin();
-        !(tensorIt.IsAtEnd() || denomIt.IsAtEnd());
-        ++tensorIt, ++denomIt)
-    {
-        J = tensorIt.Get();
-        denomIt.Set(regSquared + J[TensorFilterType::T11] + J[TensorFilterType::T22]);
-    } 
-}
-
 template < class TInputImage, class TOutputImage >
 void GaussSeidelIterativeStepImageFilter< TInputImage, TOutputImage >
 ::GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError)
@@ -197,72 +163,99 @@ void GaussSeidelIterativeStepImageFilter< TInputImage, TOutputImage >
     }
 }
 
+template < class TInputImage, class TOutputImage >
+void GaussSeidelIterativeStepImageFilter< TInputImage, TOutputImage >
+::BeforeThreadedGenerateData()
+{
+    const TensorImageType* tensor = this->GetStructureTensor();
+    const double regSquared = this->GetRegularization() * this->GetRegularization();
+    if (this->m_Coefficients.IsCurrent(tensor, tensor->GetMTime(), regSquared))
+        return;
+
+    const long width = tensor->GetBufferedRegion().GetSize()[0];
+    const long height = tensor->GetBufferedRegion().GetSize()[1];
+    const typename TensorImageType::PixelType* J = tensor->GetBufferPointer();
+    this->m_Coefficients.Allocate(width, height, 5);
+    for (long y = 0; y < height; y++)
+    {
+        float* c11 = this->m_Coefficients.GetPlane(y, 0);
+        float* c12 = this->m_Coefficients.GetPlane(y, 1);
+        float* c13 = this->m_Coefficients.GetPlane(y, 2);
+        float* c22 = this->m_Coefficients.GetPlane(y, 3);
+        float* c23 = this->m_Coefficients.GetPlane(y, 4);
+        for (long x = 0; x < width; x++, J++)
+        {
+            double denom = regSquared + (*J)[TensorFilterType::T11] + (*J)[TensorFilterType::T22];
+            c11[x] = (*J)[TensorFilterType::T11] / denom;
+            c12[x] = (*J)[TensorFilterType::T12] / denom;
+            c13[x] = (*J)[TensorFilterType::T13] / denom;
+            c22[x] = (*J)[TensorFilterType::T22] / denom;
+            c23[x] = (*J)[TensorFilterType::T23] / denom;
+        }
+    }
+    this->m_Coefficients.SetSource(tensor, tensor->GetMTime(), regSquared);
+}
+
 template < class TInputImage, class TOutputImage >
 void GaussSeidelIterativeStepImageFilter< TInputImage, TOutputImage >
 ::ThreadedGenerateData(const OutputRegionType& outputRegion, int threadId)
 {
     std::string function("GaussSiedelIterativeStepImageFilter::ThreadedGenerateData");
-    
-    typedef itk::ConstNeighborhoodIterator<InputImageType> InputIteratorType;
-    typedef itk::ImageRegionIterator<OutputImageType> OutputIteratorType;
-    typedef itk::ImageRegionConstIterator<TensorImageType> TensorIteratorType;
-    
-    // Set up input iterator (current flow field)
-    typename InputIteratorType::RadiusType radius;
-    radius.Fill(1);
-    InputIteratorType inIt(radius, this->GetInput(), outputRegion);
-    
-    // Name the neighborhood positions
-    typename InputIteratorType::OffsetType NW   = {{-1, -1}};
-    typename InputIteratorType::OffsetType N    = {{0, -1}};
-    typename InputIteratorType::OffsetType NE   = {{+1, -1}};
-    typename InputIteratorType::OffsetType W    = {{-1, 0}};
-    typename InputIteratorType::OffsetType E    = {{+1, 0}};
-    typename InputIteratorType::OffsetType SW   = {{-1, +1}};
-    typename InputIteratorType::OffsetType S    = {{0, +1}};
-    typename InputIteratorType::OffsetType SE   = {{+1, +1}};
-        
-    // Set up output iterator (next flow field)
-    OutputIteratorType outIt(this->GetOutput(), outputRegion);
-    
-    // Set up tensor and denominator iterators
-    TensorIteratorType jIt(this->GetStructureTensor(), outputRegion);
 
-    // scalar constants
-    double sixth = 1.0 / 6.0;
-    double twelfth = 1.0 / 12.0;
-    double regSquared = this->GetRegularization()*this->GetRegularization();
+    const InputImageType* input = this->GetInput();
+    OutputImageType* output = this->GetOutput();
+    const TensorImageType* tensor = this->GetStructureTensor();
+    typename InputImageType::RegionType inRegion = input->GetBufferedRegion();
+    typename OutputImageType::RegionType outRegion = output->GetBufferedRegion();
+    typename TensorImageType::RegionType tensorRegion = tensor->GetBufferedRegion();
+
+    // Geometry of this thread's region within each buffer
+    const long width = outputRegion.GetSize()[0];
+    const long rows = outputRegion.GetSize()[1];
+    const long inWidth = inRegion.GetSize()[0];
+    const long inHeight = inRegion.GetSize()[1];
+    const long inX = outputRegion.GetIndex()[0] - inRegion.GetIndex()[0];
+    const long inY = outputRegion.GetIndex()[1] - inRegion.GetIndex()[1];
+    const long outX = outputRegion.GetIndex()[0] - outRegion.GetIndex()[0];
+    const long outY = outputRegion.GetIndex()[1] - outRegion.GetIndex()[1];
+    const long tensorX = outputRegion.GetIndex()[0] - tensorRegion.GetIndex()[0];
+    const long tensorY = outputRegion.GetIndex()[1] - tensorRegion.GetIndex()[1];
+    if (width == 0 || rows == 0)
+        return;
+
+    const typename InputImageType::PixelType* in = input->GetBufferPointer();
+    typename OutputImageType::PixelType* out = output->GetBufferPointer();
 
-    // Compute next flow
-    typename InputImageType::PixelType curr, next, laplace;
-    typename TensorImageType::PixelType J;
-    double denom;
+    // Flow rows y-1, y, y+1, with one pixel of border, in u and v planes;
+    // input row r lives in slot r % 3.
+    const long padded = width + 2;
+    std::vector< float > ringU(3 * padded), ringV(3 * padded);
+    std::vector< float > averageU(width), averageV(width), nextU(width), nextV(width);
 
-    for (inIt.GoToBegin(), outIt.GoToBegin(), jIt.GoToBegin();
-         !(inIt.IsAtEnd() || outIt.IsAtEnd() || jIt.IsAtEnd());
-         ++inIt, ++outIt, ++jIt)
+    long next = std::max(0L, inY - 1);
+    for (long j = 0; j < rows; j++)
     {
-        laplace[0] = 
-            sixth   * (inIt.GetPixel(N)[0] + inIt.GetPixel(E)[0] + inIt.GetPixel(S)[0] + inIt.GetPixel(W)[0]) +
-            twelfth * (inIt.GetPixel(NW)[0] + inIt.GetPixel(NE)[0] + inIt.GetPixel(SW)[0] + inIt.GetPixel(SE)[0]);
-        laplace[1] =
-            sixth   * (inIt.GetPixel(N)[1] + inIt.GetPixel(E)[1] + inIt.GetPixel(S)[1] + inIt.GetPixel(W)[1]) +
-            twelfth * (inIt.GetPixel(NW)[1] + inIt.GetPixel(NE)[1] + inIt.GetPixel(SW)[1] + inIt.GetPixel(SE)[1]);
+        long y = inY + j;
+        for (; next <= std::min(inHeight - 1, y + 1); next++)
+        {
+            FlowKernels::SplitRow(in + next * inWidth, inWidth, inX, width, 1,
+                &ringU[(next % 3) * padded], &ringV[(next % 3) * padded]);
+        }
+        long above = (std::max(0L, y - 1) % 3) * padded;
+        long center = (y % 3) * padded;
+        long below = (std::min(inHeight - 1, y + 1) % 3) * padded;
 
-        J = jIt.Get();
-        curr = inIt.GetCenterPixel();
+        FlowKernels::NeighborAverage(&ringU[above], &ringU[center], &ringU[below], width, &averageU[0]);
+        FlowKernels::NeighborAverage(&ringV[above], &ringV[center], &ringV[below], width, &averageV[0]);
 
-        denom = regSquared + J[TensorFilterType::T11] + J[TensorFilterType::T22];
+        // The coefficients cover the tensor's buffer
+        const FlowCoefficientImage& c = this->m_Coefficients;
+        long t = tensorY + j;
+        FlowKernels::GaussSeidelUpdate(&averageU[0], &averageV[0],
+            c.GetPlane(t, 0) + tensorX, c.GetPlane(t, 1) + tensorX, c.GetPlane(t, 2) + tensorX,
+            c.GetPlane(t, 3) + tensorX, c.GetPlane(t, 4) + tensorX,
+            width, &nextU[0], &nextV[0]);
 
-        next[0] = laplace[0] - 
-            (J[TensorFilterType::T11]*laplace[0] + 
-             J[TensorFilterType::T12]*laplace[1] + 
-             J[TensorFilterType::T13]) / denom;
-        next[1] = laplace[1] - 
-            (J[TensorFilterType::T21]*laplace[0] + 
-             J[TensorFilterType::T22]*laplace[1] + 
-             J[TensorFilterType::T23]) / denom;
-        
-        outIt.Set(next);
+        FlowKernels::MergeRow(&nextU[0], &nextV[0], width, out + (outY + j) * outRegion.GetSize()[0] + outX);
     }
 }
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "itkImage.h"
+#include "itkImageToImageFilter.h"
+#include "itkVector.h"
+
+#include "SeparableGaussian.h"
+
+/**
+ * \class GaussianDerivativesImageFilter
+ * \brief Computes the Gaussian smoothed image and its first spatial derivatives in one pass.
+ *
+ * Each output pixel holds [G*I, Gx*I, Gy*I], the image smoothed by a Gaussian of standard deviation Sigma and its
+ * partial derivatives at that scale.  These are the per-frame terms of the structure tensor; computing them once per
+ * frame and handing them to StructureTensorImageFilter lets a sequence of frame pairs share them (see
+ * FrameDerivativeCache).  The kernels and borders are those of StructureTensorImageFilter, so the tensor is the same
+ * either way.
+ *
+ * Like StructureTensorImageFilter, each thread streams through the input rows of its band once, holding the
+ * horizontally filtered rows the vertical kernels need in ring buffers.
+ */
+template < class TInputImage >
+class GaussianDerivativesImageFilter
+    : public itk::ImageToImageFilter< TInputImage, itk::Image< itk::Vector< float, 3 >, TInputImage::ImageDimension > >
+{
+public:
+    typedef TInputImage InputImageType;
+
+    itkStaticConstMacro(ImageDimension, unsigned int, InputImageType::ImageDimension);
+    enum DerivativeIndex
+    {
+        Smoothed = 0,
+        DerivativeX,
+        DerivativeY
+    };
+
+    typedef itk::Vector< float, 3 > DerivativeType;
+    typedef itk::Image< DerivativeType, ImageDimension > DerivativeImageType;
+    typedef DerivativeImageType OutputImageType;
+    typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+    // Standard itk class typedefs
+    typedef GaussianDerivativesImageFilter Self;
+    typedef itk::ImageToImageFilter< InputImageType, OutputImageType > Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(GaussianDerivativesImageFilter, itk::ImageToImageFilter);
+
+    /**
+     * Get/Set the standard deviation of the Gaussian, in physical units.
+     * Derivatives are per physical unit.
+     */
+    itkGetMacro(Sigma, double);
+    itkSetMacro(Sigma, double);
+
+protected:
+    GaussianDerivativesImageFilter() : m_Sigma(1.0) {}
+    virtual ~GaussianDerivativesImageFilter() {}
+
+    /**
+     * Every output row depends on input rows a kernel radius away, so
+     * request the whole input, and produce the whole output.
+     */
+    virtual void GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError);
+    virtual void EnlargeOutputRequestedRegion(itk::DataObject* output);
+
+    void BeforeThreadedGenerateData();
+    void ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId);
+
+private:
+    // Not implemented
+    GaussianDerivativesImageFilter(const Self& other);
+    void operator=(const Self& other);
+
+    double m_Sigma;
+
+    SeparableGaussian::KernelType m_SmoothX, m_SmoothY;
+    SeparableGaussian::KernelType m_DerivativeX, m_DerivativeY;
+};
+
+//----------------- Implementation -----------------//
+
+template < class TInputImage >
+void GaussianDerivativesImageFilter< TInputImage >
+::GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError)
+{
+    Superclass::GenerateInputRequestedRegion();
+    InputImageType* input = const_cast< InputImageType* >(this->GetInput());
+    if (input)
+        input->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template < class TInputImage >
+void GaussianDerivativesImageFilter< TInputImage >
+::EnlargeOutputRequestedRegion(itk::DataObject* output)
+{
+    Superclass::EnlargeOutputRequestedRegion(output);
+    output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template < class TInputImage >
+void GaussianDerivativesImageFilter< TInputImage >
+::BeforeThreadedGenerateData()
+{
+    typename InputImageType::SpacingType spacing = this->GetInput()->GetSpacing();
+    SeparableGaussian::MakeKernels(this->m_Sigma / spacing[0], 1.0 / spacing[0], this->m_SmoothX, &this->m_DerivativeX);
+    SeparableGaussian::MakeKernels(this->m_Sigma / spacing[1], 1.0 / spacing[1], this->m_SmoothY, &this->m_DerivativeY);
+}
+
+template < class TInputImage >
+void GaussianDerivativesImageFilter< TInputImage >
+::ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId)
+{
+    const InputImageType* input = this->GetInput();
+    typename InputImageType::RegionType buffered = input->GetBufferedRegion();
+    const long width = buffered.GetSize()[0];
+    const long height = buffered.GetSize()[1];
+    const typename InputImageType::PixelType* image = input->GetBufferPointer();
+    DerivativeType* derivatives = this->GetOutput()->GetBufferPointer();
+
+    const long startY = outputRegion.GetIndex()[1] - buffered.GetIndex()[1];
+    const long endY = startY + outputRegion.GetSize()[1];
+    if (width == 0 || startY >= endY)
+        return;
+
+    const long radiusX = SeparableGaussian::Radius(this->m_SmoothX);
+    const long radiusY = SeparableGaussian::Radius(this->m_SmoothY);
+
+    // Horizontally smoothed and differentiated rows; row r lives in
+    // slot r % ring.
+    const long ring = 2 * radiusY + 1;
+    std::vector< float > smooth(ring * width), derivative(ring * width);
+    std::vector< float > padded(width + 2 * radiusX);
+    std::vector< float > S(width), Ix(width), Iy(width);
+
+    long next = std::max(0L, startY - radiusY);
+    for (long y = startY; y < endY; y++)
+    {
+        for (; next <= std::min(height - 1, y + radiusY); next++)
+        {
+            long slot = (next % ring) * width;
+            SeparableGaussian::PadRow(image + next * width, width, radiusX, &padded[0]);
+            SeparableGaussian::FilterRow(&padded[0], this->m_SmoothX, width, &smooth[slot]);
+            SeparableGaussian::FilterRow(&padded[0], this->m_DerivativeX, width, &derivative[slot]);
+        }
+
+        std::fill(S.begin(), S.end(), 0.0f);
+        std::fill(Ix.begin(), Ix.end(), 0.0f);
+        std::fill(Iy.begin(), Iy.end(), 0.0f);
+        for (long k = -radiusY; k <= radiusY; k++)
+        {
+            long slot = (SeparableGaussian::Clamp(y + k, height) % ring) * width;
+            SeparableGaussian::AccumulateRow(&smooth[slot], this->m_SmoothY[k + radiusY], width, &S[0]);
+            SeparableGaussian::AccumulateRow(&derivative[slot], this->m_SmoothY[k + radiusY], width, &Ix[0]);
+            SeparableGaussian::AccumulateRow(&smooth[slot], this->m_DerivativeY[k + radiusY], width, &Iy[0]);
+        }
+
+        DerivativeType* out = derivatives + y * width;
+        for (long x = 0; x < width; x++)
+        {
+            out[x][Smoothed] = S[x];
+            out[x][DerivativeX] = Ix[x];
+            out[x][DerivativeY] = Iy[x];
+        }
+    }
+}
@@ -21,6 +21,8 @@
  * Spatial image derivatives are estimated using derivative-of-Gaussian filter kernels.  The temporal
  * derivatives are estimated by image differencing.  The user configures the spatial derivative scale,
  * the weighting of the smoothness term, and the number of iterations.
+ * Iteration stops early once the flow stops changing, as set by the
+ * convergence tolerances.
  */
 template <class TInputImage1, class TInputImage2, class TOutputValueType = float >
 class HornOpticalFlowImageFilter :
@@ -72,16 +74,79 @@ public:
     itkSetMacro(SmoothWeighting, float);
     
     /**
-     * Get/Set the number of iterations to use in flow computation.
+     * Get/Set the maximum number of iterations to use in flow computation.
      */
     itkGetMacro(Iterations, unsigned int);
     itkSetMacro(Iterations, unsigned int);
+
+    /**
+     * Get/Set the convergence tolerances.  Iteration stops once the root
+     * mean square change in the flow from one iteration to the next falls
+     * below AbsoluteTolerance (in pixels), or below RelativeTolerance
+     * times the first iteration's change.  Zero disables a test.
+     */
+    itkGetMacro(AbsoluteTolerance, double);
+    itkSetMacro(AbsoluteTolerance, double);
+    itkGetMacro(RelativeTolerance, double);
+    itkSetMacro(RelativeTolerance, double);
+
+    /**
+     * Get/Set the number of iterations to run before testing for
+     * convergence.
+     */
+    itkGetMacro(MinimumIterations, unsigned int);
+    itkSetMacro(MinimumIterations, unsigned int);
+
+    /**
+     * Get/Set the number of steps taken in one pass over the frame, and
+     * the number of rows in the bands that take them.  Several steps per
+     * pass keep large frames in cache rather than streaming them through
+     * memory on every step, and give the same flow; convergence is only
+     * acted on at the end of a pass, so up to TileIterations - 1 extra
+     * steps may run.  See HornOpticalFlowIterativeStepImageFilter.
+     */
+    itkGetMacro(TileIterations, unsigned int);
+    itkSetMacro(TileIterations, unsigned int);
+    itkGetMacro(TileRows, unsigned int);
+    itkSetMacro(TileRows, unsigned int);
+
+    /**
+     * Get/Set whether to solve by multigrid (MultigridFlowSolver) rather
+     * than by Jacobi steps.  Multigrid needs a handful of cycles where
+     * the steps need hundreds of iterations, and the gap grows with the
+     * frame size.
+     */
+    itkGetMacro(UseMultigrid, bool);
+    itkSetMacro(UseMultigrid, bool);
+    itkBooleanMacro(UseMultigrid);
+
+    /**
+     * Get/Set the maximum number of multigrid cycles; the first is a
+     * full multigrid cycle unless an initial flow is given.  Used in
+     * place of Iterations with UseMultigrid.
+     */
+    itkGetMacro(MultigridCycles, unsigned int);
+    itkSetMacro(MultigridCycles, unsigned int);
+
+    /**
+     * Get the number of iterations (or multigrid cycles) used for the
+     * last flow field.
+     */
+    itkGetMacro(ElapsedIterations, unsigned int);
     
 protected:
     HornOpticalFlowImageFilter()
     : m_SpatialSigma(1.0),
       m_SmoothWeighting(100),
-      m_Iterations(200)
+      m_Iterations(200),
+      m_AbsoluteTolerance(0.0),
+      m_RelativeTolerance(0.0),
+      m_MinimumIterations(1),
+      m_TileIterations(1),
+      m_TileRows(64),
+      m_UseMultigrid(false),
+      m_MultigridCycles(4),
+      m_ElapsedIterations(0)
     {}
     virtual ~HornOpticalFlowImageFilter(){}
     
@@ -98,12 +163,22 @@ private:
     float m_SpatialSigma;
     float m_SmoothWeighting;
     unsigned int m_Iterations;
+    double m_AbsoluteTolerance;
+    double m_RelativeTolerance;
+    unsigned int m_MinimumIterations;
+    unsigned int m_TileIterations;
+    unsigned int m_TileRows;
+    bool m_UseMultigrid;
+    unsigned int m_MultigridCycles;
+    unsigned int m_ElapsedIterations;
 };
 
 /** Implementation **/
 
+#include <algorithm>
 #include <string>
 
+#include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
 #include "itkRecursiveGaussianImageFilter.h"
 #include "itkSubtractImageFilter.h"
@@ -111,6 +186,8 @@ private:
 #include "HornOpticalFlowIterativeStepImageFilter.h"
 #include "ImageUtils.h"
 #include "Logger.h"
+#include "MultigridFlowSolver.h"
+#include "StructureTensorImageFilter.h"
 
 template < class TInputImage1, class TInputImage2, class TComponentType >
 void HornOpticalFlowImageFilter< TInputImage1, TInputImage2, TComponentType >
@@ -151,6 +228,9 @@ void HornOpticalFlowImageFilter< TInputImage1, TInputImage2, TComponentType >
     dy->SetDirection(1);
     dx->SetSigma(this->GetSpatialSigma());
     dy->SetSigma(this->GetSpatialSigma());
+    dx->SetNumberOfThreads(this->GetNumberOfThreads());
+    dy->SetNumberOfThreads(this->GetNumberOfThreads());
+    dt->SetNumberOfThreads(this->GetNumberOfThreads());
     
     // Connect pipeline
     dx->SetInput(input1);
@@ -212,17 +292,87 @@ void HornOpticalFlowImageFilter< TInputImage1, TInputImage2, TComponentType >
         fit.Set(zero);
     }
     
+    typename Superclass::ConstOutputImagePointer initFlow = this->GetInitialFlow();
+    if (this->GetUseMultigrid())
+    {
+        // The Horn and Schunck equations are the CLG equations with the
+        // unsmoothed tensor of the image derivatives.
+        Logger::debug << function << ": Computing flow by multigrid" << std::endl;
+        typedef StructureTensorImageFilter< InternalImageType > TensorFilterType;
+        typedef typename TensorFilterType::TensorImageType TensorImageType;
+        typedef MultigridFlowSolver< OutputImageType, TensorImageType > SolverType;
+
+        typename TensorImageType::Pointer tensor = TensorImageType::New();
+        tensor->SetRegions(output->GetLargestPossibleRegion());
+        tensor->Allocate();
+        typedef itk::ImageRegionConstIterator< InternalImageType > DerivIterator;
+        typedef itk::ImageRegionIterator< TensorImageType > TensorIterator;
+        DerivIterator dxIt(dIdx, dIdx->GetLargestPossibleRegion());
+        DerivIterator dyIt(dIdy, dIdy->GetLargestPossibleRegion());
+        DerivIterator dtIt(dt->GetOutput(), dt->GetOutput()->GetLargestPossibleRegion());
+        TensorIterator jIt(tensor, tensor->GetLargestPossibleRegion());
+        typename TensorImageType::PixelType J;
+        for (dxIt.GoToBegin(), dyIt.GoToBegin(), dtIt.GoToBegin(), jIt.GoToBegin();
+             !(dxIt.IsAtEnd() || dyIt.IsAtEnd() || dtIt.IsAtEnd() || jIt.IsAtEnd());
+             ++dxIt, ++dyIt, ++dtIt, ++jIt)
+        {
+            J[TensorFilterType::T11] = dxIt.Get() * dxIt.Get();
+            J[TensorFilterType::T12] = dxIt.Get() * dyIt.Get();
+            J[TensorFilterType::T13] = dxIt.Get() * dtIt.Get();
+            J[TensorFilterType::T21] = J[TensorFilterType::T12];
+            J[TensorFilterType::T22] = dyIt.Get() * dyIt.Get();
+            J[TensorFilterType::T23] = dyIt.Get() * dtIt.Get();
+            jIt.Set(J);
+        }
+
+        // As with the steps, the smoothness term applies to the initial
+        // flow plus the increment, so solve for the total flow, starting
+        // from the initial flow, and subtract the initial flow after.
+        bool haveInit = initFlow && !initFlow.IsNull();
+        typedef itk::ImageRegionConstIterator< OutputImageType > ConstFlowIterator;
+        if (haveInit)
+        {
+            ConstFlowIterator initIt(initFlow, initFlow->GetLargestPossibleRegion());
+            for (fit.GoToBegin(), initIt.GoToBegin(); !(fit.IsAtEnd() || initIt.IsAtEnd()); ++fit, ++initIt)
+                fit.Set(initIt.Get());
+        }
+
+        typename SolverType::Pointer solver = SolverType::New();
+        solver->SetFlow(flow);
+        solver->SetStructureTensor(tensor);
+        solver->SetRegularization(this->GetSmoothWeighting());
+        solver->SetNumberOfThreads(this->GetNumberOfThreads());
+        solver->SetFullMultigrid(!haveInit);
+        solver->SetAbsoluteTolerance(this->GetAbsoluteTolerance());
+        solver->SetRelativeTolerance(this->GetRelativeTolerance());
+        solver->SetMinimumIterations(this->GetMinimumIterations());
+        solver->Iterate(this->GetMultigridCycles());
+        this->m_ElapsedIterations = solver->GetElapsedIterations();
+
+        if (haveInit)
+        {
+            ConstFlowIterator initIt(initFlow, initFlow->GetLargestPossibleRegion());
+            for (fit.GoToBegin(), initIt.GoToBegin(); !(fit.IsAtEnd() || initIt.IsAtEnd()); ++fit, ++initIt)
+                fit.Set(fit.Get() - initIt.Get());
+        }
+
+        Logger::debug << function << ": Grafting output" << std::endl;
+        this->GraftOutput(flow);
+        return;
+    }
+
     Logger::debug << function << ": Setting up step iterator" << std::endl;
     typename IterativeStepFilter::Pointer step = IterativeStepFilter::New();
+    step->SetNumberOfThreads(this->GetNumberOfThreads());
     step->SetSmoothWeighting(this->GetSmoothWeighting());
     step->SetDerivativeX(dIdx);
     step->SetDerivativeY(dIdy);
     step->SetDerivativeT(dt->GetOutput());
+    step->SetTileRows(this->GetTileRows());
     
     // If the initial flow is not set, use the zero'd flow created above.
     // Otherwise, we are initializing the optical flow computation with an externally
     // provided flow field.
-    typename Superclass::ConstOutputImagePointer initFlow = this->GetInitialFlow();
     if (!initFlow || initFlow.IsNull())
     {
         step->SetInitialFlow(flow);
@@ -233,12 +383,37 @@ void HornOpticalFlowImageFilter< TInputImage1, TInputImage2, TComponentType >
     }
     
     Logger::debug << function << ": Computing flow" << std::endl;
-    for (unsigned int i = 0; i < this->GetIterations(); i++)
+    double first = 0.0;
+    this->m_ElapsedIterations = 0;
+    while (this->m_ElapsedIterations < this->GetIterations())
     {
+        unsigned int steps = std::max(1u,
+            std::min(this->GetTileIterations(), this->GetIterations() - this->m_ElapsedIterations));
+        step->SetIterations(steps);
         step->SetInput(flow);
         step->Update();
         flow = step->GetOutput();
         flow->DisconnectPipeline();
+
+        bool converged = false;
+        double norm = 0.0;
+        for (unsigned int s = 0; s < steps; s++)
+        {
+            this->m_ElapsedIterations++;
+            norm = step->GetUpdateNorms()[s];
+            if (this->m_ElapsedIterations == 1)
+                first = norm;
+            if (this->m_ElapsedIterations >= this->GetMinimumIterations() &&
+                ((this->GetAbsoluteTolerance() > 0.0 && norm < this->GetAbsoluteTolerance()) ||
+                 (this->GetRelativeTolerance() > 0.0 && norm < this->GetRelativeTolerance() * first)))
+                converged = true;
+        }
+        if (converged)
+        {
+            Logger::debug << function << ": converged after " << this->m_ElapsedIterations
+                << " iterations, update norm " << norm << std::endl;
+            break;
+        }
         
         // Write intermediate image to watch flow evolve
 //         char file[50];
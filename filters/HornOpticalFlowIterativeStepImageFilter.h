@@ -1,9 +1,13 @@
 #pragma once
 
+#include <vector>
+
 #include "itkImage.h"
 #include "itkImageToImageFilter.h"
 #include "itkVector.h"
 
+#include "FlowCoefficientImage.h"
+
 /**
  * \class HornOpticalFlowIterativeStepImageFilter
  * \brief Implements one step in the Horn and Schunck optical flow energy minimization algorithm.
@@ -15,6 +19,28 @@
  * in one portion of the image could get ahead of the iterations in another part of the image,
  * corrupting the result.  The value at one location in an iteration depends on the neighboring 
  * values from the previous iteration.
+ *
+ * Each thread also sums the squared change between the input and output
+ * flow over its region; after the step, GetUpdateNorm() gives the root
+ * mean square change, for convergence testing.
+ *
+ * Each thread works a row at a time: the flow rows are split into u and
+ * v planes, and the neighbour average and update are computed by the
+ * vectorized FlowKernels.  The update's coefficients, the derivatives
+ * scaled by 1 / sqrt(alpha^2 + Ix^2 + Iy^2), are computed once into a
+ * FlowCoefficientImage, when the derivatives or weighting change, so a
+ * step reads that one image instead of the three derivative images.
+ *
+ * With Iterations k > 1, one update takes k steps, blocked in time so
+ * that large frames are not streamed through memory on every step.  Each
+ * thread copies a band of TileRows rows, with a halo of k rows above and
+ * below, into planar buffers, and takes all k steps there.  It then
+ * writes the band's rows of the last step.  A wrong row spoils its
+ * neighbours a row per step, so the band's rows come out exactly as k
+ * single steps would leave them; the halo rows are computed once per
+ * band that needs them.  GetUpdateNorms() gives the update norm of each
+ * of the k steps.  The tiled steps need every input to be buffered over
+ * the output's largest possible region.
  */
 template < class TInputImage, class TDerivativeImage, class TOutputImage = TInputImage >
 class HornOpticalFlowIterativeStepImageFilter :
@@ -66,6 +92,27 @@ public:
      */
     itkGetConstObjectMacro(InitialFlow, InputImageType);
     itkSetConstObjectMacro(InitialFlow, InputImageType);
+
+    /**
+     * Get/Set the number of steps each update takes, and the number of
+     * rows in the bands that take them when there is more than one.
+     */
+    itkGetMacro(Iterations, unsigned int);
+    itkSetMacro(Iterations, unsigned int);
+    itkGetMacro(TileRows, unsigned int);
+    itkSetMacro(TileRows, unsigned int);
+
+    /**
+     * Get the root mean square change in the flow made by the last step.
+     */
+    itkGetMacro(UpdateNorm, double);
+
+    /**
+     * Get the root mean square change in the flow made by each step of
+     * the last update.
+     */
+    const std::vector< double >& GetUpdateNorms() const
+    { return this->m_UpdateNorms; }
     
     /**
      * Pads the requested region by one pixel to enable computing new pixel values at every point.
@@ -74,7 +121,10 @@ public:
 
 protected:
     HornOpticalFlowIterativeStepImageFilter()
-        : m_SmoothWeighting(100)
+        : m_SmoothWeighting(100),
+          m_Iterations(1),
+          m_TileRows(64),
+          m_UpdateNorm(0.0)
     {}
     virtual ~HornOpticalFlowIterativeStepImageFilter() {}
     
@@ -82,6 +132,20 @@ protected:
      * Generates new flow estimates within the requested output region.
      */
     void ThreadedGenerateData(const OutputRegionType& outputRegion, int threadId);
+
+    /**
+     * Takes k steps on the band of rows [startY, endY) of the buffers,
+     * adding each step's sum of squared change in the band to updates.
+     */
+    void GenerateTile(long startY, long endY, unsigned int k, double* updates);
+
+    /**
+     * Compute the update coefficients if the derivatives or weighting
+     * have changed, and clear the per-thread sums of squared change;
+     * afterwards, combine the sums.
+     */
+    void BeforeThreadedGenerateData();
+    void AfterThreadedGenerateData();
     
 private:
     // Not implemented
@@ -89,20 +153,101 @@ private:
     void operator=(const Self& other);
 
     double m_SmoothWeighting;
+    unsigned int m_Iterations;
+    unsigned int m_TileRows;
     
     ConstDerivativeImagePointer m_DerivativeX;
     ConstDerivativeImagePointer m_DerivativeY;
     ConstDerivativeImagePointer m_DerivativeT;
     ConstInputImagePointer m_InitialFlow;
+
+    double m_UpdateNorm;
+    std::vector< double > m_UpdateNorms;
+
+    // Sums of squared change, by thread and then step
+    std::vector< double > m_ThreadUpdates;
+
+    // Ix, Iy, It over sqrt(alpha^2 + Ix^2 + Iy^2)
+    FlowCoefficientImage m_Coefficients;
 };
 
 /**----- Implementation -----**/
 
-#include "itkConstNeighborhoodIterator.h"
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
+#include <algorithm>
+#include <cmath>
+
+#include "FlowKernels.h"
 #include "Logger.h"
 
+template < class TInputImage, class TDerivativeImage, class TOutputImage >
+    void HornOpticalFlowIterativeStepImageFilter< TInputImage, TDerivativeImage, TOutputImage >
+    ::BeforeThreadedGenerateData()
+{
+    // The derivatives share one buffered region; the coefficients cover
+    // it.  They are computed again whenever any derivative changes.
+    const DerivativeImageType* dx = this->GetDerivativeX();
+    const DerivativeImageType* dy = this->GetDerivativeY();
+    const DerivativeImageType* dt = this->GetDerivativeT();
+    const unsigned long time = std::max(dx->GetMTime(), std::max(dy->GetMTime(), dt->GetMTime()));
+    const double weight = this->GetSmoothWeighting() * this->GetSmoothWeighting();
+    if (!this->m_Coefficients.IsCurrent(dx, time, weight))
+    {
+        const long width = dx->GetBufferedRegion().GetSize()[0];
+        const long height = dx->GetBufferedRegion().GetSize()[1];
+        this->m_Coefficients.Allocate(width, height, 3);
+        for (long y = 0; y < height; y++)
+        {
+            float* gx = this->m_Coefficients.GetPlane(y, 0);
+            float* gy = this->m_Coefficients.GetPlane(y, 1);
+            float* gt = this->m_Coefficients.GetPlane(y, 2);
+            for (long x = 0; x < width; x++)
+            {
+                double ix = dx->GetBufferPointer()[y * width + x];
+                double iy = dy->GetBufferPointer()[y * width + x];
+                double it = dt->GetBufferPointer()[y * width + x];
+                double scale = 1.0 / std::sqrt(weight + ix * ix + iy * iy);
+                gx[x] = ix * scale;
+                gy[x] = iy * scale;
+                gt[x] = it * scale;
+            }
+        }
+        this->m_Coefficients.SetSource(dx, time, weight);
+    }
+
+    unsigned int k = std::max(1u, this->m_Iterations);
+    this->m_ThreadUpdates.assign(this->GetNumberOfThreads() * k, 0.0);
+    if (k == 1)
+        return;
+
+    OutputRegionType region = this->GetOutput()->GetLargestPossibleRegion();
+    if (this->GetInput()->GetBufferedRegion() != region ||
+        this->GetInitialFlow()->GetBufferedRegion() != region ||
+        this->GetDerivativeX()->GetBufferedRegion() != region ||
+        this->GetDerivativeY()->GetBufferedRegion() != region ||
+        this->GetDerivativeT()->GetBufferedRegion() != region)
+    {
+        itkExceptionMacro(<< "Taking " << k << " steps at a time needs every input buffered over the whole image");
+    }
+}
+
+template < class TInputImage, class TDerivativeImage, class TOutputImage >
+    void HornOpticalFlowIterativeStepImageFilter< TInputImage, TDerivativeImage, TOutputImage >
+    ::AfterThreadedGenerateData()
+{
+    unsigned int k = std::max(1u, this->m_Iterations);
+    unsigned int threads = this->m_ThreadUpdates.size() / k;
+    unsigned long pixels = this->GetOutput()->GetRequestedRegion().GetNumberOfPixels();
+    this->m_UpdateNorms.assign(k, 0.0);
+    for (unsigned int s = 0; s < k; s++)
+    {
+        double sum = 0.0;
+        for (unsigned int t = 0; t < threads; t++)
+            sum += this->m_ThreadUpdates[t * k + s];
+        this->m_UpdateNorms[s] = pixels > 0 ? std::sqrt(sum / pixels) : 0.0;
+    }
+    this->m_UpdateNorm = this->m_UpdateNorms[k - 1];
+}
+
 template < class TInputImage, class TDerivativeImage, class TOutputImage >
     void HornOpticalFlowIterativeStepImageFilter< TInputImage, TDerivativeImage, TOutputImage >
     ::GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError)
@@ -127,8 +272,8 @@ template < class TInputImage, class TDerivativeImage, class TOutputImage >
     // Get a copy of the input requested region
     InputRegionType region = input->GetRequestedRegion();
     
-    // Pad by one
-    region.PadByRadius(1);
+    // Pad by one for each step
+    region.PadByRadius(std::max(1u, this->m_Iterations));
 
     // Crop the requested region at the input's largest possible region
     if (region.Crop(input->GetLargestPossibleRegion()))
@@ -156,73 +301,209 @@ template < class TInputImage, class TDerivativeImage, class TOutputImage >
     ::ThreadedGenerateData(const OutputRegionType& outputRegion, int threadId)
 {
     std::string function("HornOpticalFlowIterativeStepImageFilter::ThreadedGenerateData");
-//     if (threadId == 0)
-//     {
-//         Logger::debug << function << "(" << threadId << "): region: " << std::endl;
-//         PrintRegionInfo<OutputImageType>(outputRegion);
-//     }
-    // Get output
-    typename OutputImageType::Pointer output = this->GetOutput();
-    typename InputImageType::ConstPointer input  = this->GetInput();
-    ConstDerivativeImagePointer dx = this->GetDerivativeX();
-    ConstDerivativeImagePointer dy = this->GetDerivativeY();
-    ConstDerivativeImagePointer dt = this->GetDerivativeT();
-    
-    // Iterator typedefs
-    typedef itk::ConstNeighborhoodIterator< InputImageType > InputIteratorType;
-    typedef itk::ImageRegionConstIterator< DerivativeImageType > DerivIteratorType;
-    typedef itk::ImageRegionIterator< OutputImageType > OutputIteratorType;
-    
-    // Iterate over regions that include the 8 neighbors of each image pixel
-    typename InputImageType::SizeType radius;
-    radius.Fill(1);
-    InputIteratorType flowIt(radius, input, outputRegion);
-    InputIteratorType initIt(radius, this->GetInitialFlow(), outputRegion);
-    
-    // Iterators over the derivatives and output
-    DerivIteratorType dxIt(dx, outputRegion);
-    DerivIteratorType dyIt(dy, outputRegion);
-    DerivIteratorType dtIt(dt, outputRegion);
-    OutputIteratorType outIt(output, outputRegion);
-    
-    double weight = this->GetSmoothWeighting() * this->GetSmoothWeighting();
-    double one6th = 1.0 / 6.0;
-    double one12th = 1.0 / 12.0;
-    
-    // Iterate over all iterators
-    for (flowIt.GoToBegin(), initIt.GoToBegin(), dxIt.GoToBegin(), dyIt.GoToBegin(), dtIt.GoToBegin(), outIt.GoToBegin(); 
-         !(flowIt.IsAtEnd() || initIt.IsAtEnd() || dxIt.IsAtEnd() || dyIt.IsAtEnd() || dtIt.IsAtEnd() || outIt.IsAtEnd()); 
-         ++flowIt, ++initIt, ++dxIt, ++dyIt, ++dtIt, ++outIt)
+    unsigned int k = std::max(1u, this->m_Iterations);
+    if (k > 1)
     {
-        InputPixelType curr(flowIt.GetCenterPixel());
-        // Logger::verbose << "[" << curr[0] << "," << curr[1] << "]";
-        OutputPixelType laplace, next;
-        
-        for (int d = 0; d < curr.GetNumberOfComponents(); d++)
-        {
-            // The weighting here is like a Laplacian with the center taken out.
-            // (smoothing term)
-            laplace[d] = one6th * (flowIt.GetPixel(1)[d] + initIt.GetPixel(1)[d] + 
-                    flowIt.GetPixel(3)[d] + initIt.GetPixel(3)[d] +
-                    flowIt.GetPixel(5)[d] + initIt.GetPixel(5)[d] +
-                    flowIt.GetPixel(7)[d] + initIt.GetPixel(7)[d]) +
-                    one12th * (flowIt.GetPixel(0)[d] + initIt.GetPixel(0)[d] +
-                    flowIt.GetPixel(2)[d] + initIt.GetPixel(2)[d] +
-                    flowIt.GetPixel(6)[d] + initIt.GetPixel(6)[d] +
-                    flowIt.GetPixel(8)[d] + initIt.GetPixel(8)[d]);
+        // Buffers all cover the output's largest region; see
+        // BeforeThreadedGenerateData
+        long startY = outputRegion.GetIndex()[1] - this->GetOutput()->GetBufferedRegion().GetIndex()[1];
+        long endY = startY + outputRegion.GetSize()[1];
+        long tileRows = std::max(1L, (long) this->m_TileRows);
+        for (long y = startY; y < endY && outputRegion.GetSize()[0] > 0; y += tileRows)
+            this->GenerateTile(y, std::min(endY, y + tileRows), k, &this->m_ThreadUpdates[threadId * k]);
+        return;
+    }
+
+    const InputImageType* input = this->GetInput();
+    const InputImageType* initial = this->GetInitialFlow();
+    OutputImageType* output = this->GetOutput();
+    const FlowCoefficientImage& coefficients = this->m_Coefficients;
+
+    // Geometry of this thread's region within each buffer; the
+    // coefficients share the derivatives' layout.
+    InputRegionType inRegion = input->GetBufferedRegion();
+    InputRegionType initRegion = initial->GetBufferedRegion();
+    OutputRegionType outRegion = output->GetBufferedRegion();
+    typename DerivativeImageType::RegionType derivRegion = this->GetDerivativeX()->GetBufferedRegion();
+    const long width = outputRegion.GetSize()[0];
+    const long rows = outputRegion.GetSize()[1];
+    const long inWidth = inRegion.GetSize()[0];
+    const long inHeight = inRegion.GetSize()[1];
+    const long inX = outputRegion.GetIndex()[0] - inRegion.GetIndex()[0];
+    const long inY = outputRegion.GetIndex()[1] - inRegion.GetIndex()[1];
+    const long initWidth = initRegion.GetSize()[0];
+    const long initHeight = initRegion.GetSize()[1];
+    const long initX = outputRegion.GetIndex()[0] - initRegion.GetIndex()[0];
+    const long initY = outputRegion.GetIndex()[1] - initRegion.GetIndex()[1];
+    const long outX = outputRegion.GetIndex()[0] - outRegion.GetIndex()[0];
+    const long outY = outputRegion.GetIndex()[1] - outRegion.GetIndex()[1];
+    const long derivX = outputRegion.GetIndex()[0] - derivRegion.GetIndex()[0];
+    const long derivY = outputRegion.GetIndex()[1] - derivRegion.GetIndex()[1];
+    if (width == 0 || rows == 0)
+    {
+        this->m_ThreadUpdates[threadId] = 0.0;
+        return;
+    }
+
+    const InputPixelType* in = input->GetBufferPointer();
+    const InputPixelType* init = initial->GetBufferPointer();
+    OutputPixelType* out = output->GetBufferPointer();
 
+    // Total (input + initial) flow rows y-1, y, y+1, with one pixel of
+    // border, in u and v planes; row r lives in slot r % 3.  The initial
+    // flow is assumed to cover the same rows as the input.
+    const long padded = width + 2;
+    std::vector< float > ringU(3 * padded), ringV(3 * padded), initU(padded), initV(padded);
+    std::vector< float > averageU(width), averageV(width), currU(width), currV(width), nextU(width), nextV(width);
+
+    double update = 0.0;
+
+    long next = std::max(0L, inY - 1);
+    for (long j = 0; j < rows; j++)
+    {
+        long y = inY + j;
+        for (; next <= std::min(inHeight - 1, y + 1); next++)
+        {
+            float* u = &ringU[(next % 3) * padded];
+            float* v = &ringV[(next % 3) * padded];
+            long r = std::max(0L, std::min(initHeight - 1, next - inY + initY));
+            FlowKernels::SplitRow(in + next * inWidth, inWidth, inX, width, 1, u, v);
+            FlowKernels::SplitRow(init + r * initWidth, initWidth, initX, width, 1, &initU[0], &initV[0]);
+            for (long x = 0; x < padded; x++)
+            {
+                u[x] += initU[x];
+                v[x] += initV[x];
+            }
         }
-        // Logger::verbose << " + [" << mean[0] << "," << mean[1] << "]";
+        long above = (std::max(0L, y - 1) % 3) * padded;
+        long center = (y % 3) * padded;
+        long below = (std::min(inHeight - 1, y + 1) % 3) * padded;
+
+        // The weighting here is like a Laplacian with the center taken out.
+        // (smoothing term)
+        FlowKernels::NeighborAverage(&ringU[above], &ringU[center], &ringU[below], width, &averageU[0]);
+        FlowKernels::NeighborAverage(&ringV[above], &ringV[center], &ringV[below], width, &averageV[0]);
+
         // Compute the next flow value (data term); note that we subtract out the value from the initial flow
         // field...this is because we may be calculating the u,v incrementally
-        next[0] = laplace[0] - dxIt.Get() * (dxIt.Get() * laplace[0] + dyIt.Get() * laplace[1] + dtIt.Get()) /
-                (weight + dxIt.Get() * dxIt.Get() + dyIt.Get() * dyIt.Get()) - initIt.GetCenterPixel()[0];
-        next[1] = laplace[1] - dyIt.Get() * (dxIt.Get() * laplace[0] + dyIt.Get() * laplace[1] + dtIt.Get()) /
-                (weight + dxIt.Get() * dxIt.Get() + dyIt.Get() * dyIt.Get()) - initIt.GetCenterPixel()[1];
-        
-        // Set the next flow value
-        // Logger::verbose << " => [" << next[0] << "," << next[1] << "]" << std::endl;;
-        outIt.Set(next);
+        long d = derivY + j;
+        FlowKernels::SplitRow(init + (initY + j) * initWidth, initWidth, initX, width, 0, &initU[0], &initV[0]);
+        FlowKernels::HornUpdate(&averageU[0], &averageV[0], coefficients.GetPlane(d, 0) + derivX,
+            coefficients.GetPlane(d, 1) + derivX, coefficients.GetPlane(d, 2) + derivX, &initU[0], &initV[0],
+            width, &nextU[0], &nextV[0]);
+
+        FlowKernels::SplitRow(in + y * inWidth, inWidth, inX, width, 0, &currU[0], &currV[0]);
+        for (long x = 0; x < width; x++)
+        {
+            double du = nextU[x] - currU[x];
+            double dv = nextV[x] - currV[x];
+            update += du * du + dv * dv;
+        }
+
+        FlowKernels::MergeRow(&nextU[0], &nextV[0], width, out + (outY + j) * outRegion.GetSize()[0] + outX);
     }
+    this->m_ThreadUpdates[threadId] = update;
 }
 
+template < class TInputImage, class TDerivativeImage, class TOutputImage >
+    void HornOpticalFlowIterativeStepImageFilter< TInputImage, TDerivativeImage, TOutputImage >
+    ::GenerateTile(long startY, long endY, unsigned int k, double* updates)
+{
+    const InputPixelType* in = this->GetInput()->GetBufferPointer();
+    const InputPixelType* init = this->GetInitialFlow()->GetBufferPointer();
+    OutputPixelType* out = this->GetOutput()->GetBufferPointer();
+    const long width = this->GetOutput()->GetBufferedRegion().GetSize()[0];
+    const long height = this->GetOutput()->GetBufferedRegion().GetSize()[1];
+
+    // The band and its halo; rows at the halo's edge have a neighbour
+    // missing, so are not stepped.
+    const long firstRow = std::max(0L, startY - (long) k);
+    const long lastRow = std::min(height, endY + (long) k);
+    const long stepStart = firstRow > 0 ? firstRow + 1 : 0;
+    const long stepEnd = lastRow < height ? lastRow - 1 : height;
+    const long rows = lastRow - firstRow;
+    const long padded = width + 2;
+
+    // Planar buffers: total (input + initial) flow with one pixel of
+    // border, and the increment over the initial flow, for the current
+    // and next step; the initial flow.  The coefficients are read in
+    // place.
+    std::vector< float > totalU[2], totalV[2], incU[2], incV[2];
+    for (unsigned int b = 0; b < 2; b++)
+    {
+        totalU[b].assign(rows * padded, 0.0f);
+        totalV[b].assign(rows * padded, 0.0f);
+        incU[b].assign(rows * width, 0.0f);
+        incV[b].assign(rows * width, 0.0f);
+    }
+    std::vector< float > initU(rows * padded), initV(rows * padded);
+    std::vector< float > averageU(width), averageV(width);
+
+    for (long r = 0; r < rows; r++)
+    {
+        long y = firstRow + r;
+        FlowKernels::SplitRow(in + y * width, width, 0, width, 1, &totalU[0][r * padded], &totalV[0][r * padded]);
+        FlowKernels::SplitRow(init + y * width, width, 0, width, 1, &initU[r * padded], &initV[r * padded]);
+        for (long x = 0; x < padded; x++)
+        {
+            totalU[0][r * padded + x] += initU[r * padded + x];
+            totalV[0][r * padded + x] += initV[r * padded + x];
+        }
+        FlowKernels::SplitRow(in + y * width, width, 0, width, 0, &incU[0][r * width], &incV[0][r * width]);
+    }
+
+    const FlowCoefficientImage& coefficients = this->m_Coefficients;
+    for (unsigned int s = 0; s < k; s++)
+    {
+        unsigned int curr = s % 2, next = (s + 1) % 2;
+        double update = 0.0;
+        for (long y = stepStart; y < stepEnd; y++)
+        {
+            long r = y - firstRow;
+            long above = std::max(0L, y - 1) - firstRow;
+            long below = std::min(height - 1, y + 1) - firstRow;
+            FlowKernels::NeighborAverage(&totalU[curr][above * padded], &totalU[curr][r * padded], &totalU[curr][below * padded],
+                width, &averageU[0]);
+            FlowKernels::NeighborAverage(&totalV[curr][above * padded], &totalV[curr][r * padded], &totalV[curr][below * padded],
+                width, &averageV[0]);
+
+            float* u = &incU[next][r * width];
+            float* v = &incV[next][r * width];
+            FlowKernels::HornUpdate(&averageU[0], &averageV[0],
+                coefficients.GetPlane(y, 0), coefficients.GetPlane(y, 1), coefficients.GetPlane(y, 2),
+                &initU[r * padded + 1], &initV[r * padded + 1], width, u, v);
+
+            if (y >= startY && y < endY)
+            {
+                const float* oldU = &incU[curr][r * width];
+                const float* oldV = &incV[curr][r * width];
+                for (long x = 0; x < width; x++)
+                {
+                    double du = u[x] - oldU[x];
+                    double dv = v[x] - oldV[x];
+                    update += du * du + dv * dv;
+                }
+            }
+
+            // The next step smooths the total flow, borders repeated
+            float* tu = &totalU[next][r * padded];
+            float* tv = &totalV[next][r * padded];
+            for (long x = 0; x < width; x++)
+            {
+                tu[x + 1] = u[x] + initU[r * padded + x + 1];
+                tv[x + 1] = v[x] + initV[r * padded + x + 1];
+            }
+            tu[0] = tu[1];
+            tv[0] = tv[1];
+            tu[width + 1] = tu[width];
+            tv[width + 1] = tv[width];
+        }
+        updates[s] += update;
+    }
+
+    for (long y = startY; y < endY; y++)
+    {
+        long r = y - firstRow;
+        FlowKernels::MergeRow(&incU[k % 2][r * width], &incV[k % 2][r * width], width, out + y * width);
+    }
+}
@@ -0,0 +1,611 @@
+#pragma once
+
+#include <vector>
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+/**
+ * \class KLTFeatureTracker
+ * \brief Finds and tracks sparse image features with the pyramidal Kanade-Lucas-Tomasi tracker.
+ *
+ * DetectFeatures() seeds features at the peaks of the Harris interest
+ * image (HarrisFeatureInterestImageFilter).  A peak is a 3x3 local
+ * maximum at least StrengthThreshold times the image's largest interest
+ * value.  Peaks are taken strongest first, and any within FeatureRadius
+ * pixels of a feature already taken, or of an active feature passed in,
+ * is suppressed, until there are MaximumFeatures active features.
+ *
+ * TrackFeatures() moves each active feature from one frame to the next,
+ * given the multi-resolution pyramids of both frames (coarsest level
+ * first, as FramePyramidCache builds them).  At each level, coarse to
+ * fine, the feature's (2 WindowRadius + 1)^2 pixel window in the first
+ * frame is matched in the second by Gauss-Newton (Lucas-Kanade)
+ * iterations.  Iteration stops after Iterations steps, or once a step is
+ * below StopDistance pixels.  The displacement found at one level starts
+ * the next.  A feature is lost if its window leaves the finest level,
+ * if the window's gradient matrix there has a smaller eigenvalue (per
+ * window pixel) below MinimumEigenvalue, or if the matched windows'
+ * normalized cross correlation falls below MinimumCorrelation.  On the
+ * coarse levels windows may hang over the image's edge, whose pixels are
+ * repeated, so that features near the edge still get a coarse estimate;
+ * a coarse level where the feature cannot be matched is skipped.
+ *
+ * Features are independent, so the active features are split among
+ * NumberOfThreads threads.  Positions are in physical coordinates, so
+ * the levels of a pyramid may have any spacing and origin.  Pixels are
+ * read as floats from the images' buffers, which must hold the whole
+ * image.
+ *
+ * This is the C++ counterpart of matlab/KLTTracker.m, except that the
+ * correlation test compares consecutive frames rather than each frame
+ * with the feature's first appearance.
+ */
+template < class TImage >
+class KLTFeatureTracker :
+    public itk::Object
+{
+public:
+    // Helpful typedefs
+    typedef TImage ImageType;
+    typedef typename ImageType::PixelType PixelType;
+    typedef typename ImageType::PointType PointType;
+    typedef itk::Image< float, 2 > InterestImageType;
+
+    /**
+     * A pyramid's levels, coarsest first.
+     */
+    typedef std::vector< typename ImageType::ConstPointer > PyramidType;
+
+    /**
+     * A tracked feature.
+     */
+    struct Feature
+    {
+        unsigned int id;        // unique among the features detected by this tracker
+        PointType position;     // physical coordinates
+        float correlation;      // of the last match; 1 when detected
+        bool active;            // false once lost
+    };
+    typedef std::vector< Feature > FeatureList;
+
+    // Standard itk typedefs
+    typedef KLTFeatureTracker Self;
+    typedef itk::Object Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(KLTFeatureTracker, itk::Object);
+
+    /**
+     * Get/Set the Harris detector's derivative and integration scales
+     * and trace weight; see HarrisFeatureInterestImageFilter.
+     */
+    itkGetMacro(DerivativeSigma, float);
+    itkSetMacro(DerivativeSigma, float);
+    itkGetMacro(IntegrationSigma, float);
+    itkSetMacro(IntegrationSigma, float);
+    itkGetMacro(TraceWeight, float);
+    itkSetMacro(TraceWeight, float);
+
+    /**
+     * Get/Set the smallest interest value of a new feature, as a
+     * fraction of the image's largest.
+     */
+    itkGetMacro(StrengthThreshold, float);
+    itkSetMacro(StrengthThreshold, float);
+
+    /**
+     * Get/Set the smallest distance between features, in pixels.
+     */
+    itkGetMacro(FeatureRadius, unsigned int);
+    itkSetMacro(FeatureRadius, unsigned int);
+
+    /**
+     * Get/Set the number of active features DetectFeatures fills up to.
+     */
+    itkGetMacro(MaximumFeatures, unsigned int);
+    itkSetMacro(MaximumFeatures, unsigned int);
+
+    /**
+     * Get/Set the radius of the matched window, in pixels of each level.
+     */
+    itkGetMacro(WindowRadius, unsigned int);
+    itkSetMacro(WindowRadius, unsigned int);
+
+    /**
+     * Get/Set the most iterations per level, and the step length, in
+     * pixels, below which iteration stops.
+     */
+    itkGetMacro(Iterations, unsigned int);
+    itkSetMacro(Iterations, unsigned int);
+    itkGetMacro(StopDistance, float);
+    itkSetMacro(StopDistance, float);
+
+    /**
+     * Get/Set the smallest eigenvalue, per window pixel, of a trackable
+     * window's gradient matrix, in squared intensity per squared pixel.
+     */
+    itkGetMacro(MinimumEigenvalue, float);
+    itkSetMacro(MinimumEigenvalue, float);
+
+    /**
+     * Get/Set the smallest normalized cross correlation, in [-1, 1],
+     * between a feature's windows in consecutive frames.
+     */
+    itkGetMacro(MinimumCorrelation, float);
+    itkSetMacro(MinimumCorrelation, float);
+
+    /**
+     * Get/Set the number of threads features are tracked on.
+     */
+    itkGetMacro(NumberOfThreads, int);
+    itkSetMacro(NumberOfThreads, int);
+
+    /**
+     * Get/Set the id DetectFeatures gives the next new feature.
+     */
+    itkGetMacro(NextFeatureId, unsigned int);
+    itkSetMacro(NextFeatureId, unsigned int);
+
+    /**
+     * Append new features found in image to features, away from its
+     * active ones.  Returns the number added.
+     */
+    unsigned int DetectFeatures(const ImageType* image, FeatureList& features);
+
+    /**
+     * Move the active features from the frame of pyramid1 to the frame
+     * of pyramid2, deactivating the ones lost.  The pyramids must have
+     * the same number of levels.
+     */
+    void TrackFeatures(const PyramidType& pyramid1, const PyramidType& pyramid2, FeatureList& features);
+
+protected:
+    KLTFeatureTracker();
+    virtual ~KLTFeatureTracker() {}
+
+    void PrintSelf(std::ostream& os, itk::Indent indent) const;
+
+private:
+    // Not implemented
+    KLTFeatureTracker(const Self& other);
+    void operator=(const Self& other);
+
+    /**
+     * One pyramid level of both frames.
+     */
+    struct Level
+    {
+        const PixelType* image1;
+        const PixelType* image2;
+        long width;
+        long height;
+        double origin[2];
+        double spacing[2];
+        long start[2];
+    };
+
+    /**
+     * Track one feature; window holds three scratch windows.
+     */
+    void TrackFeature(Feature& feature, std::vector< float >& window) const;
+
+    /**
+     * Bilinear sample of a level image, repeating the edge pixels.
+     */
+    static float Sample(const Level& level, const PixelType* image, float x, float y);
+
+    /**
+     * Mark the pixels within radius of (x, y) as taken.
+     */
+    static void Mark(std::vector< unsigned char >& taken, long width, long height, long x, long y, long radius);
+
+    static ITK_THREAD_RETURN_TYPE ThreaderCallback(void* arg);
+
+    float m_DerivativeSigma;
+    float m_IntegrationSigma;
+    float m_TraceWeight;
+    float m_StrengthThreshold;
+    unsigned int m_FeatureRadius;
+    unsigned int m_MaximumFeatures;
+    unsigned int m_WindowRadius;
+    unsigned int m_Iterations;
+    float m_StopDistance;
+    float m_MinimumEigenvalue;
+    float m_MinimumCorrelation;
+    int m_NumberOfThreads;
+    unsigned int m_NextFeatureId;
+
+    // Shared with the threads during TrackFeatures
+    std::vector< Level > m_Levels;
+    FeatureList* m_Features;
+};
+
+/************************************************************************/
+/* Implementation                                                       */
+/************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#include "HarrisFeatureInterestImageFilter.h"
+#include "Logger.h"
+
+template < class TImage >
+KLTFeatureTracker< TImage >
+::KLTFeatureTracker() :
+    m_DerivativeSigma(1.0),
+    m_IntegrationSigma(2.4),
+    m_TraceWeight(0.06),
+    m_StrengthThreshold(0.01),
+    m_FeatureRadius(5),
+    m_MaximumFeatures(500),
+    m_WindowRadius(3),
+    m_Iterations(10),
+    m_StopDistance(0.01),
+    m_MinimumEigenvalue(0.01),
+    m_MinimumCorrelation(0.65),
+    m_NumberOfThreads(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+    m_NextFeatureId(0),
+    m_Features(0)
+{}
+
+template < class TImage >
+unsigned int KLTFeatureTracker< TImage >
+::DetectFeatures(const ImageType* image, FeatureList& features)
+{
+    std::string function("KLTFeatureTracker::DetectFeatures");
+    unsigned int active = 0;
+    for (unsigned int f = 0; f < features.size(); f++)
+        if (features[f].active)
+            active++;
+    if (active >= this->m_MaximumFeatures)
+        return 0;
+
+    typedef HarrisFeatureInterestImageFilter< ImageType, InterestImageType > HarrisType;
+    typename HarrisType::Pointer harris = HarrisType::New();
+    harris->SetDerivativeSigma(this->m_DerivativeSigma);
+    harris->SetIntegrationSigma(this->m_IntegrationSigma);
+    harris->SetTraceWeight(this->m_TraceWeight);
+    harris->SetInput(image);
+    harris->Update();
+
+    const InterestImageType* interest = harris->GetOutput();
+    const typename InterestImageType::RegionType region = interest->GetBufferedRegion();
+    const long width = region.GetSize()[0];
+    const long height = region.GetSize()[1];
+    const float* strength = interest->GetBufferPointer();
+
+    // Features must keep their window, and a pixel for gradients, inside
+    const long margin = this->m_WindowRadius + 1;
+    const long radius = this->m_FeatureRadius;
+    if (width <= 2 * margin || height <= 2 * margin)
+        return 0;
+
+    std::vector< unsigned char > taken(width * height, 0);
+    const typename InterestImageType::PointType& origin = interest->GetOrigin();
+    const typename InterestImageType::SpacingType& spacing = interest->GetSpacing();
+    for (unsigned int f = 0; f < features.size(); f++)
+    {
+        if (!features[f].active)
+            continue;
+        long x = (long) std::floor((features[f].position[0] - origin[0]) / spacing[0] + 0.5) - region.GetIndex()[0];
+        long y = (long) std::floor((features[f].position[1] - origin[1]) / spacing[1] + 0.5) - region.GetIndex()[1];
+        Mark(taken, width, height, x, y, radius);
+    }
+
+    float peak = 0;
+    for (long y = margin; y < height - margin; y++)
+        for (long x = margin; x < width - margin; x++)
+            peak = std::max(peak, strength[y * width + x]);
+    if (peak <= 0)
+        return 0;
+
+    // Local maxima; ties go to the first pixel in scan order
+    typedef std::pair< float, long > CandidateType;
+    std::vector< CandidateType > candidates;
+    const float threshold = this->m_StrengthThreshold * peak;
+    for (long y = margin; y < height - margin; y++)
+    {
+        for (long x = margin; x < width - margin; x++)
+        {
+            const float* s = strength + y * width + x;
+            if (*s < threshold || *s <= 0 ||
+                !(*s > s[-width - 1] && *s > s[-width] && *s > s[-width + 1] && *s > s[-1] &&
+                  *s >= s[1] && *s >= s[width - 1] && *s >= s[width] && *s >= s[width + 1]))
+                continue;
+            candidates.push_back(CandidateType(*s, y * width + x));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater< CandidateType >());
+
+    unsigned int added = 0;
+    for (unsigned int c = 0; c < candidates.size() && active + added < this->m_MaximumFeatures; c++)
+    {
+        long offset = candidates[c].second;
+        if (taken[offset])
+            continue;
+        long x = offset % width, y = offset / width;
+        Mark(taken, width, height, x, y, radius);
+
+        Feature feature;
+        feature.id = this->m_NextFeatureId++;
+        feature.position[0] = origin[0] + (x + region.GetIndex()[0]) * spacing[0];
+        feature.position[1] = origin[1] + (y + region.GetIndex()[1]) * spacing[1];
+        feature.correlation = 1;
+        feature.active = true;
+        features.push_back(feature);
+        added++;
+    }
+    Logger::verbose << function << ": " << added << " new features from " << candidates.size()
+        << " interest peaks" << std::endl;
+    return added;
+}
+
+template < class TImage >
+void KLTFeatureTracker< TImage >
+::TrackFeatures(const PyramidType& pyramid1, const PyramidType& pyramid2, FeatureList& features)
+{
+    std::string function("KLTFeatureTracker::TrackFeatures");
+    if (pyramid1.empty() || pyramid1.size() != pyramid2.size())
+    {
+        itkExceptionMacro(<< "Pyramids are empty or have different numbers of levels");
+    }
+
+    this->m_Levels.resize(pyramid1.size());
+    for (unsigned int l = 0; l < pyramid1.size(); l++)
+    {
+        const ImageType* image1 = pyramid1[l];
+        const ImageType* image2 = pyramid2[l];
+        if (image1->GetBufferedRegion() != image2->GetBufferedRegion())
+        {
+            itkExceptionMacro(<< "Pyramid level " << l << " differs between the frames");
+        }
+        Level& level = this->m_Levels[l];
+        level.image1 = image1->GetBufferPointer();
+        level.image2 = image2->GetBufferPointer();
+        level.width = image1->GetBufferedRegion().GetSize()[0];
+        level.height = image1->GetBufferedRegion().GetSize()[1];
+        for (int d = 0; d < 2; d++)
+        {
+            level.origin[d] = image1->GetOrigin()[d];
+            level.spacing[d] = image1->GetSpacing()[d];
+            level.start[d] = image1->GetBufferedRegion().GetIndex()[d];
+        }
+    }
+
+    if (!features.empty())
+    {
+        itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+        threader->SetNumberOfThreads(std::max(1, (int) std::min((long) this->m_NumberOfThreads, (long) features.size())));
+        this->m_Features = &features;
+        threader->SetSingleMethod(ThreaderCallback, this);
+        threader->SingleMethodExecute();
+        this->m_Features = 0;
+    }
+    this->m_Levels.clear();
+
+    unsigned int active = 0;
+    for (unsigned int f = 0; f < features.size(); f++)
+        if (features[f].active)
+            active++;
+    Logger::verbose << function << ": " << active << " of " << features.size() << " features active" << std::endl;
+}
+
+template < class TImage >
+ITK_THREAD_RETURN_TYPE KLTFeatureTracker< TImage >
+::ThreaderCallback(void* arg)
+{
+    typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+    ThreadInfoType* info = static_cast< ThreadInfoType* >(arg);
+    Self* self = static_cast< Self* >(info->UserData);
+
+    // Split the features evenly among the threads
+    FeatureList& features = *self->m_Features;
+    long count = features.size();
+    long start = (count * info->ThreadID) / info->NumberOfThreads;
+    long end = (count * (info->ThreadID + 1)) / info->NumberOfThreads;
+
+    long side = 2 * self->m_WindowRadius + 1;
+    std::vector< float > window(3 * side * side);
+    for (long f = start; f < end; f++)
+    {
+        if (features[f].active)
+            self->TrackFeature(features[f], window);
+    }
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template < class TImage >
+void KLTFeatureTracker< TImage >
+::TrackFeature(Feature& feature, std::vector< float >& window) const
+{
+    const long r = this->m_WindowRadius;
+    const long n = (2 * r + 1) * (2 * r + 1);
+    float* T = &window[0];
+    float* Gx = T + n;
+    float* Gy = Gx + n;
+
+    // The displacement so far, in physical units
+    double gx = 0, gy = 0;
+    const unsigned int levels = this->m_Levels.size();
+    for (unsigned int l = 0; l < levels; l++)
+    {
+        const Level& level = this->m_Levels[l];
+        const bool finest = l + 1 == levels;
+        const float px = (feature.position[0] - level.origin[0]) / level.spacing[0] - level.start[0];
+        const float py = (feature.position[1] - level.origin[1]) / level.spacing[1] - level.start[1];
+        float dx = gx / level.spacing[0];
+        float dy = gy / level.spacing[1];
+
+        // Coarse windows may hang over the edge, which is repeated; at the
+        // finest level the windows must be inside
+        const float m = finest ? r : 0;
+        if (px - m < 0 || px + m > level.width - 1 || py - m < 0 || py + m > level.height - 1)
+        {
+            if (finest)
+            {
+                feature.active = false;
+                return;
+            }
+            continue;
+        }
+
+        // The first frame's window and its gradient matrix
+        double g11 = 0, g12 = 0, g22 = 0;
+        long k = 0;
+        for (long j = -r; j <= r; j++)
+        {
+            for (long i = -r; i <= r; i++, k++)
+            {
+                float x = px + i, y = py + j;
+                T[k] = Sample(level, level.image1, x, y);
+                Gx[k] = 0.5f * (Sample(level, level.image1, x + 1, y) - Sample(level, level.image1, x - 1, y));
+                Gy[k] = 0.5f * (Sample(level, level.image1, x, y + 1) - Sample(level, level.image1, x, y - 1));
+                g11 += Gx[k] * Gx[k];
+                g12 += Gx[k] * Gy[k];
+                g22 += Gy[k] * Gy[k];
+            }
+        }
+        double det = g11 * g22 - g12 * g12;
+        double smaller = 0.5 * (g11 + g22) - std::sqrt(0.25 * (g11 - g22) * (g11 - g22) + g12 * g12);
+        if (!(smaller / n >= this->m_MinimumEigenvalue) || det <= 0)
+        {
+            if (finest)
+            {
+                feature.active = false;
+                return;
+            }
+            continue;
+        }
+
+        // Gauss-Newton steps on the second frame's window
+        bool inside = true;
+        for (unsigned int it = 0; it < this->m_Iterations; it++)
+        {
+            float qx = px + dx, qy = py + dy;
+            if (qx - m < 0 || qx + m > level.width - 1 || qy - m < 0 || qy + m > level.height - 1)
+            {
+                inside = false;
+                break;
+            }
+            double b1 = 0, b2 = 0;
+            k = 0;
+            for (long j = -r; j <= r; j++)
+            {
+                for (long i = -r; i <= r; i++, k++)
+                {
+                    double e = T[k] - Sample(level, level.image2, qx + i, qy + j);
+                    b1 += e * Gx[k];
+                    b2 += e * Gy[k];
+                }
+            }
+            float sx = (g22 * b1 - g12 * b2) / det;
+            float sy = (g11 * b2 - g12 * b1) / det;
+            dx += sx;
+            dy += sy;
+            if (sx * sx + sy * sy < this->m_StopDistance * this->m_StopDistance)
+                break;
+        }
+        if (!inside)
+        {
+            if (finest)
+            {
+                feature.active = false;
+                return;
+            }
+            continue;
+        }
+        gx = dx * level.spacing[0];
+        gy = dy * level.spacing[1];
+
+        if (finest)
+        {
+            float qx = px + dx, qy = py + dy;
+            if (qx - r < 0 || qx + r > level.width - 1 || qy - r < 0 || qy + r > level.height - 1)
+            {
+                feature.active = false;
+                return;
+            }
+
+            // Normalized cross correlation of the matched windows
+            double mean1 = 0, mean2 = 0;
+            k = 0;
+            for (long j = -r; j <= r; j++)
+            {
+                for (long i = -r; i <= r; i++, k++)
+                {
+                    Gx[k] = Sample(level, level.image2, qx + i, qy + j);
+                    mean1 += T[k];
+                    mean2 += Gx[k];
+                }
+            }
+            mean1 /= n;
+            mean2 /= n;
+            double s12 = 0, s11 = 0, s22 = 0;
+            for (k = 0; k < n; k++)
+            {
+                double a = T[k] - mean1, b = Gx[k] - mean2;
+                s12 += a * b;
+                s11 += a * a;
+                s22 += b * b;
+            }
+            feature.correlation = s11 > 0 && s22 > 0 ? s12 / std::sqrt(s11 * s22) : 0;
+            feature.active = feature.correlation >= this->m_MinimumCorrelation;
+            feature.position[0] += gx;
+            feature.position[1] += gy;
+        }
+    }
+}
+
+template < class TImage >
+float KLTFeatureTracker< TImage >
+::Sample(const Level& level, const PixelType* image, float x, float y)
+{
+    long x0 = (long) std::floor(x), y0 = (long) std::floor(y);
+    float fx = x - x0, fy = y - y0;
+    long x1 = std::min(std::max(x0 + 1, 0L), level.width - 1);
+    long y1 = std::min(std::max(y0 + 1, 0L), level.height - 1);
+    x0 = std::min(std::max(x0, 0L), level.width - 1);
+    y0 = std::min(std::max(y0, 0L), level.height - 1);
+
+    const PixelType* row0 = image + y0 * level.width;
+    const PixelType* row1 = image + y1 * level.width;
+    float top = (1 - fx) * static_cast< float >(row0[x0]) + fx * static_cast< float >(row0[x1]);
+    float bottom = (1 - fx) * static_cast< float >(row1[x0]) + fx * static_cast< float >(row1[x1]);
+    return (1 - fy) * top + fy * bottom;
+}
+
+template < class TImage >
+void KLTFeatureTracker< TImage >
+::Mark(std::vector< unsigned char >& taken, long width, long height, long x, long y, long radius)
+{
+    for (long j = std::max(0L, y - radius); j <= std::min(height - 1, y + radius); j++)
+        for (long i = std::max(0L, x - radius); i <= std::min(width - 1, x + radius); i++)
+            if ((i - x) * (i - x) + (j - y) * (j - y) <= radius * radius)
+                taken[j * width + i] = 1;
+}
+
+template < class TImage >
+void KLTFeatureTracker< TImage >
+::PrintSelf(std::ostream& os, itk::Indent indent) const
+{
+    Superclass::PrintSelf(os, indent);
+    os << indent << "DerivativeSigma: " << this->m_DerivativeSigma << std::endl;
+    os << indent << "IntegrationSigma: " << this->m_IntegrationSigma << std::endl;
+    os << indent << "TraceWeight: " << this->m_TraceWeight << std::endl;
+    os << indent << "StrengthThreshold: " << this->m_StrengthThreshold << std::endl;
+    os << indent << "FeatureRadius: " << this->m_FeatureRadius << std::endl;
+    os << indent << "MaximumFeatures: " << this->m_MaximumFeatures << std::endl;
+    os << indent << "WindowRadius: " << this->m_WindowRadius << std::endl;
+    os << indent << "Iterations: " << this->m_Iterations << std::endl;
+    os << indent << "StopDistance: " << this->m_StopDistance << std::endl;
+    os << indent << "MinimumEigenvalue: " << this->m_MinimumEigenvalue << std::endl;
+    os << indent << "MinimumCorrelation: " << this->m_MinimumCorrelation << std::endl;
+    os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+}
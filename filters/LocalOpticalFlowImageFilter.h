@@ -0,0 +1,311 @@
+#pragma once
+
+#include <vector>
+
+#include "itkImage.h"
+#include "itkVector.h"
+
+#include "OpticalFlowImageFilter.h"
+#include "StructureTensorImageFilter.h"
+
+/**
+ * \class LocalOpticalFlowImageFilter
+ * \brief Computes Lucas-Kanade (local) optical flow in one pass.
+ *
+ * With no smoothing term, the combined local-global equations solved by
+ * CLGOpticFlowImageFilter reduce at each pixel to the 2x2 system
+ *
+ *   [T11 T12] [u]     [T13]
+ *   [T12 T22] [v] = - [T23]
+ *
+ * in the integrated structure tensor T, which is solved in closed form.
+ * There is no iteration, so the flow costs little more than the tensor;
+ * use it for previews, under MultiResolutionOpticalFlowMethod for
+ * pyramidal Lucas-Kanade, or as the starting point of a CLG solve (see
+ * CLGOpticFlowImageFilter::InitializeLocally).
+ *
+ * The system is only trusted where the image has texture in both
+ * directions.  A pixel is reliable if the smaller eigenvalue of the
+ * spatial part [T11 T12; T12 T22] is at least MinimumEigenvalue, and at
+ * least ConditionThreshold times the larger one (a reciprocal condition
+ * number; edges, where only the normal flow is known, fail this).
+ * Unreliable pixels get zero flow; GetReliableFraction() gives the share
+ * that were reliable.
+ *
+ * The tensor is computed from the inputs with StructureTensorImageFilter
+ * at SpatialSigma and IntegrationSigma, or may be given with
+ * SetStructureTensor (over the whole image), e.g. when the caller has
+ * already computed it.  Output rows are solved in parallel.
+ */
+template <class TInputImage1, class TInputImage2, class TOutputValueType = float >
+class LocalOpticalFlowImageFilter :
+    public OpticalFlowImageFilter< TInputImage1, TInputImage2, TOutputValueType >
+{
+public:
+    /** Some convenient typedefs */
+    typedef TInputImage1 Input1ImageType;
+    typedef TInputImage2 Input2ImageType;
+
+    /** Image typedef support */
+    itkStaticConstMacro(ImageDimension, unsigned int, Input1ImageType::ImageDimension);
+    typedef Input1ImageType InputImageType;
+
+    typedef TOutputValueType OutputValueType;
+    typedef itk::Vector<OutputValueType, ImageDimension> OutputPixelType;
+    typedef itk::Image<OutputPixelType, ImageDimension> OutputImageType;
+    typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+    /** Internal processing types */
+    typedef StructureTensorImageFilter< Input1ImageType > TensorFilterType;
+    typedef typename TensorFilterType::TensorImageType TensorImageType;
+    typedef typename TensorFilterType::DerivativeImageType DerivativeImageType;
+
+    /** Standard itk class typedefs */
+    typedef LocalOpticalFlowImageFilter Self;
+    typedef OpticalFlowImageFilter<Input1ImageType, Input2ImageType, OutputValueType > Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    /** itk New factory method and type info. */
+    itkNewMacro(Self);
+    itkTypeMacro(LocalOpticalFlowImageFilter, OpticalFlowImageFilter);
+
+    /**
+     * Get/Set the spatial filter deviation. This is the smoothing
+     * applied to the input images before differentiation.
+     */
+    itkGetMacro(SpatialSigma, double);
+    itkSetMacro(SpatialSigma, double);
+
+    /**
+     * Get/Set the integration standard deviation; the size of the
+     * Lucas-Kanade window.
+     */
+    itkGetMacro(IntegrationSigma, double);
+    itkSetMacro(IntegrationSigma, double);
+
+    /**
+     * Get/Set the smallest eigenvalue of the spatial tensor a reliable
+     * pixel may have, in squared intensity per squared physical unit.
+     */
+    itkGetMacro(MinimumEigenvalue, double);
+    itkSetMacro(MinimumEigenvalue, double);
+
+    /**
+     * Get/Set the smallest ratio of the spatial tensor's eigenvalues,
+     * smaller over larger, a reliable pixel may have; in [0, 1].
+     */
+    itkGetMacro(ConditionThreshold, double);
+    itkSetMacro(ConditionThreshold, double);
+
+    /**
+     * Get/Set a precomputed structure tensor of the inputs, covering the
+     * whole image; NULL computes it.
+     */
+    itkGetConstObjectMacro(StructureTensor, TensorImageType);
+    itkSetConstObjectMacro(StructureTensor, TensorImageType);
+
+    /**
+     * Get/Set precomputed smoothed images and spatial derivatives of the
+     * two inputs, at SpatialSigma; see StructureTensorImageFilter.  Both
+     * or neither must be set.
+     */
+    itkGetConstObjectMacro(Derivatives1, DerivativeImageType);
+    itkSetConstObjectMacro(Derivatives1, DerivativeImageType);
+    itkGetConstObjectMacro(Derivatives2, DerivativeImageType);
+    itkSetConstObjectMacro(Derivatives2, DerivativeImageType);
+
+    /**
+     * Get the fraction of the last flow field's pixels that were
+     * reliable.
+     */
+    itkGetMacro(ReliableFraction, double);
+
+    /**
+     * The tensor integrates over the whole image, so request all of both
+     * inputs, and produce all of the output.
+     */
+    virtual void GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError);
+    virtual void EnlargeOutputRequestedRegion(itk::DataObject* output);
+
+protected:
+    LocalOpticalFlowImageFilter() :
+        m_SpatialSigma(1.0),
+        m_IntegrationSigma(4.0),
+        m_MinimumEigenvalue(1e-6),
+        m_ConditionThreshold(0.01),
+        m_ReliableFraction(0.0)
+    {}
+
+    virtual ~LocalOpticalFlowImageFilter() {}
+
+    void PrintSelf(std::ostream& os, itk::Indent indent) const;
+
+    /**
+     * Computes the structure tensor, unless one was given.
+     */
+    void BeforeThreadedGenerateData();
+
+    /**
+     * Solves each pixel's system within the given output region.
+     */
+    void ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId);
+
+    /**
+     * Counts the reliable pixels and drops the tensor.
+     */
+    void AfterThreadedGenerateData();
+
+private:
+    // Not implemented
+    LocalOpticalFlowImageFilter(const Self& other);
+    void operator=(const Self& other);
+
+    double m_SpatialSigma;
+    double m_IntegrationSigma;
+    double m_MinimumEigenvalue;
+    double m_ConditionThreshold;
+    double m_ReliableFraction;
+    typename TensorImageType::ConstPointer m_StructureTensor;
+    typename DerivativeImageType::ConstPointer m_Derivatives1;
+    typename DerivativeImageType::ConstPointer m_Derivatives2;
+
+    // The tensor in use for this update, and reliable pixels by thread
+    typename TensorImageType::ConstPointer m_Tensor;
+    std::vector< unsigned long > m_ThreadReliable;
+};
+
+/************************************************************************/
+/* Implementation                                                       */
+/************************************************************************/
+
+#include <cmath>
+
+#include "Logger.h"
+
+template <class TInputImage1, class TInputImage2, class TOutputValueType>
+void LocalOpticalFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
+::GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError)
+{
+    Superclass::GenerateInputRequestedRegion();
+
+    if (this->GetInput1())
+        this->GetInput1()->SetRequestedRegionToLargestPossibleRegion();
+    if (this->GetInput2())
+        this->GetInput2()->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TInputImage1, class TInputImage2, class TOutputValueType>
+void LocalOpticalFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
+::EnlargeOutputRequestedRegion(itk::DataObject* output)
+{
+    Superclass::EnlargeOutputRequestedRegion(output);
+    output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TInputImage1, class TInputImage2, class TOutputValueType>
+void LocalOpticalFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
+::BeforeThreadedGenerateData()
+{
+    std::string function("LocalOpticalFlowImageFilter::BeforeThreadedGenerateData");
+    if (this->m_StructureTensor)
+    {
+        this->m_Tensor = this->m_StructureTensor;
+    }
+    else
+    {
+        Logger::debug << function << ": computing image structure tensor" << std::endl;
+        typename TensorFilterType::Pointer tensor = TensorFilterType::New();
+        tensor->SetSpatialSigma(this->GetSpatialSigma());
+        tensor->SetIntegrationSigma(this->GetIntegrationSigma());
+        tensor->SetInput1(this->GetInput1());
+        tensor->SetInput2(this->GetInput2());
+        tensor->SetDerivatives1(this->GetDerivatives1());
+        tensor->SetDerivatives2(this->GetDerivatives2());
+        tensor->SetNumberOfThreads(this->GetNumberOfThreads());
+        tensor->Update();
+        this->m_Tensor = tensor->GetOutput();
+    }
+
+    if (this->m_Tensor->GetBufferedRegion() != this->GetOutput()->GetBufferedRegion())
+    {
+        itkExceptionMacro(<< "Structure tensor and flow field regions differ");
+    }
+    this->m_ThreadReliable.assign(this->GetNumberOfThreads(), 0);
+}
+
+template <class TInputImage1, class TInputImage2, class TOutputValueType>
+void LocalOpticalFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
+::ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId)
+{
+    // The tensor and output share one buffered region
+    OutputImageType* output = this->GetOutput();
+    const OutputImageRegionType bufferRegion = output->GetBufferedRegion();
+    const long bufferWidth = bufferRegion.GetSize()[0];
+    const long width = outputRegion.GetSize()[0];
+    const long rows = outputRegion.GetSize()[1];
+    const long startX = outputRegion.GetIndex()[0] - bufferRegion.GetIndex()[0];
+    const long startY = outputRegion.GetIndex()[1] - bufferRegion.GetIndex()[1];
+
+    const typename TensorImageType::PixelType* tensor = this->m_Tensor->GetBufferPointer();
+    OutputPixelType* out = output->GetBufferPointer();
+    const double minimum = this->m_MinimumEigenvalue;
+    const double ratio = this->m_ConditionThreshold;
+    unsigned long reliable = 0;
+    for (long j = 0; j < rows; j++)
+    {
+        long offset = (startY + j) * bufferWidth + startX;
+        const typename TensorImageType::PixelType* J = tensor + offset;
+        OutputPixelType* flow = out + offset;
+        for (long x = 0; x < width; x++)
+        {
+            double a = J[x][TensorFilterType::T11];
+            double b = J[x][TensorFilterType::T12];
+            double c = J[x][TensorFilterType::T22];
+
+            // Eigenvalues of the spatial tensor
+            double mean = 0.5 * (a + c);
+            double root = std::sqrt(0.25 * (a - c) * (a - c) + b * b);
+            double smaller = mean - root, larger = mean + root;
+            if (!(smaller >= minimum && smaller >= ratio * larger))
+            {
+                flow[x].Fill(0);
+                continue;
+            }
+
+            double det = a * c - b * b;
+            double t13 = J[x][TensorFilterType::T13];
+            double t23 = J[x][TensorFilterType::T23];
+            flow[x][0] = (b * t23 - c * t13) / det;
+            flow[x][1] = (b * t13 - a * t23) / det;
+            reliable++;
+        }
+    }
+    this->m_ThreadReliable[threadId] = reliable;
+}
+
+template <class TInputImage1, class TInputImage2, class TOutputValueType>
+void LocalOpticalFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
+::AfterThreadedGenerateData()
+{
+    std::string function("LocalOpticalFlowImageFilter::AfterThreadedGenerateData");
+    unsigned long reliable = 0;
+    for (unsigned int t = 0; t < this->m_ThreadReliable.size(); t++)
+        reliable += this->m_ThreadReliable[t];
+    unsigned long pixels = this->GetOutput()->GetRequestedRegion().GetNumberOfPixels();
+    this->m_ReliableFraction = pixels > 0 ? (double) reliable / pixels : 0.0;
+    Logger::debug << function << ": " << reliable << " of " << pixels << " pixels reliable" << std::endl;
+
+    this->m_Tensor = NULL;
+}
+
+template <class TInputImage1, class TInputImage2, class TOutputValueType>
+void LocalOpticalFlowImageFilter<TInputImage1, TInputImage2, TOutputValueType>
+::PrintSelf(std::ostream& os, itk::Indent indent) const
+{
+    Superclass::PrintSelf(os, indent);
+    os << indent << "SpatialSigma: " << this->m_SpatialSigma << std::endl;
+    os << indent << "IntegrationSigma: " << this->m_IntegrationSigma << std::endl;
+    os << indent << "MinimumEigenvalue: " << this->m_MinimumEigenvalue << std::endl;
+    os << indent << "ConditionThreshold: " << this->m_ConditionThreshold << std::endl;
+}
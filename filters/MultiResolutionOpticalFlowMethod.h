@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cmath>
+#include <vector>
+
+#include "itkMultiThreader.h"
+
 #include "OpticalFlowImageFilter.h"
 #include "CommonTypes.h"
 
@@ -27,6 +32,9 @@ public:
     typedef typename OpticalFlowType::OutputImageType OutputImageType;
     typedef typename OutputImageType::Pointer OutputImagePointer;
     typedef typename OutputImageType::PixelType OutputPixelType;
+
+    /** An image pyramid's levels, coarsest first. */
+    typedef std::vector< typename ImageType::ConstPointer > PyramidType;
     
     /** Get/Set the number of levels in the multiresolution flow computation. */
     itkGetMacro(NumberOfLevels, unsigned int);
@@ -35,35 +43,114 @@ public:
     /** Get/Set the optical flow computation method. */
     itkGetObjectMacro(OpticalFlow, OpticalFlowType);
     itkSetObjectMacro(OpticalFlow, OpticalFlowType);
+
+    /**
+     * Set precomputed pyramids of the two inputs, as
+     * itk::RecursiveMultiResolutionPyramidImageFilter builds them with
+     * NumberOfLevels levels and its default schedule; see
+     * FramePyramidCache.  Set the inputs first: changing an input drops
+     * its pyramid.  An input without one (or with one of the wrong
+     * number of levels or geometry) has its pyramid built here.
+     */
+    void SetPyramid1(const PyramidType& pyramid)
+    {
+        this->m_Pyramid1 = pyramid;
+        this->Modified();
+    }
+    void SetPyramid2(const PyramidType& pyramid)
+    {
+        this->m_Pyramid2 = pyramid;
+        this->Modified();
+    }
+    const PyramidType& GetPyramid1() const { return this->m_Pyramid1; }
+    const PyramidType& GetPyramid2() const { return this->m_Pyramid2; }
     
 protected:
     MultiResolutionOpticalFlowMethod() {}
     ~MultiResolutionOpticalFlowMethod() {}
     
     void GenerateData();
+
+    /**
+     * Drops the pyramid of an input that changes, so that a pyramid of
+     * the previous frame is never used with the new one.
+     */
+    void SetNthInput(unsigned int index, itk::DataObject* input)
+    {
+        if (input != this->itk::ProcessObject::GetInput(index))
+        {
+            if (index == 0)
+                this->m_Pyramid1.clear();
+            else if (index == 1)
+                this->m_Pyramid2.clear();
+        }
+        Superclass::SetNthInput(index, input);
+    }
     
 private:
     MultiResolutionOpticalFlowMethod(const Self& other);
     void operator=(const Self& other);
     
+    /**
+     * The given pyramid if it has NumberOfLevels levels, else a new
+     * pyramid of image.
+     */
+    template < class TImage >
+    PyramidType GetLevels(const PyramidType& pyramid, const TImage* image);
+
+    /**
+     * The flow buffer for the given level, laid out like image; kept
+     * from the last update if the level's geometry has not changed.
+     */
+    OutputImagePointer GetLevelFlow(unsigned int level, const ImageType* image);
+
+    /**
+     * The mean of image, which pads the warped moving image.
+     */
+    static double Mean(const ImageType* image);
+
+    /**
+     * output = factor * (flow + increment), sampled bilinearly at
+     * output's pixels by physical position, in one threaded pass.  This
+     * takes a level's flow update, expands the sum to the next level
+     * (factor 2), and writes the result, without the intermediate images
+     * an add, resample, and rescale pipeline would stream through.  The
+     * increment may be null.
+     */
+    void ResampleFlow(const OutputImageType* flow, const OutputImageType* increment, double factor,
+        OutputImageType* output);
+
+    struct ResampleJob
+    {
+        const OutputImageType* flow;
+        const OutputImageType* increment;
+        OutputImageType* output;
+        double factor;
+    };
+    static ITK_THREAD_RETURN_TYPE ResampleThreaderCallback(void* arg);
+    static double Snap(double index)
+    {
+        double nearest = std::floor(index + 0.5);
+        return std::fabs(index - nearest) < 1e-6 ? nearest : index;
+    }
+
     unsigned int m_NumberOfLevels;
     OpticalFlowPointer m_OpticalFlow;
+    PyramidType m_Pyramid1;
+    PyramidType m_Pyramid2;
+    std::vector< OutputImagePointer > m_LevelFlows;
 //     FixedImagePointer m_FixedImage;
 //     MovingImagePointer m_MovingImage;
 };
 
 //------- Implementation --------//
 
-#include "itkAddImageFilter.h"
-#include "itkImageRegionIterator.h"
+#include <algorithm>
+
+#include "itkImageRegionConstIterator.h"
 #include "itkRecursiveMultiResolutionPyramidImageFilter.h"
-#include "itkSimilarity2DTransform.h"
-#include "itkStatisticsImageFilter.h"
-#include "itkUnaryFunctorImageFilter.h"
-#include "itkVectorResampleImageFilter.h"
-#include "itkVectorRescaleIntensityImageFilter.h"
-#include "itkWarpImageFilter.h"
 
+#include "FlowWarpImageFilter.h"
 #include "Logger.h"
 #include "ImageUtils.h"
 
@@ -72,106 +159,59 @@ void MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::GenerateData
 {
     std::string function("MultiResolutionOpticalFlowMethod::GenerateData");
     
-    typedef itk::RecursiveMultiResolutionPyramidImageFilter< FixedImageType, ImageType > FixedPyramidType;
-    typedef itk::RecursiveMultiResolutionPyramidImageFilter< MovingImageType, ImageType > MovingPyramidType;
-    typedef itk::WarpImageFilter< ImageType, ImageType, OutputImageType > WarpType;
-    typedef itk::StatisticsImageFilter< ImageType > StatsType;
-    typedef itk::AddImageFilter< OutputImageType, OutputImageType, OutputImageType > AddType;
-    typedef itk::VectorResampleImageFilter< OutputImageType, OutputImageType > ResampleType;
-    typedef itk::UnaryFunctorImageFilter< OutputImageType, OutputImageType, itk::Functor::VectorMagnitudeLinearTransform< OutputPixelType, OutputPixelType > > ScaleType;
+    typedef FlowWarpImageFilter< ImageType, ImageType, OutputImageType > WarpType;
     
     // Allocate output
     Superclass::AllocateOutputs();
     
     Logger::debug << function << ": Setting up image pyramids" << std::endl;
-    // A multi-resolution image pyramid for the fixed input image
-    typename FixedPyramidType::Pointer fixedPyr = FixedPyramidType::New();
-    fixedPyr->SetInput(this->GetInput1());
-    fixedPyr->SetNumberOfLevels(this->GetNumberOfLevels());
-    fixedPyr->Update();
+    // Multi-resolution image pyramids for the fixed and moving input images
+    PyramidType fixedPyr = this->GetLevels(this->m_Pyramid1, this->GetInput1());
+    PyramidType movingPyr = this->GetLevels(this->m_Pyramid2, this->GetInput2());
+    unsigned int levels = fixedPyr.size();
     
-    // A multi-resolution image pyramid for the moving input image
-    typename MovingPyramidType::Pointer movingPyr = MovingPyramidType::New();
-    movingPyr->SetInput(this->GetInput2());
-    movingPyr->SetNumberOfLevels(this->GetNumberOfLevels());
-    movingPyr->Update();
-    
-    Logger::debug << function << ": Fixed pyramid has  " << fixedPyr->GetNumberOfOutputs() << " output images." << std::endl;
-    Logger::debug << function << ": Moving pyramid has " << movingPyr->GetNumberOfOutputs() << " output images." << std::endl;
+    Logger::debug << function << ": Fixed pyramid has  " << fixedPyr.size() << " output images." << std::endl;
+    Logger::debug << function << ": Moving pyramid has " << movingPyr.size() << " output images." << std::endl;
     
     Logger::debug << function << ": Creating initial flow field" << std::endl;
-    // Create an initially empty flow field
-    OutputImagePointer currentFlow = OutputImageType::New();
-    MovingImagePointer lowresImg = movingPyr->GetOutput(0);
-    currentFlow->SetRegions(lowresImg->GetLargestPossibleRegion());
-    currentFlow->SetOrigin(lowresImg->GetOrigin());
-    currentFlow->SetSpacing(lowresImg->GetSpacing());
-    currentFlow->Allocate();
-    
-    // Fill initial flow field with [0,0] vectors
-    typename OutputImageType::PixelType zero;
-    zero.Fill(0.0);
-    typedef itk::ImageRegionIterator< OutputImageType > IteratorType;
-    IteratorType iter(currentFlow, currentFlow->GetLargestPossibleRegion());
-    for (iter.GoToBegin(); !iter.IsAtEnd(); ++iter)
+    OutputImagePointer currentFlow = this->GetLevelFlow(0, movingPyr[0]);
+    if (this->GetInitialFlow())
+    {
+        // Given an initial flow (e.g. a warm start from the previous frame
+        // pair), start from it instead, shrunk to the coarsest level.  The
+        // flow is scaled by 2 per level, as between the levels below.
+        Logger::debug << function << ": Shrinking initial flow to the coarsest level" << std::endl;
+        this->ResampleFlow(this->GetInitialFlow(), 0, std::pow(0.5, (double) (levels - 1)), currentFlow);
+    }
+    else
     {
-        iter.Set(zero);
+        // Fill initial flow field with [0,0] vectors
+        OutputPixelType zero;
+        zero.Fill(0.0);
+        currentFlow->FillBuffer(zero);
     }
+    currentFlow->Modified();
     
-    Logger::debug << function << ": Creating flow warper, adder, resampler, and rescaler" << std::endl;
     // Warp the moving image with the current optical flow estimate
     typename WarpType::Pointer warp = WarpType::New();
-    typename StatsType::Pointer stats = StatsType::New(); // used to compute warping outside value
-    
-    // Compute updated optical flow using in loop below
-    
-    // Add the differential flow update to the current flow estimate
-    typename AddType::Pointer add = AddType::New();
-    
-    // Upsample the current flow estimate for the next level
-    typename ResampleType::Pointer resample = ResampleType::New();
-    typedef itk::Similarity2DTransform< double > TransformType;
-    typename TransformType::Pointer transform = TransformType::New();
-    // Somehow, I guess because the spacing halves and region size doubles at each
-    // step of the multi-res pyramid, the scaling we use in the transform is just 1.
-    transform->SetScale(1.0);
-    resample->SetTransform(transform);
-    
-    // Rescale the flow estimate due to upsampling
-    typename ScaleType::Pointer scale = ScaleType::New();
-    scale->GetFunctor().SetFactor(2.0);
-    scale->SetInput(resample->GetOutput());
-    scale->InPlaceOff();
+    warp->SetNumberOfThreads(this->GetNumberOfThreads());
     
     Logger::debug << function << ": Compute multiple resolution optical flow..." << std::endl;
     // Perform optical flow computation at each level of the pyramid
-    for (int level = 0; level < this->GetNumberOfLevels(); level++)
+    for (unsigned int level = 0; level < levels; level++)
     {
-        FixedImagePointer fixedImg = fixedPyr->GetOutput(level);
-        MovingImagePointer movingImg = movingPyr->GetOutput(level);
+        typename ImageType::ConstPointer fixedImg = fixedPyr[level];
+        typename ImageType::ConstPointer movingImg = movingPyr[level];
                 
         Logger::debug << function << ": Level => " << level << " warping moving image with current flow estimate" << std::endl;
-        
-        stats->SetInput(movingImg);
-        stats->Update();
-        // Warp the moving image with the current optical flow estimate
+        // Pad the warped image with the moving image's mean
         warp->SetInput(movingImg);
         warp->SetDeformationField(currentFlow);
-        warp->SetEdgePaddingValue(stats->GetMean());
+        warp->SetEdgePaddingValue(Mean(movingImg));
         warp->SetOutputOrigin(movingImg->GetOrigin());
         warp->SetOutputSpacing(movingImg->GetSpacing());
         warp->UpdateLargestPossibleRegion();
         
-//         Logger::debug << function << ": Level => " << level << " Flow input image information:" << std::endl;
-//         PrintImageInfo<FixedImageType>(fixedImg, "Fixed image", Logger::debug);
-//         PrintImageInfo<MovingImageType>(movingImg, "Moving image", Logger::debug);
-//         PrintImageInfo(warp->GetOutput(), "Warped image", Logger::debug);
-//         PrintImageInfo<OutputImageType>(currentFlow, "Current flow", Logger::debug);
-        
-//         char filename[80];
-//         sprintf(filename, "warp-lev-%d.tif", level);
-//         WriteImage< MovingImageType, CommonTypes::InputImageType >(warp->GetOutput(), std::string(filename), false);
-        
         Logger::debug << function << ": Level => " << level << " setting up flow computation" << std::endl;
         // Compute optical flow at current resolution level using the optical flow method
         // provided by the caller
@@ -180,53 +220,183 @@ void MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::GenerateData
         this->GetOpticalFlow()->SetInitialFlow(currentFlow);
         this->GetOpticalFlow()->UpdateLargestPossibleRegion();
         
-        Logger::debug << function << ": Level => " << level << " setting up flow addition" << std::endl;
-        // Add the differential flow update to the current flow estimate
-        add->SetInput1(currentFlow);
-        add->SetInput2(this->GetOpticalFlow()->GetOutput());
+        // Add the differential flow update to the current flow estimate.
+        // The finest level's sum is the output; below that, the sum is
+        // upsampled and scaled for the next level in the same pass.
+        const OutputImageType* increment = this->GetOpticalFlow()->GetOutput();
+        if (level == levels-1)
+        {
+            Logger::debug << function << ": Level => " << level << " adding flow update" << std::endl;
+            this->ResampleFlow(currentFlow, increment, 1.0, this->GetOutput());
+            break;
+        }
         
-        Logger::debug << function << ": Level => " << level << " executing flow, add" << std::endl;
-        add->UpdateLargestPossibleRegion();
+        Logger::debug << function << ": Level => " << level << " adding flow update and expanding it to the next level" << std::endl;
+        OutputImagePointer nextFlow = this->GetLevelFlow(level+1, fixedPyr[level+1]);
+        this->ResampleFlow(currentFlow, increment, 2.0, nextFlow);
+        nextFlow->Modified();
+        currentFlow = nextFlow;
         
-//         sprintf(filename, "add-lev-%d.mha", level);
-//         WriteImage<OutputImageType>(add->GetOutput(), std::string(filename));
-        
-        if (level == this->GetNumberOfLevels()-1) break; // Done...no need to resample and rescale
-        
-        Logger::debug << function << ": Level => " << level << " resampling flow for next level" << std::endl;
-        // Setup region information for resampling
-        resample->SetInput(add->GetOutput());
-        FixedImagePointer nextImg = fixedPyr->GetOutput(level+1);
-        resample->SetOutputStartIndex(nextImg->GetLargestPossibleRegion().GetIndex());
-        resample->SetSize(nextImg->GetLargestPossibleRegion().GetSize());
-        resample->SetOutputOrigin(nextImg->GetOrigin());
-        resample->SetOutputSpacing(nextImg->GetSpacing());
-        resample->UpdateLargestPossibleRegion();
-        
-//         sprintf(filename, "resample-lev-%d.mha", level);
-//         WriteImage<OutputImageType>(resample->GetOutput(), std::string(filename));
-        
-        Logger::debug << function << ": Level => " << level << " rescaling flow for next level" << std::endl;
-        scale->UpdateLargestPossibleRegion();
-        
-//         sprintf(filename, "rescale-lev-%d.mha", level);
-//         WriteImage<OutputImageType>(scale->GetOutput(), std::string(filename));
-        
-        currentFlow = scale->GetOutput();
-        currentFlow->DisconnectPipeline();
-        
-        Logger::debug << function << ": Level => " << level << " Flow output image information:" << std::endl;
-//         PrintImageInfo< OutputImageType >(this->GetOpticalFlow()->GetOutput(), "Flow output", Logger::debug);
-//         PrintImageInfo< OutputImageType >(add->GetOutput(), "Add output", Logger::debug);
-//         PrintImageInfo< OutputImageType >(resample->GetOutput(), "Resample output", Logger::debug);
-//         PrintImageInfo< OutputImageType >(scale->GetOutput(), "Scale output", Logger::debug);
         PrintImageInfo< OutputImageType >(currentFlow, "Updated flow", Logger::debug);
     }
     
-//     Logger::debug << function << "Final flow output image information:" << std::endl;
-//     PrintImageInfo< OutputImageType >(this->GetOpticalFlow()->GetOutput(), "Flow output", Logger::debug);
-//     PrintImageInfo< OutputImageType >(add->GetOutput(), "Add output", Logger::debug);
-
-    this->GraftOutput(add->GetOutput());
     PrintImageInfo< OutputImageType >(this->GetOutput(), "MR flow output", Logger::debug);
 }
+
+template < class TFixedImage, class TMovingImage >
+typename MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::OutputImagePointer
+MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::GetLevelFlow(unsigned int level, const ImageType* image)
+{
+    if (this->m_LevelFlows.size() <= level)
+        this->m_LevelFlows.resize(level + 1);
+
+    OutputImagePointer& flow = this->m_LevelFlows[level];
+    if (!flow ||
+        flow->GetLargestPossibleRegion() != image->GetLargestPossibleRegion() ||
+        flow->GetSpacing() != image->GetSpacing() ||
+        flow->GetOrigin() != image->GetOrigin())
+    {
+        flow = OutputImageType::New();
+        flow->SetRegions(image->GetLargestPossibleRegion());
+        flow->SetOrigin(image->GetOrigin());
+        flow->SetSpacing(image->GetSpacing());
+        flow->Allocate();
+    }
+    return flow;
+}
+
+template < class TFixedImage, class TMovingImage >
+double MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::Mean(const ImageType* image)
+{
+    double sum = 0.0;
+    unsigned long count = 0;
+    itk::ImageRegionConstIterator< ImageType > it(image, image->GetBufferedRegion());
+    for (it.GoToBegin(); !it.IsAtEnd(); ++it, ++count)
+        sum += it.Get();
+    return count > 0 ? sum / count : 0.0;
+}
+
+template < class TFixedImage, class TMovingImage >
+void MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::ResampleFlow(
+    const OutputImageType* flow, const OutputImageType* increment, double factor, OutputImageType* output)
+{
+    if (increment && increment->GetBufferedRegion() != flow->GetBufferedRegion())
+    {
+        itkExceptionMacro(<< "Flow update does not cover the current flow");
+    }
+
+    ResampleJob job;
+    job.flow = flow;
+    job.increment = increment;
+    job.factor = factor;
+    job.output = output;
+
+    long height = output->GetBufferedRegion().GetSize()[1];
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(std::max(1, (int) std::min((long) this->GetNumberOfThreads(), height)));
+    threader->SetSingleMethod(ResampleThreaderCallback, &job);
+    threader->SingleMethodExecute();
+}
+
+template < class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::ResampleThreaderCallback(void* arg)
+{
+    typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+    ThreadInfoType* info = static_cast< ThreadInfoType* >(arg);
+    ResampleJob* job = static_cast< ResampleJob* >(info->UserData);
+
+    const OutputPixelType* flow = job->flow->GetBufferPointer();
+    const OutputPixelType* increment = job->increment ? job->increment->GetBufferPointer() : 0;
+    OutputPixelType* output = job->output->GetBufferPointer();
+    const long inWidth = job->flow->GetBufferedRegion().GetSize()[0];
+    const long inHeight = job->flow->GetBufferedRegion().GetSize()[1];
+    const long width = job->output->GetBufferedRegion().GetSize()[0];
+    const long height = job->output->GetBufferedRegion().GetSize()[1];
+    const long startY = (height * info->ThreadID) / info->NumberOfThreads;
+    const long endY = (height * (info->ThreadID + 1)) / info->NumberOfThreads;
+    if (inWidth == 0 || inHeight == 0)
+        return ITK_THREAD_RETURN_VALUE;
+
+    // Where each output column and row falls in the input, by physical
+    // position; positions off the input take its edge, and positions
+    // within rounding of a pixel take that pixel.
+    std::vector< long > x0(width), x1(width);
+    std::vector< float > ax(width);
+    for (long x = 0; x < width; x++)
+    {
+        double px = (job->output->GetOrigin()[0] + x * job->output->GetSpacing()[0] - job->flow->GetOrigin()[0])
+            / job->flow->GetSpacing()[0];
+        px = std::max(0.0, std::min((double) (inWidth - 1), Snap(px)));
+        x0[x] = std::min((long) px, inWidth - 1);
+        x1[x] = std::min(x0[x] + 1, inWidth - 1);
+        ax[x] = px - x0[x];
+    }
+
+    for (long y = startY; y < endY; y++)
+    {
+        double py = (job->output->GetOrigin()[1] + y * job->output->GetSpacing()[1] - job->flow->GetOrigin()[1])
+            / job->flow->GetSpacing()[1];
+        py = std::max(0.0, std::min((double) (inHeight - 1), Snap(py)));
+        long y0 = std::min((long) py, inHeight - 1);
+        long y1 = std::min(y0 + 1, inHeight - 1);
+        float ay = py - y0;
+        const long top = y0 * inWidth, bottom = y1 * inWidth;
+
+        OutputPixelType* out = output + y * width;
+        for (long x = 0; x < width; x++)
+        {
+            for (unsigned int c = 0; c < 2; c++)
+            {
+                float f00 = flow[top + x0[x]][c], f01 = flow[top + x1[x]][c];
+                float f10 = flow[bottom + x0[x]][c], f11 = flow[bottom + x1[x]][c];
+                if (increment)
+                {
+                    f00 += increment[top + x0[x]][c];
+                    f01 += increment[top + x1[x]][c];
+                    f10 += increment[bottom + x0[x]][c];
+                    f11 += increment[bottom + x1[x]][c];
+                }
+                float upper = f00 + ax[x] * (f01 - f00);
+                float lower = f10 + ax[x] * (f11 - f10);
+                out[x][c] = job->factor * (upper + ay * (lower - upper));
+            }
+        }
+    }
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template < class TFixedImage, class TMovingImage >
+template < class TImage >
+typename MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::PyramidType
+MultiResolutionOpticalFlowMethod< TFixedImage, TMovingImage >::GetLevels(const PyramidType& pyramid, const TImage* image)
+{
+    if (pyramid.size() == this->GetNumberOfLevels())
+    {
+        // The finest level is the image itself, at the same geometry
+        const ImageType* finest = pyramid.back();
+        if (finest->GetLargestPossibleRegion() == image->GetLargestPossibleRegion() &&
+            finest->GetSpacing() == image->GetSpacing() &&
+            finest->GetOrigin() == image->GetOrigin())
+            return pyramid;
+        Logger::warning << "MultiResolutionOpticalFlowMethod::GetLevels: pyramid does not match its input; "
+            << "rebuilding it" << std::endl;
+    }
+    else if (!pyramid.empty())
+        Logger::warning << "MultiResolutionOpticalFlowMethod::GetLevels: pyramid has " << pyramid.size()
+            << " levels, not " << this->GetNumberOfLevels() << "; rebuilding it" << std::endl;
+
+    typedef itk::RecursiveMultiResolutionPyramidImageFilter< TImage, ImageType > PyramidFilterType;
+    typename PyramidFilterType::Pointer filter = PyramidFilterType::New();
+    filter->SetInput(image);
+    filter->SetNumberOfLevels(this->GetNumberOfLevels());
+    filter->Update();
+
+    PyramidType levels;
+    for (unsigned int level = 0; level < filter->GetNumberOfOutputs(); level++)
+    {
+        typename ImageType::Pointer output = filter->GetOutput(level);
+        output->DisconnectPipeline();
+        levels.push_back(output.GetPointer());
+    }
+    return levels;
+}
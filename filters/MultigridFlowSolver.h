@@ -0,0 +1,550 @@
+#pragma once
+
+#include <vector>
+
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+#include "CommonTypes.h"
+#include "RedBlackSORSolver.h"
+#include "StructureTensorImageFilter.h"
+
+/**
+ * \class MultigridFlowSolver
+ * \brief Solves the CLG (and Horn and Schunck) optical flow equations in place by multigrid.
+ *
+ * Solves the same system as RedBlackSORSolver,
+ *
+ *   r^2 (w - avg(w)) + J w = -(J13, J23)
+ *
+ * but rather than relaxing only on the image grid, where smooth errors
+ * take thousands of sweeps to die out on large frames, it relaxes on a
+ * hierarchy of grids, each half the size of the one above.  A V-cycle
+ * smooths the flow with a few Gauss-Seidel sweeps, passes the remaining
+ * residual down to the next coarser grid, solves for the correction
+ * there (recursively), interpolates the correction back up, and smooths
+ * again.  Each cycle reduces the error by a roughly fixed factor no
+ * matter how large the image, so a handful of cycles replace hundreds of
+ * sweeps.
+ *
+ * Coarse grids average 2x2 blocks of the structure tensor, and since
+ * their pixels are twice as far apart, use half the regularization
+ * constant.  The residual equation on a coarse grid has the same form as
+ * the original, with the restricted residual in place of (J13, J23), so
+ * every grid is relaxed by a RedBlackSORSolver; the smoothing is
+ * threaded the same way.  Each grid's smoother computes its coefficients
+ * once, when the grids are built, and the restricted residuals are
+ * written straight into the right hand side of its coefficient image.
+ *
+ * With FullMultigrid, the first cycle starts from the coarsest grid
+ * instead of the given flow: it solves there, interpolates the solution
+ * up as the initial estimate for the next grid, and runs a V-cycle on
+ * each grid on the way up.  This replaces the initial flow.
+ *
+ * Iterate() counts cycles as iterations; the update norm and convergence
+ * tolerances are as in RedBlackSORSolver, measured over whole cycles.
+ *
+ * The flow and structure tensor images must have the same buffered
+ * region.
+ */
+template < class TFlowImage,
+           class TTensorImage = StructureTensorImageFilter< CommonTypes::InternalImageType >::TensorImageType >
+class MultigridFlowSolver :
+    public itk::Object
+{
+public:
+    // Helpful typedefs
+    typedef TFlowImage FlowImageType;
+    typedef typename FlowImageType::PixelType FlowPixelType;
+    typedef typename FlowImageType::RegionType RegionType;
+    typedef TTensorImage TensorImageType;
+    typedef typename TensorImageType::PixelType TensorPixelType;
+    typedef StructureTensorImageFilter< CommonTypes::InternalImageType > TensorFilterType;
+    typedef RedBlackSORSolver< FlowImageType, TensorImageType > SmootherType;
+
+    // Standard itk typedefs
+    typedef MultigridFlowSolver Self;
+    typedef itk::Object Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(MultigridFlowSolver, itk::Object);
+
+    /**
+     * Get/Set the flow field; this is both the initial estimate and the
+     * result.
+     */
+    itkGetObjectMacro(Flow, FlowImageType);
+    itkSetObjectMacro(Flow, FlowImageType);
+
+    /**
+     * Get/Set image structure tensor, used for data term of optical flow computation.
+     */
+    itkGetConstObjectMacro(StructureTensor, TensorImageType);
+    itkSetConstObjectMacro(StructureTensor, TensorImageType);
+
+    /**
+     * Get/Set the regularization constant. This is the constant
+     * weighting of the smoothing term in Horn and Schunck's energy
+     * functional.
+     */
+    itkGetMacro(Regularization, double);
+    itkSetMacro(Regularization, double);
+
+    /**
+     * Get/Set the number of threads used to smooth the flow field.
+     */
+    itkGetMacro(NumberOfThreads, int);
+    itkSetMacro(NumberOfThreads, int);
+
+    /**
+     * Get/Set the Gauss-Seidel sweeps before and after each coarse grid
+     * correction.
+     */
+    itkGetMacro(PreSmoothing, unsigned int);
+    itkSetMacro(PreSmoothing, unsigned int);
+    itkGetMacro(PostSmoothing, unsigned int);
+    itkSetMacro(PostSmoothing, unsigned int);
+
+    /**
+     * Get/Set the sweeps used to solve on the coarsest grid.
+     */
+    itkGetMacro(CoarseIterations, unsigned int);
+    itkSetMacro(CoarseIterations, unsigned int);
+
+    /**
+     * Get/Set the size, in pixels, below which a grid is not coarsened
+     * further.
+     */
+    itkGetMacro(MinimumSize, unsigned int);
+    itkSetMacro(MinimumSize, unsigned int);
+
+    /**
+     * Get/Set whether the first cycle is a full multigrid cycle, starting
+     * from the coarsest grid rather than the given flow.
+     */
+    itkGetMacro(FullMultigrid, bool);
+    itkSetMacro(FullMultigrid, bool);
+
+    /**
+     * Get/Set the convergence tolerances on the update norm; zero
+     * disables a test.
+     */
+    itkGetMacro(AbsoluteTolerance, double);
+    itkSetMacro(AbsoluteTolerance, double);
+    itkGetMacro(RelativeTolerance, double);
+    itkSetMacro(RelativeTolerance, double);
+
+    /**
+     * Get/Set the number of cycles to run before testing for convergence.
+     */
+    itkGetMacro(MinimumIterations, unsigned int);
+    itkSetMacro(MinimumIterations, unsigned int);
+
+    /**
+     * Get the number of cycles the last Iterate() ran, and the update
+     * norm of its last cycle.
+     */
+    itkGetMacro(ElapsedIterations, unsigned int);
+    itkGetMacro(UpdateNorm, double);
+
+    /**
+     * Run up to the given number of multigrid cycles, stopping early if
+     * the flow converges.
+     */
+    void Iterate(unsigned int cycles);
+
+protected:
+    MultigridFlowSolver();
+    virtual ~MultigridFlowSolver() {}
+
+    void PrintSelf(std::ostream& os, itk::Indent indent) const;
+
+    /**
+     * Build the coarse grids: halve the image until it is smaller than
+     * MinimumSize, averaging the structure tensor as we go; and compute
+     * each grid's smoother coefficients.
+     */
+    void BuildLevels();
+
+    /**
+     * One V-cycle on the given grid, and all coarser grids.
+     */
+    void VCycle(unsigned int level);
+
+    /**
+     * Gauss-Seidel sweeps on the given grid.
+     */
+    void Smooth(unsigned int level, unsigned int iterations);
+
+    /**
+     * Compute the residual on the given grid, and average it down into
+     * the right hand side of the next coarser grid's smoother.
+     */
+    void RestrictResidual(unsigned int level);
+
+    /**
+     * Interpolate the next coarser grid's flow up to the given grid; add
+     * it to the flow there, or replace the flow.
+     */
+    void Prolong(unsigned int level, bool add);
+
+    const TensorImageType* GetTensor(unsigned int level) const
+    { return level == 0 ? this->m_StructureTensor.GetPointer() : this->m_Tensors[level].GetPointer(); }
+
+private:
+    // Not implemented
+    MultigridFlowSolver(const Self& other);
+    void operator=(const Self& other);
+
+    typename FlowImageType::Pointer m_Flow;
+    typename TensorImageType::ConstPointer m_StructureTensor;
+    double m_Regularization;
+    int m_NumberOfThreads;
+    unsigned int m_PreSmoothing;
+    unsigned int m_PostSmoothing;
+    unsigned int m_CoarseIterations;
+    unsigned int m_MinimumSize;
+    bool m_FullMultigrid;
+    double m_AbsoluteTolerance;
+    double m_RelativeTolerance;
+    unsigned int m_MinimumIterations;
+    unsigned int m_ElapsedIterations;
+    double m_UpdateNorm;
+
+    // The grids; level 0 is the image grid, and its flow and tensor are
+    // the solver's inputs.
+    std::vector< typename FlowImageType::Pointer > m_Flows;
+    std::vector< typename TensorImageType::Pointer > m_Tensors;
+    std::vector< typename SmootherType::Pointer > m_Smoothers;
+};
+
+//-------------------------------------
+// Implementation
+//-------------------------------------
+
+#include <algorithm>
+#include <cmath>
+
+#include "Logger.h"
+
+template < class TFlowImage, class TTensorImage >
+MultigridFlowSolver< TFlowImage, TTensorImage >
+::MultigridFlowSolver() :
+    m_Flow(0),
+    m_StructureTensor(0),
+    m_Regularization(100),
+    m_NumberOfThreads(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+    m_PreSmoothing(2),
+    m_PostSmoothing(2),
+    m_CoarseIterations(50),
+    m_MinimumSize(8),
+    m_FullMultigrid(true),
+    m_AbsoluteTolerance(0.0),
+    m_RelativeTolerance(0.0),
+    m_MinimumIterations(1),
+    m_ElapsedIterations(0),
+    m_UpdateNorm(0.0)
+{}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::Iterate(unsigned int cycles)
+{
+    std::string function("MultigridFlowSolver::Iterate");
+    if (!this->m_Flow || !this->m_StructureTensor)
+    {
+        Logger::warning << function << ": flow field or structure tensor was not set!" << std::endl;
+        return;
+    }
+    if (this->m_Flow->GetBufferedRegion() != this->m_StructureTensor->GetBufferedRegion())
+    {
+        itkExceptionMacro(<< "Flow field and structure tensor regions differ");
+    }
+
+    this->m_ElapsedIterations = 0;
+    this->m_UpdateNorm = 0.0;
+    if (cycles == 0 || this->m_Flow->GetBufferedRegion().GetNumberOfPixels() == 0)
+        return;
+
+    // The coarse grids' right hand sides are overwritten by each cycle, so
+    // rebuild them for every solution.
+    this->BuildLevels();
+    unsigned int levels = this->m_Flows.size();
+    Logger::debug << function << ": up to " << cycles << " cycles on " << levels << " grids" << std::endl;
+
+    // Keep the previous flow, to measure each cycle's change
+    unsigned long pixels = this->m_Flow->GetBufferedRegion().GetNumberOfPixels();
+    std::vector< FlowPixelType > previous(this->m_Flow->GetBufferPointer(),
+                                          this->m_Flow->GetBufferPointer() + pixels);
+
+    double first = 0.0;
+    while (this->m_ElapsedIterations < cycles)
+    {
+        if (this->m_ElapsedIterations == 0 && this->m_FullMultigrid)
+        {
+            // Solve on the coarsest grid, then work up, using each grid's
+            // solution as the next finer grid's initial estimate.
+            FlowPixelType zero;
+            zero.Fill(0);
+            this->m_Flows[levels - 1]->FillBuffer(zero);
+            this->Smooth(levels - 1, this->m_CoarseIterations);
+            for (int level = (int) levels - 2; level >= 0; level--)
+            {
+                this->Prolong(level, false);
+                this->VCycle(level);
+            }
+        }
+        else
+        {
+            this->VCycle(0);
+        }
+        this->m_ElapsedIterations++;
+
+        const FlowPixelType* flow = this->m_Flow->GetBufferPointer();
+        double sum = 0.0;
+        for (unsigned long i = 0; i < pixels; i++)
+        {
+            double du = flow[i][0] - previous[i][0];
+            double dv = flow[i][1] - previous[i][1];
+            sum += du * du + dv * dv;
+            previous[i] = flow[i];
+        }
+        this->m_UpdateNorm = std::sqrt(sum / pixels);
+        if (this->m_ElapsedIterations == 1)
+            first = this->m_UpdateNorm;
+
+        if (this->m_ElapsedIterations >= this->m_MinimumIterations &&
+            ((this->m_AbsoluteTolerance > 0.0 && this->m_UpdateNorm < this->m_AbsoluteTolerance) ||
+             (this->m_RelativeTolerance > 0.0 && this->m_UpdateNorm < this->m_RelativeTolerance * first)))
+            break;
+    }
+
+    this->m_Flow->Modified();
+    Logger::debug << function << ": " << this->m_ElapsedIterations << " cycles, update norm "
+        << this->m_UpdateNorm << std::endl;
+}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::BuildLevels()
+{
+    this->m_Flows.clear();
+    this->m_Tensors.clear();
+    this->m_Smoothers.clear();
+
+    this->m_Flows.push_back(this->m_Flow);
+    this->m_Tensors.push_back(0);
+
+    RegionType region = this->m_Flow->GetBufferedRegion();
+    long width = region.GetSize()[0];
+    long height = region.GetSize()[1];
+    while (width >= 2 * (long) this->m_MinimumSize && height >= 2 * (long) this->m_MinimumSize)
+    {
+        const TensorPixelType* fine = this->GetTensor(this->m_Tensors.size() - 1)->GetBufferPointer();
+        long coarseWidth = (width + 1) / 2;
+        long coarseHeight = (height + 1) / 2;
+
+        RegionType coarseRegion;
+        coarseRegion.SetSize(0, coarseWidth);
+        coarseRegion.SetSize(1, coarseHeight);
+
+        typename FlowImageType::Pointer flow = FlowImageType::New();
+        flow->SetRegions(coarseRegion);
+        flow->Allocate();
+        typename TensorImageType::Pointer tensor = TensorImageType::New();
+        tensor->SetRegions(coarseRegion);
+        tensor->Allocate();
+
+        // Average each 2x2 block (or what is left of it at the far edges)
+        TensorPixelType* coarse = tensor->GetBufferPointer();
+        for (long y = 0; y < coarseHeight; y++)
+        {
+            for (long x = 0; x < coarseWidth; x++)
+            {
+                TensorPixelType& sum = coarse[y * coarseWidth + x];
+                sum.Fill(0);
+                unsigned int count = 0;
+                for (long fy = 2 * y; fy < std::min(2 * y + 2, height); fy++)
+                {
+                    for (long fx = 2 * x; fx < std::min(2 * x + 2, width); fx++)
+                    {
+                        sum += fine[fy * width + fx];
+                        count++;
+                    }
+                }
+                for (unsigned int i = 0; i < TensorFilterType::TensorSize; i++)
+                    sum[i] /= count;
+            }
+        }
+
+        this->m_Flows.push_back(flow);
+        this->m_Tensors.push_back(tensor);
+        width = coarseWidth;
+        height = coarseHeight;
+    }
+
+    // Coarser grids have pixels twice as far apart, which halves the
+    // regularization constant in pixel units.
+    double regularization = this->m_Regularization;
+    for (unsigned int level = 0; level < this->m_Flows.size(); level++)
+    {
+        typename SmootherType::Pointer smoother = SmootherType::New();
+        smoother->SetFlow(this->m_Flows[level]);
+        smoother->SetStructureTensor(this->GetTensor(level));
+        smoother->SetRegularization(regularization);
+        smoother->SetRelaxation(1.0);
+        smoother->SetNumberOfThreads(this->m_NumberOfThreads);
+        smoother->UpdateCoefficients();
+        this->m_Smoothers.push_back(smoother);
+        regularization *= 0.5;
+    }
+}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::VCycle(unsigned int level)
+{
+    if (level == this->m_Flows.size() - 1)
+    {
+        this->Smooth(level, this->m_CoarseIterations);
+        return;
+    }
+
+    this->Smooth(level, this->m_PreSmoothing);
+
+    // Solve for the correction on the coarser grid, starting from zero
+    this->RestrictResidual(level);
+    FlowPixelType zero;
+    zero.Fill(0);
+    this->m_Flows[level + 1]->FillBuffer(zero);
+    this->VCycle(level + 1);
+    this->Prolong(level, true);
+
+    this->Smooth(level, this->m_PostSmoothing);
+}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::Smooth(unsigned int level, unsigned int iterations)
+{
+    this->m_Smoothers[level]->Iterate(iterations);
+}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::RestrictResidual(unsigned int level)
+{
+    const FlowPixelType* flow = this->m_Flows[level]->GetBufferPointer();
+    const TensorPixelType* tensor = this->GetTensor(level)->GetBufferPointer();
+    const FlowCoefficientImage& rhs = this->m_Smoothers[level]->GetCoefficients();
+    long width = this->m_Flows[level]->GetBufferedRegion().GetSize()[0];
+    long height = this->m_Flows[level]->GetBufferedRegion().GetSize()[1];
+
+    FlowCoefficientImage& coarse = this->m_Smoothers[level + 1]->GetCoefficients();
+    long coarseWidth = this->m_Flows[level + 1]->GetBufferedRegion().GetSize()[0];
+    long coarseHeight = this->m_Flows[level + 1]->GetBufferedRegion().GetSize()[1];
+
+    const double sixth = 1.0 / 6.0;
+    const double twelfth = 1.0 / 12.0;
+    double regularization = this->m_Smoothers[level]->GetRegularization();
+    const double alpha = regularization * regularization;
+
+    for (long cy = 0; cy < coarseHeight; cy++)
+    {
+        for (long cx = 0; cx < coarseWidth; cx++)
+        {
+            double sum[2] = { 0.0, 0.0 };
+            for (long y = 2 * cy; y < std::min(2 * cy + 2, height); y++)
+            {
+                // Zero-flux borders, as in the smoother
+                const float* b[2] = { rhs.GetPlane(y, SmootherType::B1), rhs.GetPlane(y, SmootherType::B2) };
+                const FlowPixelType* row = flow + y * width;
+                const FlowPixelType* up = flow + (y > 0 ? y - 1 : y) * width;
+                const FlowPixelType* down = flow + (y < height - 1 ? y + 1 : y) * width;
+                for (long x = 2 * cx; x < std::min(2 * cx + 2, width); x++)
+                {
+                    long xm = x > 0 ? x - 1 : x;
+                    long xp = x < width - 1 ? x + 1 : x;
+                    const TensorPixelType& J = tensor[y * width + x];
+                    double w[2] = { row[x][0], row[x][1] };
+                    for (unsigned int d = 0; d < 2; d++)
+                    {
+                        double avg =
+                            sixth   * (up[x][d] + row[xp][d] + down[x][d] + row[xm][d]) +
+                            twelfth * (up[xm][d] + up[xp][d] + down[xm][d] + down[xp][d]);
+                        double data = d == 0 ?
+                            J[TensorFilterType::T11] * w[0] + J[TensorFilterType::T12] * w[1] - b[0][x] :
+                            J[TensorFilterType::T21] * w[0] + J[TensorFilterType::T22] * w[1] - b[1][x];
+                        sum[d] -= alpha * (w[d] - avg) + data;
+                    }
+                }
+            }
+
+            // The coarse grid solves A e = r.  A coarse pixel past the edge
+            // of an odd-sized grid covers fewer than four fine pixels; the
+            // missing ones contribute no residual.
+            coarse.GetPlane(cy, SmootherType::B1)[cx] = 0.25 * sum[0];
+            coarse.GetPlane(cy, SmootherType::B2)[cx] = 0.25 * sum[1];
+        }
+    }
+}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::Prolong(unsigned int level, bool add)
+{
+    FlowPixelType* flow = this->m_Flows[level]->GetBufferPointer();
+    long width = this->m_Flows[level]->GetBufferedRegion().GetSize()[0];
+    long height = this->m_Flows[level]->GetBufferedRegion().GetSize()[1];
+
+    const FlowPixelType* coarse = this->m_Flows[level + 1]->GetBufferPointer();
+    long coarseWidth = this->m_Flows[level + 1]->GetBufferedRegion().GetSize()[0];
+    long coarseHeight = this->m_Flows[level + 1]->GetBufferedRegion().GetSize()[1];
+
+    // Bilinear interpolation between coarse pixel centers: each fine
+    // pixel takes 9/16 of its parent, 3/16 of each of the two nearest
+    // side neighbors, and 1/16 of the diagonal neighbor.
+    for (long y = 0; y < height; y++)
+    {
+        long py = y / 2;
+        long qy = (y % 2 == 0) ? py - 1 : py + 1;
+        qy = std::max(0L, std::min(qy, coarseHeight - 1));
+        const FlowPixelType* parentRow = coarse + py * coarseWidth;
+        const FlowPixelType* neighborRow = coarse + qy * coarseWidth;
+        for (long x = 0; x < width; x++)
+        {
+            long px = x / 2;
+            long qx = (x % 2 == 0) ? px - 1 : px + 1;
+            qx = std::max(0L, std::min(qx, coarseWidth - 1));
+            for (unsigned int d = 0; d < 2; d++)
+            {
+                double value =
+                    0.5625 * parentRow[px][d] + 0.1875 * (parentRow[qx][d] + neighborRow[px][d]) +
+                    0.0625 * neighborRow[qx][d];
+                if (add)
+                    flow[y * width + x][d] += value;
+                else
+                    flow[y * width + x][d] = value;
+            }
+        }
+    }
+}
+
+template < class TFlowImage, class TTensorImage >
+void MultigridFlowSolver< TFlowImage, TTensorImage >
+::PrintSelf(std::ostream& os, itk::Indent indent) const
+{
+    Superclass::PrintSelf(os, indent);
+    os << indent << "Regularization: " << this->m_Regularization << std::endl;
+    os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+    os << indent << "PreSmoothing: " << this->m_PreSmoothing << std::endl;
+    os << indent << "PostSmoothing: " << this->m_PostSmoothing << std::endl;
+    os << indent << "CoarseIterations: " << this->m_CoarseIterations << std::endl;
+    os << indent << "MinimumSize: " << this->m_MinimumSize << std::endl;
+    os << indent << "FullMultigrid: " << this->m_FullMultigrid << std::endl;
+    os << indent << "AbsoluteTolerance: " << this->m_AbsoluteTolerance << std::endl;
+    os << indent << "RelativeTolerance: " << this->m_RelativeTolerance << std::endl;
+    os << indent << "MinimumIterations: " << this->m_MinimumIterations << std::endl;
+}
@@ -0,0 +1,623 @@
+#pragma once
+
+#include <vector>
+
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+#include "Barrier.h"
+#include "CommonTypes.h"
+#include "FlowCoefficientImage.h"
+#include "StructureTensorImageFilter.h"
+
+/**
+ * \class RedBlackSORSolver
+ * \brief Solves the CLG optical flow equations in place by successive over-relaxation.
+ *
+ * Given the image structure tensor J and the regularization constant r,
+ * the Euler-Lagrange equations of the combined local-global energy
+ * functional are, at each pixel,
+ *
+ *   r^2 (w - avg(w)) + J w = -(J13, J23)
+ *
+ * where w = (u,v) is the flow and avg(w) is the 9-point neighborhood
+ * average also used by GaussSeidelIterativeStepImageFilter (1/6 for edge
+ * neighbors, 1/12 for corners, zero-flux at the image borders).  Each
+ * relaxation step solves this 2x2 system for one pixel given its
+ * neighbors, and moves the pixel Relaxation (omega) of the way from its
+ * old value to the solution.
+ *
+ * The inverse of each pixel's 2x2 system depends only on the tensor and
+ * the regularization, so it is computed once, when either changes, into
+ * a FlowCoefficientImage along with the right hand side.  Each sweep then
+ * reads only the coefficients and the flow, with no divisions.
+ *
+ * The flow is updated in place, in a single buffer.  Because the 9-point
+ * stencil includes the diagonal neighbors, the classic two-color
+ * (red-black) ordering is not enough to keep neighbors apart; pixels are
+ * colored by (x mod 2, y mod 2), which gives four colors none of whose
+ * pixels neighbor each other.  All pixels of one color can then be
+ * updated at the same time, so each thread relaxes its own band of rows
+ * and the threads meet at a Barrier between colors.
+ *
+ * A color is relaxed a row at a time, with the vectorized FlowKernels:
+ * the row and its neighbors are split into u and v planes, the neighbor
+ * averages and the update are computed over the whole row, and only the
+ * pixels of the color are written back.  Half of each row's arithmetic
+ * is thrown away, but it runs on contiguous floats.
+ *
+ * Each thread sums the squared change of the pixels it relaxes, and
+ * the threads combine their sums at the end of every iteration into the
+ * update norm: the root mean square change of the flow, in pixels.
+ * Iteration stops early once the update norm falls below
+ * AbsoluteTolerance, or below RelativeTolerance times the update norm of
+ * the first iteration, but never before MinimumIterations.  A tolerance
+ * of zero disables that test.
+ *
+ * For frames too large for the cache, each iteration streams the flow
+ * and coefficients through memory, and the solver is limited by memory
+ * bandwidth.  With TileIterations k > 1 the solver blocks the iterations
+ * in time instead.  It copies a band of TileRows rows, with a halo of
+ * 2k rows above and below, into a small buffer, and relaxes it k times
+ * there.  It then writes the band's rows to a second flow buffer.
+ * Within one iteration a wrong row spoils at most two rows, one in the
+ * even-row colors and one in the odd-row colors.  So the band's rows
+ * end up exactly as k global iterations would leave them.  The halo
+ * rows are relaxed once per band that needs them, so that work
+ * is repeated.  The convergence tests are made on the same per-iteration
+ * update norms, but only after every k iterations, so a tiled solve may
+ * run up to k-1 iterations past the point an untiled one stops.
+ *
+ * The flow and structure tensor images must have the same buffered
+ * region.
+ */
+template < class TFlowImage,
+           class TTensorImage = StructureTensorImageFilter< CommonTypes::InternalImageType >::TensorImageType >
+class RedBlackSORSolver :
+    public itk::Object
+{
+public:
+    // Helpful typedefs
+    typedef TFlowImage FlowImageType;
+    typedef typename FlowImageType::PixelType FlowPixelType;
+    typedef TTensorImage TensorImageType;
+    typedef typename TensorImageType::PixelType TensorPixelType;
+    typedef StructureTensorImageFilter< CommonTypes::InternalImageType > TensorFilterType;
+
+    // Standard itk typedefs
+    typedef RedBlackSORSolver Self;
+    typedef itk::Object Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(RedBlackSORSolver, itk::Object);
+
+    /**
+     * Get/Set the flow field; this is both the initial estimate and the
+     * result.
+     */
+    itkGetObjectMacro(Flow, FlowImageType);
+    itkSetObjectMacro(Flow, FlowImageType);
+
+    /**
+     * Get/Set image structure tensor, used for data term of optical flow computation.
+     */
+    itkGetConstObjectMacro(StructureTensor, TensorImageType);
+    itkSetConstObjectMacro(StructureTensor, TensorImageType);
+
+    /**
+     * Get/Set the regularization constant. This is the constant
+     * weighting of the smoothing term in Horn and Schunck's energy
+     * functional.
+     */
+    itkGetMacro(Regularization, double);
+    itkSetMacro(Regularization, double);
+
+    /**
+     * Get/Set the relaxation constant (omega), in (0, 2).  One gives
+     * plain Gauss-Seidel; larger values over-relax.
+     */
+    itkGetMacro(Relaxation, double);
+    itkSetMacro(Relaxation, double);
+
+    /**
+     * Get/Set the number of threads used to relax the flow field.
+     */
+    itkGetMacro(NumberOfThreads, int);
+    itkSetMacro(NumberOfThreads, int);
+
+    /**
+     * Get/Set the convergence tolerances on the update norm; zero
+     * disables a test.
+     */
+    itkGetMacro(AbsoluteTolerance, double);
+    itkSetMacro(AbsoluteTolerance, double);
+    itkGetMacro(RelativeTolerance, double);
+    itkSetMacro(RelativeTolerance, double);
+
+    /**
+     * Get/Set the number of iterations to run before testing for
+     * convergence.
+     */
+    itkGetMacro(MinimumIterations, unsigned int);
+    itkSetMacro(MinimumIterations, unsigned int);
+
+    /**
+     * Get/Set the number of iterations run on each band of rows while it
+     * is in cache, and the number of rows in a band.  TileIterations of
+     * zero or one relaxes the whole flow field in every iteration.
+     */
+    itkGetMacro(TileIterations, unsigned int);
+    itkSetMacro(TileIterations, unsigned int);
+    itkGetMacro(TileRows, unsigned int);
+    itkSetMacro(TileRows, unsigned int);
+
+    /**
+     * Get the number of iterations the last Iterate() ran, and the update
+     * norm of its last iteration.
+     */
+    itkGetMacro(ElapsedIterations, unsigned int);
+    itkGetMacro(UpdateNorm, double);
+
+    /**
+     * Relax the flow field up to the given number of times, stopping
+     * early if it converges.  Each iteration updates every pixel once.
+     */
+    void Iterate(unsigned int iterations);
+
+    /**
+     * The planes of the coefficient image: the inverse of each pixel's
+     * symmetric system matrix r^2 + J, the right hand side -(J13, J23),
+     * and a weight that is zero where the system is singular.
+     */
+    enum CoefficientPlane
+    {
+        I11 = 0,
+        I12,
+        I22,
+        B1,
+        B2,
+        Weight,
+        CoefficientCount
+    };
+
+    /**
+     * Compute the coefficients from the structure tensor and the
+     * regularization, unless they are current.  Iterate() calls this.
+     */
+    void UpdateCoefficients();
+
+    /**
+     * Get the coefficient image.  MultigridFlowSolver writes the right
+     * hand sides of its coarse grids straight into it.
+     */
+    FlowCoefficientImage& GetCoefficients() { return this->m_Coefficients; }
+
+protected:
+    RedBlackSORSolver();
+    virtual ~RedBlackSORSolver() {}
+
+    void PrintSelf(std::ostream& os, itk::Indent indent) const;
+
+    /**
+     * Update every pixel of one color in rows [startY, endY), and return
+     * the sum of their squared changes.  flow holds the rows from
+     * firstRow on, including the neighbors of rows startY to endY-1
+     * within the image.
+     */
+    double RelaxColor(unsigned int color, FlowPixelType* flow, long firstRow, long startY, long endY);
+
+    /**
+     * Relax the rows of one tile k times in the thread's tile buffer,
+     * reading the flow from source and writing the rows [startY, endY)
+     * to destination.  Stores the sum of squared changes in those rows
+     * in each iteration in updates.
+     */
+    void RelaxTile(const FlowPixelType* source, FlowPixelType* destination, std::vector< FlowPixelType >& buffer,
+        long startY, long endY, unsigned int k, double* updates);
+
+    /**
+     * Whether to stop after the given (one-based) iteration, whose update
+     * norm is norm, the first iteration's having been first.
+     */
+    bool HasConverged(unsigned int iteration, double norm, double first) const;
+
+    /**
+     * Thread entry point; relaxes one band of rows for every iteration.
+     */
+    static ITK_THREAD_RETURN_TYPE ThreaderCallback(void* arg);
+    static ITK_THREAD_RETURN_TYPE TiledThreaderCallback(void* arg);
+
+private:
+    // Not implemented
+    RedBlackSORSolver(const Self& other);
+    void operator=(const Self& other);
+
+    typename FlowImageType::Pointer m_Flow;
+    typename TensorImageType::ConstPointer m_StructureTensor;
+    double m_Regularization;
+    double m_Relaxation;
+    int m_NumberOfThreads;
+    double m_AbsoluteTolerance;
+    double m_RelativeTolerance;
+    unsigned int m_MinimumIterations;
+    unsigned int m_TileIterations;
+    unsigned int m_TileRows;
+    unsigned int m_ElapsedIterations;
+    double m_UpdateNorm;
+
+    FlowCoefficientImage m_Coefficients;
+
+    // State shared by the threads of one Iterate() call.  Each thread
+    // writes its partial sum into the slot for the iteration's parity, so
+    // the next iteration cannot overwrite sums still being read.
+    unsigned int m_PendingIterations;
+    Barrier* m_Barrier;
+    double m_Omega;
+    std::vector< double > m_ThreadUpdates[2];
+
+    // Tiled state: the second flow buffer, and the sums of squared
+    // change per tile and iteration of a block, by block parity.
+    std::vector< FlowPixelType > m_Scratch;
+    std::vector< double > m_TileUpdates[2];
+};
+
+//-------------------------------------
+// Implementation
+//-------------------------------------
+
+#include <algorithm>
+#include <cmath>
+
+#include "FlowKernels.h"
+#include "Logger.h"
+
+template < class TFlowImage, class TTensorImage >
+RedBlackSORSolver< TFlowImage, TTensorImage >
+::RedBlackSORSolver() :
+    m_Flow(0),
+    m_StructureTensor(0),
+    m_Regularization(100),
+    m_Relaxation(1.9),
+    m_NumberOfThreads(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+    m_AbsoluteTolerance(0.0),
+    m_RelativeTolerance(0.0),
+    m_MinimumIterations(1),
+    m_TileIterations(1),
+    m_TileRows(64),
+    m_ElapsedIterations(0),
+    m_UpdateNorm(0.0),
+    m_PendingIterations(0),
+    m_Barrier(0),
+    m_Omega(1.0)
+{}
+
+template < class TFlowImage, class TTensorImage >
+void RedBlackSORSolver< TFlowImage, TTensorImage >
+::Iterate(unsigned int iterations)
+{
+    std::string function("RedBlackSORSolver::Iterate");
+    if (!this->m_Flow || !this->m_StructureTensor)
+    {
+        Logger::warning << function << ": flow field or structure tensor was not set!" << std::endl;
+        return;
+    }
+    if (this->m_Flow->GetBufferedRegion() != this->m_StructureTensor->GetBufferedRegion())
+    {
+        itkExceptionMacro(<< "Flow field and structure tensor regions differ");
+    }
+
+    this->UpdateCoefficients();
+
+    this->m_Omega = this->m_Relaxation;
+    if (this->m_Omega <= 0.0 || this->m_Omega >= 2.0)
+    {
+        Logger::warning << function << ": relaxation " << this->m_Omega
+            << " is outside (0, 2) and would diverge; using 1" << std::endl;
+        this->m_Omega = 1.0;
+    }
+
+    this->m_ElapsedIterations = 0;
+    this->m_UpdateNorm = 0.0;
+    long height = this->m_Flow->GetBufferedRegion().GetSize()[1];
+    if (iterations == 0 || height == 0)
+        return;
+
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads(std::max(1, (int) std::min((long) this->m_NumberOfThreads, height)));
+    int threads = threader->GetNumberOfThreads();
+
+    Barrier barrier(threads);
+    this->m_Barrier = &barrier;
+    this->m_PendingIterations = iterations;
+    this->m_ThreadUpdates[0].assign(threads, 0.0);
+    this->m_ThreadUpdates[1].assign(threads, 0.0);
+
+    bool tiled = this->m_TileIterations > 1 && iterations > 1;
+    if (tiled)
+    {
+        long tileRows = std::max(1L, (long) this->m_TileRows);
+        long tiles = (height + tileRows - 1) / tileRows;
+        this->m_Scratch.resize(this->m_Flow->GetBufferedRegion().GetNumberOfPixels());
+        this->m_TileUpdates[0].assign(tiles * this->m_TileIterations, 0.0);
+        this->m_TileUpdates[1].assign(tiles * this->m_TileIterations, 0.0);
+    }
+
+    Logger::verbose << function << ": up to " << iterations << " iterations on "
+        << threads << " threads" << std::endl;
+    if (tiled)
+    {
+        Logger::verbose << function << ": " << this->m_TileIterations << " iterations at a time in bands of "
+            << this->m_TileRows << " rows" << std::endl;
+    }
+    threader->SetSingleMethod(tiled ? TiledThreaderCallback : ThreaderCallback, this);
+    threader->SingleMethodExecute();
+
+    this->m_Barrier = 0;
+    this->m_Scratch.clear();
+    this->m_Flow->Modified();
+    Logger::verbose << function << ": " << this->m_ElapsedIterations << " iterations, update norm "
+        << this->m_UpdateNorm << std::endl;
+}
+
+template < class TFlowImage, class TTensorImage >
+void RedBlackSORSolver< TFlowImage, TTensorImage >
+::UpdateCoefficients()
+{
+    const TensorImageType* tensor = this->m_StructureTensor;
+    const double alpha = this->m_Regularization * this->m_Regularization;
+    if (this->m_Coefficients.IsCurrent(tensor, tensor->GetMTime(), alpha))
+        return;
+
+    const long width = tensor->GetBufferedRegion().GetSize()[0];
+    const long height = tensor->GetBufferedRegion().GetSize()[1];
+    const TensorPixelType* J = tensor->GetBufferPointer();
+    this->m_Coefficients.Allocate(width, height, CoefficientCount);
+    for (long y = 0; y < height; y++)
+    {
+        float* i11 = this->m_Coefficients.GetPlane(y, I11);
+        float* i12 = this->m_Coefficients.GetPlane(y, I12);
+        float* i22 = this->m_Coefficients.GetPlane(y, I22);
+        float* b1 = this->m_Coefficients.GetPlane(y, B1);
+        float* b2 = this->m_Coefficients.GetPlane(y, B2);
+        float* weight = this->m_Coefficients.GetPlane(y, Weight);
+        for (long x = 0; x < width; x++, J++)
+        {
+            // J is symmetric, so is its inverse
+            double a11 = alpha + (*J)[TensorFilterType::T11];
+            double a12 = (*J)[TensorFilterType::T12];
+            double a22 = alpha + (*J)[TensorFilterType::T22];
+            double det = a11 * a22 - a12 * a12;
+            weight[x] = det == 0.0 ? 0.0f : 1.0f;
+            if (det == 0.0)
+                det = 1.0;
+            i11[x] = a22 / det;
+            i12[x] = -a12 / det;
+            i22[x] = a11 / det;
+            b1[x] = -(*J)[TensorFilterType::T13];
+            b2[x] = -(*J)[TensorFilterType::T23];
+        }
+    }
+    this->m_Coefficients.SetSource(tensor, tensor->GetMTime(), alpha);
+}
+
+template < class TFlowImage, class TTensorImage >
+ITK_THREAD_RETURN_TYPE RedBlackSORSolver< TFlowImage, TTensorImage >
+::ThreaderCallback(void* arg)
+{
+    typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+    ThreadInfoType* info = static_cast< ThreadInfoType* >(arg);
+    Self* self = static_cast< Self* >(info->UserData);
+
+    // Split the rows evenly among the threads
+    long height = self->m_Flow->GetBufferedRegion().GetSize()[1];
+    long startY = (height * info->ThreadID) / info->NumberOfThreads;
+    long endY = (height * (info->ThreadID + 1)) / info->NumberOfThreads;
+
+    // Every thread reduces the same partial sums in the same order, so
+    // all of them reach the same decision about stopping.
+    double first = 0.0, norm = 0.0;
+    unsigned int i = 0;
+    while (i < self->m_PendingIterations)
+    {
+        std::vector< double >& updates = self->m_ThreadUpdates[i % 2];
+        double update = 0.0;
+        for (unsigned int color = 0; color < 4; color++)
+        {
+            update += self->RelaxColor(color, self->m_Flow->GetBufferPointer(), 0, startY, endY);
+            if (color == 3)
+                updates[info->ThreadID] = update;
+            self->m_Barrier->Wait();
+        }
+
+        double sum = 0.0;
+        for (unsigned int t = 0; t < updates.size(); t++)
+            sum += updates[t];
+        norm = std::sqrt(sum / self->m_Flow->GetBufferedRegion().GetNumberOfPixels());
+        if (i == 0)
+            first = norm;
+        i++;
+        if (self->HasConverged(i, norm, first))
+            break;
+    }
+
+    if (info->ThreadID == 0)
+    {
+        self->m_ElapsedIterations = i;
+        self->m_UpdateNorm = norm;
+    }
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template < class TFlowImage, class TTensorImage >
+ITK_THREAD_RETURN_TYPE RedBlackSORSolver< TFlowImage, TTensorImage >
+::TiledThreaderCallback(void* arg)
+{
+    typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+    ThreadInfoType* info = static_cast< ThreadInfoType* >(arg);
+    Self* self = static_cast< Self* >(info->UserData);
+
+    long height = self->m_Flow->GetBufferedRegion().GetSize()[1];
+    long tileRows = std::max(1L, (long) self->m_TileRows);
+    long tiles = (height + tileRows - 1) / tileRows;
+    unsigned int k = self->m_TileIterations;
+    unsigned long pixels = self->m_Flow->GetBufferedRegion().GetNumberOfPixels();
+
+    // Blocks alternate between the flow buffer and the scratch buffer
+    FlowPixelType* buffers[2] = { self->m_Flow->GetBufferPointer(), &self->m_Scratch[0] };
+    std::vector< FlowPixelType > buffer;
+
+    double first = 0.0, norm = 0.0;
+    unsigned int i = 0, block = 0;
+    bool converged = false;
+    while (i < self->m_PendingIterations && !converged)
+    {
+        unsigned int steps = std::min(k, self->m_PendingIterations - i);
+        std::vector< double >& updates = self->m_TileUpdates[block % 2];
+        for (long t = info->ThreadID; t < tiles; t += info->NumberOfThreads)
+        {
+            self->RelaxTile(buffers[block % 2], buffers[(block + 1) % 2], buffer,
+                t * tileRows, std::min(height, (t + 1) * tileRows), steps, &updates[t * k]);
+        }
+        self->m_Barrier->Wait();
+
+        // Every thread sums the tiles in the same order, and so reaches
+        // the same decision about stopping.
+        for (unsigned int s = 0; s < steps; s++)
+        {
+            double sum = 0.0;
+            for (long t = 0; t < tiles; t++)
+                sum += updates[t * k + s];
+            norm = std::sqrt(sum / pixels);
+            if (i == 0)
+                first = norm;
+            i++;
+            converged = converged || self->HasConverged(i, norm, first);
+        }
+        block++;
+    }
+
+    // The result of an odd number of blocks is in the scratch buffer;
+    // copy it back, a band per thread.
+    if (block % 2 == 1)
+    {
+        long width = self->m_Flow->GetBufferedRegion().GetSize()[0];
+        long startY = (height * info->ThreadID) / info->NumberOfThreads;
+        long endY = (height * (info->ThreadID + 1)) / info->NumberOfThreads;
+        std::copy(buffers[1] + startY * width, buffers[1] + endY * width, buffers[0] + startY * width);
+    }
+
+    if (info->ThreadID == 0)
+    {
+        self->m_ElapsedIterations = i;
+        self->m_UpdateNorm = norm;
+    }
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template < class TFlowImage, class TTensorImage >
+void RedBlackSORSolver< TFlowImage, TTensorImage >
+::RelaxTile(const FlowPixelType* source, FlowPixelType* destination, std::vector< FlowPixelType >& buffer,
+    long startY, long endY, unsigned int k, double* updates)
+{
+    long width = this->m_Flow->GetBufferedRegion().GetSize()[0];
+    long height = this->m_Flow->GetBufferedRegion().GetSize()[1];
+
+    // The tile and its halo; rows at the halo's edge have a neighbor
+    // missing, so are not relaxed.
+    long halo = 2 * k;
+    long firstRow = std::max(0L, startY - halo);
+    long lastRow = std::min(height, endY + halo);
+    long relaxStart = firstRow > 0 ? firstRow + 1 : 0;
+    long relaxEnd = lastRow < height ? lastRow - 1 : height;
+    buffer.assign(source + firstRow * width, source + lastRow * width);
+
+    for (unsigned int s = 0; s < k; s++)
+    {
+        updates[s] = 0.0;
+        for (unsigned int color = 0; color < 4; color++)
+        {
+            this->RelaxColor(color, &buffer[0], firstRow, relaxStart, startY);
+            updates[s] += this->RelaxColor(color, &buffer[0], firstRow, startY, endY);
+            this->RelaxColor(color, &buffer[0], firstRow, endY, relaxEnd);
+        }
+    }
+
+    std::copy(buffer.begin() + (startY - firstRow) * width, buffer.begin() + (endY - firstRow) * width,
+        destination + startY * width);
+}
+
+template < class TFlowImage, class TTensorImage >
+bool RedBlackSORSolver< TFlowImage, TTensorImage >
+::HasConverged(unsigned int iteration, double norm, double first) const
+{
+    if (iteration < this->m_MinimumIterations)
+        return false;
+    return (this->m_AbsoluteTolerance > 0.0 && norm < this->m_AbsoluteTolerance) ||
+           (this->m_RelativeTolerance > 0.0 && norm < this->m_RelativeTolerance * first);
+}
+
+template < class TFlowImage, class TTensorImage >
+double RedBlackSORSolver< TFlowImage, TTensorImage >
+::RelaxColor(unsigned int color, FlowPixelType* flow, long firstRow, long startY, long endY)
+{
+    long width = this->m_Flow->GetBufferedRegion().GetSize()[0];
+    long height = this->m_Flow->GetBufferedRegion().GetSize()[1];
+    const FlowCoefficientImage& c = this->m_Coefficients;
+
+    const double alpha = this->m_Regularization * this->m_Regularization;
+    const float omega = this->m_Omega;
+
+    // Rows above, at, and below the one relaxed, in u and v planes with
+    // one pixel of border; and the relaxed row.
+    const long padded = width + 2;
+    std::vector< float > aboveU(padded), aboveV(padded), rowU(padded), rowV(padded), belowU(padded), belowV(padded);
+    std::vector< float > averageU(width), averageV(width), nextU(width), nextV(width);
+
+    double update = 0.0;
+    long colorX = color % 2;
+    long colorY = color / 2;
+    long firstY = startY + ((startY % 2) == colorY ? 0 : 1);
+    for (long y = firstY; y < endY; y += 2)
+    {
+        // Zero-flux borders: reflect missing neighbors onto the edge pixel
+        FlowPixelType* row = flow + (y - firstRow) * width;
+        const FlowPixelType* up = flow + ((y > 0 ? y - 1 : y) - firstRow) * width;
+        const FlowPixelType* down = flow + ((y < height - 1 ? y + 1 : y) - firstRow) * width;
+        FlowKernels::SplitRow(up, width, 0, width, 1, &aboveU[0], &aboveV[0]);
+        FlowKernels::SplitRow(row, width, 0, width, 1, &rowU[0], &rowV[0]);
+        FlowKernels::SplitRow(down, width, 0, width, 1, &belowU[0], &belowV[0]);
+        FlowKernels::NeighborAverage(&aboveU[0], &rowU[0], &belowU[0], width, &averageU[0]);
+        FlowKernels::NeighborAverage(&aboveV[0], &rowV[0], &belowV[0], width, &averageV[0]);
+
+        // The kernel relaxes the whole row; keep only this color's pixels
+        FlowKernels::RedBlackUpdate(&averageU[0], &averageV[0], &rowU[1], &rowV[1],
+            c.GetPlane(y, I11), c.GetPlane(y, I12), c.GetPlane(y, I22), c.GetPlane(y, B1), c.GetPlane(y, B2),
+            c.GetPlane(y, Weight), alpha, omega, width, &nextU[0], &nextV[0]);
+        for (long x = colorX; x < width; x += 2)
+        {
+            double du = nextU[x] - rowU[x + 1];
+            double dv = nextV[x] - rowV[x + 1];
+            row[x][0] = nextU[x];
+            row[x][1] = nextV[x];
+            update += du * du + dv * dv;
+        }
+    }
+    return update;
+}
+
+template < class TFlowImage, class TTensorImage >
+void RedBlackSORSolver< TFlowImage, TTensorImage >
+::PrintSelf(std::ostream& os, itk::Indent indent) const
+{
+    Superclass::PrintSelf(os, indent);
+    os << indent << "Regularization: " << this->m_Regularization << std::endl;
+    os << indent << "Relaxation: " << this->m_Relaxation << std::endl;
+    os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+    os << indent << "AbsoluteTolerance: " << this->m_AbsoluteTolerance << std::endl;
+    os << indent << "RelativeTolerance: " << this->m_RelativeTolerance << std::endl;
+    os << indent << "MinimumIterations: " << this->m_MinimumIterations << std::endl;
+    os << indent << "TileIterations: " << this->m_TileIterations << std::endl;
+    os << indent << "TileRows: " << this->m_TileRows << std::endl;
+}
@@ -178,8 +178,10 @@ void RegistrationMotionFilter<TInputImage1, TInputImage2, TOutputValueType>
 	// available data for the patch neighborhood.
 	// For the fixed image, we need to pad the region by PatchRadius + MaximumDisplacement to ensure each
 	// pixel location has neighborhood data for every possible location of the moving patch.
-	Input1ImageType::RegionType moveRegion = movePtr->GetLargestPossibleRegion(); // movePtr->GetRequestedRegion();
-	Input2ImageType::RegionType fixRegion = fixPtr->GetLargestPossibleRegion(); // fixPtr->GetRequestedRegion();
+	// The superclass has set both requested regions to the output's, so
+	// readers upstream need only supply the padded output region.
+	typename Input1ImageType::RegionType moveRegion = movePtr->GetRequestedRegion();
+	typename Input2ImageType::RegionType fixRegion = fixPtr->GetRequestedRegion();
 	moveRegion.PadByRadius(this->m_PatchRadius);
 	fixRegion.PadByRadius(this->m_PatchRadius + this->m_MaximumDisplacement);
 
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * \class SeparableGaussian
+ * \brief Sampled Gaussian kernels and the row operations to apply them.
+ *
+ * These are the building blocks of the streaming, separable filters
+ * (GaussianDerivativesImageFilter, StructureTensorImageFilter): a
+ * kernel is applied along a row by padding the row and correlating, and
+ * down a column by accumulating weighted rows.  The loops run along
+ * contiguous rows of floats, which the compiler vectorizes.
+ */
+struct SeparableGaussian
+{
+    typedef std::vector< float > KernelType;
+
+    /**
+     * Sample a Gaussian of the given standard deviation, in pixels, and,
+     * if derivative is not NULL, its first derivative, scaled by scale.
+     * Each kernel has 2r+1 taps, for correlation, with r = ceil(3 sigma).
+     * The Gaussian sums to one, and the derivative of a unit ramp is
+     * scale.  A vanishing sigma gives the identity and central
+     * differences.
+     */
+    static void MakeKernels(double sigma, double scale, KernelType& smooth, KernelType* derivative)
+    {
+        long radius = sigma > 0.0 ? std::max(1L, (long) std::ceil(3.0 * sigma)) : 1;
+        smooth.assign(2 * radius + 1, 0.0f);
+        if (derivative)
+            derivative->assign(2 * radius + 1, 0.0f);
+
+        if (sigma <= 0.0)
+        {
+            smooth[radius] = 1.0f;
+            if (derivative)
+            {
+                (*derivative)[radius - 1] = -0.5 * scale;
+                (*derivative)[radius + 1] = 0.5 * scale;
+            }
+            return;
+        }
+
+        std::vector< double > g(2 * radius + 1);
+        double sum = 0.0, moment = 0.0;
+        for (long k = -radius; k <= radius; k++)
+        {
+            g[k + radius] = std::exp(-0.5 * k * k / (sigma * sigma));
+            sum += g[k + radius];
+            moment += k * k * g[k + radius];
+        }
+        for (long k = -radius; k <= radius; k++)
+        {
+            smooth[k + radius] = g[k + radius] / sum;
+            if (derivative)
+                (*derivative)[k + radius] = scale * k * g[k + radius] / moment;
+        }
+    }
+
+    /**
+     * The radius r of a kernel of 2r+1 taps.
+     */
+    static long Radius(const KernelType& kernel)
+    {
+        return kernel.size() / 2;
+    }
+
+    /**
+     * Copy a row into a float buffer, replicating the end pixels radius
+     * times on either side (zero-flux borders).
+     */
+    template < class TPixel >
+    static void PadRow(const TPixel* row, long width, long radius, float* padded)
+    {
+        for (long x = 0; x < radius; x++)
+            padded[x] = row[0];
+        for (long x = 0; x < width; x++)
+            padded[x + radius] = row[x];
+        for (long x = 0; x < radius; x++)
+            padded[width + radius + x] = row[width - 1];
+    }
+
+    /**
+     * Correlate a padded row with a kernel.
+     */
+    static void FilterRow(const float* padded, const KernelType& kernel, long width, float* out)
+    {
+        std::fill(out, out + width, 0.0f);
+        for (unsigned int k = 0; k < kernel.size(); k++)
+            AccumulateRow(padded + k, kernel[k], width, out);
+    }
+
+    /**
+     * out += weight * row
+     */
+    static void AccumulateRow(const float* row, float weight, long width, float* out)
+    {
+        for (long x = 0; x < width; x++)
+            out[x] += weight * row[x];
+    }
+
+    /**
+     * Clamp a row (or column) index to [0, size), for zero-flux borders.
+     */
+    static long Clamp(long index, long size)
+    {
+        return std::max(0L, std::min(size - 1, index));
+    }
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <deque>
+
+#include "Logger.h"
+
+/**
+ * \class SlidingFrameCache
+ * \brief Holds what was computed from each of the last few frames of a sequence.
+ *
+ * Flow over a sequence is computed pair by pair, (0,1), (1,2), ..., so every frame but the ends appears in two pairs:
+ * second in one and first in the next.  Anything computed from one frame alone, such as its derivatives or its
+ * pyramid, can be computed once and handed to both pairs.  Entries are keyed by frame index and a parameter of the
+ * computation; the cache is a sliding window that holds the most recently computed frames (two by default, the
+ * current pair) and drops the oldest.
+ *
+ * TComputePolicy says what is computed.  It provides
+ *
+ *   - InputImageType, the frame;
+ *   - ParameterType, compared with ==, e.g. a scale or a number of levels;
+ *   - ValueType, the result, which is copied out of the cache, so should be a smart pointer or a small container
+ *     of them;
+ *   - static ValueType Compute(const InputImageType* image, ParameterType parameter, int threads), where threads
+ *     is zero to leave ITK's default;
+ *   - static const char* GetName(), which labels the statistics.
+ *
+ * FrameDerivativeCache and FramePyramidCache are built on this.  The cache does not read frames itself; the caller
+ * passes the frame, which is only used on a miss.
+ */
+template < class TComputePolicy >
+class SlidingFrameCache
+{
+public:
+    typedef TComputePolicy PolicyType;
+    typedef typename PolicyType::InputImageType InputImageType;
+    typedef typename PolicyType::ParameterType ParameterType;
+    typedef typename PolicyType::ValueType ValueType;
+
+    SlidingFrameCache(unsigned int capacity = 2) :
+        capacity(capacity < 1 ? 1 : capacity),
+        threads(0),
+        hits(0),
+        misses(0)
+    {}
+
+    /**
+     * Get the result for the given frame and parameter, computing it
+     * from image if it is not held.
+     */
+    ValueType Get(unsigned int frame, ParameterType parameter, const InputImageType* image)
+    {
+        for (typename EntryList::iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+        {
+            if (it->frame == frame && it->parameter == parameter)
+            {
+                this->hits++;
+                return it->value;
+            }
+        }
+
+        this->misses++;
+        Entry entry;
+        entry.frame = frame;
+        entry.parameter = parameter;
+        entry.value = PolicyType::Compute(image, parameter, this->threads);
+        if (this->entries.size() >= this->capacity)
+            this->entries.pop_front();
+        this->entries.push_back(entry);
+        return entry.value;
+    }
+
+    /**
+     * Drop every entry, e.g. when the sequence changes.
+     */
+    void Clear()
+    {
+        this->entries.clear();
+    }
+
+    /**
+     * Set the number of threads the computation uses; zero (the default)
+     * leaves ITK's default.
+     */
+    void SetNumberOfThreads(int threads)
+    {
+        this->threads = threads;
+    }
+
+    unsigned long GetHitCount() const { return this->hits; }
+    unsigned long GetMissCount() const { return this->misses; }
+
+    /**
+     * Log cache statistics.
+     */
+    void LogStatistics() const
+    {
+        Logger::debug << PolicyType::GetName() << ": " << this->misses << " frames computed, "
+            << this->hits << " reused" << std::endl;
+    }
+
+private:
+    // Not implemented
+    SlidingFrameCache(const SlidingFrameCache& other);
+    void operator=(const SlidingFrameCache& other);
+
+    struct Entry
+    {
+        unsigned int frame;
+        ParameterType parameter;
+        ValueType value;
+    };
+    typedef std::deque< Entry > EntryList;
+
+    EntryList entries;      // oldest at the front
+    unsigned int capacity;
+    int threads;
+    unsigned long hits;
+    unsigned long misses;
+};
@@ -4,6 +4,9 @@
 #include "itkImageToImageFilter.h"
 #include "itkVector.h"
 
+#include "GaussianDerivativesImageFilter.h"
+#include "SeparableGaussian.h"
+
 /**
  * \class StructureTensorImageFilter
  * \brief Computes the image structure tensor for a pair of images.
@@ -17,7 +20,20 @@
  * scale determines the size of the window over which tensor terms are averaged (smoothed).
  *
  * Note that in general, the structure tensor T is a 3x3 matrix, but we only compute the 6 components needed for optical
- * flow computations.
+ * flow computations.  T21 equals T12; it is stored for the convenience of the flow filters, but computed once.
+ *
+ * The whole computation is fused into a single threaded pass.  Each thread owns a band of output rows and streams
+ * through the input rows once, keeping only the few rows each separable Gaussian needs in small ring buffers: input
+ * rows are smoothed and differentiated horizontally as they arrive, then vertically into Ix, Iy and It; the five
+ * distinct products are integrated horizontally, then vertically into the output.  No full-size intermediate images
+ * are made.  The Gaussians are sampled (FIR) kernels, truncated at three standard deviations, with zero-flux borders;
+ * the inner loops run along contiguous rows of floats, which the compiler vectorizes.  Both scales are in physical
+ * units, and derivatives are per physical unit.
+ *
+ * The smoothed image and its spatial derivatives depend on one frame only.  When flow is computed over a sequence,
+ * each frame is the second image of one pair and the first of the next, so these may be computed once per frame with
+ * GaussianDerivativesImageFilter (at SpatialSigma) and given to this filter with SetDerivatives1/SetDerivatives2;
+ * then only the pairwise terms are computed here.  The inputs must still be set; they give the image geometry.
  */
 template < class TInputImage >
 class StructureTensorImageFilter 
@@ -43,6 +59,10 @@ public:
     typedef itk::Vector< TensorComponentType, TensorSize > TensorType;
     typedef itk::Image< TensorType, ImageDimension > TensorImageType;
     typedef TensorImageType OutputImageType;
+
+    typedef GaussianDerivativesImageFilter< InputImageType > DerivativeFilterType;
+    typedef typename DerivativeFilterType::DerivativeType DerivativeType;
+    typedef typename DerivativeFilterType::DerivativeImageType DerivativeImageType;
     
     // Standard itk class typedefs
     typedef StructureTensorImageFilter Self;
@@ -92,13 +112,41 @@ public:
     {
         this->SetNthInput(1, const_cast<TInputImage*>(image2));
     }
+
+    /**
+     * Get/Set precomputed smoothed images and derivatives, from
+     * GaussianDerivativesImageFilter at SpatialSigma, for the first and
+     * second images.  Both or neither must be set; NULL computes them.
+     */
+    itkGetConstObjectMacro(Derivatives1, DerivativeImageType);
+    itkSetConstObjectMacro(Derivatives1, DerivativeImageType);
+    itkGetConstObjectMacro(Derivatives2, DerivativeImageType);
+    itkSetConstObjectMacro(Derivatives2, DerivativeImageType);
     
 protected:
     StructureTensorImageFilter();
     virtual ~StructureTensorImageFilter();
-    
-    void GenerateData();
-    
+
+    typedef typename TensorImageType::RegionType OutputImageRegionType;
+
+    /**
+     * Every output row depends on input rows up to both kernel radii
+     * away, so request the whole input, and produce the whole output.
+     */
+    virtual void GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError);
+    virtual void EnlargeOutputRequestedRegion(itk::DataObject* output);
+
+    /**
+     * Sample the Gaussian kernels for the input spacing, and check any
+     * precomputed derivatives.
+     */
+    void BeforeThreadedGenerateData();
+
+    /**
+     * Compute the structure tensor for a band of output rows.
+     */
+    void ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId);
+
 private:
     // Not implemented
     StructureTensorImageFilter(const Self& other);
@@ -106,160 +154,235 @@ private:
     
     double m_SpatialSigma;
     double m_IntegrationSigma;
+
+    typename DerivativeImageType::ConstPointer m_Derivatives1;
+    typename DerivativeImageType::ConstPointer m_Derivatives2;
+
+    // Kernels for the current input spacing
+    SeparableGaussian::KernelType m_SmoothX, m_SmoothY;
+    SeparableGaussian::KernelType m_DerivativeX, m_DerivativeY;
+    SeparableGaussian::KernelType m_IntegrateX, m_IntegrateY;
 };
 
 /************************************************************************/
 /* Implementation
 /************************************************************************/
 
-#include "itkAdaptImageFilter.h"
-#include "itkImageDuplicator.h"
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
-#include "itkNthElementPixelAccessor.h"
-#include "itkRecursiveGaussianImageFilter.h"
-#include "itkSubtractImageFilter.h"
+#include <vector>
                  
 #include "ImageUtils.h"
 #include "Logger.h"
-#include "NaryJoinImageFilter.h"
 
 template < class TInputImage >
 StructureTensorImageFilter< TInputImage >::StructureTensorImageFilter()
     : m_SpatialSigma(1.0),
       m_IntegrationSigma(2.0)
 {
+    this->SetNumberOfRequiredInputs(2);
 }
 
 template < class TInputImage >
 StructureTensorImageFilter< TInputImage >::~StructureTensorImageFilter()
 {}
-                 
+
 template < class TInputImage >
 void StructureTensorImageFilter< TInputImage >
-::GenerateData()
+::GenerateInputRequestedRegion() throw (itk::InvalidRequestedRegionError)
 {
-    std::string function("StructureTensorImageFilter::GenerateData");
-    Logger::debug << function << ": entering..." << std::endl;
-    
-    // Allocate the output buffer
-    Logger::debug << function << ": allocating output buffer" << std::endl;
-    Superclass::AllocateOutputs();
-    typename TensorImageType::Pointer output = this->GetOutput();
-    typename TensorImageType::RegionType outRegion = output->GetRequestedRegion();
-
-    // Build the spatiotemporal gradient of the input images
-    typedef itk::Image<TensorComponentType, ImageDimension> InternalImageType;
-    typedef itk::RecursiveGaussianImageFilter<InternalImageType, InternalImageType> GaussianFilterType;
-    typedef itk::SubtractImageFilter<InputImageType, InputImageType, InternalImageType> DifferenceFilterType;
-    typedef itk::ImageDuplicator<InternalImageType> DuplicatorType;
-
-    Logger::debug << function << ": setting up Gaussian filters" << std::endl;
-    // Setup Derivative filters
-    typename GaussianFilterType::Pointer gX = GaussianFilterType::New();
-    typename GaussianFilterType::Pointer gY = GaussianFilterType::New();
-    typename DifferenceFilterType::Pointer dT = DifferenceFilterType::New();
-    typename DuplicatorType::Pointer copier = DuplicatorType::New();
-
-    gX->SetDirection(0);
-    gY->SetDirection(1);
-    
-    gX->SetInput(this->GetInput1());
-    gY->SetInput(gX->GetOutput());
-    
-    // Setup filters for spatial derivatives
-    Logger::debug << function << ": computing spatial derivatives" << std::endl;
-    typename InternalImageType::Pointer Ix, Iy, It;
-    gX->SetSigma(this->m_SpatialSigma);
-    gY->SetSigma(this->m_SpatialSigma);
-    
-    // Ix
-    gX->SetFirstOrder();
-    gY->SetZeroOrder();
-    gY->Update();
-    copier->SetInputImage(gY->GetOutput());
-    copier->Update();
-    Ix = copier->GetOutput();
-    
-    // Iy
-    gX->SetZeroOrder();
-    gY->SetFirstOrder();
-    gY->Update();
-    copier->SetInputImage(gY->GetOutput());
-    copier->Update();
-    Iy = copier->GetOutput();
-    
-    // It, I2 - I1
-    gX->SetZeroOrder();
-    gY->SetZeroOrder();
-    gY->Update();
-    copier->SetInputImage(gY->GetOutput());
-    copier->Update();
-    dT->SetInput2(copier->GetOutput());
-    gX->SetInput(this->GetInput2());
-    gY->Update();
-    copier->SetInputImage(gY->GetOutput());
-    copier->Update();
-    dT->SetInput1(copier->GetOutput());
-    dT->Update();
-    It = dT->GetOutput();
-    
-    // Compute structure tensor
-    Logger::debug << function << ": computing structure tensor" << std::endl;
-    typedef itk::ImageRegionIterator<TensorImageType> TensorIteratorType;
-    typedef itk::ImageRegionConstIterator<InternalImageType> ImageIteratorType;
-    ImageIteratorType itIx(Ix, Ix->GetLargestPossibleRegion());
-    ImageIteratorType itIy(Iy, Iy->GetLargestPossibleRegion());
-    ImageIteratorType itIt(It, It->GetLargestPossibleRegion());
-    TensorIteratorType itTensor(output, outRegion);
-
-    TensorType tensor;
-    for (itIx.GoToBegin(), itIy.GoToBegin(), itIt.GoToBegin(), itTensor.GoToBegin();
-         !(itIx.IsAtEnd() || itIy.IsAtEnd() || itIt.IsAtEnd() || itTensor.IsAtEnd());
-         ++itIx, ++itIy, ++itIt, ++itTensor)
+    Superclass::GenerateInputRequestedRegion();
+    for (unsigned int i = 0; i < 2; i++)
     {
-        // First row, x terms
-        tensor[T11] = itIx.Get() * itIx.Get();
-        tensor[T12] = itIx.Get() * itIy.Get();
-        tensor[T13] = itIx.Get() * itIt.Get();
-        
-        // Second row, y terms
-        tensor[T21] = itIy.Get() * itIx.Get();
-        tensor[T22] = itIy.Get() * itIy.Get();
-        tensor[T23] = itIy.Get() * itIt.Get();
-        
-        itTensor.Set(tensor);
+        InputImageType* input = const_cast< InputImageType* >(this->GetInput(i));
+        if (input)
+            input->SetRequestedRegionToLargestPossibleRegion();
     }
-    // WriteImage< TensorImageType >(output, "tensor-pre-smooth.mha");
-    
-    // Smooth each structure tensor component independently...must split, smooth, and rejoin.
-    Logger::debug << function << ": smoothing structure tensor (integrating)" << std::endl;
-    typedef itk::AdaptImageFilter<TensorImageType, InternalImageType, itk::NthElementPixelAccessor<TensorComponentType, TensorType> > SplitType;
-    typedef NaryJoinImageFilter< InternalImageType, TensorSize > JoinType;
-    
-    typename SplitType::Pointer split = SplitType::New();
-    typename JoinType::Pointer join = JoinType::New();
-    split->SetInput(output);
-    gX->SetInput(split->GetOutput());
-    gY->SetInput(gX->GetOutput());
-    
-    gX->SetZeroOrder();
-    gY->SetZeroOrder();
-    gX->SetSigma(this->m_IntegrationSigma);
-    gY->SetSigma(this->m_IntegrationSigma);
-    
-    for (int t = 0; t < TensorSize; t++)
+}
+
+template < class TInputImage >
+void StructureTensorImageFilter< TInputImage >
+::EnlargeOutputRequestedRegion(itk::DataObject* output)
+{
+    Superclass::EnlargeOutputRequestedRegion(output);
+    output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template < class TInputImage >
+void StructureTensorImageFilter< TInputImage >
+::BeforeThreadedGenerateData()
+{
+    std::string function("StructureTensorImageFilter::BeforeThreadedGenerateData");
+    if (this->m_Derivatives1.IsNull() != this->m_Derivatives2.IsNull())
     {
-        split->GetAccessor().SetElementNumber(t);
-        split->Modified(); // we have to let the image adapter know we changed the pixel accessor
-        gY->Update();
-        copier->SetInputImage(gY->GetOutput());
-        copier->Update();
-        join->SetNthInput(t, const_cast<InternalImageType*>(copier->GetOutput()));
+        itkExceptionMacro(<< "Derivatives must be given for both images, or for neither");
+    }
+    if (!this->m_Derivatives1.IsNull())
+    {
+        typename InputImageType::RegionType region = this->GetInput1()->GetBufferedRegion();
+        if (this->m_Derivatives1->GetBufferedRegion() != region ||
+            this->m_Derivatives2->GetBufferedRegion() != region)
+        {
+            itkExceptionMacro(<< "Derivatives do not cover the input images");
+        }
+    }
+
+    typename InputImageType::SpacingType spacing = this->GetInput1()->GetSpacing();
+    SeparableGaussian::MakeKernels(this->m_SpatialSigma / spacing[0], 1.0 / spacing[0],
+                                   this->m_SmoothX, &this->m_DerivativeX);
+    SeparableGaussian::MakeKernels(this->m_SpatialSigma / spacing[1], 1.0 / spacing[1],
+                                   this->m_SmoothY, &this->m_DerivativeY);
+    SeparableGaussian::MakeKernels(this->m_IntegrationSigma / spacing[0], 1.0, this->m_IntegrateX, NULL);
+    SeparableGaussian::MakeKernels(this->m_IntegrationSigma / spacing[1], 1.0, this->m_IntegrateY, NULL);
+    Logger::debug << function << ": spatial radius " << SeparableGaussian::Radius(this->m_SmoothX)
+        << ", integration radius " << SeparableGaussian::Radius(this->m_IntegrateX)
+        << (this->m_Derivatives1.IsNull() ? "" : ", precomputed derivatives") << std::endl;
+}
+                 
+template < class TInputImage >
+void StructureTensorImageFilter< TInputImage >
+::ThreadedGenerateData(const OutputImageRegionType& outputRegion, int threadId)
+{
+    // The distinct products, in the order they are integrated
+    enum { XX = 0, XY, XT, YY, YT, Products };
+
+    const InputImageType* input1 = this->GetInput1();
+    const InputImageType* input2 = this->GetInput2();
+    TensorImageType* output = this->GetOutput();
+    typename InputImageType::RegionType buffered = input1->GetBufferedRegion();
+    const long width = buffered.GetSize()[0];
+    const long height = buffered.GetSize()[1];
+    const typename InputImageType::PixelType* image1 = input1->GetBufferPointer();
+    const typename InputImageType::PixelType* image2 = input2->GetBufferPointer();
+    TensorType* tensor = output->GetBufferPointer();
+
+    // Precomputed per-frame terms, if given
+    const bool precomputed = !this->m_Derivatives1.IsNull();
+    const DerivativeType* derivatives1 = precomputed ? this->m_Derivatives1->GetBufferPointer() : NULL;
+    const DerivativeType* derivatives2 = precomputed ? this->m_Derivatives2->GetBufferPointer() : NULL;
+
+    // This thread's band of output rows
+    const long startY = outputRegion.GetIndex()[1] - buffered.GetIndex()[1];
+    const long endY = startY + outputRegion.GetSize()[1];
+    if (width == 0 || startY >= endY)
+        return;
+
+    const long spatialX = SeparableGaussian::Radius(this->m_SmoothX);
+    const long spatialY = SeparableGaussian::Radius(this->m_SmoothY);
+    const long integrateX = SeparableGaussian::Radius(this->m_IntegrateX);
+    const long integrateY = SeparableGaussian::Radius(this->m_IntegrateY);
+
+    // Ring buffers: horizontally filtered input rows, for the vertical
+    // spatial filters, and horizontally integrated product rows, for the
+    // vertical integration.  Row r lives in slot r % ring size.
+    const long inputRing = precomputed ? 0 : 2 * spatialY + 1;
+    const long productRing = 2 * integrateY + 1;
+    std::vector< float > smooth1(inputRing * width), derivative1(inputRing * width), smooth2(inputRing * width);
+    std::vector< float > products(Products * productRing * width);
+    std::vector< float > padded(width + 2 * std::max(spatialX, integrateX));
+    std::vector< float > Ix(width), Iy(width), It(width), smoothed(width), accumulator(width);
+
+    long nextInput = std::max(0L, startY - integrateY - spatialY);
+    long nextProduct = std::max(0L, startY - integrateY);
+    for (long y = startY; y < endY; y++)
+    {
+        // Produce the product rows output row y integrates over
+        for (; nextProduct <= std::min(height - 1, y + integrateY); nextProduct++)
+        {
+            long r = nextProduct;
+
+            // Spatio-temporal gradient of row r
+            if (precomputed)
+            {
+                const DerivativeType* d1 = derivatives1 + r * width;
+                const DerivativeType* d2 = derivatives2 + r * width;
+                for (long x = 0; x < width; x++)
+                {
+                    Ix[x] = d1[x][DerivativeFilterType::DerivativeX];
+                    Iy[x] = d1[x][DerivativeFilterType::DerivativeY];
+                    It[x] = d2[x][DerivativeFilterType::Smoothed] - d1[x][DerivativeFilterType::Smoothed];
+                }
+            }
+            else
+            {
+                // ...from the filtered input rows it depends on
+                for (; nextInput <= std::min(height - 1, r + spatialY); nextInput++)
+                {
+                    long slot = (nextInput % inputRing) * width;
+                    SeparableGaussian::PadRow(image1 + nextInput * width, width, spatialX, &padded[0]);
+                    SeparableGaussian::FilterRow(&padded[0], this->m_SmoothX, width, &smooth1[slot]);
+                    SeparableGaussian::FilterRow(&padded[0], this->m_DerivativeX, width, &derivative1[slot]);
+                    SeparableGaussian::PadRow(image2 + nextInput * width, width, spatialX, &padded[0]);
+                    SeparableGaussian::FilterRow(&padded[0], this->m_SmoothX, width, &smooth2[slot]);
+                }
+
+                std::fill(Ix.begin(), Ix.end(), 0.0f);
+                std::fill(Iy.begin(), Iy.end(), 0.0f);
+                std::fill(It.begin(), It.end(), 0.0f);
+                std::fill(smoothed.begin(), smoothed.end(), 0.0f);
+                for (long k = -spatialY; k <= spatialY; k++)
+                {
+                    long slot = (SeparableGaussian::Clamp(r + k, height) % inputRing) * width;
+                    float smooth = this->m_SmoothY[k + spatialY];
+                    SeparableGaussian::AccumulateRow(&derivative1[slot], smooth, width, &Ix[0]);
+                    SeparableGaussian::AccumulateRow(&smooth1[slot], this->m_DerivativeY[k + spatialY], width, &Iy[0]);
+                    SeparableGaussian::AccumulateRow(&smooth2[slot], smooth, width, &It[0]);
+                    SeparableGaussian::AccumulateRow(&smooth1[slot], smooth, width, &smoothed[0]);
+                }
+                for (long x = 0; x < width; x++)
+                    It[x] -= smoothed[x];
+            }
+
+            // Products, integrated horizontally
+            for (unsigned int p = 0; p < Products; p++)
+            {
+                const float* a = p < YY ? &Ix[0] : &Iy[0];
+                const float* b = (p == XX) ? &Ix[0] : (p == XY || p == YY) ? &Iy[0] : &It[0];
+                float* row = &padded[integrateX];
+                for (long x = 0; x < width; x++)
+                    row[x] = a[x] * b[x];
+                for (long x = 0; x < integrateX; x++)
+                {
+                    padded[x] = row[0];
+                    row[width + x] = row[width - 1];
+                }
+                SeparableGaussian::FilterRow(&padded[0], this->m_IntegrateX, width,
+                                             &products[(p * productRing + r % productRing) * width]);
+            }
+        }
+
+        // Integrate vertically into the output
+        TensorType* out = tensor + y * width;
+        for (unsigned int p = 0; p < Products; p++)
+        {
+            std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+            for (long k = -integrateY; k <= integrateY; k++)
+            {
+                long slot = SeparableGaussian::Clamp(y + k, height) % productRing;
+                SeparableGaussian::AccumulateRow(&products[(p * productRing + slot) * width],
+                                                 this->m_IntegrateY[k + integrateY], width, &accumulator[0]);
+            }
+            switch (p)
+            {
+            case XX:
+                for (long x = 0; x < width; x++)
+                    out[x][T11] = accumulator[x];
+                break;
+            case XY:
+                for (long x = 0; x < width; x++)
+                    out[x][T12] = out[x][T21] = accumulator[x];
+                break;
+            case XT:
+                for (long x = 0; x < width; x++)
+                    out[x][T13] = accumulator[x];
+                break;
+            case YY:
+                for (long x = 0; x < width; x++)
+                    out[x][T22] = accumulator[x];
+                break;
+            case YT:
+                for (long x = 0; x < width; x++)
+                    out[x][T23] = accumulator[x];
+                break;
+            }
+        }
     }
-    
-    join->Update();
-    this->GraftOutput(join->GetOutput());
-    // WriteImage< TensorImageType >(join->GetOutput(), "tensor-post-smooth.mha");
-    Logger::debug << function << ": done" << std::endl;
 }
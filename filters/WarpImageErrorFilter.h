@@ -1,10 +1,11 @@
 #pragma once
 
-#import "itkImage.h"
-#import "itkImageToImageFilter.h"
-#import "itkSqrtImageFilter.h" 
-#import "itkSquaredDifferenceImageFilter.h"
-#import "itkWarpImageFilter.h"
+#include "itkImage.h"
+#include "itkImageToImageFilter.h"
+#include "itkSqrtImageFilter.h" 
+#include "itkSquaredDifferenceImageFilter.h"
+
+#include "FlowWarpImageFilter.h"
 
 /**
  * WarpImageErrorFilter computes the error in a deformation field used to map one image onto another.
@@ -33,7 +34,7 @@ public:
     typedef TOutputImage OutputType;
     typedef TDeformationField DeformationType;
 
-    typedef itk::WarpImageFilter< InputType1, InputType1, DeformationType > WarpType;
+    typedef FlowWarpImageFilter< InputType1, InputType1, DeformationType > WarpType;
     typedef itk::SquaredDifferenceImageFilter< InputType1, InputType2, OutputType > DifferenceType;
     typedef itk::SqrtImageFilter< OutputType, OutputType > SqrtType;
 
@@ -52,9 +53,9 @@ public:
         this->SetNthInput(0, const_cast<TInputImage1*> (image1));
     }
 
-    TInputImage2* GetInput1()
+    TInputImage2* GetInput2()
     {
-        return const_cast<TInputImage2*> (this->GetInput(1));
+        return const_cast<TInputImage2*> (this->itk::ProcessObject::GetInput(1));
     }
 
     /**
@@ -67,7 +68,7 @@ public:
 
     TDeformationField* GetDeformationField()
     {
-        return const_cast<TDeformationField*> (this->GetInput(2));
+        return static_cast<TDeformationField*> (this->itk::ProcessObject::GetInput(2));
     }
 
     /**
@@ -86,7 +87,7 @@ protected:
 
 private:
     WarpImageErrorFilter(const Self&);  // Not implemented
-    operator=(const Self&);             // Not implemented
+    void operator=(const Self&);        // Not implemented
 };
 
 /** Implementation **/
@@ -99,14 +100,16 @@ void WarpImageErrorFilter<TInputImage1, TInputImage2, TOutputImage, TDeformation
     Superclass::AllocateOutputs();
 
     // Instantiate objects
-    WarpType::Pointer warper = WarpType::New();
-    DifferenceType::Pointer diff = DifferenceType::New();
-    SqrtType::Pointer sqrt = SqrtType::New();
+    typename WarpType::Pointer warper = WarpType::New();
+    typename DifferenceType::Pointer diff = DifferenceType::New();
+    typename SqrtType::Pointer sqrt = SqrtType::New();
 
     // Create pipeline
     warper->SetInput(this->GetInput1());
     warper->SetDeformationField(this->GetDeformationField());
-    diff->SetInput1(this->warper->GetOutput());
+    warper->SetOutputOrigin(this->GetInput1()->GetOrigin());
+    warper->SetOutputSpacing(this->GetInput1()->GetSpacing());
+    diff->SetInput1(warper->GetOutput());
     diff->SetInput2(this->GetInput2());
     sqrt->SetInput(diff->GetOutput());
 
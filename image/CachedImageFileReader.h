@@ -0,0 +1,183 @@
+#pragma once
+
+#include <string>
+
+#include "itkImageFileReader.h"
+#include "itkImageSource.h"
+#include "itkRealTimeClock.h"
+
+#include "FrameCache.h"
+#include "ImageIOPool.h"
+#include "ImageUtils.h"
+#include "ReaderTelemetry.h"
+
+/**
+ * \class CachedImageFileReader
+ * \brief Pipeline source that reads an image file through the FrameCache.
+ *
+ * A drop-in replacement for an itk::ImageFileReader followed by a pixel
+ * type cast.  The file is decoded as TInputImage once and shared through
+ * the FrameCache with every other reader of the same file.  The output
+ * is always this reader's own buffer: the converted frame when a
+ * conversion is needed, and otherwise a copy of the cached frame, so
+ * in-place filters downstream cannot overwrite the frame other readers
+ * see.
+ *
+ * The output's requested region is honoured: when downstream filters
+ * (a region of interest, say) ask for part of the image, only that part
+ * is read, through ReadCachedImage's region path, and the output buffers
+ * just that region of the whole image.  Output information comes from
+ * the cached frame when there is one, and otherwise from the file header.
+ *
+ * Each frame fetched is recorded in the reader's telemetry.
+ */
+template < class TInputImage, class TOutputImage = TInputImage >
+class CachedImageFileReader :
+    public itk::ImageSource< TOutputImage >
+{
+public:
+    typedef CachedImageFileReader Self;
+    typedef itk::ImageSource< TOutputImage > Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+    itkNewMacro(Self);
+    itkTypeMacro(CachedImageFileReader, ImageSource);
+
+    typedef TInputImage InputImageType;
+    typedef TOutputImage OutputImageType;
+    typedef typename OutputImageType::Pointer OutputImagePointer;
+    typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+    itkSetStringMacro(FileName);
+    itkGetStringMacro(FileName);
+
+    /**
+     * The frames this reader has fetched, and how long decoding took.
+     */
+    const ReaderTelemetry& GetTelemetry() const
+    { return this->m_Telemetry; }
+
+protected:
+    CachedImageFileReader() :
+        m_FileName("")
+    {}
+    virtual ~CachedImageFileReader() {}
+
+    /**
+     * Report the image's size, spacing, and origin, without decoding it.
+     */
+    virtual void GenerateOutputInformation()
+    {
+        if (this->m_FileName == "")
+        {
+            itkExceptionMacro(<< "No file name specified");
+        }
+
+        itk::DataObject::Pointer cached = FrameCache::Instance().Find(this->m_FileName,
+            FrameCache::PixelTypeKey< InputImageType >());
+        const InputImageType* frame = dynamic_cast< InputImageType* >(cached.GetPointer());
+        if (frame)
+        {
+            this->CopyOutputInformation(frame);
+            return;
+        }
+
+        // Read just the header
+        PooledImageIO io(this->m_FileName);
+        typedef itk::ImageFileReader< InputImageType > HeaderReaderType;
+        typename HeaderReaderType::Pointer header = HeaderReaderType::New();
+        header->SetFileName(this->m_FileName.c_str());
+        if (io.GetPointer())
+            header->SetImageIO(io.GetPointer());
+        header->UpdateOutputInformation();
+        this->CopyOutputInformation(header->GetOutput());
+    }
+
+    /**
+     * Give the output the size, spacing, and origin of a frame of the file.
+     */
+    void CopyOutputInformation(const InputImageType* frame)
+    {
+        OutputImageType* output = this->GetOutput();
+        OutputImageRegionType largest;
+        CopyRegion< InputImageType, OutputImageType >(frame->GetLargestPossibleRegion(), largest);
+        output->SetLargestPossibleRegion(largest);
+        output->SetSpacing(frame->GetSpacing());
+        output->SetOrigin(frame->GetOrigin());
+    }
+
+    /**
+     * Requests outside the image are cropped to it.
+     */
+    virtual void EnlargeOutputRequestedRegion(itk::DataObject* output)
+    {
+        OutputImageType* image = dynamic_cast< OutputImageType* >(output);
+        if (image)
+        {
+            OutputImageRegionType region(image->GetRequestedRegion());
+            if (!region.Crop(image->GetLargestPossibleRegion()))
+                region = image->GetLargestPossibleRegion();
+            image->SetRequestedRegion(region);
+        }
+    }
+
+    virtual void GenerateData()
+    {
+        OutputImageType* output = this->GetOutput();
+        OutputImageRegionType largest(output->GetLargestPossibleRegion());
+        OutputImageRegionType requested(output->GetRequestedRegion());
+        if (requested == largest)
+        {
+            this->GraftOutput(this->ReadFrame(NULL));
+            return;
+        }
+
+        // Put the region back where it lies in the whole image
+        OutputImagePointer frame = this->ReadFrame(&requested);
+        typename OutputImageType::PointType origin(output->GetOrigin());
+        frame->SetLargestPossibleRegion(largest);
+        frame->SetBufferedRegion(requested);
+        frame->SetRequestedRegion(requested);
+        frame->SetOrigin(origin);
+        this->GraftOutput(frame);
+    }
+
+    /**
+     * Fetch the frame, or the given region of it, through the FrameCache,
+     * recording the fetch, and convert or copy it into an image of our
+     * own.
+     */
+    OutputImagePointer ReadFrame(const OutputImageRegionType* region)
+    {
+        itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+        double start = clock->GetTimeStamp();
+        bool decoded = false;
+        typename InputImageType::Pointer cached;
+        if (region)
+        {
+            typename InputImageType::RegionType inputRegion;
+            CopyRegion< OutputImageType, InputImageType >(*region, inputRegion);
+            cached = ReadCachedImage< InputImageType >(this->m_FileName, inputRegion, &decoded);
+        }
+        else
+        {
+            cached = ReadCachedImage< InputImageType >(this->m_FileName, &decoded);
+        }
+
+        OutputImagePointer frame = FrameConverter< InputImageType, OutputImageType >::Convert(cached);
+        if (static_cast< const void* >(frame.GetPointer()) == static_cast< const void* >(cached.GetPointer()))
+        {
+            frame = CopyImage< OutputImageType >(frame);
+        }
+        this->m_Telemetry.RecordLoad(decoded, clock->GetTimeStamp() - start, FrameCache::ImageBytes(frame.GetPointer()));
+        return frame;
+    }
+
+private:
+    // not implemented
+    CachedImageFileReader(const Self& other);
+    void operator=(const Self& other);
+
+    std::string m_FileName;
+    ReaderTelemetry m_Telemetry;
+};
@@ -6,7 +6,10 @@
 
 DataSource::DataSource() :
     name("NewDataSource"),
-    files()
+    files(),
+    manifest(),
+    pixelDataType(ScalarShort),
+    pixelDataTypeSet(false)
 {
     // create a default video
     video = new ImageSetReaderUS2();
@@ -21,6 +24,25 @@ DataSource::~DataSource()
     }
 }
 
+void DataSource::SetFiles(const FileSet& files)
+{
+    this->files = files;
+    this->manifest.Build(this->files);
+    
+    // Read the files in the pixel type they hold, unless told otherwise
+    PixelDataType type;
+    if (!this->pixelDataTypeSet &&
+        GetManifestPixelDataType(this->manifest, type) &&
+        type != this->pixelDataType)
+    {
+        this->ChangeReader(type);
+    }
+    else
+    {
+        this->video->SetFiles(this->files);
+    }
+}
+
 itk::DataObject* DataSource::GetImage(unsigned int i)
 {
      Logger::verbose << "DataSource::GetImage(" << i << ") const" << std::endl;
@@ -54,38 +76,65 @@ const itk::DataObject* DataSource::GetImage(unsigned int i) const
 void DataSource::SetPixelDataType(PixelDataType type)
 {
     Logger::verbose << "DataSource::SetPixelDataType: type => " << type << std::endl;
-    if (type != this->GetPixelDataType())
+    this->pixelDataTypeSet = true;
+    if (type != this->pixelDataType)
+    {
+        this->ChangeReader(type);
+    }
+}
+
+void DataSource::ChangeReader(PixelDataType type)
+{
+    if (this->video != 0)
+    {
+        delete(this->video);
+        this->video = 0;
+    }
+    switch (type)
     {
-        if (this->video != 0)
-        {
-            delete(this->video);
-            this->video = 0;
-        }
-        switch (type)
-        {
-            case ScalarChar:
-                Logger::verbose << "DataSource: setting ImageSetReader for ScalarChar pixels" << std::endl;
-                video = new ImageSetReaderUC2(this->files);
-                break;
-            case ScalarShort:
-                Logger::verbose << "DataSource: setting ImageSetReader for ScalarShort pixels" << std::endl;
-                video = new ImageSetReaderUS2(this->files);
-                break;
-            case ScalarFloat:
-                Logger::verbose << "DataSource: setting ImageSetReader for ScalarFloat pixels" << std::endl;
-                video = new ImageSetReaderF2(this->files);
-                break;
-            case VectorFloat:
-                Logger::verbose << "DataSource: setting ImageSetReader for VectorFloat pixels" << std::endl;
-                video = new ImageSetReaderV2F2(this->files);
-                break;
-        }
+        case ScalarChar:
+            Logger::verbose << "DataSource: setting ImageSetReader for ScalarChar pixels" << std::endl;
+            video = new ImageSetReaderUC2(this->files);
+            break;
+        case ScalarShort:
+            Logger::verbose << "DataSource: setting ImageSetReader for ScalarShort pixels" << std::endl;
+            video = new ImageSetReaderUS2(this->files);
+            break;
+        case ScalarFloat:
+            Logger::verbose << "DataSource: setting ImageSetReader for ScalarFloat pixels" << std::endl;
+            video = new ImageSetReaderF2(this->files);
+            break;
+        case VectorFloat:
+            Logger::verbose << "DataSource: setting ImageSetReader for VectorFloat pixels" << std::endl;
+            video = new ImageSetReaderV2F2(this->files);
+            break;
     }
+    this->pixelDataType = type;
 }
 
 PixelDataType DataSource::GetPixelDataType()
 {
-    return GetInputPixelDataType(this->video);
+    return this->pixelDataType;
+}
+
+bool GetManifestPixelDataType(const SequenceManifest& manifest, PixelDataType& type)
+{
+    std::string component = manifest.GetComponentType();
+    unsigned int count = manifest.GetComponentCount();
+    if (component == "" || count == 0)
+        return false;
+    
+    if (count == 2)
+        type = VectorFloat;
+    else if (count > 1)
+        return false;
+    else if (component == "unsigned_char")
+        type = ScalarChar;
+    else if (component == "unsigned_short")
+        type = ScalarShort;
+    else
+        type = ScalarFloat;
+    return true;
 }
 
 PixelDataType GetInputPixelDataType(ImageSetReaderBase* reader)
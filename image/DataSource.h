@@ -9,6 +9,7 @@
 
 #include "FileSet.h"
 #include "ImageSetReader.h"
+#include "SequenceManifest.h"
 
 enum PixelDataType
 { 
@@ -30,6 +31,12 @@ typedef ImageSetReader< ImageTypeV2F2, ImageTypeV2F2 > ImageSetReaderV2F2;
 
 PixelDataType GetInputPixelDataType(ImageSetReaderBase* reader);
 
+/**
+ * Determine the pixel data type of the frames described by a manifest.
+ * Returns false if the manifest has no frames or the frames disagree.
+ */
+bool GetManifestPixelDataType(const SequenceManifest& manifest, PixelDataType& type);
+
 // template < class TOutputType >
 // PixelDataType GetInputPixelDataType(ImageSetReader< ImageTypeUC2, TOutputType >* reader)
 // {
@@ -87,11 +94,19 @@ public:
         return this->files;
     }
 
-    void SetFiles(const FileSet& files)
-    {
-        this->files = files;
-        this->video->SetFiles(this->files);
-    }
+    /**
+     * Set the files behind this data source.  The files' SequenceManifest
+     * sets the pixel data type, unless SetPixelDataType() has been
+     * called; a type set there stands, whichever is called first.
+     */
+    void SetFiles(const FileSet& files);
+    
+    /**
+     * The manifest of the files behind this data source: frame sizes,
+     * pixel types, and spacing, without opening the images.
+     */
+    const SequenceManifest& GetManifest() const
+    { return this->manifest; }
 
     int size() const
     {
@@ -126,7 +141,15 @@ protected:
     virtual ~DataSource();
 
 private:
+    /**
+     * Replace the image reader with one for the given pixel type.
+     */
+    void ChangeReader(PixelDataType type);
+    
     std::string name;
     FileSet files;
+    SequenceManifest manifest;
+    PixelDataType pixelDataType;
+    bool pixelDataTypeSet;
     ImageSetReaderBase* video;
 };
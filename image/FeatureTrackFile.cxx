@@ -0,0 +1,162 @@
+#include "FeatureTrackFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "FileUtils.h"
+#include "Logger.h"
+
+namespace
+{
+    const char TRACK_MAGIC[8] = { 'I', 'T', 'T', 'R', 'A', 'C', 'K', '\0' };
+    const unsigned int TRACK_VERSION = 1;
+    const std::string TRACK_EXTENSION(".itr");
+}
+
+bool FeatureTrackFile::IsTrackFile(const std::string& filename)
+{
+    return ExtensionPart(filename) == TRACK_EXTENSION;
+}
+
+FeatureTrackWriter::FeatureTrackWriter() :
+    filename(""),
+    file(NULL)
+{
+    memset(&this->header, 0, sizeof(FeatureTrackFile::Header));
+}
+
+FeatureTrackWriter::~FeatureTrackWriter()
+{
+    this->Close();
+}
+
+bool FeatureTrackWriter::Open(const std::string& filename)
+{
+    std::string function("FeatureTrackWriter::Open");
+    this->Close();
+
+    this->file = fopen(filename.c_str(), "wb");
+    if (this->file == NULL)
+    {
+        Logger::error << function << ": unable to open " << filename << std::endl;
+        return false;
+    }
+
+    this->filename = filename;
+    memset(&this->header, 0, sizeof(FeatureTrackFile::Header));
+    memcpy(this->header.magic, TRACK_MAGIC, sizeof(TRACK_MAGIC));
+    this->header.version = TRACK_VERSION;
+
+    // Reserve the header; Close() fills it in
+    if (fwrite(&this->header, sizeof(FeatureTrackFile::Header), 1, this->file) != 1)
+    {
+        Logger::error << function << ": unable to write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FeatureTrackWriter::AppendFrame(const FeatureTrackFile::PointList& points)
+{
+    std::string function("FeatureTrackWriter::AppendFrame");
+    if (this->file == NULL)
+        return false;
+
+    unsigned int count = points.size();
+    if (fwrite(&count, sizeof(count), 1, this->file) != 1 ||
+        (count > 0 && fwrite(&points[0], sizeof(FeatureTrackFile::Point), count, this->file) != count))
+    {
+        Logger::error << function << ": unable to write " << this->filename << std::endl;
+        return false;
+    }
+
+    for (unsigned int i = 0; i < count; i++)
+        this->header.trackCount = std::max(this->header.trackCount, points[i].id + 1);
+    this->header.frameCount++;
+    return true;
+}
+
+bool FeatureTrackWriter::Close()
+{
+    if (this->file == NULL)
+        return false;
+
+    bool ok = fseek(this->file, 0, SEEK_SET) == 0 &&
+        fwrite(&this->header, sizeof(FeatureTrackFile::Header), 1, this->file) == 1;
+    ok = fclose(this->file) == 0 && ok;
+    this->file = NULL;
+
+    if (!ok)
+        Logger::error << "FeatureTrackWriter::Close: unable to write " << this->filename << std::endl;
+    return ok;
+}
+
+FeatureTrackReader::FeatureTrackReader() :
+    filename(""),
+    file(NULL),
+    frame(0)
+{
+    memset(&this->header, 0, sizeof(FeatureTrackFile::Header));
+}
+
+FeatureTrackReader::~FeatureTrackReader()
+{
+    this->Close();
+}
+
+bool FeatureTrackReader::Open(const std::string& filename)
+{
+    std::string function("FeatureTrackReader::Open");
+    this->Close();
+
+    this->file = fopen(filename.c_str(), "rb");
+    if (this->file == NULL)
+    {
+        Logger::error << function << ": unable to open " << filename << std::endl;
+        return false;
+    }
+
+    this->filename = filename;
+    this->frame = 0;
+    if (fread(&this->header, sizeof(FeatureTrackFile::Header), 1, this->file) != 1 ||
+        memcmp(this->header.magic, TRACK_MAGIC, sizeof(TRACK_MAGIC)) != 0 ||
+        this->header.version != TRACK_VERSION)
+    {
+        Logger::error << function << ": " << filename << " is not a feature track file" << std::endl;
+        this->Close();
+        return false;
+    }
+    return true;
+}
+
+bool FeatureTrackReader::ReadFrame(FeatureTrackFile::PointList& points)
+{
+    std::string function("FeatureTrackReader::ReadFrame");
+    points.clear();
+    if (this->file == NULL || this->frame >= this->header.frameCount)
+        return false;
+
+    unsigned int count = 0;
+    if (fread(&count, sizeof(count), 1, this->file) != 1 ||
+        count > this->header.trackCount)
+    {
+        Logger::error << function << ": " << this->filename << " is truncated or corrupt" << std::endl;
+        return false;
+    }
+    points.resize(count);
+    if (count > 0 && fread(&points[0], sizeof(FeatureTrackFile::Point), count, this->file) != count)
+    {
+        Logger::error << function << ": " << this->filename << " is truncated" << std::endl;
+        points.clear();
+        return false;
+    }
+    this->frame++;
+    return true;
+}
+
+void FeatureTrackReader::Close()
+{
+    if (this->file != NULL)
+        fclose(this->file);
+    this->file = NULL;
+}
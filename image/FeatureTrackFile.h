@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * \class FeatureTrackFile
+ * \brief The feature track file format, for sparse feature trajectories.
+ *
+ * A feature track file (extension .itr) holds the positions of
+ * tracked features, frame by frame, in native byte order:
+ *
+ *   - a fixed 24 byte Header (magic, version, frame and track counts);
+ *   - for each frame, the number of features seen in it, followed by
+ *     that many Points: a feature's id and its physical position.
+ *
+ * A feature that is lost is simply not listed again, so the file holds
+ * 12 bytes per feature per frame tracked, and no more.  Feature ids run
+ * from 0 to TrackCount - 1; a track is the Points with one id.
+ *
+ * Write a file with FeatureTrackWriter and read it with
+ * FeatureTrackReader.
+ */
+class FeatureTrackFile
+{
+public:
+    /**
+     * The on-disk header.
+     */
+    struct Header
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int frameCount;
+        unsigned int trackCount;
+        unsigned int reserved;
+    };
+
+    /**
+     * A feature's position in one frame.
+     */
+    struct Point
+    {
+        unsigned int id;
+        float x;
+        float y;
+    };
+    typedef std::vector< Point > PointList;
+
+    /**
+     * True if the file name has the feature track extension.
+     */
+    static bool IsTrackFile(const std::string& filename);
+
+private:
+    FeatureTrackFile();
+};
+
+/**
+ * \class FeatureTrackWriter
+ * \brief Writes a feature track file.
+ *
+ * Open() the file, AppendFrame() each frame's features in order, and
+ * Close() to write the header.
+ */
+class FeatureTrackWriter
+{
+public:
+    FeatureTrackWriter();
+    ~FeatureTrackWriter();
+
+    bool Open(const std::string& filename);
+
+    /**
+     * Write the features seen in the next frame.
+     */
+    bool AppendFrame(const FeatureTrackFile::PointList& points);
+
+    /**
+     * Write the header and close the file.
+     */
+    bool Close();
+
+private:
+    // not implemented
+    FeatureTrackWriter(const FeatureTrackWriter& other);
+    void operator=(const FeatureTrackWriter& other);
+
+    std::string filename;
+    std::FILE* file;
+    FeatureTrackFile::Header header;
+};
+
+/**
+ * \class FeatureTrackReader
+ * \brief Reads a feature track file a frame at a time.
+ */
+class FeatureTrackReader
+{
+public:
+    FeatureTrackReader();
+    ~FeatureTrackReader();
+
+    /**
+     * Open a track file.  Returns false (and logs why) if the file
+     * cannot be opened or is not a valid track file.
+     */
+    bool Open(const std::string& filename);
+
+    /**
+     * Read the features of the next frame.  Returns false after the last
+     * frame, or on a read error.
+     */
+    bool ReadFrame(FeatureTrackFile::PointList& points);
+
+    void Close();
+
+    unsigned int GetFrameCount() const
+    { return this->header.frameCount; }
+    unsigned int GetTrackCount() const
+    { return this->header.trackCount; }
+
+private:
+    // not implemented
+    FeatureTrackReader(const FeatureTrackReader& other);
+    void operator=(const FeatureTrackReader& other);
+
+    std::string filename;
+    std::FILE* file;
+    FeatureTrackFile::Header header;
+    unsigned int frame;
+};
@@ -0,0 +1,535 @@
+#include "FlowCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+typedef unsigned __int64 BitBufferType;
+#else
+#include <stdint.h>
+typedef uint64_t BitBufferType;
+#endif
+
+#include "Logger.h"
+
+namespace
+{
+    const char FLOW_MAGIC[8] = { 'I', 'T', 'F', 'L', 'O', 'W', 0, 0 };
+    const unsigned int FLOW_VERSION = 1;
+
+    // Quantized values are kept within +/- 2^30 so residuals fit in an int
+    const int QUANT_LIMIT = (1 << 30) - 1;
+
+    // Rice codes with a quotient this large are escaped to 32 raw bits
+    const unsigned int RICE_LIMIT = 24;
+    const unsigned int MAX_RICE_K = 24;
+
+    // Contexts are the bit length of the local gradient activity
+    const unsigned int CONTEXT_COUNT = 16;
+    const unsigned int CONTEXT_RESET = 64;
+
+    /**
+     * Writes bits, least significant first.
+     */
+    class BitWriter
+    {
+    public:
+        BitWriter(std::vector< unsigned char >& data) :
+            data(data), buffer(0), count(0)
+        {}
+
+        // Append the low bits of value; bits <= 32
+        void Put(unsigned int value, unsigned int bits)
+        {
+            this->buffer |= ((BitBufferType) value) << this->count;
+            this->count += bits;
+            while (this->count >= 8)
+            {
+                this->data.push_back((unsigned char) (this->buffer & 0xff));
+                this->buffer >>= 8;
+                this->count -= 8;
+            }
+        }
+
+        void Flush()
+        {
+            if (this->count > 0)
+                this->data.push_back((unsigned char) (this->buffer & 0xff));
+            this->buffer = 0;
+            this->count = 0;
+        }
+
+    private:
+        std::vector< unsigned char >& data;
+        BitBufferType buffer;
+        unsigned int count;
+    };
+
+    /**
+     * Reads bits written by BitWriter.  Reading past the end yields zeros
+     * and sets the overrun flag.
+     */
+    class BitReader
+    {
+    public:
+        BitReader(const unsigned char* data, unsigned int bytes) :
+            next(data), end(data + bytes), buffer(0), count(0), overrun(false)
+        {}
+
+        // bits <= 32
+        unsigned int Get(unsigned int bits)
+        {
+            if (this->count < bits)
+                this->Fill();
+            if (this->count < bits)
+            {
+                this->overrun = true;
+                this->count = bits;
+            }
+            unsigned int value = (unsigned int) (this->buffer & ((((BitBufferType) 1) << bits) - 1));
+            this->buffer >>= bits;
+            this->count -= bits;
+            return value;
+        }
+
+        // Count one bits up to a zero bit (consumed) or limit ones
+        unsigned int GetUnary(unsigned int limit)
+        {
+            unsigned int ones = 0;
+            while (ones < limit)
+            {
+                if (this->count == 0)
+                    this->Fill();
+                if (this->count == 0)
+                {
+                    this->overrun = true;
+                    return limit;
+                }
+                unsigned int bit = (unsigned int) (this->buffer & 1);
+                this->buffer >>= 1;
+                this->count--;
+                if (!bit)
+                    break;
+                ones++;
+            }
+            return ones;
+        }
+
+        bool Overrun() const
+        { return this->overrun; }
+
+    private:
+        void Fill()
+        {
+            while (this->count <= 56 && this->next < this->end)
+            {
+                this->buffer |= ((BitBufferType) *this->next++) << this->count;
+                this->count += 8;
+            }
+        }
+
+        const unsigned char* next;
+        const unsigned char* end;
+        BitBufferType buffer;
+        unsigned int count;
+        bool overrun;
+    };
+
+    /**
+     * Running statistics that choose the Rice parameter for one context.
+     */
+    struct RiceContext
+    {
+        unsigned int sum;
+        unsigned int count;
+
+        RiceContext() : sum(4), count(1) {}
+
+        unsigned int K() const
+        {
+            unsigned int k = 0;
+            while ((this->count << k) < this->sum && k < MAX_RICE_K)
+                k++;
+            return k;
+        }
+
+        void Update(unsigned int value)
+        {
+            this->sum += std::min(value, 1u << MAX_RICE_K);
+            this->count++;
+            if (this->count >= CONTEXT_RESET)
+            {
+                this->sum >>= 1;
+                this->count >>= 1;
+            }
+        }
+    };
+
+    unsigned int Context(int a, int b, int c)
+    {
+        unsigned int activity = (unsigned int) std::abs(a - c) + (unsigned int) std::abs(b - c);
+        unsigned int bits = 0;
+        while (activity > 0 && bits < CONTEXT_COUNT - 1)
+        {
+            activity >>= 1;
+            bits++;
+        }
+        return bits;
+    }
+
+    /**
+     * The LOCO-I median edge detector.
+     */
+    int Predict(int a, int b, int c)
+    {
+        int lo = std::min(a, b);
+        int hi = std::max(a, b);
+        if (c >= hi)
+            return lo;
+        if (c <= lo)
+            return hi;
+        return a + b - c;
+    }
+
+    /**
+     * Neighbours of pixel (x, y) in a plane of quantized values.  Off the
+     * top or left edge, the missing neighbours copy the ones that exist,
+     * so the prediction is the left (first row) or upper (first column)
+     * value.
+     */
+    void Neighbours(const int* row, const int* above, unsigned int x, int& a, int& b, int& c)
+    {
+        if (above == NULL)
+        {
+            a = b = c = (x > 0 ? row[x-1] : 0);
+        }
+        else if (x == 0)
+        {
+            a = b = c = above[0];
+        }
+        else
+        {
+            a = row[x-1];
+            b = above[x];
+            c = above[x-1];
+        }
+    }
+
+    unsigned short FloatToHalf(float value)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, sizeof(bits));
+        unsigned int sign = (bits >> 16) & 0x8000;
+        unsigned int mantissa = bits & 0x7fffff;
+        int exponent = (int) ((bits >> 23) & 0xff);
+
+        if (exponent == 255)
+            return (unsigned short) (sign | (mantissa ? 0x7e00 : 0x7c00));
+
+        exponent = exponent - 127 + 15;
+        if (exponent >= 31)
+            return (unsigned short) (sign | 0x7c00);
+
+        if (exponent <= 0)
+        {
+            // Subnormal half, or zero
+            if (exponent < -10)
+                return (unsigned short) sign;
+            mantissa |= 0x800000;
+            unsigned int shift = (unsigned int) (14 - exponent);
+            unsigned int half = mantissa >> shift;
+            unsigned int rest = mantissa & ((1u << shift) - 1);
+            unsigned int middle = 1u << (shift - 1);
+            if (rest > middle || (rest == middle && (half & 1)))
+                half++;
+            return (unsigned short) (sign | half);
+        }
+
+        // Round to nearest even; a carry correctly bumps the exponent
+        unsigned int half = ((unsigned int) exponent << 10) | (mantissa >> 13);
+        unsigned int rest = mantissa & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            half++;
+        return (unsigned short) (sign | half);
+    }
+
+    float HalfToFloat(unsigned short half)
+    {
+        unsigned int sign = ((unsigned int) half & 0x8000) << 16;
+        unsigned int exponent = (half >> 10) & 0x1f;
+        unsigned int mantissa = half & 0x3ff;
+        unsigned int bits;
+
+        if (exponent == 0)
+        {
+            float value = mantissa * (1.0f / 16777216.0f);
+            return sign ? -value : value;
+        }
+        else if (exponent == 31)
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        else
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    /**
+     * Map a component value to the integer that is coded.  Half floats
+     * are mapped so that integer order matches value order.
+     */
+    int Quantize(float value, FlowCodec::Quantization quantization, double step)
+    {
+        if (quantization == FlowCodec::HalfFloat)
+        {
+            unsigned short half = FloatToHalf(value);
+            return (half & 0x8000) ? -(int) (half & 0x7fff) : (int) half;
+        }
+
+        if (value != value)     // NaN
+            return 0;
+        double scaled = std::floor(value / step + 0.5);
+        if (scaled > QUANT_LIMIT)
+            return QUANT_LIMIT;
+        if (scaled < -QUANT_LIMIT)
+            return -QUANT_LIMIT;
+        return (int) scaled;
+    }
+
+    float Dequantize(int value, FlowCodec::Quantization quantization, double step)
+    {
+        if (quantization == FlowCodec::HalfFloat)
+        {
+            unsigned short half = value < 0 ? (unsigned short) (0x8000 | -value) : (unsigned short) value;
+            return HalfToFloat(half);
+        }
+        return (float) (value * step);
+    }
+
+    bool ValidHeader(const FlowCodec::Header& header)
+    {
+        return memcmp(header.magic, FLOW_MAGIC, sizeof(FLOW_MAGIC)) == 0 &&
+            header.version == FLOW_VERSION &&
+            (header.quantization == FlowCodec::HalfFloat ||
+             (header.quantization == FlowCodec::FixedPoint && header.step > 0)) &&
+            header.width > 0 && header.height > 0;
+    }
+}
+
+void FlowCodec::InitHeader(Header& header, unsigned int width, unsigned int height,
+    Quantization quantization, double errorBound)
+{
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, FLOW_MAGIC, sizeof(FLOW_MAGIC));
+    header.version = FLOW_VERSION;
+    header.quantization = quantization;
+    header.width = width;
+    header.height = height;
+    header.step = 2.0 * errorBound;
+    header.spacing[0] = header.spacing[1] = 1.0;
+}
+
+bool FlowCodec::ReadHeader(const std::string& filename, Header& header)
+{
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+    {
+        Logger::warning << "FlowCodec::ReadHeader: unable to open " << filename << std::endl;
+        return false;
+    }
+
+    bool ok = fread(&header, sizeof(Header), 1, file) == 1 && ValidHeader(header);
+    fclose(file);
+    if (!ok)
+        Logger::warning << "FlowCodec::ReadHeader: " << filename << " is not a flow file" << std::endl;
+    return ok;
+}
+
+bool FlowCodec::Read(const std::string& filename, Header& header, float* flow)
+{
+    std::string function("FlowCodec::Read");
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+    {
+        Logger::warning << function << ": unable to open " << filename << std::endl;
+        return false;
+    }
+
+    std::vector< unsigned char > data;
+    bool ok = fread(&header, sizeof(Header), 1, file) == 1 && ValidHeader(header);
+    if (ok)
+    {
+        data.resize((std::size_t) header.planeBytes[0] + header.planeBytes[1]);
+        ok = data.empty() || fread(&data[0], 1, data.size(), file) == data.size();
+    }
+    fclose(file);
+
+    if (ok)
+    {
+        Quantization quantization = (Quantization) header.quantization;
+        const unsigned char* planes = data.empty() ? NULL : &data[0];
+        ok = DecodePlane(planes, header.planeBytes[0], 0, header.width, header.height,
+                quantization, header.step, flow) &&
+             DecodePlane(planes + header.planeBytes[0], header.planeBytes[1], 1, header.width, header.height,
+                quantization, header.step, flow);
+    }
+
+    if (!ok)
+        Logger::warning << function << ": " << filename << " is not a valid flow file" << std::endl;
+    return ok;
+}
+
+bool FlowCodec::Write(const std::string& filename, Header& header, const float* flow)
+{
+    std::string function("FlowCodec::Write");
+    Quantization quantization = (Quantization) header.quantization;
+    if (quantization == FixedPoint && !(header.step > 0))
+    {
+        Logger::error << function << ": fixed point quantization needs a positive error bound" << std::endl;
+        return false;
+    }
+
+    std::vector< unsigned char > u, v;
+    EncodePlane(flow, 0, header.width, header.height, quantization, header.step, u);
+    EncodePlane(flow, 1, header.width, header.height, quantization, header.step, v);
+    header.planeBytes[0] = u.size();
+    header.planeBytes[1] = v.size();
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+    {
+        Logger::error << function << ": unable to create " << filename << std::endl;
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+        (u.empty() || fwrite(&u[0], 1, u.size(), file) == u.size()) &&
+        (v.empty() || fwrite(&v[0], 1, v.size(), file) == v.size());
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok)
+        Logger::error << function << ": unable to write " << filename << std::endl;
+    else
+        Logger::debug << function << ": " << filename << ": " << (sizeof(Header) + u.size() + v.size())
+            << " bytes for " << header.width << "x" << header.height << " flow" << std::endl;
+    return ok;
+}
+
+void FlowCodec::EncodePlane(const float* flow, unsigned int component,
+    unsigned int width, unsigned int height,
+    Quantization quantization, double step,
+    std::vector< unsigned char >& data)
+{
+    std::vector< int > rows(2 * width);
+    int* row = &rows[0];
+    int* above = &rows[width];
+    RiceContext contexts[CONTEXT_COUNT];
+    BitWriter bits(data);
+
+    const float* in = flow + component;
+    for (unsigned int y = 0; y < height; y++)
+    {
+        for (unsigned int x = 0; x < width; x++, in += 2)
+            row[x] = Quantize(*in, quantization, step);
+
+        for (unsigned int x = 0; x < width; x++)
+        {
+            int a, b, c;
+            Neighbours(row, y > 0 ? above : NULL, x, a, b, c);
+            int residual = row[x] - Predict(a, b, c);
+            unsigned int value = residual >= 0 ?
+                ((unsigned int) residual << 1) : (((unsigned int) -residual << 1) - 1);
+
+            RiceContext& context = contexts[Context(a, b, c)];
+            unsigned int k = context.K();
+            unsigned int quotient = value >> k;
+            if (quotient < RICE_LIMIT)
+            {
+                bits.Put((1u << quotient) - 1, quotient + 1);   // quotient ones, then a zero
+                if (k > 0)
+                    bits.Put(value & ((1u << k) - 1), k);
+            }
+            else
+            {
+                bits.Put((1u << RICE_LIMIT) - 1, RICE_LIMIT);
+                bits.Put(value, 32);
+            }
+            context.Update(value);
+        }
+
+        std::swap(row, above);
+    }
+
+    bits.Flush();
+}
+
+bool FlowCodec::DecodePlane(const unsigned char* data, unsigned int bytes,
+    unsigned int component, unsigned int width, unsigned int height,
+    Quantization quantization, double step, float* flow)
+{
+    std::vector< int > rows(2 * width);
+    int* row = &rows[0];
+    int* above = &rows[width];
+    RiceContext contexts[CONTEXT_COUNT];
+    BitReader bits(data, bytes);
+
+    float* out = flow + component;
+    for (unsigned int y = 0; y < height; y++)
+    {
+        for (unsigned int x = 0; x < width; x++, out += 2)
+        {
+            int a, b, c;
+            Neighbours(row, y > 0 ? above : NULL, x, a, b, c);
+
+            RiceContext& context = contexts[Context(a, b, c)];
+            unsigned int k = context.K();
+            unsigned int quotient = bits.GetUnary(RICE_LIMIT);
+            unsigned int value;
+            if (quotient < RICE_LIMIT)
+                value = (quotient << k) | (k > 0 ? bits.Get(k) : 0);
+            else
+                value = bits.Get(32);
+            context.Update(value);
+
+            int residual = (value & 1) ? -(int) ((value + 1) >> 1) : (int) (value >> 1);
+            row[x] = Predict(a, b, c) + residual;
+            *out = Dequantize(row[x], quantization, step);
+        }
+
+        if (bits.Overrun())
+            return false;
+        std::swap(row, above);
+    }
+
+    return true;
+}
+
+bool FlowCodec::IsFlowFile(const std::string& filename)
+{
+    std::string::size_type dot = filename.rfind('.');
+    return dot != std::string::npos && filename.substr(dot) == ".itf";
+}
+
+FlowCodec::Quantization FlowCodec::GetDefaultQuantization()
+{
+    const char* quantization = getenv("IT_FLOW_QUANTIZATION");
+    if (quantization && std::string(quantization) == "half")
+        return HalfFloat;
+    return FixedPoint;
+}
+
+double FlowCodec::GetDefaultErrorBound()
+{
+    const char* bound = getenv("IT_FLOW_ERROR_BOUND");
+    if (bound)
+    {
+        double value = strtod(bound, NULL);
+        if (value > 0)
+            return value;
+    }
+    return 1.0 / 256.0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * \class FlowCodec
+ * \brief Compact storage for dense 2D flow fields.
+ *
+ * A flow field stored as itk::Vector< float, 2 > pixels costs 8 bytes
+ * per pixel per frame, far more precision than optical flow has.  A flow
+ * file (extension .itf) stores a field in a few bits per component:
+ *
+ *   - Quantization.  FixedPoint rounds each component to a multiple of
+ *     Step, so no value is off by more than Step / 2 pixels (values
+ *     beyond 2^30 steps are clamped).  HalfFloat rounds to IEEE half
+ *     precision, a relative error of at most 2^-11.
+ *   - Planar layout.  All u components are stored, then all v
+ *     components, so each plane is a smooth scalar field.
+ *   - Prediction.  Each quantized value is predicted from its left,
+ *     upper and upper-left neighbours with the median edge detector of
+ *     LOCO-I / JPEG-LS, and only the residual is kept.
+ *   - Entropy coding.  Residuals are Rice coded with a parameter adapted
+ *     per context, where the context is the local gradient activity.
+ *
+ * Decoding undoes the entropy coding and prediction exactly; the only
+ * loss is the quantization.  The file is a fixed Header followed by the
+ * u and v planes, in native byte order.
+ *
+ * FlowImageIO makes .itf files readable and writable through ITK, so
+ * WriteImage(), ReadImage() and the sequence readers handle them like
+ * any other image file.
+ */
+class FlowCodec
+{
+public:
+    enum Quantization
+    {
+        FixedPoint = 1,
+        HalfFloat = 2
+    };
+
+    /**
+     * The on-disk header.
+     */
+    struct Header
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int quantization;
+        unsigned int width;
+        unsigned int height;
+        unsigned int planeBytes[2];
+        double step;
+        double spacing[2];
+        double origin[2];
+    };
+
+    /**
+     * Fill in a header for a width x height flow field.  With FixedPoint
+     * quantization, errorBound is the largest error allowed in either
+     * component; it is ignored for HalfFloat.
+     */
+    static void InitHeader(Header& header, unsigned int width, unsigned int height,
+        Quantization quantization, double errorBound);
+
+    /**
+     * Read just the header of a flow file.  Returns false (and logs why)
+     * if the file cannot be read or is not a flow file.
+     */
+    static bool ReadHeader(const std::string& filename, Header& header);
+
+    /**
+     * Read a flow file into flow, which must hold 2 * width * height
+     * floats (interleaved u, v, as in an itk::Vector< float, 2 > image).
+     */
+    static bool Read(const std::string& filename, Header& header, float* flow);
+
+    /**
+     * Encode flow (interleaved u, v) and write it to filename.  The
+     * header's width, height, quantization and step must be set; the
+     * plane sizes are filled in.
+     */
+    static bool Write(const std::string& filename, Header& header, const float* flow);
+
+    /**
+     * Encode one component (0 for u, 1 for v) of an interleaved flow
+     * field, appending the coded plane to data.
+     */
+    static void EncodePlane(const float* flow, unsigned int component,
+        unsigned int width, unsigned int height,
+        Quantization quantization, double step,
+        std::vector< unsigned char >& data);
+
+    /**
+     * Decode one plane into the given component of an interleaved flow
+     * field.  Returns false if the coded plane is truncated or corrupt.
+     */
+    static bool DecodePlane(const unsigned char* data, unsigned int bytes,
+        unsigned int component, unsigned int width, unsigned int height,
+        Quantization quantization, double step, float* flow);
+
+    /**
+     * True if the file name has the flow file extension.
+     */
+    static bool IsFlowFile(const std::string& filename);
+
+    /**
+     * The quantization and error bound used when the writer has not been
+     * told otherwise: FixedPoint with an error bound of 1/256 pixel.  The
+     * environment variable IT_FLOW_QUANTIZATION (fixed or half) and
+     * IT_FLOW_ERROR_BOUND (in pixels) override these.
+     */
+    static Quantization GetDefaultQuantization();
+    static double GetDefaultErrorBound();
+};
@@ -0,0 +1,133 @@
+#include "FlowImageIO.h"
+
+#include "itkCreateObjectFunction.h"
+#include "itkVersion.h"
+
+#include "Mutex.h"
+#include "MutexLocker.h"
+
+FlowImageIO::FlowImageIO() :
+    m_Quantization(FlowCodec::GetDefaultQuantization()),
+    m_ErrorBound(FlowCodec::GetDefaultErrorBound())
+{
+    this->SetNumberOfDimensions(2);
+    this->SetPixelType(VECTOR);
+    this->SetComponentType(FLOAT);
+    this->SetNumberOfComponents(2);
+}
+
+FlowImageIO::~FlowImageIO()
+{
+}
+
+bool FlowImageIO::CanReadFile(const char* filename)
+{
+    // Every registered image IO is asked about every file; only look
+    // inside files with our extension
+    FlowCodec::Header header;
+    return FlowCodec::IsFlowFile(filename) &&
+        FlowCodec::ReadHeader(filename, header);
+}
+
+void FlowImageIO::ReadImageInformation()
+{
+    FlowCodec::Header header;
+    if (!FlowCodec::ReadHeader(this->GetFileName(), header))
+    {
+        itkExceptionMacro(<< "Unable to read flow file header from " << this->GetFileName());
+    }
+
+    this->SetNumberOfDimensions(2);
+    this->SetPixelType(VECTOR);
+    this->SetComponentType(FLOAT);
+    this->SetNumberOfComponents(2);
+    for (unsigned int d = 0; d < 2; d++)
+    {
+        this->SetDimensions(d, d == 0 ? header.width : header.height);
+        this->SetSpacing(d, header.spacing[d]);
+        this->SetOrigin(d, header.origin[d]);
+    }
+}
+
+void FlowImageIO::Read(void* buffer)
+{
+    FlowCodec::Header header;
+    if (!FlowCodec::Read(this->GetFileName(), header, static_cast< float* >(buffer)))
+    {
+        itkExceptionMacro(<< "Unable to read flow file " << this->GetFileName());
+    }
+}
+
+bool FlowImageIO::CanWriteFile(const char* filename)
+{
+    return FlowCodec::IsFlowFile(filename);
+}
+
+void FlowImageIO::WriteImageInformation()
+{
+    // The header is written with the pixels
+}
+
+void FlowImageIO::Write(const void* buffer)
+{
+    if (this->GetNumberOfDimensions() != 2 ||
+        this->GetComponentType() != FLOAT ||
+        this->GetNumberOfComponents() != 2)
+    {
+        itkExceptionMacro(<< this->GetFileName() << ": flow files hold only 2D images of itk::Vector< float, 2 > pixels");
+    }
+
+    FlowCodec::Header header;
+    FlowCodec::InitHeader(header, this->GetDimensions(0), this->GetDimensions(1),
+        this->m_Quantization, this->m_ErrorBound);
+    for (unsigned int d = 0; d < 2; d++)
+    {
+        header.spacing[d] = this->GetSpacing(d);
+        header.origin[d] = this->GetOrigin(d);
+    }
+
+    if (!FlowCodec::Write(this->GetFileName(), header, static_cast< const float* >(buffer)))
+    {
+        itkExceptionMacro(<< "Unable to write flow file " << this->GetFileName());
+    }
+}
+
+void FlowImageIO::PrintSelf(std::ostream& os, itk::Indent indent) const
+{
+    Superclass::PrintSelf(os, indent);
+    os << indent << "Quantization: " << (this->m_Quantization == FlowCodec::HalfFloat ? "half float" : "fixed point") << std::endl;
+    os << indent << "ErrorBound: " << this->m_ErrorBound << std::endl;
+}
+
+FlowImageIOFactory::FlowImageIOFactory()
+{
+    this->RegisterOverride("itkImageIOBase", "FlowImageIO", "ImageTracker flow file IO", 1,
+        itk::CreateObjectFunction< FlowImageIO >::New());
+}
+
+const char* FlowImageIOFactory::GetITKSourceVersion() const
+{
+    return ITK_SOURCE_VERSION;
+}
+
+const char* FlowImageIOFactory::GetDescription() const
+{
+    return "ImageTracker flow file (.itf) ImageIO factory";
+}
+
+namespace
+{
+    Mutex registerMutex;
+    bool registered = false;
+}
+
+void RegisterFlowImageIO()
+{
+    MutexLocker lock(registerMutex);
+    if (!registered)
+    {
+        FlowImageIOFactory::Pointer factory = FlowImageIOFactory::New();
+        itk::ObjectFactoryBase::RegisterFactory(factory);
+        registered = true;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "itkImageIOBase.h"
+#include "itkObjectFactoryBase.h"
+
+#include "FlowCodec.h"
+
+/**
+ * \class FlowImageIO
+ * \brief Reads and writes FlowCodec flow files (.itf) through ITK.
+ *
+ * Only 2D images of itk::Vector< float, 2 > pixels can be written.  The
+ * quantization and error bound used for writing default to
+ * FlowCodec::GetDefaultQuantization() and GetDefaultErrorBound().
+ */
+class FlowImageIO :
+    public itk::ImageIOBase
+{
+public:
+    typedef FlowImageIO Self;
+    typedef itk::ImageIOBase Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+    itkNewMacro(Self);
+    itkTypeMacro(FlowImageIO, ImageIOBase);
+
+    /**
+     * Get/Set how written flow fields are quantized, and the largest
+     * error allowed in a component for FixedPoint quantization.
+     */
+    itkGetMacro(Quantization, FlowCodec::Quantization);
+    itkSetMacro(Quantization, FlowCodec::Quantization);
+    itkGetMacro(ErrorBound, double);
+    itkSetMacro(ErrorBound, double);
+
+    virtual bool CanReadFile(const char* filename);
+    virtual void ReadImageInformation();
+    virtual void Read(void* buffer);
+
+    virtual bool CanWriteFile(const char* filename);
+    virtual void WriteImageInformation();
+    virtual void Write(const void* buffer);
+
+protected:
+    FlowImageIO();
+    virtual ~FlowImageIO();
+    void PrintSelf(std::ostream& os, itk::Indent indent) const;
+
+private:
+    // not implemented
+    FlowImageIO(const Self& other);
+    void operator=(const Self& other);
+
+    FlowCodec::Quantization m_Quantization;
+    double m_ErrorBound;
+};
+
+/**
+ * \class FlowImageIOFactory
+ * \brief Creates FlowImageIO objects for the ITK image IO factory.
+ */
+class FlowImageIOFactory :
+    public itk::ObjectFactoryBase
+{
+public:
+    typedef FlowImageIOFactory Self;
+    typedef itk::ObjectFactoryBase Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+    itkFactorylessNewMacro(Self);
+    itkTypeMacro(FlowImageIOFactory, ObjectFactoryBase);
+
+    virtual const char* GetITKSourceVersion() const;
+    virtual const char* GetDescription() const;
+
+protected:
+    FlowImageIOFactory();
+    virtual ~FlowImageIOFactory() {}
+
+private:
+    // not implemented
+    FlowImageIOFactory(const Self& other);
+    void operator=(const Self& other);
+};
+
+/**
+ * Make the image file formats ImageTracker adds to ITK (flow files,
+ * .itf) available to ITK's image readers and writers.  ReadImage and
+ * WriteImage (ImageUtils.h) do this for you; call it before using an
+ * itk::ImageFileReader or itk::ImageFileWriter directly.  Safe to call
+ * any number of times, from any thread.
+ */
+void RegisterFlowImageIO();
@@ -0,0 +1,199 @@
+#include "FrameCache.h"
+
+#include <cstdlib>
+
+#include "FileUtils.h"
+
+namespace
+{
+    // Construction of a method-static is not guaranteed to be
+    // thread-safe, so build the cache while the program is still single
+    // threaded.  Readers initialized statically elsewhere still get a
+    // constructed cache, as Instance() builds it on their first call.
+    FrameCache& s_constructed = FrameCache::Instance();
+}
+
+FrameCache& FrameCache::Instance()
+{
+    static FrameCache s_instance;
+    return s_instance;
+}
+
+FrameCache::FrameCache() :
+    entries(),
+    usage(),
+    budget(512ul * 1024ul * 1024ul),
+    resident(0),
+    hitCount(0),
+    missCount(0),
+    evictionCount(0)
+{
+    const char* megabytes = getenv("IT_FRAME_CACHE_MB");
+    if (megabytes)
+    {
+        this->budget = strtoul(megabytes, NULL, 10) * 1024ul * 1024ul;
+    }
+}
+
+FrameCache::~FrameCache()
+{
+}
+
+itk::DataObject::Pointer FrameCache::Find(const std::string& file, const std::string& pixelType, const std::string& region)
+{
+    Key key;
+    key.file = file;
+    key.pixelType = pixelType;
+    key.region = region;
+
+    MutexLocker lock(this->mutex);
+    EntryMap::iterator it = this->entries.find(key);
+    if (it == this->entries.end())
+    {
+        this->missCount++;
+        return NULL;
+    }
+
+    // A frame whose file has been rewritten since it was read is stale
+    long time, size;
+    if (!FileStamp(file, time, size) ||
+        time != it->second.fileTime ||
+        size != it->second.fileSize)
+    {
+        Logger::verbose << "FrameCache::Find: " << file << " changed on disk" << std::endl;
+        this->Erase(it);
+        this->missCount++;
+        return NULL;
+    }
+
+    // Move this frame to the front of the usage list
+    this->usage.splice(this->usage.begin(), this->usage, it->second.usage);
+    this->hitCount++;
+    return it->second.frame;
+}
+
+void FrameCache::Insert(const std::string& file, const std::string& pixelType, const std::string& region,
+    itk::DataObject* frame, unsigned long bytes)
+{
+    Key key;
+    key.file = file;
+    key.pixelType = pixelType;
+    key.region = region;
+
+    long time, size;
+    if (!frame || !FileStamp(file, time, size))
+        return;
+
+    MutexLocker lock(this->mutex);
+    if (bytes > this->budget)
+        return;
+
+    // Another reader may have beaten us to this frame
+    EntryMap::iterator it = this->entries.find(key);
+    if (it != this->entries.end())
+        this->Erase(it);
+
+    this->Shrink(this->budget - bytes);
+
+    this->usage.push_front(key);
+    Entry& entry = this->entries[key];
+    entry.frame = frame;
+    entry.bytes = bytes;
+    entry.fileTime = time;
+    entry.fileSize = size;
+    entry.usage = this->usage.begin();
+    this->resident += bytes;
+}
+
+void FrameCache::Remove(const std::string& file)
+{
+    MutexLocker lock(this->mutex);
+    EntryMap::iterator it = this->entries.begin();
+    while (it != this->entries.end())
+    {
+        if (it->first.file == file)
+            this->Erase(it++);
+        else
+            ++it;
+    }
+}
+
+void FrameCache::Clear()
+{
+    MutexLocker lock(this->mutex);
+    this->entries.clear();
+    this->usage.clear();
+    this->resident = 0;
+}
+
+unsigned long FrameCache::GetMemoryBudget()
+{
+    MutexLocker lock(this->mutex);
+    return this->budget;
+}
+
+void FrameCache::SetMemoryBudget(unsigned long bytes)
+{
+    MutexLocker lock(this->mutex);
+    this->budget = bytes;
+    this->Shrink(bytes);
+}
+
+unsigned long FrameCache::GetResidentBytes()
+{
+    MutexLocker lock(this->mutex);
+    return this->resident;
+}
+
+unsigned int FrameCache::GetFrameCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->entries.size();
+}
+
+unsigned long FrameCache::GetHitCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->hitCount;
+}
+
+unsigned long FrameCache::GetMissCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->missCount;
+}
+
+unsigned long FrameCache::GetEvictionCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->evictionCount;
+}
+
+void FrameCache::LogStatistics()
+{
+    MutexLocker lock(this->mutex);
+    Logger::info << "FrameCache statistics" << std::endl;
+    Logger::info << "\tFrames:   \t" << this->entries.size() << std::endl;
+    Logger::info << "\tResident: \t" << this->resident << " / " << this->budget << " bytes" << std::endl;
+    Logger::info << "\tHits:     \t" << this->hitCount << std::endl;
+    Logger::info << "\tMisses:   \t" << this->missCount << std::endl;
+    Logger::info << "\tEvictions:\t" << this->evictionCount << std::endl;
+}
+
+void FrameCache::Shrink(unsigned long bytes)
+{
+    while (this->resident > bytes && !this->usage.empty())
+    {
+        this->Erase(this->entries.find(this->usage.back()));
+        this->evictionCount++;
+    }
+}
+
+void FrameCache::Erase(EntryMap::iterator it)
+{
+    // Frames still referenced by a reader or pipeline stay alive until
+    // they are released there; we only stop accounting for them.
+    this->resident -= it->second.bytes;
+    this->usage.erase(it->second.usage);
+    this->entries.erase(it);
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <typeinfo>
+
+#include "itkCastImageFilter.h"
+#include "itkDataObject.h"
+
+#include "ImageUtils.h"
+#include "Logger.h"
+#include "Mutex.h"
+#include "MutexLocker.h"
+
+/**
+ * \class FrameCache
+ * \brief Process-wide, byte-budgeted cache of decoded image frames.
+ *
+ * Every reader of image sequences in ImageTracker (ImageSetReader,
+ * ImageFileSetReader, VectorFileSetReader, and so DataSource) looks up
+ * frames here before decoding them, so the same frame is decoded only
+ * once no matter how many readers and pipelines ask for it.  Frames are
+ * keyed by file name, pixel type, and region (empty for the whole image).
+ * Frames are held in the pixel type they were decoded as, usually the
+ * type on disk; readers that hand out float images widen the cached
+ * frame when it is requested, so a cached 8-bit frame costs a quarter of
+ * the memory of its float conversion.  When the bytes held exceed the
+ * memory budget, the least recently used frames are released.
+ *
+ * A cached entry is dropped when the file on disk changes size or
+ * modification time, so that results rewritten by a pipeline are read
+ * again.
+ *
+ * Cached frames are shared: treat them as read-only.  Filters that run
+ * in place must be given a copy, or have InPlaceOff().  (The output of
+ * CachedImageFileReader is already a copy.)
+ *
+ * The singleton implementation is method-static, as in
+ * ImageTrackerController.  FrameCache.cxx also calls Instance() during
+ * static initialization, so the cache is built before main() can start
+ * any reader threads, and Instance() may then be called from any thread.
+ */
+class FrameCache
+{
+public:
+    /**
+     * Obtain the singleton instance of this FrameCache.
+     */
+    static FrameCache& Instance();
+
+    /**
+     * Look up a frame.  Returns NULL if the frame is not cached.
+     */
+    itk::DataObject::Pointer Find(const std::string& file, const std::string& pixelType, const std::string& region = "");
+
+    /**
+     * Add a frame occupying the given number of bytes.  Frames larger
+     * than the whole memory budget are not cached.
+     */
+    void Insert(const std::string& file, const std::string& pixelType, const std::string& region,
+        itk::DataObject* frame, unsigned long bytes);
+
+    /**
+     * Drop every frame read from the given file.
+     */
+    void Remove(const std::string& file);
+
+    /**
+     * Drop every frame.
+     */
+    void Clear();
+
+    /**
+     * Get/Set the number of bytes this cache may hold.  The default is
+     * 512MB, or IT_FRAME_CACHE_MB megabytes if that environment variable
+     * is set.  A budget of zero disables caching.
+     */
+    unsigned long GetMemoryBudget();
+    void SetMemoryBudget(unsigned long bytes);
+
+    /**
+     * Cache statistics.
+     */
+    unsigned long GetResidentBytes();
+    unsigned int GetFrameCount();
+    unsigned long GetHitCount();
+    unsigned long GetMissCount();
+    unsigned long GetEvictionCount();
+
+    /**
+     * Log cache statistics.
+     */
+    void LogStatistics();
+
+    /**
+     * The pixel type key for frames decoded as TImage.
+     */
+    template < class TImage >
+    static std::string PixelTypeKey()
+    {
+        return typeid(TImage).name();
+    }
+
+    /**
+     * The region key for frames holding only part of an image: the
+     * region's index and size, e.g. "10,20+64x48".
+     */
+    template < class TRegion >
+    static std::string RegionKey(const TRegion& region)
+    {
+        itk::OStringStream key;
+        for (unsigned int d = 0; d < TRegion::GetImageDimension(); d++)
+            key << (d > 0 ? "," : "") << region.GetIndex()[d];
+        key << "+";
+        for (unsigned int d = 0; d < TRegion::GetImageDimension(); d++)
+            key << (d > 0 ? "x" : "") << region.GetSize()[d];
+        return key.str();
+    }
+
+    /**
+     * The number of bytes held in an image's pixel buffer.
+     */
+    template < class TImage >
+    static unsigned long ImageBytes(const TImage* image)
+    {
+        return image->GetBufferedRegion().GetNumberOfPixels() * sizeof(typename TImage::PixelType);
+    }
+
+private:
+    FrameCache();
+    ~FrameCache();
+
+    // not implemented
+    FrameCache(const FrameCache& other);
+    void operator=(const FrameCache& other);
+
+    struct Key
+    {
+        std::string file;
+        std::string pixelType;
+        std::string region;
+
+        bool operator<(const Key& other) const
+        {
+            if (this->file != other.file)
+                return this->file < other.file;
+            if (this->pixelType != other.pixelType)
+                return this->pixelType < other.pixelType;
+            return this->region < other.region;
+        }
+    };
+
+    typedef std::list< Key > UsageList;
+
+    struct Entry
+    {
+        itk::DataObject::Pointer frame;
+        unsigned long bytes;
+        long fileTime;
+        long fileSize;
+        UsageList::iterator usage;
+    };
+
+    typedef std::map< Key, Entry > EntryMap;
+
+    /**
+     * Drop least recently used frames until the cache fits in the given
+     * number of bytes.  Call with the lock held.
+     */
+    void Shrink(unsigned long bytes);
+
+    /**
+     * Drop one entry.  Call with the lock held.
+     */
+    void Erase(EntryMap::iterator it);
+
+    EntryMap entries;
+    UsageList usage;        // most recently used at the front
+
+    unsigned long budget;
+    unsigned long resident;
+    unsigned long hitCount;
+    unsigned long missCount;
+    unsigned long evictionCount;
+
+    Mutex mutex;
+};
+
+/**
+ * Converts a frame decoded as TInputImage to TOutputImage.  Frames
+ * that need no conversion are passed through untouched; integer frames
+ * are widened to float with WidenImage.
+ */
+template < class TInputImage, class TOutputImage >
+struct FrameConverter
+{
+    static typename TOutputImage::Pointer Convert(TInputImage* input)
+    {
+        typedef itk::CastImageFilter< TInputImage, TOutputImage > CastType;
+        typename CastType::Pointer cast = CastType::New();
+        cast->SetInput(input);
+        cast->Update();
+        typename TOutputImage::Pointer output = cast->GetOutput();
+        output->DisconnectPipeline();
+        return output;
+    }
+};
+
+template < class TImage >
+struct FrameConverter< TImage, TImage >
+{
+    static typename TImage::Pointer Convert(TImage* input)
+    {
+        return input;
+    }
+};
+
+template < unsigned int VDimension >
+struct FrameConverter< itk::Image< unsigned char, VDimension >, itk::Image< float, VDimension > >
+{
+    typedef itk::Image< unsigned char, VDimension > InputImageType;
+    typedef itk::Image< float, VDimension > OutputImageType;
+    static typename OutputImageType::Pointer Convert(InputImageType* input)
+    {
+        return WidenImage< InputImageType, OutputImageType >(input);
+    }
+};
+
+template < unsigned int VDimension >
+struct FrameConverter< itk::Image< unsigned short, VDimension >, itk::Image< float, VDimension > >
+{
+    typedef itk::Image< unsigned short, VDimension > InputImageType;
+    typedef itk::Image< float, VDimension > OutputImageType;
+    static typename OutputImageType::Pointer Convert(InputImageType* input)
+    {
+        return WidenImage< InputImageType, OutputImageType >(input);
+    }
+};
+
+/**
+ * Read an image from disk through the shared FrameCache, in the pixel
+ * type it is decoded as.  The returned image may be shared with other
+ * readers; do not modify it.  If decoded is given, it is set to whether
+ * the file had to be decoded.
+ */
+template < class TImage >
+typename TImage::Pointer ReadCachedImage(const std::string& filename, bool* decoded = NULL)
+{
+    FrameCache& cache = FrameCache::Instance();
+    std::string pixelType = FrameCache::PixelTypeKey< TImage >();
+
+    itk::DataObject::Pointer cached = cache.Find(filename, pixelType);
+    TImage* frame = dynamic_cast< TImage* >(cached.GetPointer());
+    if (decoded)
+        *decoded = (frame == NULL);
+    if (frame)
+        return frame;
+
+    typename TImage::Pointer image = ReadImage< TImage >(filename);
+    image->DisconnectPipeline();
+    cache.Insert(filename, pixelType, "", image, FrameCache::ImageBytes(image.GetPointer()));
+    return image;
+}
+
+/**
+ * Read an image through the shared FrameCache, decoding the file as
+ * TInputImage and converting it to TOutputImage.  Only the decoded frame
+ * is cached; the conversion is made on every call.  When no conversion
+ * is needed the returned image is the shared cached frame.
+ */
+template < class TInputImage, class TOutputImage >
+typename TOutputImage::Pointer ReadCachedImage(const std::string& filename, bool* decoded = NULL)
+{
+    typename TInputImage::Pointer frame = ReadCachedImage< TInputImage >(filename, decoded);
+    return FrameConverter< TInputImage, TOutputImage >::Convert(frame);
+}
+
+/**
+ * Read part of an image through the shared FrameCache, in the pixel type
+ * it is decoded as.  The returned image holds just the given region
+ * (cropped to the image bounds), starting at index zero with its origin
+ * at the region's first pixel, as from ReadImageRegion().  Regions are
+ * cached separately from whole frames and from each other, keyed by
+ * RegionKey(); when the whole frame is already cached the region is cut
+ * from it rather than read from disk.  The returned image may be shared
+ * with other readers; do not modify it.  If decoded is given, it is set
+ * to whether the file had to be decoded.
+ */
+template < class TImage >
+typename TImage::Pointer ReadCachedImage(const std::string& filename, const typename TImage::RegionType& region,
+    bool* decoded = NULL)
+{
+    FrameCache& cache = FrameCache::Instance();
+    std::string pixelType = FrameCache::PixelTypeKey< TImage >();
+    std::string regionKey = FrameCache::RegionKey(region);
+
+    itk::DataObject::Pointer cached = cache.Find(filename, pixelType, regionKey);
+    TImage* frame = dynamic_cast< TImage* >(cached.GetPointer());
+    if (decoded)
+        *decoded = false;
+    if (frame)
+        return frame;
+
+    typename TImage::Pointer image;
+    cached = cache.Find(filename, pixelType);
+    TImage* whole = dynamic_cast< TImage* >(cached.GetPointer());
+    if (whole)
+    {
+        typename TImage::RegionType crop(region);
+        if (!crop.Crop(whole->GetLargestPossibleRegion()))
+        {
+            itk::OStringStream message;
+            message << "ReadCachedImage: the requested region lies outside " << filename;
+            throw itk::ExceptionObject(__FILE__, __LINE__, message.str().c_str(), "ReadCachedImage");
+        }
+        image = ExtractImageRegion< TImage >(whole, crop);
+    }
+    else
+    {
+        image = ReadImageRegion< TImage >(filename, region);
+        if (decoded)
+            *decoded = true;
+    }
+    cache.Insert(filename, pixelType, regionKey, image, FrameCache::ImageBytes(image.GetPointer()));
+    return image;
+}
@@ -2,6 +2,8 @@
 
 #include "itkImage.h"
 
+#include "ReaderTelemetry.h"
+
 /**
  * \class ImageFileSet
  * \brief Provides access to a set of image files.
@@ -52,5 +54,11 @@ public:
     /**
      * Get the number of images in this ImageFileSet.
      */
-    virtual int GetImageCount() = 0;
+    virtual int GetImageCount() = 0;    
+    /**
+     * A snapshot of the telemetry of the reads behind this ImageFileSet; see
+     * ReaderTelemetry.  Sets that keep none return empty telemetry.
+     */
+    virtual ReaderTelemetry GetTelemetry()
+    { return ReaderTelemetry(); }
 };
@@ -3,22 +3,21 @@
 #include <algorithm>
 #include <string>
 
+#include "itkRealTimeClock.h"
+
+#include "FrameCache.h"
+#include "ImageStackUtils.h"
+#include "ImageUtils.h"
 #include "Logger.h"
 
 ImageFileSetReader::ImageFileSetReader()
-    : pixelType(FloatPixel), files(), index(0)
+    : stack(NULL), pixelType(FloatPixel), files(), index(0)
 {
-    this->readerUC2 = ReaderTypeUC2::New();
-    this->readerUS2 = ReaderTypeUS2::New();
-    this->readerF2 = ReaderTypeF2::New();
-    
-    this->casterUC2 = CasterTypeUC2::New();
-    this->casterUS2 = CasterTypeUS2::New();
-    this->casterF2 = CasterTypeF2::New();
-    
-    this->casterUC2->SetInput(this->readerUC2->GetOutput());
-    this->casterUS2->SetInput(this->readerUS2->GetOutput());
-    this->casterF2->SetInput(this->readerF2->GetOutput());
+    this->stackOutput = ImageType::New();
+
+    this->readerUC2 = CachedReaderTypeUC2::New();
+    this->readerUS2 = CachedReaderTypeUS2::New();
+    this->readerF2 = CachedReaderTypeF2::New();
 }
 
 ImageFileSetReader::~ImageFileSetReader()
@@ -28,6 +27,8 @@ ImageFileSetReader::~ImageFileSetReader()
 void ImageFileSetReader::SetFileSet(const FileSet& files)
 {
     this->files = files;
+    this->telemetry.Reset();
+    this->stack = ImageStack::OpenFileSet(files);
     
     // prime the current reader
     this->SetImageIndex(this->index);
@@ -52,10 +53,14 @@ void ImageFileSetReader::SetImageIndex(unsigned int idx)
 //     Logger::verbose << function << ": " << idx << std::endl;
     
     // ensure index is between 0 and size - 1.
-    this->index = std::min((int) idx, (int) this->files.size()-1);
+    this->index = std::min((int) idx, this->GetImageCount()-1);
     this->index = std::max((int) this->index, 0);
     
-    if (this->files.size() > 0)
+    if (this->stack)
+    {
+        this->UpdateStackOutput();
+    }
+    else if (this->files.size() > 0)
     {
         if (this->pixelType == CharPixel)
             this->readerUC2->SetFileName(this->files[this->index].c_str());
@@ -73,7 +78,7 @@ unsigned int ImageFileSetReader::GetImageIndex()
 
 int ImageFileSetReader::GetImageCount()
 {
-    return this->files.size();
+    return this->stack ? this->stack->GetFrameCount() : this->files.size();
 }
 
 ImageFileSet::ImageType* ImageFileSetReader::GetOutput()
@@ -81,16 +86,62 @@ ImageFileSet::ImageType* ImageFileSetReader::GetOutput()
 //     std::string function("ImageFileSetReader::GetOutput");
 //     Logger::verbose << function << ": " << this->index << std::endl;
 
-    if (this->pixelType == CharPixel)
-        return this->casterUC2->GetOutput();
+    if (this->stack)
+        return this->stackOutput;
+    else if (this->pixelType == CharPixel)
+        return this->readerUC2->GetOutput();
     else if (this->pixelType == ShortPixel)
-        return this->casterUS2->GetOutput();
+        return this->readerUS2->GetOutput();
     else
-        return this->casterF2->GetOutput();
+        return this->readerF2->GetOutput();
 }
 
 ImageFileSet::ImageType* ImageFileSetReader::GetImage(unsigned int idx)
 {
+    // The current frame is already loaded
+    unsigned int previous = this->index;
     this->SetImageIndex(idx);
+    this->telemetry.RecordRequest(this->index == previous);
     return this->GetOutput();
 }
+
+ReaderTelemetry ImageFileSetReader::GetTelemetry()
+{
+    ReaderTelemetry snapshot(this->telemetry);
+    snapshot.Merge(this->readerUC2->GetTelemetry());
+    snapshot.Merge(this->readerUS2->GetTelemetry());
+    snapshot.Merge(this->readerF2->GetTelemetry());
+    snapshot.SetResidentBytes(FrameCache::ImageBytes(this->GetOutput()), FrameCache::Instance().GetResidentBytes());
+    return snapshot;
+}
+
+void ImageFileSetReader::UpdateStackOutput()
+{
+    std::string function("ImageFileSetReader::UpdateStackOutput");
+    if (this->stack->GetFrameCount() == 0)
+        return;
+    
+    // Float frames are used in place; integer frames are widened
+    itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+    double start = clock->GetTimeStamp();
+    ImageType::Pointer frame;
+    switch (this->stack->GetPixelType())
+    {
+        case ImageStack::CharFrame:
+            frame = WidenImage<ImageTypeUC2, ImageType>(ReadStackFrame<ImageTypeUC2>(this->stack, this->index));
+            break;
+        case ImageStack::ShortFrame:
+            frame = WidenImage<ImageTypeUS2, ImageType>(ReadStackFrame<ImageTypeUS2>(this->stack, this->index));
+            break;
+        case ImageStack::FloatFrame:
+            frame = ReadStackFrame<ImageType>(this->stack, this->index);
+            break;
+        default:
+            Logger::error << function << ": " << this->stack->GetFileName() << " does not hold scalar images" << std::endl;
+            return;
+    }
+    
+    this->stackOutput->Graft(frame);
+    this->stackOutput->Modified();
+    this->telemetry.RecordLoad(false, clock->GetTimeStamp() - start, FrameCache::ImageBytes(frame.GetPointer()));
+}
@@ -2,9 +2,11 @@
 
 #include "itkLightObject.h"
 
+#include "CachedImageFileReader.h"
 #include "FileSet.h"
 #include "ImageFileSet.h"
 #include "ImageFileSetTypes.h"
+#include "ImageStack.h"
 
 /**
  * \class ImageFileSetReader
@@ -15,6 +17,13 @@
  * casting pipelines for each type.  Setting the PixelType for this
  * ImageFileReader switches among these pipelines.  The output image
  * is always ImageFileSet::ImageType.
+ *
+ * Frames are read through the shared FrameCache, so stepping back and
+ * forth through a sequence (or viewing the same files in several
+ * places) decodes each frame once.
+ *
+ * A FileSet holding a single image stack (.its) file is read as the
+ * frames inside the stack, in whatever pixel type the stack holds.
  */
 class ImageFileSetReader
     : public itk::LightObject, 
@@ -27,6 +36,10 @@ public:
     typedef itk::SmartPointer<const Self> ConstPointer;
     itkNewMacro(Self);
     
+    typedef CachedImageFileReader< ImageTypeUC2, ImageType > CachedReaderTypeUC2;
+    typedef CachedImageFileReader< ImageTypeUS2, ImageType > CachedReaderTypeUS2;
+    typedef CachedImageFileReader< ImageTypeF2, ImageType > CachedReaderTypeF2;
+    
     /**
      * Set the file names that this ImageFileSet should read
      * if it reads from disk.
@@ -47,6 +60,7 @@ public:
     virtual int GetImageCount();
     virtual ImageFileSet::ImageType* GetOutput();
     virtual ImageFileSet::ImageType* GetImage(unsigned int index);
+    virtual ReaderTelemetry GetTelemetry();
     
 protected:
     ImageFileSetReader();
@@ -57,15 +71,22 @@ private:
     ImageFileSetReader(const Self& other);
     void operator=(const Self& other);
     
-    ReaderTypeUC2::Pointer readerUC2;
-    ReaderTypeUS2::Pointer readerUS2;
-    ReaderTypeF2::Pointer readerF2;
+    /**
+     * Point the stack output at the current stack frame.
+     */
+    void UpdateStackOutput();
     
-    CasterTypeUC2::Pointer casterUC2;
-    CasterTypeUS2::Pointer casterUS2;
-    CasterTypeF2::Pointer casterF2;
+    CachedReaderTypeUC2::Pointer readerUC2;
+    CachedReaderTypeUS2::Pointer readerUS2;
+    CachedReaderTypeF2::Pointer readerF2;
+    
+    ImageStack::Pointer stack;
+    ImageType::Pointer stackOutput;
     
     ScalarPixelType pixelType;
     FileSet files;
     unsigned int index;
+    
+    // Requests and stack frame loads; file loads are in the readers
+    ReaderTelemetry telemetry;
 };
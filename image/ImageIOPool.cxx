@@ -0,0 +1,150 @@
+#include "ImageIOPool.h"
+
+#include <cctype>
+
+#include "itkImageIOFactory.h"
+
+#include "FileUtils.h"
+#include "FlowImageIO.h"
+#include "Logger.h"
+#include "MutexLocker.h"
+
+namespace
+{
+    // Idle ImageIOs kept per format; enough for every worker thread
+    const unsigned int MAX_IDLE = 16;
+
+    // Worker threads acquire ImageIOs concurrently; make sure none of
+    // them is the first caller of Instance().
+    ImageIOPool& s_constructed = ImageIOPool::Instance();
+}
+
+ImageIOPool& ImageIOPool::Instance()
+{
+    static ImageIOPool s_instance;
+    return s_instance;
+}
+
+ImageIOPool::ImageIOPool() :
+    formats(),
+    idle(),
+    detectCount(0),
+    reuseCount(0),
+    createCount(0)
+{
+}
+
+ImageIOPool::~ImageIOPool()
+{
+}
+
+std::string ImageIOPool::SequenceKey(const std::string& filename)
+{
+    std::string extension(ExtensionPart(filename));
+    for (unsigned int i = 0; i < extension.size(); i++)
+        extension[i] = tolower(extension[i]);
+    return DirectoryPart(filename) + "*." + extension;
+}
+
+itk::ImageIOBase::Pointer ImageIOPool::Acquire(const std::string& filename)
+{
+    std::string key(SequenceKey(filename));
+    itk::ImageIOBase::Pointer prototype;
+    itk::ImageIOBase::Pointer io;
+    {
+        MutexLocker lock(this->mutex);
+        std::map< std::string, itk::ImageIOBase::Pointer >::iterator it = this->formats.find(key);
+        if (it != this->formats.end())
+        {
+            prototype = it->second;
+            IOVector& ios = this->idle[prototype->GetNameOfClass()];
+            if (!ios.empty())
+            {
+                io = ios.back();
+                ios.pop_back();
+                this->reuseCount++;
+            }
+        }
+    }
+
+    if (prototype)
+    {
+        if (!io)
+        {
+            io = dynamic_cast< itk::ImageIOBase* >(prototype->CreateAnother().GetPointer());
+            MutexLocker lock(this->mutex);
+            this->createCount++;
+        }
+
+        // The only per-frame check: that the sequence's format reads this file
+        if (io && io->CanReadFile(filename.c_str()))
+            return io;
+
+        Logger::verbose << "ImageIOPool::Acquire: " << filename
+            << " is not in its sequence's format; detecting it again" << std::endl;
+        if (io)
+            this->Release(io);
+    }
+
+    io = this->Detect(filename);
+    if (io)
+    {
+        MutexLocker lock(this->mutex);
+        this->formats[key] = io;
+        this->detectCount++;
+        this->createCount++;
+    }
+    return io;
+}
+
+void ImageIOPool::Release(itk::ImageIOBase* io)
+{
+    if (io == NULL)
+        return;
+
+    MutexLocker lock(this->mutex);
+    IOVector& ios = this->idle[io->GetNameOfClass()];
+    if (ios.size() < MAX_IDLE)
+        ios.push_back(io);
+}
+
+void ImageIOPool::Clear()
+{
+    MutexLocker lock(this->mutex);
+    this->formats.clear();
+    this->idle.clear();
+}
+
+itk::ImageIOBase::Pointer ImageIOPool::Detect(const std::string& filename)
+{
+    RegisterFlowImageIO();
+    return itk::ImageIOFactory::CreateImageIO(filename.c_str(), itk::ImageIOFactory::ReadMode);
+}
+
+unsigned long ImageIOPool::GetDetectCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->detectCount;
+}
+
+unsigned long ImageIOPool::GetReuseCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->reuseCount;
+}
+
+unsigned long ImageIOPool::GetCreateCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->createCount;
+}
+
+void ImageIOPool::LogStatistics()
+{
+    MutexLocker lock(this->mutex);
+    Logger::verbose << "ImageIOPool statistics" << std::endl;
+    Logger::verbose << "\tSequences:\t" << this->formats.size() << std::endl;
+    Logger::verbose << "\tDetected: \t" << this->detectCount << std::endl;
+    Logger::verbose << "\tCreated:  \t" << this->createCount << std::endl;
+    Logger::verbose << "\tReused:   \t" << this->reuseCount << std::endl;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "itkImageIOBase.h"
+
+#include "Mutex.h"
+
+/**
+ * \class ImageIOPool
+ * \brief Process-wide pool of reusable ImageIO objects.
+ *
+ * Left to itself, every itk::ImageFileReader asks the ImageIO object
+ * factory for a new ImageIO, which creates one of every registered
+ * format and asks each whether it can read the file.  Image sequences
+ * are almost always a single format, so the pool detects the format
+ * once per sequence (files sharing a directory and extension) and keeps
+ * the detected ImageIO as a prototype.  Later frames only check that
+ * the sequence's format can read them, and so validate one header
+ * rather than probing every format; a file that fails the check is
+ * detected again from scratch.
+ *
+ * An ImageIO holds per-file state and must not be shared by two reads
+ * at once.  Acquire() hands out an ImageIO for the caller's exclusive
+ * use and Release() returns it to the pool, so each worker thread reading
+ * a sequence ends up with its own ImageIO, reused from frame to frame.
+ * PooledImageIO does both, and is what the readers use.
+ *
+ * Like FrameCache, the pool is a method-static singleton that is built
+ * during static initialization, ahead of any worker thread.
+ */
+class ImageIOPool
+{
+public:
+    /**
+     * Obtain the singleton instance of this ImageIOPool.
+     */
+    static ImageIOPool& Instance();
+
+    /**
+     * Get an ImageIO able to read the given file, for the caller's
+     * exclusive use until it is released.  Returns NULL if no registered
+     * format can read the file.
+     */
+    itk::ImageIOBase::Pointer Acquire(const std::string& filename);
+
+    /**
+     * Return an ImageIO from Acquire() to the pool.
+     */
+    void Release(itk::ImageIOBase* io);
+
+    /**
+     * Drop every pooled ImageIO and every detected format.
+     */
+    void Clear();
+
+    /**
+     * Pool statistics.  Detections count files whose format had to be
+     * found by probing every registered format; reuses count ImageIOs
+     * handed out again from the pool; creations count ImageIOs made, by
+     * detection or by copying a sequence's prototype.
+     */
+    unsigned long GetDetectCount();
+    unsigned long GetReuseCount();
+    unsigned long GetCreateCount();
+    void LogStatistics();
+
+private:
+    ImageIOPool();
+    ~ImageIOPool();
+
+    // not implemented
+    ImageIOPool(const ImageIOPool& other);
+    void operator=(const ImageIOPool& other);
+
+    /**
+     * The key of the sequence a file belongs to.
+     */
+    static std::string SequenceKey(const std::string& filename);
+
+    /**
+     * Probe every registered format for one that reads the file.
+     */
+    itk::ImageIOBase::Pointer Detect(const std::string& filename);
+
+    typedef std::vector< itk::ImageIOBase::Pointer > IOVector;
+
+    // Detected format per sequence, as a prototype ImageIO
+    std::map< std::string, itk::ImageIOBase::Pointer > formats;
+
+    // Idle ImageIOs, per ImageIO class
+    std::map< std::string, IOVector > idle;
+
+    unsigned long detectCount;
+    unsigned long reuseCount;
+    unsigned long createCount;
+
+    Mutex mutex;
+};
+
+/**
+ * \class PooledImageIO
+ * \brief Holds an ImageIO from the ImageIOPool for the life of a read.
+ *
+ * Give GetPointer() to an itk::ImageFileReader with SetImageIO(), and
+ * disconnect the reader's output before this goes out of scope so the
+ * reader cannot touch the ImageIO once it is back in the pool.
+ */
+class PooledImageIO
+{
+public:
+    PooledImageIO(const std::string& filename) :
+        io(ImageIOPool::Instance().Acquire(filename))
+    {}
+
+    ~PooledImageIO()
+    {
+        if (this->io)
+            ImageIOPool::Instance().Release(this->io);
+    }
+
+    itk::ImageIOBase* GetPointer()
+    { return this->io.GetPointer(); }
+
+private:
+    // not implemented
+    PooledImageIO(const PooledImageIO& other);
+    void operator=(const PooledImageIO& other);
+
+    itk::ImageIOBase::Pointer io;
+};
@@ -2,22 +2,38 @@
 
 #include <algorithm>
 #include <deque>
+#include <exception>
+#include <map>
 #include <string>
+#include <utility>
 
 #include "itkAdaptImageFilter.h"
 #include "itkCastImageFilter.h"
 #include "itkDataObject.h"
 #include "itkImageFileReader.h"
 #include "itkLightObject.h"
+#include "itkRealTimeClock.h"
 #include "itkVector.h"
 
+#include "Condition.h"
 #include "FileSet.h"
+#include "FrameCache.h"
+#include "ImageStack.h"
+#include "ImageStackUtils.h"
 #include "ImageUtils.h"
 #include "Logger.h"
+#include "Mutex.h"
+#include "MutexLocker.h"
+#include "ReaderTelemetry.h"
+#include "Thread.h"
 
 /**
  * Base class for reading a set of images.  Defines generic methods all ImageSetReaders must implement,
  * such as image access and file name getting/setting.
+ *
+ * A file set holding a single image stack (.its) file is read as the
+ * frames inside the stack; frames of another scalar type than the
+ * reader's are cast to it (see StackFrameReader).
  */
 class ImageSetReaderBase
 {
@@ -29,7 +45,8 @@ public:
      * Default constructor.
      */
     ImageSetReaderBase() :
-        files()
+        files(),
+        stack(NULL)
     {}
     
     virtual ~ImageSetReaderBase() {}
@@ -48,10 +65,27 @@ public:
     { return this->files; }
     
     virtual void SetFiles(const FileSet& files)
-    { this->files = files; }
+    {
+        this->files = files;
+        this->stack = ImageStack::OpenFileSet(files);
+    }
     
     int size()
-    { return this->files.size(); }
+    { return this->stack ? this->stack->GetFrameCount() : this->files.size(); }
+    
+    /**
+     * The image stack behind this reader, or NULL if the reader reads
+     * individual image files.
+     */
+    ImageStack* GetStack()
+    { return this->stack; }
+    
+    /**
+     * A snapshot of this reader's telemetry.  Readers that keep none
+     * return empty telemetry.
+     */
+    virtual ReaderTelemetry GetTelemetry()
+    { return ReaderTelemetry(); }
     
     /**
      * Assignment copy. Target grabs other image set's file list.
@@ -72,6 +106,9 @@ protected:
 private:
     // The set of filenames behind this ImageSetReader.
     FileSet files;
+    
+    // The stack file behind this ImageSetReader, if any.
+    ImageStack::Pointer stack;
 };
 
 template < class TInputPixel, class TOutputPixel >
@@ -110,6 +147,37 @@ public:
  * an ImageSetReader by setting the CacheRadius; this controls how
  * many images are loaded in front of and behind the most recently
  * accessed image.
+ *
+ * With Prefetch turned on, the ImageSetReader watches the pattern of
+ * requests (stepping forward, stepping backward, or requesting
+ * overlapping (i, i+1) pairs) and decodes the next PrefetchDepth
+ * images beyond the cache window on a background thread.  Image
+ * decoding then overlaps whatever the caller does with the images
+ * it already has.
+ *
+ * Images are read through the shared FrameCache, so images already
+ * decoded by another reader (or evicted from this reader's cache window
+ * but still resident in the FrameCache) are not decoded again.  The
+ * returned images may be shared; treat them as read-only.
+ *
+ * The cache window and the FrameCache hold images in the input pixel
+ * type.  An image is converted to the output pixel type (e.g. widened
+ * from unsigned char to float) only when it is requested, and only the
+ * last couple of conversions are kept, so a wide CacheRadius costs
+ * source-sized memory per image.
+ *
+ * GetTelemetry() reports window hits, decode times, throughput, prefetch
+ * effectiveness and resident memory while the reader runs; see
+ * ReaderTelemetry.
+ *
+ * A consumer that only needs part of each image can SetRegion(), with a
+ * halo of extra pixels on every side for filters that look at their
+ * neighbours.  The reader then reads, caches, and converts only the
+ * region plus halo (cropped to the image bounds): streaming ImageIOs
+ * decode just the strips or tiles that cover it, and the FrameCache
+ * keeps it under its own region key.  The returned images hold just that
+ * region, starting at index zero with the origin moved to the region's
+ * first pixel, as from itk::RegionOfInterestImageFilter.
  */
 template < class TInput, class TOutput = TInput >
 class ImageSetReader : 
@@ -123,13 +191,28 @@ public:
     typedef TOutput OutputImageType;
     typedef typename InputImageType::Pointer InputImagePointer;
     typedef typename OutputImageType::Pointer OutputImagePointer;
+    typedef typename InputImageType::RegionType RegionType;
     // typedef itk::CastImageFilter< InputImageType, OutputImageType > CasterType;
     typedef itk::AdaptImageFilter< InputImageType, OutputImageType, 
         PixelAccessor< typename InputImageType::PixelType, typename OutputImageType::PixelType > > CasterType;
     typedef typename CasterType::Pointer CasterPointer;
 
-    // We have to store references to the image caster--otherwise it gets deleted.
-    typedef std::deque<CasterPointer> ImageArray;
+    // We hold references to the images in our cache window, in the input pixel type.
+    typedef std::deque<InputImagePointer> ImageArray;
+    typedef std::map<int, InputImagePointer> PrefetchMap;
+    typedef std::deque< std::pair<int, OutputImagePointer> > ConvertedArray;
+    
+    /**
+     * The pattern of recent image requests, used to decide which images
+     * to prefetch.
+     */
+    enum AccessPattern
+    {
+        UnknownAccess,
+        ForwardAccess,
+        BackwardAccess,
+        PairwiseAccess
+    };
     
     /**
      * Default constructor.
@@ -137,13 +220,27 @@ public:
     ImageSetReader() :
         Superclass(),
         images(),
+        converted(),
         requestCount(0),
         readCount(0),
         maxCount(0),
         m_CacheRadius(0),
+        m_Region(),
+        m_Halo(0),
+        m_UseRegion(false),
         m_Index(-1),
         m_MinIndex(-1),
-        m_MaxIndex(-1)
+        m_MaxIndex(-1),
+        prefetchHitCount(0),
+        prefetchMissCount(0),
+        m_Prefetch(false),
+        m_PrefetchDepth(0),
+        m_Pattern(UnknownAccess),
+        m_Travel(0),
+        m_LastStep(0),
+        m_PrefetchLoading(-1),
+        m_PrefetchGeneration(0),
+        m_PrefetchStop(false)
     {}
 
     /**
@@ -152,13 +249,27 @@ public:
     ImageSetReader(const FileSet& set) :
         Superclass(),
         images(),
+        converted(),
         requestCount(0),
         readCount(0),
         maxCount(0),
         m_CacheRadius(0),
+        m_Region(),
+        m_Halo(0),
+        m_UseRegion(false),
         m_Index(-1),
         m_MinIndex(-1),
-        m_MaxIndex(-1)
+        m_MaxIndex(-1),
+        prefetchHitCount(0),
+        prefetchMissCount(0),
+        m_Prefetch(false),
+        m_PrefetchDepth(0),
+        m_Pattern(UnknownAccess),
+        m_Travel(0),
+        m_LastStep(0),
+        m_PrefetchLoading(-1),
+        m_PrefetchGeneration(0),
+        m_PrefetchStop(false)
     {
         this->SetFiles(set);
     }
@@ -166,6 +277,7 @@ public:
     virtual ~ImageSetReader()
     {
         Logger::debug << "ImageSetReader::~ImageSetReader()" << std::endl;
+        this->StopPrefetch();
         this->LogStatistics();
     }
 
@@ -190,8 +302,41 @@ public:
         Logger::info << "\tRequests:\t" << this->requestCount << std::endl;
         Logger::info << "\tReads:   \t" << this->readCount << std::endl;
         Logger::info << "\tMax:     \t" << this->maxCount << std::endl;
+        if (this->m_Prefetch)
+        {
+            Logger::info << "\tDepth:   \t" << this->GetPrefetchDepth() << std::endl;
+            Logger::info << "\tHits:    \t" << this->prefetchHitCount << std::endl;
+            Logger::info << "\tMisses:  \t" << this->prefetchMissCount << std::endl;
+        }
+        this->GetTelemetry().Print(Logger::verbose);
     }
     
+    /**
+     * A snapshot of this reader's telemetry.  Call from the thread that
+     * requests images.
+     */
+    virtual ReaderTelemetry GetTelemetry();
+    
+    /**
+     * Access statistics.  Requests count calls to operator[]; reads count
+     * images loaded through the FrameCache, whether on the caller's thread
+     * or the prefetch thread.  Prefetch hits count images that were waiting
+     * (or being decoded) on the prefetch thread when the cache needed
+     * them; misses count images the cache had to read itself while
+     * prefetching was on.
+     */
+    int GetRequestCount()
+    { return this->requestCount; }
+    int GetReadCount()
+    {
+        MutexLocker lock(this->m_PrefetchMutex);
+        return this->readCount;
+    }
+    int GetPrefetchHitCount()
+    { return this->prefetchHitCount; }
+    int GetPrefetchMissCount()
+    { return this->prefetchMissCount; }
+    
     /**
      * Get/Set the cache radius used by this ImageSetReader.  The cache radius
      * determines how many images will be kept in memory concurrently.
@@ -199,19 +344,117 @@ public:
     unsigned int GetCacheRadius() 
     { return this->m_CacheRadius; }
     void SetCacheRadius(unsigned int radius);
+    
+    /**
+     * Get/Set the region of each image to read, and the halo: how many
+     * pixels around the region to read with it.  Images read with a region
+     * hold only the region plus halo, cropped to the image bounds.
+     * ClearRegion() goes back to reading whole images, the default.
+     * Changing the region discards the images held by this reader.
+     */
+    void SetRegion(const RegionType& region, unsigned int halo = 0);
+    void ClearRegion();
+    const RegionType& GetRegion()
+    { return this->m_Region; }
+    unsigned int GetHalo()
+    { return this->m_Halo; }
+    bool GetUseRegion()
+    { return this->m_UseRegion; }
+    
+    /**
+     * Get/Set whether images are decoded ahead of time on a background
+     * thread.  Prefetching is off by default.
+     */
+    bool GetPrefetch()
+    { return this->m_Prefetch; }
+    void SetPrefetch(bool prefetch);
+    
+    /**
+     * Get/Set how many images beyond the cache window are prefetched in
+     * the direction of travel.  A depth of zero (the default) prefetches
+     * CacheRadius images, and at least one.
+     */
+    unsigned int GetPrefetchDepth()
+    { return this->m_PrefetchDepth > 0 ? this->m_PrefetchDepth : std::max(1u, this->m_CacheRadius); }
+    void SetPrefetchDepth(unsigned int depth)
+    { this->m_PrefetchDepth = depth; }
+    
+    /**
+     * Get the most recently detected access pattern.
+     */
+    AccessPattern GetAccessPattern()
+    { return this->m_Pattern; }
 
 private:
     
     /**
-     * Load the image with the given index from disk.
+     * Load the image with the given index from the FrameCache or disk,
+     * recording the load in the telemetry.
+     */
+    InputImagePointer LoadImage(unsigned int index);
+    
+    /**
+     * Read the image with the given index, setting decoded to whether it
+     * had to be decoded.
+     */
+    InputImagePointer ReadFrame(unsigned int index, bool& decoded);
+    
+    /**
+     * Discard every image held or prefetched, so the next request loads
+     * from scratch.  Called when the cache window or region changes.
+     */
+    void ResetCache();
+    
+    /**
+     * Get the image with the given index for the cache, either from the
+     * prefetched images or by loading it from disk.
+     */
+    InputImagePointer FetchImage(unsigned int index);
+    
+    /**
+     * Convert the image at the given index in the cache window to the
+     * output pixel type, reusing a recent conversion if there is one.
      */
-    CasterPointer LoadImage(unsigned int index);
+    OutputImagePointer ConvertImage(int index);
+    
+    /**
+     * Update the access pattern given a newly requested index.
+     */
+    void UpdateAccessPattern(int index);
+    
+    /**
+     * Queue up images for the prefetch thread beyond the current cache
+     * window, in the direction of travel.
+     */
+    void SchedulePrefetch();
+    
+    /**
+     * Discard all prefetched and queued images, waiting for any image in
+     * progress on the prefetch thread.  Called whenever the files or cache
+     * change.
+     */
+    void ClearPrefetch();
+    
+    /**
+     * Stop the prefetch thread and wait for it to finish.
+     */
+    void StopPrefetch();
+    
+    /**
+     * Prefetch thread main loop.
+     */
+    void PrefetchLoop();
+    static void PrefetchCallback(void* self)
+    { static_cast<Self*>(self)->PrefetchLoop(); }
 
     /*
-     * We use a vector of image reader pointers to store the images
+     * We use a deque of image pointers to store the images
      * we have loaded.
      */
     ImageArray images;
+    
+    // The most recent conversions to the output pixel type, newest first.
+    ConvertedArray converted;
 
     // Reader statistics variables
     int requestCount;
@@ -220,9 +463,35 @@ private:
     
     // Image cache managment variables
     unsigned int m_CacheRadius;
+    RegionType m_Region;
+    unsigned int m_Halo;
+    bool m_UseRegion;
     int m_Index;
     int m_MinIndex;
     int m_MaxIndex;
+    
+    // Prefetch statistics variables
+    int prefetchHitCount;
+    int prefetchMissCount;
+    
+    // Prefetch management variables.  The mutex guards the queue, the
+    // prefetched images, the loading index, the generation, the stop
+    // flag, readCount, and the telemetry.
+    bool m_Prefetch;
+    unsigned int m_PrefetchDepth;
+    AccessPattern m_Pattern;
+    int m_Travel;
+    int m_LastStep;
+    std::deque<int> m_PrefetchQueue;
+    PrefetchMap m_Prefetched;
+    int m_PrefetchLoading;
+    unsigned int m_PrefetchGeneration;
+    bool m_PrefetchStop;
+    Mutex m_PrefetchMutex;
+    Condition m_PrefetchCondition;
+    Thread m_PrefetchThread;
+    
+    ReaderTelemetry telemetry;
 };
 
 // Implementation //
@@ -238,6 +507,12 @@ ImageSetReader<TInput, TOutput>::operator[](unsigned int idx)
     // Ensure the requested index is valid
     // Doing this ensures we always return an image--the last one, if the requested index is too high.
     idx = std::min((int) idx, this->size()-1);
+    this->UpdateAccessPattern(idx);
+    {
+        bool hit = this->m_Index >= 0 && (int) idx >= this->m_MinIndex && (int) idx <= this->m_MaxIndex;
+        MutexLocker lock(this->m_PrefetchMutex);
+        this->telemetry.RecordRequest(hit);
+    }
     
     // See how far the requested index is from the current index
     int dIdx = idx - this->m_Index;
@@ -268,7 +543,7 @@ ImageSetReader<TInput, TOutput>::operator[](unsigned int idx)
             for (int i = this->m_MaxIndex + 1; i <= maxIndex; i++)
             {
 //                 Logger::verbose << function << ": pushing image onto the back" << std::endl;
-                this->images.push_back(this->LoadImage(i));
+                this->images.push_back(this->FetchImage(i));
             }
         }
         else if (dIdx < 0)
@@ -284,7 +559,7 @@ ImageSetReader<TInput, TOutput>::operator[](unsigned int idx)
             for (int i = this->m_MinIndex - 1; i >= minIndex; i--)
             {
 //                 Logger::verbose << function << ": pushing image onto the front" << std::endl;
-                this->images.push_front(this->LoadImage(i));
+                this->images.push_front(this->FetchImage(i));
             }
         }
     }
@@ -296,7 +571,7 @@ ImageSetReader<TInput, TOutput>::operator[](unsigned int idx)
         this->images.clear();
         for (int i = minIndex; i <= maxIndex; i++)
         {
-            this->images.push_front(this->LoadImage(i));
+            this->images.push_back(this->FetchImage(i));
         }
     }
     
@@ -305,29 +580,332 @@ ImageSetReader<TInput, TOutput>::operator[](unsigned int idx)
     this->m_MaxIndex = maxIndex;
     this->maxCount = std::max(this->maxCount, (int) this->images.size());
     
+    if (this->m_Prefetch)
+        this->SchedulePrefetch();
+    
 //     Logger::verbose << function << ": image cache size " << this->images.size() << std::endl;
 //     Logger::verbose << function << ": returning image at index " << (this->m_Index - this->m_MinIndex) << std::endl;
-    return this->images[this->m_Index - this->m_MinIndex]->GetOutput();
+    return this->ConvertImage(this->m_Index);
 }
 
 template < class TInput, class TOutput >
-typename ImageSetReader<TInput, TOutput>::CasterPointer
+typename ImageSetReader<TInput, TOutput>::InputImagePointer
 ImageSetReader<TInput, TOutput>::LoadImage(unsigned int index)
 {
-    this->readCount++;
+    itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+    double start = clock->GetTimeStamp();
+    bool decoded = false;
+    InputImagePointer image = this->ReadFrame(index, decoded);
+    double seconds = clock->GetTimeStamp() - start;
+    
+    MutexLocker lock(this->m_PrefetchMutex);
+    this->telemetry.RecordLoad(decoded, seconds, FrameCache::ImageBytes(image.GetPointer()));
+    return image;
+}
+
+template < class TInput, class TOutput >
+typename ImageSetReader<TInput, TOutput>::InputImagePointer
+ImageSetReader<TInput, TOutput>::ReadFrame(unsigned int index, bool& decoded)
+{
+    if (this->m_UseRegion)
+    {
+        RegionType region = PadRegionByRadius(this->m_Region, this->m_Halo);
+        if (this->GetStack())
+        {
+            // Copy out just the region; only the pages it covers are touched
+            InputImagePointer frame = StackFrameReader<InputImageType>::Read(this->GetStack(), index);
+            if (!region.Crop(frame->GetLargestPossibleRegion()))
+            {
+                itk::OStringStream message;
+                message << "ImageSetReader::LoadImage: the requested region lies outside image " << index;
+                throw itk::ExceptionObject(__FILE__, __LINE__, message.str().c_str(), "ImageSetReader::LoadImage");
+            }
+            return ExtractImageRegion<InputImageType>(frame, region);
+        }
+        return ReadCachedImage<InputImageType>(this->GetFiles()[index], region, &decoded);
+    }
+    
+    // Stack frames are mapped, not decoded; there is nothing to cache
+    if (this->GetStack())
+        return StackFrameReader<InputImageType>::Read(this->GetStack(), index);
+    
+    // Read the image, or share the frame another reader already decoded
+    return ReadCachedImage<InputImageType>(this->GetFiles()[index], &decoded);
+}
+
+template < class TInput, class TOutput >
+typename ImageSetReader<TInput, TOutput>::OutputImagePointer
+ImageSetReader<TInput, TOutput>::ConvertImage(int index)
+{
+    for (typename ConvertedArray::iterator it = this->converted.begin(); it != this->converted.end(); ++it)
+    {
+        if (it->first == index)
+            return it->second;
+    }
+    
+    // Keep enough conversions for both images of a pair
+    OutputImagePointer image = 
+        FrameConverter<InputImageType, OutputImageType>::Convert(this->images[index - this->m_MinIndex]);
+    this->converted.push_front(std::make_pair(index, image));
+    if (this->converted.size() > 2)
+        this->converted.pop_back();
+    return image;
+}
+
+template < class TInput, class TOutput >
+typename ImageSetReader<TInput, TOutput>::InputImagePointer
+ImageSetReader<TInput, TOutput>::FetchImage(unsigned int index)
+{
+    {
+        MutexLocker lock(this->m_PrefetchMutex);
+        if (this->m_Prefetch)
+        {
+            // If the prefetch thread is decoding this image right now, wait for it
+            bool waited = false;
+            while (this->m_PrefetchLoading == (int) index)
+            {
+                waited = true;
+                this->m_PrefetchCondition.Wait(this->m_PrefetchMutex);
+            }
+            
+            typename PrefetchMap::iterator it = this->m_Prefetched.find(index);
+            if (it != this->m_Prefetched.end())
+            {
+                InputImagePointer image = it->second;
+                this->m_Prefetched.erase(it);
+                this->prefetchHitCount++;
+                this->telemetry.RecordPrefetch(true);
+                return image;
+            }
+            
+            // The prefetch thread did not get to this image (or could not
+            // keep it); take it off the queue and read it here.
+            this->m_PrefetchQueue.erase(
+                std::remove(this->m_PrefetchQueue.begin(), this->m_PrefetchQueue.end(), (int) index),
+                this->m_PrefetchQueue.end());
+            if (!waited)
+            {
+                this->prefetchMissCount++;
+                this->telemetry.RecordPrefetch(false);
+            }
+        }
+        this->readCount++;
+    }
+    
+    return this->LoadImage(index);
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::UpdateAccessPattern(int index)
+{
+    if (this->m_Index < 0)
+    {
+        this->m_Pattern = UnknownAccess;
+        this->m_Travel = 0;
+        this->m_LastStep = 0;
+        return;
+    }
+    
+    int step = index - this->m_Index;
+    if (step == 0)
+        return;     // repeated request, e.g. the second image of one pair is the first of the next
     
-    // Cast the image to the output image type
-    CasterPointer cast = CasterType::New();
-    cast->SetInput(ReadImage<InputImageType>(this->GetFiles()[index]));
-    cast->Update();
-    return cast;
+    if (abs(step) > (int) (this->GetCacheRadius() + this->GetPrefetchDepth() + 1))
+    {
+        // A jump; we know nothing about where the caller is headed next
+        this->m_Pattern = UnknownAccess;
+        this->m_Travel = 0;
+    }
+    else if (this->m_LastStep != 0 && (step > 0) != (this->m_LastStep > 0))
+    {
+        // Alternating steps, e.g. pairs requested as (i+1, i), (i+2, i+1).
+        // The net motion over the last two steps gives the direction of travel.
+        int net = step + this->m_LastStep;
+        this->m_Pattern = PairwiseAccess;
+        this->m_Travel = net > 0 ? 1 : (net < 0 ? -1 : 0);
+    }
+    else
+    {
+        this->m_Pattern = step > 0 ? ForwardAccess : BackwardAccess;
+        this->m_Travel = step > 0 ? 1 : -1;
+    }
+    this->m_LastStep = step;
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::SchedulePrefetch()
+{
+    int depth = this->GetPrefetchDepth();
+    if (this->m_Pattern == PairwiseAccess)
+    {
+        // Reach far enough to cover the other image of the next pair
+        depth += abs(this->m_LastStep);
+    }
+    
+    MutexLocker lock(this->m_PrefetchMutex);
+    
+    // Anything still queued is stale; decide from scratch what to load
+    this->m_PrefetchQueue.clear();
+    
+    // Drop prefetched images that fell too far behind the cache window
+    int lo = this->m_MinIndex - depth;
+    int hi = this->m_MaxIndex + depth;
+    typename PrefetchMap::iterator it = this->m_Prefetched.begin();
+    while (it != this->m_Prefetched.end())
+    {
+        if (it->first < lo || it->first > hi)
+            this->m_Prefetched.erase(it++);
+        else
+            ++it;
+    }
+    
+    // Queue the images just beyond the cache window, nearest first
+    for (int d = 1; d <= depth && this->m_Travel != 0; d++)
+    {
+        int i = this->m_Travel > 0 ? this->m_MaxIndex + d : this->m_MinIndex - d;
+        if (i < 0 || i >= this->size())
+            break;
+        if (i != this->m_PrefetchLoading && 
+            this->m_Prefetched.find(i) == this->m_Prefetched.end())
+        {
+            this->m_PrefetchQueue.push_back(i);
+        }
+    }
+    
+    if (!this->m_PrefetchQueue.empty())
+        this->m_PrefetchCondition.Broadcast();
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::ClearPrefetch()
+{
+    MutexLocker lock(this->m_PrefetchMutex);
+    this->m_PrefetchQueue.clear();
+    this->m_Prefetched.clear();
+    
+    // Any image in progress belongs to the old generation and will be discarded
+    this->m_PrefetchGeneration++;
+    while (this->m_PrefetchLoading >= 0)
+    {
+        this->m_PrefetchCondition.Wait(this->m_PrefetchMutex);
+    }
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::StopPrefetch()
+{
+    {
+        MutexLocker lock(this->m_PrefetchMutex);
+        this->m_PrefetchStop = true;
+        this->m_PrefetchQueue.clear();
+        this->m_PrefetchCondition.Broadcast();
+    }
+    this->m_PrefetchThread.Join();
+    
+    MutexLocker lock(this->m_PrefetchMutex);
+    this->m_Prefetched.clear();
+    this->m_PrefetchStop = false;
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::PrefetchLoop()
+{
+    this->m_PrefetchMutex.Lock();
+    while (!this->m_PrefetchStop)
+    {
+        if (this->m_PrefetchQueue.empty())
+        {
+            this->m_PrefetchCondition.Wait(this->m_PrefetchMutex);
+            continue;
+        }
+        
+        int index = this->m_PrefetchQueue.front();
+        this->m_PrefetchQueue.pop_front();
+        unsigned int generation = this->m_PrefetchGeneration;
+        this->m_PrefetchLoading = index;
+        this->readCount++;
+        this->m_PrefetchMutex.Unlock();
+        
+        InputImagePointer image;
+        try
+        {
+            image = this->LoadImage(index);
+        }
+        catch (itk::ExceptionObject& e)
+        {
+            // Leave the image for the caller to read (and fail on) itself
+            Logger::warning << "ImageSetReader::PrefetchLoop: unable to read image " << index << std::endl;
+        }
+        catch (std::exception& e)
+        {
+            // e.g. std::bad_alloc; escaping the thread would terminate the program
+            Logger::warning << "ImageSetReader::PrefetchLoop: unable to read image " << index << ": " << e.what() << std::endl;
+        }
+        catch (...)
+        {
+            Logger::warning << "ImageSetReader::PrefetchLoop: unable to read image " << index << ": unknown exception" << std::endl;
+        }
+        
+        this->m_PrefetchMutex.Lock();
+        if (image && generation == this->m_PrefetchGeneration)
+            this->m_Prefetched[index] = image;
+        this->m_PrefetchLoading = -1;
+        this->m_PrefetchCondition.Broadcast();
+    }
+    this->m_PrefetchMutex.Unlock();
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::SetPrefetch(bool prefetch)
+{
+    if (prefetch == this->m_Prefetch)
+        return;
+    
+    if (prefetch)
+    {
+        this->m_Prefetch = true;
+        if (!this->m_PrefetchThread.Start(&Self::PrefetchCallback, this))
+        {
+            Logger::warning << "ImageSetReader::SetPrefetch: unable to start prefetch thread" << std::endl;
+            this->m_Prefetch = false;
+        }
+    }
+    else
+    {
+        this->StopPrefetch();
+        this->m_Prefetch = false;
+    }
 }
 
 template < class TInput, class TOutput >
 void ImageSetReader<TInput, TOutput>::SetCacheRadius(unsigned int radius)
 {
+    this->ResetCache();
     this->m_CacheRadius = radius;
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::SetRegion(const RegionType& region, unsigned int halo)
+{
+    this->ResetCache();
+    this->m_Region = region;
+    this->m_Halo = halo;
+    this->m_UseRegion = true;
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::ClearRegion()
+{
+    this->ResetCache();
+    this->m_UseRegion = false;
+}
+
+template < class TInput, class TOutput >
+void ImageSetReader<TInput, TOutput>::ResetCache()
+{
+    this->ClearPrefetch();
     this->images.clear();
+    this->converted.clear();
     
     // this will force a load on the next request
     this->m_Index = -1; 
@@ -335,6 +913,30 @@ void ImageSetReader<TInput, TOutput>::SetCacheRadius(unsigned int radius)
     this->m_MaxIndex = -1;
 }
 
+template < class TInput, class TOutput >
+ReaderTelemetry ImageSetReader<TInput, TOutput>::GetTelemetry()
+{
+    unsigned long bytes = 0;
+    for (typename ImageArray::iterator it = this->images.begin(); it != this->images.end(); ++it)
+        bytes += FrameCache::ImageBytes(it->GetPointer());
+    for (typename ConvertedArray::iterator it = this->converted.begin(); it != this->converted.end(); ++it)
+    {
+        // Conversions to the same pixel type are the input images themselves
+        if (dynamic_cast< InputImageType* >(static_cast< itk::DataObject* >(it->second.GetPointer())) == NULL)
+            bytes += FrameCache::ImageBytes(it->second.GetPointer());
+    }
+    
+    ReaderTelemetry snapshot;
+    {
+        MutexLocker lock(this->m_PrefetchMutex);
+        for (typename PrefetchMap::iterator it = this->m_Prefetched.begin(); it != this->m_Prefetched.end(); ++it)
+            bytes += FrameCache::ImageBytes(it->second.GetPointer());
+        snapshot = this->telemetry;
+    }
+    snapshot.SetResidentBytes(bytes, FrameCache::Instance().GetResidentBytes());
+    return snapshot;
+}
+
 template < class TInput, class TOutput >
 itk::DataObject*
 ImageSetReader<TInput, TOutput>::GetImage(unsigned int index)
@@ -346,12 +948,19 @@ ImageSetReader<TInput, TOutput>::GetImage(unsigned int index)
 template < class TInput, class TOutput >
 void ImageSetReader< TInput, TOutput >::SetFiles(const FileSet& files)
 {
+    // The prefetch thread must not be reading while the file list changes.
+    this->ClearPrefetch();
     Superclass::SetFiles(files);
+    {
+        MutexLocker lock(this->m_PrefetchMutex);
+        this->telemetry.Reset();
+    }
     // We must be sure to make the images and indices to be valid.
     // For example, we need to ensure that enough space is reserved to
     // hold all image pointers and make sure no indices refer to old
     // files that should no longer be loaded by this ImageSetReader.
     this->images.clear();
+    this->converted.clear();
     
     // this will force a load on the next request
     this->m_Index = -1;
@@ -0,0 +1,291 @@
+#include "ImageStack.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "FileUtils.h"
+#include "Logger.h"
+
+namespace
+{
+    const char STACK_MAGIC[8] = { 'I', 'T', 'S', 'T', 'A', 'C', 'K', '\0' };
+    const unsigned int STACK_VERSION = 1;
+    const std::string STACK_EXTENSION(".its");
+
+    // Frames start on a page boundary after the index, and each frame
+    // on a cache line boundary after that.
+    const StackOffsetType FIRST_FRAME_ALIGNMENT = 4096;
+    const StackOffsetType FRAME_ALIGNMENT = 64;
+
+    StackOffsetType Align(StackOffsetType offset, StackOffsetType alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+}
+
+ImageStack::ImageStack() :
+    filename(""),
+    base(NULL),
+    length(0),
+    offsets(NULL)
+#ifdef _WIN32
+    , file(INVALID_HANDLE_VALUE),
+    mapping(NULL)
+#endif
+{
+    memset(&this->header, 0, sizeof(Header));
+}
+
+ImageStack::~ImageStack()
+{
+    this->Close();
+}
+
+bool ImageStack::Open(const std::string& filename)
+{
+    std::string function("ImageStack::Open");
+    this->Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        Logger::error << function << ": unable to open " << filename << std::endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : NULL;
+    if (view == NULL)
+    {
+        Logger::error << function << ": unable to map " << filename << std::endl;
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    this->file = file;
+    this->mapping = mapping;
+    this->base = (char*) view;
+    this->length = (unsigned long) size.QuadPart;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        Logger::error << function << ": unable to open " << filename << std::endl;
+        return false;
+    }
+    struct stat info;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        view = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        Logger::error << function << ": unable to map " << filename << std::endl;
+        return false;
+    }
+    this->base = (char*) view;
+    this->length = (unsigned long) info.st_size;
+#endif
+    this->filename = filename;
+
+    // Validate the header and frame index before handing out any pointers
+    bool valid = this->length >= sizeof(Header);
+    if (valid)
+    {
+        memcpy(&this->header, this->base, sizeof(Header));
+        valid = memcmp(this->header.magic, STACK_MAGIC, sizeof(STACK_MAGIC)) == 0 &&
+            this->header.version == STACK_VERSION &&
+            this->header.frameBytes == this->header.width * this->header.height * PixelBytes(this->GetPixelType()) &&
+            this->header.frameBytes > 0 &&
+            sizeof(Header) + this->header.frameCount * sizeof(StackOffsetType) <= this->length;
+    }
+    if (valid)
+    {
+        this->offsets = (const StackOffsetType*) (this->base + sizeof(Header));
+        for (unsigned int i = 0; i < this->header.frameCount && valid; i++)
+        {
+            valid = this->offsets[i] % FRAME_ALIGNMENT == 0 &&
+                this->offsets[i] + this->header.frameBytes <= this->length;
+        }
+    }
+    if (!valid)
+    {
+        Logger::error << function << ": " << filename << " is not a valid image stack" << std::endl;
+        this->Close();
+        return false;
+    }
+
+    Logger::verbose << function << ": " << filename << " holds " << this->header.frameCount
+        << " frames of " << this->header.width << "x" << this->header.height << std::endl;
+    return true;
+}
+
+void ImageStack::Close()
+{
+    if (this->base != NULL)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(this->base);
+        CloseHandle((HANDLE) this->mapping);
+        CloseHandle((HANDLE) this->file);
+        this->mapping = NULL;
+        this->file = INVALID_HANDLE_VALUE;
+#else
+        munmap(this->base, this->length);
+#endif
+    }
+    this->base = NULL;
+    this->length = 0;
+    this->offsets = NULL;
+    memset(&this->header, 0, sizeof(Header));
+}
+
+void* ImageStack::GetFrame(unsigned int index) const
+{
+    if (this->base == NULL || index >= this->header.frameCount)
+        return NULL;
+    return this->base + this->offsets[index];
+}
+
+bool ImageStack::IsStackFile(const std::string& filename)
+{
+    return ExtensionPart(filename) == STACK_EXTENSION;
+}
+
+ImageStack::Pointer ImageStack::OpenFileSet(const FileSet& files)
+{
+    if (files.size() != 1 || !IsStackFile(files[0]))
+        return NULL;
+
+    Pointer stack = ImageStack::New();
+    if (!stack->Open(files[0]))
+        return NULL;
+    return stack;
+}
+
+unsigned int ImageStack::PixelBytes(FramePixelType type)
+{
+    switch (type)
+    {
+        case CharFrame:         return 1;
+        case ShortFrame:        return 2;
+        case FloatFrame:        return 4;
+        case VectorFloatFrame:  return 8;
+        default:                return 0;
+    }
+}
+
+ImageStackWriter::ImageStackWriter() :
+    filename(""),
+    file(NULL),
+    capacity(0),
+    position(0),
+    offsets()
+{
+    memset(&this->header, 0, sizeof(ImageStack::Header));
+}
+
+ImageStackWriter::~ImageStackWriter()
+{
+    this->Close();
+}
+
+bool ImageStackWriter::Open(const std::string& filename, ImageStack::FramePixelType pixelType,
+    unsigned int width, unsigned int height, unsigned int frameCount,
+    const double spacing[2], const double origin[2])
+{
+    std::string function("ImageStackWriter::Open");
+    this->Close();
+
+    this->file = fopen(filename.c_str(), "wb");
+    if (this->file == NULL)
+    {
+        Logger::error << function << ": unable to open " << filename << std::endl;
+        return false;
+    }
+
+    this->filename = filename;
+    memset(&this->header, 0, sizeof(ImageStack::Header));
+    memcpy(this->header.magic, STACK_MAGIC, sizeof(STACK_MAGIC));
+    this->header.version = STACK_VERSION;
+    this->header.pixelType = pixelType;
+    this->header.width = width;
+    this->header.height = height;
+    this->header.frameCount = 0;
+    this->header.frameBytes = width * height * ImageStack::PixelBytes(pixelType);
+    for (int d = 0; d < 2; d++)
+    {
+        this->header.spacing[d] = spacing[d];
+        this->header.origin[d] = origin[d];
+    }
+    this->capacity = frameCount;
+    this->offsets.clear();
+
+    // Reserve the header and index; Close() fills them in
+    this->position = Align(sizeof(ImageStack::Header) + frameCount * sizeof(StackOffsetType), FIRST_FRAME_ALIGNMENT);
+    std::vector< char > zeros(this->position, 0);
+    if (fwrite(&zeros[0], 1, zeros.size(), this->file) != zeros.size())
+    {
+        Logger::error << function << ": unable to write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ImageStackWriter::AppendFrame(const void* pixels)
+{
+    std::string function("ImageStackWriter::AppendFrame");
+    if (this->file == NULL)
+        return false;
+    if (this->offsets.size() >= this->capacity)
+    {
+        Logger::error << function << ": " << this->filename << " was opened for " << this->capacity << " frames" << std::endl;
+        return false;
+    }
+
+    unsigned int padding = (unsigned int) (Align(this->header.frameBytes, FRAME_ALIGNMENT) - this->header.frameBytes);
+    static const char zeros[64] = { 0 };
+    if (fwrite(pixels, 1, this->header.frameBytes, this->file) != this->header.frameBytes ||
+        fwrite(zeros, 1, padding, this->file) != padding)
+    {
+        Logger::error << function << ": unable to write " << this->filename << std::endl;
+        return false;
+    }
+
+    this->offsets.push_back(this->position);
+    this->position += this->header.frameBytes + padding;
+    return true;
+}
+
+bool ImageStackWriter::Close()
+{
+    if (this->file == NULL)
+        return false;
+
+    this->header.frameCount = this->offsets.size();
+    bool ok = fseek(this->file, 0, SEEK_SET) == 0 &&
+        fwrite(&this->header, sizeof(ImageStack::Header), 1, this->file) == 1 &&
+        (this->offsets.empty() ||
+         fwrite(&this->offsets[0], sizeof(StackOffsetType), this->offsets.size(), this->file) == this->offsets.size());
+    ok = fclose(this->file) == 0 && ok;
+    this->file = NULL;
+
+    if (!ok)
+        Logger::error << "ImageStackWriter::Close: unable to write " << this->filename << std::endl;
+    return ok;
+}
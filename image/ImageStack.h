@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+typedef unsigned __int64 StackOffsetType;
+#else
+#include <stdint.h>
+typedef uint64_t StackOffsetType;
+#endif
+
+#include "itkLightObject.h"
+#include "itkObjectFactory.h"
+
+#include "FileSet.h"
+
+/**
+ * \class ImageStack
+ * \brief A whole image sequence in one memory-mapped file.
+ *
+ * An image stack file (extension .its) holds every frame of a 2D image
+ * sequence, uncompressed, in native byte order:
+ *
+ *   - a fixed 64 byte Header (magic, version, pixel type, frame size and
+ *     count, spacing, origin);
+ *   - the frame index: one StackOffsetType file offset per frame;
+ *   - the raw frames, each starting on a 64 byte boundary.
+ *
+ * Opening a stack maps the whole file into memory; GetFrame() is then a
+ * pointer lookup, with no open, format probe, header parse or decode per
+ * frame.  The mapping is copy-on-write, so a stray write into a frame
+ * stays in this process and never reaches the file.  Use ReadStackFrame()
+ * (ImageStackUtils.h) to wrap a frame as an itk::Image without copying.
+ *
+ * ImageSetReader and ImageFileSetReader read a FileSet holding a single
+ * .its file as the sequence of frames inside it.  The convertstack app
+ * builds stacks from numbered image files.
+ */
+class ImageStack :
+    public itk::LightObject
+{
+public:
+    typedef ImageStack Self;
+    typedef itk::LightObject Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+    itkNewMacro(Self);
+
+    /**
+     * Pixel types a stack may hold.  The values are stored in the file.
+     */
+    enum FramePixelType
+    {
+        UnknownFrame = 0,
+        CharFrame = 1,          // unsigned char
+        ShortFrame = 2,         // unsigned short
+        FloatFrame = 3,         // float
+        VectorFloatFrame = 4    // itk::Vector< float, 2 >
+    };
+
+    /**
+     * The on-disk header.
+     */
+    struct Header
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int pixelType;
+        unsigned int width;
+        unsigned int height;
+        unsigned int frameCount;
+        unsigned int frameBytes;
+        double spacing[2];
+        double origin[2];
+    };
+
+    /**
+     * Map a stack file into memory.  Returns false (and logs why) if the
+     * file cannot be opened or is not a valid stack.
+     */
+    bool Open(const std::string& filename);
+
+    /**
+     * Unmap the file.  Images imported with ReadStackFrame() hold a
+     * reference to their stack, which closes itself when the last of them
+     * is released; do not Close() a stack whose frames are still in use.
+     */
+    void Close();
+
+    bool IsOpen() const
+    { return this->base != NULL; }
+
+    const std::string& GetFileName() const
+    { return this->filename; }
+
+    FramePixelType GetPixelType() const
+    { return (FramePixelType) this->header.pixelType; }
+    unsigned int GetWidth() const
+    { return this->header.width; }
+    unsigned int GetHeight() const
+    { return this->header.height; }
+    unsigned int GetFrameCount() const
+    { return this->header.frameCount; }
+    unsigned int GetFrameBytes() const
+    { return this->header.frameBytes; }
+    const double* GetSpacing() const
+    { return this->header.spacing; }
+    const double* GetOrigin() const
+    { return this->header.origin; }
+
+    /**
+     * Pointer to the pixels of a frame, or NULL if the index is out of range.
+     */
+    void* GetFrame(unsigned int index) const;
+
+    /**
+     * True if the file name has the image stack extension.
+     */
+    static bool IsStackFile(const std::string& filename);
+
+    /**
+     * Open the stack behind a FileSet, if the FileSet names a single
+     * image stack file.  Returns NULL otherwise.
+     */
+    static Pointer OpenFileSet(const FileSet& files);
+
+    /**
+     * The size of one pixel of the given type.
+     */
+    static unsigned int PixelBytes(FramePixelType type);
+
+protected:
+    ImageStack();
+    virtual ~ImageStack();
+
+private:
+    // not implemented
+    ImageStack(const Self& other);
+    void operator=(const Self& other);
+
+    std::string filename;
+    Header header;
+    char* base;
+    unsigned long length;
+    const StackOffsetType* offsets;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+};
+
+/**
+ * \class ImageStackWriter
+ * \brief Writes frames to an image stack file.
+ *
+ * Open() the file with the frame geometry and count, AppendFrame() each
+ * frame's pixels in order, and Close() to write the frame index.
+ */
+class ImageStackWriter
+{
+public:
+    ImageStackWriter();
+    ~ImageStackWriter();
+
+    bool Open(const std::string& filename, ImageStack::FramePixelType pixelType,
+        unsigned int width, unsigned int height, unsigned int frameCount,
+        const double spacing[2], const double origin[2]);
+
+    /**
+     * Write one frame of width * height pixels.
+     */
+    bool AppendFrame(const void* pixels);
+
+    /**
+     * Write the frame index and header, and close the file.  A stack
+     * closed early records only the frames appended so far.
+     */
+    bool Close();
+
+private:
+    // not implemented
+    ImageStackWriter(const ImageStackWriter& other);
+    void operator=(const ImageStackWriter& other);
+
+    std::string filename;
+    std::FILE* file;
+    ImageStack::Header header;
+    unsigned int capacity;
+    StackOffsetType position;
+    std::vector< StackOffsetType > offsets;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "itkCastImageFilter.h"
+#include "itkExceptionObject.h"
+#include "itkImage.h"
+#include "itkImportImageContainer.h"
+#include "itkVector.h"
+
+#include "ImageStack.h"
+
+/**
+ * Maps itk pixel types to the pixel types an ImageStack stores.
+ */
+template < class TPixel >
+struct StackPixelTraits
+{
+    static ImageStack::FramePixelType Type() { return ImageStack::UnknownFrame; }
+};
+
+template <>
+struct StackPixelTraits< unsigned char >
+{
+    static ImageStack::FramePixelType Type() { return ImageStack::CharFrame; }
+};
+
+template <>
+struct StackPixelTraits< unsigned short >
+{
+    static ImageStack::FramePixelType Type() { return ImageStack::ShortFrame; }
+};
+
+template <>
+struct StackPixelTraits< float >
+{
+    static ImageStack::FramePixelType Type() { return ImageStack::FloatFrame; }
+};
+
+template <>
+struct StackPixelTraits< itk::Vector< float, 2 > >
+{
+    static ImageStack::FramePixelType Type() { return ImageStack::VectorFloatFrame; }
+};
+
+/**
+ * \class StackFrameContainer
+ * \brief Pixel container that points into a memory-mapped ImageStack.
+ *
+ * The container does not own its pixels; it holds a reference to the
+ * stack so the mapping outlives every image built on it.
+ */
+template < class TElementIdentifier, class TElement >
+class StackFrameContainer :
+    public itk::ImportImageContainer< TElementIdentifier, TElement >
+{
+public:
+    typedef StackFrameContainer Self;
+    typedef itk::ImportImageContainer< TElementIdentifier, TElement > Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+    itkNewMacro(Self);
+    itkTypeMacro(StackFrameContainer, ImportImageContainer);
+
+    void SetStack(ImageStack* stack)
+    { this->m_Stack = stack; }
+
+protected:
+    StackFrameContainer() :
+        m_Stack(NULL)
+    {}
+    virtual ~StackFrameContainer() {}
+
+private:
+    // not implemented
+    StackFrameContainer(const Self& other);
+    void operator=(const Self& other);
+
+    ImageStack::Pointer m_Stack;
+};
+
+/**
+ * Wrap frame index of an image stack as an itk::Image, without copying.
+ * The stack must hold TImage's pixel type; otherwise this throws an
+ * itk::ExceptionObject.  The image is backed by a copy-on-write mapping:
+ * writes to it are private to this process, but treat it as read-only
+ * anyway, since other images may share the same pages.
+ */
+template < class TImage >
+typename TImage::Pointer ReadStackFrame(ImageStack* stack, unsigned int index)
+{
+    typedef typename TImage::PixelType PixelType;
+    typedef typename TImage::PixelContainer::ElementIdentifier ElementIdentifier;
+    typedef StackFrameContainer< ElementIdentifier, PixelType > ContainerType;
+
+    if (StackPixelTraits< PixelType >::Type() != stack->GetPixelType())
+    {
+        itk::OStringStream message;
+        message << "ReadStackFrame: " << stack->GetFileName() << " holds pixels of type "
+                << stack->GetPixelType() << ", not " << StackPixelTraits< PixelType >::Type();
+        throw itk::ExceptionObject(__FILE__, __LINE__, message.str().c_str(), "ReadStackFrame");
+    }
+
+    PixelType* pixels = static_cast< PixelType* >(stack->GetFrame(index));
+    if (pixels == NULL)
+    {
+        itk::OStringStream message;
+        message << "ReadStackFrame: " << stack->GetFileName() << " has no frame " << index;
+        throw itk::ExceptionObject(__FILE__, __LINE__, message.str().c_str(), "ReadStackFrame");
+    }
+
+    typename TImage::SizeType size;
+    size[0] = stack->GetWidth();
+    size[1] = stack->GetHeight();
+    typename TImage::IndexType start;
+    start.Fill(0);
+    typename TImage::RegionType region;
+    region.SetSize(size);
+    region.SetIndex(start);
+
+    typename ContainerType::Pointer container = ContainerType::New();
+    container->SetStack(stack);
+    container->SetImportPointer(pixels, region.GetNumberOfPixels(), false);
+
+    typename TImage::Pointer image = TImage::New();
+    image->SetRegions(region);
+    image->SetSpacing(stack->GetSpacing());
+    image->SetOrigin(stack->GetOrigin());
+    image->SetPixelContainer(container);
+    return image;
+}
+
+/**
+ * \class StackFrameReader
+ * \brief Reads the frames of an image stack as TImage, whatever they hold.
+ *
+ * A stack of TImage's pixel type is wrapped without copying, as by
+ * ReadStackFrame().  A stack of another scalar pixel type is copied and
+ * cast to TImage, as an itk::ImageFileReader casts an image file, so a
+ * stack can be read in whatever type the user asks for.  Vector stacks
+ * are only read as vector images.
+ */
+template < class TImage >
+struct StackFrameReader
+{
+    static typename TImage::Pointer Read(ImageStack* stack, unsigned int index)
+    {
+        if (StackPixelTraits< typename TImage::PixelType >::Type() == stack->GetPixelType())
+            return ReadStackFrame< TImage >(stack, index);
+
+        switch (stack->GetPixelType())
+        {
+            case ImageStack::CharFrame:
+                return Cast< itk::Image< unsigned char, 2 > >(stack, index);
+            case ImageStack::ShortFrame:
+                return Cast< itk::Image< unsigned short, 2 > >(stack, index);
+            case ImageStack::FloatFrame:
+                return Cast< itk::Image< float, 2 > >(stack, index);
+            default:
+                // ReadStackFrame explains the mismatch
+                return ReadStackFrame< TImage >(stack, index);
+        }
+    }
+
+private:
+    template < class TStackImage >
+    static typename TImage::Pointer Cast(ImageStack* stack, unsigned int index)
+    {
+        typedef itk::CastImageFilter< TStackImage, TImage > CastType;
+        typename CastType::Pointer cast = CastType::New();
+        cast->SetInput(ReadStackFrame< TStackImage >(stack, index));
+        cast->Update();
+        typename TImage::Pointer frame = cast->GetOutput();
+        frame->DisconnectPipeline();
+        return frame;
+    }
+};
+
+template <>
+struct StackFrameReader< itk::Image< itk::Vector< float, 2 >, 2 > >
+{
+    typedef itk::Image< itk::Vector< float, 2 >, 2 > ImageType;
+    static ImageType::Pointer Read(ImageStack* stack, unsigned int index)
+    {
+        return ReadStackFrame< ImageType >(stack, index);
+    }
+};
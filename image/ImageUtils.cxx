@@ -3,6 +3,11 @@
 #include "itkAdaptImageFilter.h"
 #include "itkNthElementPixelAccessor.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IT_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 template <>
 void PrintImageInfo< ImageTypeV2F2 >(const ImageTypeV2F2* image, const std::string& label, LogStream &logger)
 {
@@ -45,3 +50,41 @@ void PrintImageInfo< ImageTypeV2F2 >(const ImageTypeV2F2* image, const std::stri
         logger << "\tstd:  \t" << (float) stats->GetSigma() << std::endl;
     }
 }
+
+void WidenPixels(const unsigned char* input, float* output, unsigned long count)
+{
+    unsigned long i = 0;
+#ifdef IT_USE_SSE2
+    // 16 pixels at a time: unpack bytes to words to dwords, then convert
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (input + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_ps(output + i,      _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_ps(output + i + 4,  _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_ps(output + i + 8,  _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_ps(output + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+    }
+#endif
+    for (; i < count; i++)
+        output[i] = (float) input[i];
+}
+
+void WidenPixels(const unsigned short* input, float* output, unsigned long count)
+{
+    unsigned long i = 0;
+#ifdef IT_USE_SSE2
+    // 8 pixels at a time: unpack words to dwords, then convert
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i*) (input + i));
+        _mm_storeu_ps(output + i,     _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)));
+        _mm_storeu_ps(output + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)));
+    }
+#endif
+    for (; i < count; i++)
+        output[i] = (float) input[i];
+}
@@ -7,11 +7,15 @@
 #include "itkImageDuplicator.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
 #include "itkRescaleIntensityImageFilter.h"
 #include "itkStatisticsImageFilter.h"
 #include "itkVector.h"
 
 #include "CommonTypes.h"
+#include "FlowImageIO.h"
+#include "ImageIOPool.h"
 #include "Logger.h"
 
 template < class TImage >
@@ -93,6 +97,7 @@ template < class TImage >
 void WriteImage(const TImage* image, const std::string& filename)
 {
     Logger::verbose << "Writing:\t" << filename << std::endl;
+    RegisterFlowImageIO();
     typedef itk::ImageFileWriter< TImage > WriterType;
     typename WriterType::Pointer writer = WriterType::New();
     writer->SetInput(image);
@@ -104,6 +109,7 @@ template < class TImageIn, class TImageOut >
 void WriteImage(const TImageIn* image, const std::string& filename, bool rescale = false)
 {
     Logger::verbose << "Writing:\t" << filename << std::endl;
+    RegisterFlowImageIO();
     typedef itk::RescaleIntensityImageFilter< TImageIn, TImageOut > RescaleType;
     typedef itk::CastImageFilter< TImageIn, TImageOut > CastType;
     typedef itk::ImageFileWriter< TImageOut > WriterType;
@@ -136,11 +142,111 @@ template < class TImage >
 typename TImage::Pointer ReadImage(const std::string& filename)
 {
     Logger::verbose << "Reading:\t" << filename << std::endl;
+    RegisterFlowImageIO();
+    PooledImageIO io(filename);
     typedef itk::ImageFileReader< TImage > ReaderType;
     typename ReaderType::Pointer reader = ReaderType::New();
     reader->SetFileName(filename.c_str());
+    if (io.GetPointer())
+        reader->SetImageIO(io.GetPointer());
     reader->Update();
-    return reader->GetOutput();
+
+    // The ImageIO goes back to the pool; the image must not reach it
+    typename TImage::Pointer image = reader->GetOutput();
+    image->DisconnectPipeline();
+    return image;
+}
+
+/**
+ * Copy a region of an image into a new image holding just that region.
+ * As with itk::RegionOfInterestImageFilter, the new image's region starts
+ * at index zero and its origin is moved to the physical location of the
+ * region's first pixel.  The region must lie within the input's buffered
+ * region.
+ */
+template < class TImage >
+typename TImage::Pointer ExtractImageRegion(const TImage* input, const typename TImage::RegionType& region)
+{
+    typename TImage::RegionType outRegion;
+    typename TImage::IndexType start;
+    start.Fill(0);
+    outRegion.SetIndex(start);
+    outRegion.SetSize(region.GetSize());
+
+    typename TImage::PointType origin;
+    input->TransformIndexToPhysicalPoint(region.GetIndex(), origin);
+
+    typename TImage::Pointer output = TImage::New();
+    output->SetRegions(outRegion);
+    output->SetSpacing(input->GetSpacing());
+    output->SetOrigin(origin);
+    output->Allocate();
+
+    itk::ImageRegionConstIterator< TImage > inIt(input, region);
+    itk::ImageRegionIterator< TImage > outIt(output, outRegion);
+    for (inIt.GoToBegin(), outIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt, ++outIt)
+        outIt.Set(inIt.Get());
+    return output;
+}
+
+/**
+ * Read part of an image from disk, returning an image that holds just
+ * the requested region (cropped to the image bounds), as from
+ * ExtractImageRegion.  Only the requested region is asked of the ImageIO;
+ * formats that can stream decode just the strips or tiles covering it,
+ * others decode the whole file and the region is cut from it.  Throws an
+ * itk::ExceptionObject if the region does not overlap the image.
+ */
+template < class TImage >
+typename TImage::Pointer ReadImageRegion(const std::string& filename, const typename TImage::RegionType& region)
+{
+    Logger::verbose << "Reading:\t" << filename << " (region)" << std::endl;
+    RegisterFlowImageIO();
+    PooledImageIO io(filename);
+    typedef itk::ImageFileReader< TImage > ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(filename.c_str());
+    if (io.GetPointer())
+        reader->SetImageIO(io.GetPointer());
+    reader->SetUseStreaming(true);
+    reader->UpdateOutputInformation();
+
+    typename TImage::RegionType crop(region);
+    if (!crop.Crop(reader->GetOutput()->GetLargestPossibleRegion()))
+    {
+        itk::OStringStream message;
+        message << "ReadImageRegion: the requested region lies outside " << filename;
+        throw itk::ExceptionObject(__FILE__, __LINE__, message.str().c_str(), "ReadImageRegion");
+    }
+
+    reader->GetOutput()->SetRequestedRegion(crop);
+    reader->Update();
+    return ExtractImageRegion< TImage >(reader->GetOutput(), crop);
+}
+
+/**
+ * Convert a buffer of integer pixels to float.  These use SSE2 where the
+ * compiler targets it, and plain loops otherwise.
+ */
+void WidenPixels(const unsigned char* input, float* output, unsigned long count);
+void WidenPixels(const unsigned short* input, float* output, unsigned long count);
+
+/**
+ * Allocate a float image with the same geometry as the input and widen
+ * the input's pixels into it.
+ */
+template < class TInputImage, class TOutputImage >
+typename TOutputImage::Pointer WidenImage(const TInputImage* input)
+{
+    typename TOutputImage::Pointer output = TOutputImage::New();
+    output->SetRegions(input->GetBufferedRegion());
+    output->SetLargestPossibleRegion(input->GetLargestPossibleRegion());
+    output->SetSpacing(input->GetSpacing());
+    output->SetOrigin(input->GetOrigin());
+    output->Allocate();
+    WidenPixels(input->GetBufferPointer(), output->GetBufferPointer(),
+        input->GetBufferedRegion().GetNumberOfPixels());
+    return output;
 }
 
 template < class TImage >
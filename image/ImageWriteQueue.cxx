@@ -0,0 +1,225 @@
+#include "ImageWriteQueue.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "itkExceptionObject.h"
+#include "itkRealTimeClock.h"
+
+#include "FrameCache.h"
+#include "Logger.h"
+#include "MutexLocker.h"
+
+ImageWriteQueue::ImageWriteQueue(unsigned int writers, unsigned int capacity) :
+    jobs(),
+    threads(),
+    capacity(std::max(1u, capacity)),
+    active(0),
+    stop(false),
+    writeCount(0),
+    failureCount(0),
+    flushFailures(0),
+    stallCount(0),
+    stallTime(0.0),
+    highWater(0)
+{
+    writers = std::max(1u, writers);
+    for (unsigned int i = 0; i < writers; i++)
+    {
+        Thread* thread = new Thread();
+        if (thread->Start(&ImageWriteQueue::RunWriter, this))
+        {
+            this->threads.push_back(thread);
+        }
+        else
+        {
+            Logger::warning << "ImageWriteQueue: unable to start writer thread " << i << std::endl;
+            delete thread;
+        }
+    }
+}
+
+ImageWriteQueue::~ImageWriteQueue()
+{
+    this->Flush();
+
+    {
+        MutexLocker lock(this->mutex);
+        this->stop = true;
+        this->jobReady.Broadcast();
+    }
+
+    for (unsigned int i = 0; i < this->threads.size(); i++)
+    {
+        this->threads[i]->Join();
+        delete this->threads[i];
+    }
+}
+
+bool ImageWriteQueue::Flush()
+{
+    MutexLocker lock(this->mutex);
+    while (!this->jobs.empty() || this->active > 0)
+        this->jobDone.Wait(this->mutex);
+
+    bool ok = (this->failureCount == this->flushFailures);
+    this->flushFailures = this->failureCount;
+    return ok;
+}
+
+void ImageWriteQueue::Push(Job* job)
+{
+    // With no writer threads, write here rather than wait forever
+    if (this->threads.empty())
+    {
+        try
+        {
+            job->Write();
+            FrameCache::Instance().Remove(job->filename);
+            MutexLocker lock(this->mutex);
+            this->writeCount++;
+        }
+        catch (itk::ExceptionObject& e)
+        {
+            Logger::error << "ImageWriteQueue: unable to write " << job->filename << ": " << e.GetDescription() << std::endl;
+            MutexLocker lock(this->mutex);
+            this->failureCount++;
+        }
+        catch (std::exception& e)
+        {
+            Logger::error << "ImageWriteQueue: unable to write " << job->filename << ": " << e.what() << std::endl;
+            MutexLocker lock(this->mutex);
+            this->failureCount++;
+        }
+        catch (...)
+        {
+            Logger::error << "ImageWriteQueue: unable to write " << job->filename << ": unknown exception" << std::endl;
+            MutexLocker lock(this->mutex);
+            this->failureCount++;
+        }
+        delete job;
+        return;
+    }
+
+    MutexLocker lock(this->mutex);
+    if (this->jobs.size() >= this->capacity)
+    {
+        // The writers have fallen behind; wait for room
+        itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+        double start = clock->GetTimeStamp();
+        while (this->jobs.size() >= this->capacity)
+            this->jobDone.Wait(this->mutex);
+        this->stallCount++;
+        this->stallTime += clock->GetTimeStamp() - start;
+    }
+
+    this->jobs.push_back(job);
+    this->highWater = std::max(this->highWater, (unsigned int) this->jobs.size() + this->active);
+    this->jobReady.Signal();
+}
+
+void ImageWriteQueue::RunWriter(void* self)
+{
+    static_cast< ImageWriteQueue* >(self)->WriteJobs();
+}
+
+void ImageWriteQueue::WriteJobs()
+{
+    this->mutex.Lock();
+    while (true)
+    {
+        while (this->jobs.empty() && !this->stop)
+            this->jobReady.Wait(this->mutex);
+        if (this->jobs.empty())
+            break;
+
+        Job* job = this->jobs.front();
+        this->jobs.pop_front();
+        this->active++;
+        this->jobDone.Broadcast();
+        this->mutex.Unlock();
+
+        bool ok = true;
+        try
+        {
+            job->Write();
+
+            // Anyone reading this file again should see the new contents
+            FrameCache::Instance().Remove(job->filename);
+        }
+        catch (itk::ExceptionObject& e)
+        {
+            Logger::error << "ImageWriteQueue: unable to write " << job->filename << ": " << e.GetDescription() << std::endl;
+            ok = false;
+        }
+        catch (std::exception& e)
+        {
+            // e.g. std::bad_alloc; escaping the thread would terminate the
+            // program, and leave active counting a job that never finishes
+            Logger::error << "ImageWriteQueue: unable to write " << job->filename << ": " << e.what() << std::endl;
+            ok = false;
+        }
+        catch (...)
+        {
+            Logger::error << "ImageWriteQueue: unable to write " << job->filename << ": unknown exception" << std::endl;
+            ok = false;
+        }
+        delete job;
+
+        this->mutex.Lock();
+        this->active--;
+        if (ok)
+            this->writeCount++;
+        else
+            this->failureCount++;
+        this->jobDone.Broadcast();
+    }
+    this->mutex.Unlock();
+}
+
+unsigned long ImageWriteQueue::GetWriteCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->writeCount;
+}
+
+unsigned long ImageWriteQueue::GetFailureCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->failureCount;
+}
+
+unsigned long ImageWriteQueue::GetStallCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->stallCount;
+}
+
+double ImageWriteQueue::GetStallTime()
+{
+    MutexLocker lock(this->mutex);
+    return this->stallTime;
+}
+
+unsigned int ImageWriteQueue::GetHighWaterMark()
+{
+    MutexLocker lock(this->mutex);
+    return this->highWater;
+}
+
+void ImageWriteQueue::LogStatistics()
+{
+    MutexLocker lock(this->mutex);
+    Logger::verbose << "ImageWriteQueue statistics" << std::endl;
+    Logger::verbose << "\tThreads:   \t" << this->threads.size() << std::endl;
+    Logger::verbose << "\tCapacity:  \t" << this->capacity << std::endl;
+    Logger::verbose << "\tWritten:   \t" << this->writeCount << std::endl;
+    Logger::verbose << "\tFailed:    \t" << this->failureCount << std::endl;
+    Logger::verbose << "\tHigh water:\t" << this->highWater << std::endl;
+    Logger::verbose << "\tStalls:    \t" << this->stallCount << " (" << this->stallTime << " s)" << std::endl;
+    if (this->stallCount > 0)
+    {
+        Logger::info << "ImageWriteQueue: computation waited " << this->stallTime
+            << " s on disk writes; consider more writer threads" << std::endl;
+    }
+}
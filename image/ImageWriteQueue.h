@@ -0,0 +1,171 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Condition.h"
+#include "ImageUtils.h"
+#include "Mutex.h"
+#include "Thread.h"
+
+/**
+ * \class ImageWriteQueue
+ * \brief Writes images to disk on background threads.
+ *
+ * Pipelines used to write each output frame from their main loop, so
+ * the next frame's computation waited on encoding and disk I/O.  An
+ * ImageWriteQueue takes finished images and writes them on one or more
+ * writer threads while the pipeline moves on.
+ *
+ * The queue holds at most Capacity images that are waiting to be
+ * written.  Write() blocks while the queue is full; each such wait is
+ * counted as a stall, together with the time spent waiting, so a
+ * pipeline that outruns its disk can report it.  Flush() blocks until
+ * every queued image has been written, and the destructor flushes too.
+ *
+ * The queue takes ownership of the images it is given: it keeps a
+ * reference until the image is written, and the caller must not change
+ * the image after handing it over.  Filter outputs should be updated and
+ * disconnected from their filter (DisconnectPipeline()) first, so that
+ * the filter allocates a new buffer on its next update rather than
+ * writing over an image that is still queued.  Images shared with
+ * someone else, such as the output of an ImageSetReader, should be
+ * copied.
+ *
+ * Write errors are logged; Flush() reports whether any write failed.
+ */
+class ImageWriteQueue
+{
+public:
+    /**
+     * Create a queue with the given number of writer threads that holds
+     * up to capacity images waiting to be written.
+     */
+    ImageWriteQueue(unsigned int writers = 1, unsigned int capacity = 4);
+    virtual ~ImageWriteQueue();
+
+    /**
+     * Queue image to be written to filename.
+     */
+    template < class TImage >
+    void Write(TImage* image, const std::string& filename)
+    {
+        this->Push(new ImageJob< TImage >(image, filename));
+    }
+
+    /**
+     * Queue image to be converted to TImageOut (by casting, or rescaling
+     * to the output pixel range) and written to filename.  The conversion
+     * happens on the writer thread.
+     */
+    template < class TImageIn, class TImageOut >
+    void Write(TImageIn* image, const std::string& filename, bool rescale = false)
+    {
+        this->Push(new ConvertImageJob< TImageIn, TImageOut >(image, filename, rescale));
+    }
+
+    /**
+     * Wait until every queued image has been written.  Returns false if
+     * any write since the last Flush() failed.
+     */
+    bool Flush();
+
+    unsigned int GetThreadCount() const
+    { return this->threads.size(); }
+    unsigned int GetCapacity() const
+    { return this->capacity; }
+
+    /**
+     * Statistics on the work done by this queue.  Stalls count the times
+     * Write() had to wait for room in the queue; the stall time is the
+     * total time spent waiting, in seconds.  The high water mark is the
+     * most images that were ever queued or being written at once.
+     */
+    unsigned long GetWriteCount();
+    unsigned long GetFailureCount();
+    unsigned long GetStallCount();
+    double GetStallTime();
+    unsigned int GetHighWaterMark();
+    void LogStatistics();
+
+private:
+    /**
+     * A queued write.  Subclasses know the image type.
+     */
+    class Job
+    {
+    public:
+        Job(const std::string& filename) :
+            filename(filename)
+        {}
+        virtual ~Job() {}
+        virtual void Write() = 0;
+
+        std::string filename;
+    };
+
+    template < class TImage >
+    class ImageJob : public Job
+    {
+    public:
+        ImageJob(TImage* image, const std::string& filename) :
+            Job(filename),
+            image(image)
+        {}
+        virtual void Write()
+        { WriteImage< TImage >(this->image, this->filename); }
+
+        typename TImage::Pointer image;
+    };
+
+    template < class TImageIn, class TImageOut >
+    class ConvertImageJob : public Job
+    {
+    public:
+        ConvertImageJob(TImageIn* image, const std::string& filename, bool rescale) :
+            Job(filename),
+            image(image),
+            rescale(rescale)
+        {}
+        virtual void Write()
+        { WriteImage< TImageIn, TImageOut >(this->image, this->filename, this->rescale); }
+
+        typename TImageIn::Pointer image;
+        bool rescale;
+    };
+
+    typedef std::deque< Job* > JobQueue;
+    typedef std::vector< Thread* > ThreadVector;
+
+    // Not implemented on purpose.
+    ImageWriteQueue(const ImageWriteQueue& other);
+    void operator=(const ImageWriteQueue& other);
+
+    /**
+     * Add a job to the queue, waiting for room if necessary.
+     */
+    void Push(Job* job);
+
+    /**
+     * Writer thread entry point and loop.
+     */
+    static void RunWriter(void* self);
+    void WriteJobs();
+
+    Mutex mutex;
+    Condition jobReady;     // signalled when a job is queued, or on shutdown
+    Condition jobDone;      // signalled when a job is taken or finished
+    JobQueue jobs;
+    ThreadVector threads;
+    unsigned int capacity;
+    unsigned int active;    // jobs being written right now
+    bool stop;
+
+    unsigned long writeCount;
+    unsigned long failureCount;
+    unsigned long flushFailures;
+    unsigned long stallCount;
+    double stallTime;
+    unsigned int highWater;
+};
@@ -0,0 +1,187 @@
+#include "ReaderTelemetry.h"
+
+#include <algorithm>
+
+#include "itkMacro.h"
+#include "itkRealTimeClock.h"
+
+ReaderTelemetry::ReaderTelemetry()
+{
+    this->Reset();
+}
+
+void ReaderTelemetry::Reset()
+{
+    this->start = Now();
+    this->requests = 0;
+    this->hits = 0;
+    this->loads = 0;
+    this->decodes = 0;
+    this->bytesDecoded = 0;
+    this->decodeTime = 0.0;
+    std::fill(this->latency, this->latency + LatencyBuckets, 0ul);
+    this->prefetchHits = 0;
+    this->prefetchMisses = 0;
+    this->residentBytes = 0;
+    this->cacheResidentBytes = 0;
+}
+
+void ReaderTelemetry::RecordRequest(bool hit)
+{
+    this->requests++;
+    if (hit)
+        this->hits++;
+}
+
+void ReaderTelemetry::RecordLoad(bool decoded, double seconds, unsigned long bytes)
+{
+    this->loads++;
+    if (!decoded)
+        return;
+
+    this->decodes++;
+    this->bytesDecoded += bytes;
+    this->decodeTime += seconds;
+
+    unsigned int bucket = 0;
+    double limit = 1.0;
+    while (bucket < LatencyBuckets - 1 && seconds * 1000.0 >= limit)
+    {
+        bucket++;
+        limit *= 2.0;
+    }
+    this->latency[bucket]++;
+}
+
+void ReaderTelemetry::RecordPrefetch(bool hit)
+{
+    if (hit)
+        this->prefetchHits++;
+    else
+        this->prefetchMisses++;
+}
+
+void ReaderTelemetry::SetResidentBytes(unsigned long reader, unsigned long cache)
+{
+    this->residentBytes = reader;
+    this->cacheResidentBytes = cache;
+}
+
+void ReaderTelemetry::Merge(const ReaderTelemetry& other)
+{
+    this->start = std::min(this->start, other.start);
+    this->requests += other.requests;
+    this->hits += other.hits;
+    this->loads += other.loads;
+    this->decodes += other.decodes;
+    this->bytesDecoded += other.bytesDecoded;
+    this->decodeTime += other.decodeTime;
+    for (unsigned int i = 0; i < LatencyBuckets; i++)
+        this->latency[i] += other.latency[i];
+    this->prefetchHits += other.prefetchHits;
+    this->prefetchMisses += other.prefetchMisses;
+    this->residentBytes += other.residentBytes;
+    // The FrameCache is shared; don't count it twice
+    this->cacheResidentBytes = std::max(this->cacheResidentBytes, other.cacheResidentBytes);
+}
+
+double ReaderTelemetry::GetLatencyLimit(unsigned int bucket)
+{
+    if (bucket >= LatencyBuckets - 1)
+        return 0.0;
+    return (double) (1ul << bucket);
+}
+
+double ReaderTelemetry::GetElapsedTime() const
+{
+    return Now() - this->start;
+}
+
+double ReaderTelemetry::GetHitRate() const
+{
+    return this->requests > 0 ? (double) this->hits / this->requests : 0.0;
+}
+
+double ReaderTelemetry::GetCacheHitRate() const
+{
+    return this->loads > 0 ? (double) (this->loads - this->decodes) / this->loads : 0.0;
+}
+
+double ReaderTelemetry::GetPrefetchEffectiveness() const
+{
+    unsigned long total = this->prefetchHits + this->prefetchMisses;
+    return total > 0 ? (double) this->prefetchHits / total : 0.0;
+}
+
+double ReaderTelemetry::GetBytesPerSecond() const
+{
+    double elapsed = this->GetElapsedTime();
+    return elapsed > 0.0 ? this->bytesDecoded / elapsed : 0.0;
+}
+
+double ReaderTelemetry::GetDecodeBytesPerSecond() const
+{
+    return this->decodeTime > 0.0 ? this->bytesDecoded / this->decodeTime : 0.0;
+}
+
+double ReaderTelemetry::GetLatencyPercentile(double fraction) const
+{
+    if (this->decodes == 0)
+        return 0.0;
+
+    // Report the upper limit of the bucket holding the given fraction
+    unsigned long target = (unsigned long) (fraction * this->decodes + 0.5);
+    unsigned long count = 0;
+    for (unsigned int i = 0; i < LatencyBuckets - 1; i++)
+    {
+        count += this->latency[i];
+        if (count >= target)
+            return GetLatencyLimit(i);
+    }
+    return 2.0 * GetLatencyLimit(LatencyBuckets - 2);
+}
+
+std::string ReaderTelemetry::GetSummary() const
+{
+    itk::OStringStream summary;
+    summary.precision(3);
+    summary << "hit rate " << 100.0 * this->GetHitRate() << "%"
+            << ", cache hit rate " << 100.0 * this->GetCacheHitRate() << "%"
+            << ", " << this->decodes << " decodes"
+            << " (median " << this->GetLatencyPercentile(0.5) << " ms"
+            << ", 95% " << this->GetLatencyPercentile(0.95) << " ms)"
+            << ", " << this->GetBytesPerSecond() / (1024.0 * 1024.0) << " MB/s"
+            << ", " << this->residentBytes / (1024 * 1024) << " MB resident";
+    if (this->prefetchHits + this->prefetchMisses > 0)
+        summary << ", prefetch " << 100.0 * this->GetPrefetchEffectiveness() << "% effective";
+    return summary.str();
+}
+
+void ReaderTelemetry::Print(LogStream& logger) const
+{
+    logger << "Reader telemetry" << std::endl;
+    logger << "\tElapsed:     \t" << this->GetElapsedTime() << " s" << std::endl;
+    logger << "\tRequests:    \t" << this->requests << " (" << 100.0 * this->GetHitRate() << "% hits)" << std::endl;
+    logger << "\tLoads:       \t" << this->loads << " (" << 100.0 * this->GetCacheHitRate() << "% cached)" << std::endl;
+    logger << "\tDecodes:     \t" << this->decodes << ", " << this->bytesDecoded << " bytes in " << this->decodeTime << " s" << std::endl;
+    logger << "\tDecode rate: \t" << this->GetDecodeBytesPerSecond() << " bytes/s decoding, "
+           << this->GetBytesPerSecond() << " bytes/s overall" << std::endl;
+    logger << "\tPrefetch:    \t" << this->prefetchHits << " hits, " << this->prefetchMisses << " misses" << std::endl;
+    logger << "\tResident:    \t" << this->residentBytes << " bytes (FrameCache " << this->cacheResidentBytes << ")" << std::endl;
+    logger << "\tDecode times:" << std::endl;
+    for (unsigned int i = 0; i < LatencyBuckets; i++)
+    {
+        if (this->latency[i] == 0)
+            continue;
+        if (i < LatencyBuckets - 1)
+            logger << "\t\t< " << GetLatencyLimit(i) << " ms:\t" << this->latency[i] << std::endl;
+        else
+            logger << "\t\tslower:\t" << this->latency[i] << std::endl;
+    }
+}
+
+double ReaderTelemetry::Now()
+{
+    itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+    return clock->GetTimeStamp();
+}
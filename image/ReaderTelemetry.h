@@ -0,0 +1,164 @@
+#pragma once
+
+#include <string>
+
+#include "Logger.h"
+
+/**
+ * \class ReaderTelemetry
+ * \brief Running statistics on the image reads of a sequence reader.
+ *
+ * Sequence readers (ImageSetReader, ImageFileSetReader,
+ * VectorFileSetReader) keep a ReaderTelemetry as they serve images, and
+ * hand out copies with GetTelemetry() while they run, so a long job can
+ * be watched rather than only summarized when the reader is destroyed.
+ * Pipelines pass their input's telemetry on to their observers.
+ *
+ * The statistics are:
+ *
+ *   - Requests, and window hits: requests answered from the images the
+ *     reader already holds.  The hit rate shows whether CacheRadius is
+ *     large enough for the access pattern.
+ *   - Loads: images brought into the reader, and how many of those had
+ *     to be decoded from disk rather than found in the FrameCache or
+ *     mapped from an image stack.
+ *   - A histogram of decode times, in power-of-two millisecond buckets,
+ *     and the bytes decoded, per second of decoding and per second of
+ *     running time.  A job whose decode rate is close to its running
+ *     rate spends its time waiting on I/O.
+ *   - Prefetch hits and misses: images the prefetch thread had ready (or
+ *     in progress) when they were needed, and images it did not.
+ *   - Bytes resident in the reader, and in the shared FrameCache.
+ *
+ * Recording is not thread-safe; readers record under their own locks.
+ */
+class ReaderTelemetry
+{
+public:
+    /**
+     * Decode time histogram buckets.  Bucket i counts decodes that took
+     * less than 2^i ms (and at least 2^(i-1) ms); the last bucket counts
+     * everything slower.
+     */
+    enum { LatencyBuckets = 12 };
+
+    ReaderTelemetry();
+
+    /**
+     * Forget everything recorded, and restart the clock.
+     */
+    void Reset();
+
+    /**
+     * Record one image request, and whether the reader already held the
+     * image.
+     */
+    void RecordRequest(bool hit);
+
+    /**
+     * Record one image load that took the given time, in seconds, and
+     * yielded the given number of bytes.  decoded is false for loads
+     * served without decoding (by the FrameCache or an image stack).
+     */
+    void RecordLoad(bool decoded, double seconds, unsigned long bytes);
+
+    /**
+     * Record whether the prefetch thread had an image ready when needed.
+     */
+    void RecordPrefetch(bool hit);
+
+    /**
+     * Set the bytes held by the reader, and by the FrameCache.
+     */
+    void SetResidentBytes(unsigned long reader, unsigned long cache);
+
+    /**
+     * Add the statistics of another reader to these, e.g. to combine the
+     * per-pixel-type readers of an ImageFileSetReader.
+     */
+    void Merge(const ReaderTelemetry& other);
+
+    unsigned long GetRequestCount() const
+    { return this->requests; }
+    unsigned long GetHitCount() const
+    { return this->hits; }
+    unsigned long GetLoadCount() const
+    { return this->loads; }
+    unsigned long GetDecodeCount() const
+    { return this->decodes; }
+    unsigned long GetBytesDecoded() const
+    { return this->bytesDecoded; }
+    double GetDecodeTime() const
+    { return this->decodeTime; }
+    unsigned long GetPrefetchHitCount() const
+    { return this->prefetchHits; }
+    unsigned long GetPrefetchMissCount() const
+    { return this->prefetchMisses; }
+    unsigned long GetResidentBytes() const
+    { return this->residentBytes; }
+    unsigned long GetCacheResidentBytes() const
+    { return this->cacheResidentBytes; }
+    unsigned long GetLatencyCount(unsigned int bucket) const
+    { return bucket < LatencyBuckets ? this->latency[bucket] : 0; }
+
+    /**
+     * The upper limit of a latency bucket, in milliseconds (zero for the
+     * last, unbounded, bucket).
+     */
+    static double GetLatencyLimit(unsigned int bucket);
+
+    /**
+     * Seconds since the telemetry was started or reset.
+     */
+    double GetElapsedTime() const;
+
+    /**
+     * Derived rates.  The hit rate is the fraction of requests answered
+     * from the reader's window; the cache hit rate is the fraction of
+     * loads that needed no decoding; the prefetch effectiveness is the
+     * fraction of prefetch-era loads the prefetch thread had ready.  Each
+     * is zero when nothing has been recorded.
+     */
+    double GetHitRate() const;
+    double GetCacheHitRate() const;
+    double GetPrefetchEffectiveness() const;
+
+    /**
+     * Bytes decoded per second of running time, and per second spent
+     * decoding.
+     */
+    double GetBytesPerSecond() const;
+    double GetDecodeBytesPerSecond() const;
+
+    /**
+     * Decode time at the given fraction (e.g. 0.5, 0.95) of decodes, in
+     * milliseconds, estimated from the histogram.
+     */
+    double GetLatencyPercentile(double fraction) const;
+
+    /**
+     * A one-line summary, suitable for progress messages.
+     */
+    std::string GetSummary() const;
+
+    /**
+     * Log every statistic, including the latency histogram.
+     */
+    void Print(LogStream& logger) const;
+
+private:
+    static double Now();
+
+    double start;
+    unsigned long requests;
+    unsigned long hits;
+    unsigned long loads;
+    unsigned long decodes;
+    unsigned long bytesDecoded;
+    double decodeTime;
+    unsigned long latency[LatencyBuckets];
+    unsigned long prefetchHits;
+    unsigned long prefetchMisses;
+    unsigned long residentBytes;
+    unsigned long cacheResidentBytes;
+};
@@ -0,0 +1,286 @@
+#include "SequenceManifest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+
+#include "itkImageIOBase.h"
+
+#include "FileUtils.h"
+#include "ImageIOPool.h"
+#include "ImageStack.h"
+#include "Logger.h"
+
+namespace
+{
+    const std::string MANIFEST_NAME("ImageTracker.manifest");
+    const std::string MANIFEST_HEADER("# ImageTracker manifest 2");
+
+    void ClearFrame(SequenceManifest::FrameInfo& info)
+    {
+        info.width = info.height = 0;
+        info.componentType = "";
+        info.components = 0;
+        info.spacing[0] = info.spacing[1] = 1.0;
+        info.bytes = 0;
+        info.time = 0;
+    }
+}
+
+SequenceManifest::SequenceManifest() :
+    frames(),
+    probeCount(0)
+{
+}
+
+SequenceManifest::SequenceManifest(const FileSet& files) :
+    frames(),
+    probeCount(0)
+{
+    this->Build(files);
+}
+
+bool SequenceManifest::Build(const FileSet& files)
+{
+    std::string function("SequenceManifest::Build");
+    this->frames.clear();
+    this->probeCount = 0;
+
+    if (files.size() == 1 && ImageStack::IsStackFile(files[0]))
+        return this->BuildStack(files[0]);
+
+    std::map< std::string, FrameMap > directories;
+    std::set< std::string > changed;
+    bool ok = true;
+
+    for (unsigned int i = 0; i < files.size(); i++)
+    {
+        std::string file = files[i];
+        std::string directory = DirectoryPart(file);
+        std::string name = file.substr(directory.size());
+
+        // Load each directory's manifest the first time we need it
+        if (directories.find(directory) == directories.end())
+            Load(directory, directories[directory]);
+        FrameMap& entries = directories[directory];
+
+        FrameInfo info;
+        ClearFrame(info);
+        long time, size;
+        if (!FileStamp(file, time, size))
+        {
+            Logger::warning << function << ": unable to find " << file << std::endl;
+            ok = false;
+        }
+        else
+        {
+            FrameMap::iterator it = entries.find(name);
+            if (it != entries.end() &&
+                it->second.time == time &&
+                it->second.bytes == (unsigned long) size)
+            {
+                info = it->second;
+            }
+            else
+            {
+                this->probeCount++;
+                if (Probe(file, info))
+                {
+                    info.bytes = size;
+                    info.time = time;
+                    info.file = name;
+                    entries[name] = info;
+                    changed.insert(directory);
+                }
+                else
+                {
+                    Logger::warning << function << ": unable to read image information from " << file << std::endl;
+                    ClearFrame(info);
+                    ok = false;
+                }
+            }
+        }
+
+        info.file = file;
+        this->frames.push_back(info);
+    }
+
+    for (std::set< std::string >::iterator it = changed.begin(); it != changed.end(); ++it)
+        Save(*it, directories[*it]);
+
+    Logger::debug << function << ": " << this->frames.size() << " frames, "
+        << this->probeCount << " probed" << std::endl;
+    return ok;
+}
+
+bool SequenceManifest::BuildStack(const std::string& file)
+{
+    ImageStack::Pointer stack = ImageStack::New();
+    if (!stack->Open(file))
+        return false;
+
+    FrameInfo info;
+    ClearFrame(info);
+    info.file = file;
+    info.width = stack->GetWidth();
+    info.height = stack->GetHeight();
+    info.spacing[0] = stack->GetSpacing()[0];
+    info.spacing[1] = stack->GetSpacing()[1];
+    info.bytes = stack->GetFrameBytes();
+    long size;
+    FileStamp(file, info.time, size);
+
+    switch (stack->GetPixelType())
+    {
+        case ImageStack::CharFrame:
+            info.componentType = "unsigned_char";
+            info.components = 1;
+            break;
+        case ImageStack::ShortFrame:
+            info.componentType = "unsigned_short";
+            info.components = 1;
+            break;
+        case ImageStack::FloatFrame:
+            info.componentType = "float";
+            info.components = 1;
+            break;
+        case ImageStack::VectorFloatFrame:
+            info.componentType = "float";
+            info.components = 2;
+            break;
+        default:
+            break;
+    }
+
+    this->frames.assign(stack->GetFrameCount(), info);
+    return true;
+}
+
+std::string SequenceManifest::GetComponentType() const
+{
+    if (this->frames.empty())
+        return "";
+    for (unsigned int i = 1; i < this->frames.size(); i++)
+    {
+        if (this->frames[i].componentType != this->frames[0].componentType)
+            return "";
+    }
+    return this->frames[0].componentType;
+}
+
+unsigned int SequenceManifest::GetComponentCount() const
+{
+    if (this->frames.empty())
+        return 0;
+    for (unsigned int i = 1; i < this->frames.size(); i++)
+    {
+        if (this->frames[i].components != this->frames[0].components)
+            return 0;
+    }
+    return this->frames[0].components;
+}
+
+bool SequenceManifest::IsUniformSize() const
+{
+    for (unsigned int i = 1; i < this->frames.size(); i++)
+    {
+        if (this->frames[i].width != this->frames[0].width ||
+            this->frames[i].height != this->frames[0].height)
+            return false;
+    }
+    return true;
+}
+
+std::string SequenceManifest::ManifestFile(const std::string& directory)
+{
+    return directory + MANIFEST_NAME;
+}
+
+void SequenceManifest::Load(const std::string& directory, FrameMap& entries)
+{
+    std::ifstream in(ManifestFile(directory).c_str());
+    if (!in.good())
+        return;
+
+    std::string line;
+    std::getline(in, line);
+    if (line != MANIFEST_HEADER)
+    {
+        Logger::warning << "SequenceManifest::Load: ignoring " << ManifestFile(directory)
+            << "; it was written by a different version" << std::endl;
+        return;
+    }
+
+    // One frame per line: the file name, a tab, then the values
+    while (std::getline(in, line))
+    {
+        std::string::size_type tab = line.find('\t');
+        if (tab == std::string::npos)
+            continue;
+
+        FrameInfo info;
+        ClearFrame(info);
+        info.file = line.substr(0, tab);
+        char type[64];
+        if (sscanf(line.c_str() + tab + 1, "%u %u %63s %u %lf %lf %lu %ld",
+                &info.width, &info.height, type, &info.components,
+                &info.spacing[0], &info.spacing[1],
+                &info.bytes, &info.time) == 8)
+        {
+            info.componentType = type;
+            entries[info.file] = info;
+        }
+    }
+}
+
+bool SequenceManifest::Save(const std::string& directory, const FrameMap& entries)
+{
+    std::string filename(ManifestFile(directory));
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::trunc);
+    if (!out.good())
+    {
+        Logger::debug << "SequenceManifest::Save: unable to write " << filename << std::endl;
+        return false;
+    }
+
+    out.precision(17);
+    out << MANIFEST_HEADER << std::endl;
+    for (FrameMap::const_iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        const FrameInfo& info = it->second;
+        out << info.file << "\t"
+            << info.width << " " << info.height << " "
+            << info.componentType << " " << info.components << " "
+            << info.spacing[0] << " " << info.spacing[1] << " "
+            << info.bytes << " " << info.time << std::endl;
+    }
+    return out.good();
+}
+
+bool SequenceManifest::Probe(const std::string& file, FrameInfo& info)
+{
+    // Read only the header; no pixels are decoded
+    PooledImageIO pooled(file);
+    itk::ImageIOBase* io = pooled.GetPointer();
+    if (io == NULL)
+        return false;
+
+    try
+    {
+        io->SetFileName(file.c_str());
+        io->ReadImageInformation();
+    }
+    catch (itk::ExceptionObject& e)
+    {
+        return false;
+    }
+
+    info.width = io->GetDimensions(0);
+    info.height = io->GetNumberOfDimensions() > 1 ? io->GetDimensions(1) : 1;
+    info.componentType = io->GetComponentTypeAsString(io->GetComponentType());
+    info.components = io->GetNumberOfComponents();
+    info.spacing[0] = io->GetSpacing(0);
+    info.spacing[1] = io->GetNumberOfDimensions() > 1 ? io->GetSpacing(1) : 1.0;
+    return true;
+}
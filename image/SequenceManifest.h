@@ -0,0 +1,116 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "FileSet.h"
+
+/**
+ * \class SequenceManifest
+ * \brief Persisted per-frame information about the files in a FileSet.
+ *
+ * Learning the pixel type and size of an image sequence used to mean
+ * opening (and often decoding) its files.  A SequenceManifest records,
+ * for each frame, the image size, pixel component type and count,
+ * spacing, file size and modification time, so callers can answer those
+ * questions without touching the images.  Only the image headers are
+ * ever read.
+ *
+ * Manifests are saved as ImageTracker.manifest in each directory that
+ * holds frames, and shared by every FileSet drawn from that directory.
+ * Build() reloads the saved manifest, stats each file, and probes only
+ * files that are new or whose size or modification time changed; the
+ * manifest is saved again if anything changed.  Directories that cannot
+ * be written simply are not saved.
+ *
+ * A FileSet naming a single image stack (.its) is described from the
+ * stack header, one entry per frame.
+ */
+class SequenceManifest
+{
+public:
+    /**
+     * What the manifest knows about one frame.
+     */
+    struct FrameInfo
+    {
+        std::string file;
+        unsigned int width;
+        unsigned int height;
+        std::string componentType;  // as itk::ImageIOBase::GetComponentTypeAsString
+        unsigned int components;
+        double spacing[2];
+        unsigned long bytes;        // file size
+        long time;                  // file modification time
+    };
+
+    typedef std::vector< FrameInfo > FrameVector;
+
+    SequenceManifest();
+
+    /**
+     * Build the manifest for a FileSet.
+     */
+    SequenceManifest(const FileSet& files);
+
+    /**
+     * Build the manifest for a FileSet, reusing saved manifests for files
+     * that have not changed.  Returns false if any file could not be
+     * described; those frames have zero size.
+     */
+    bool Build(const FileSet& files);
+
+    unsigned int size() const
+    { return this->frames.size(); }
+
+    const FrameInfo& operator[](unsigned int index) const
+    { return this->frames[index]; }
+
+    /**
+     * The component type and count shared by every frame, or "" and 0 if
+     * frames differ (or there are none).
+     */
+    std::string GetComponentType() const;
+    unsigned int GetComponentCount() const;
+
+    /**
+     * True if every frame has the same size.
+     */
+    bool IsUniformSize() const;
+
+    /**
+     * The number of files probed (rather than taken from a saved
+     * manifest) by the last Build().
+     */
+    unsigned int GetProbeCount() const
+    { return this->probeCount; }
+
+    /**
+     * The manifest file name for a directory.
+     */
+    static std::string ManifestFile(const std::string& directory);
+
+private:
+    typedef std::map< std::string, FrameInfo > FrameMap;
+
+    /**
+     * Read and write the manifest for one directory.  Entries are keyed
+     * by file name without the directory.
+     */
+    static void Load(const std::string& directory, FrameMap& entries);
+    static bool Save(const std::string& directory, const FrameMap& entries);
+
+    /**
+     * Describe one file by reading its image header.
+     */
+    static bool Probe(const std::string& file, FrameInfo& info);
+
+    /**
+     * Describe the frames of an image stack.
+     */
+    bool BuildStack(const std::string& file);
+
+    FrameVector frames;
+    unsigned int probeCount;
+};
@@ -3,6 +3,8 @@
 #include "itkImage.h"
 #include "itkVector.h"
 
+#include "ReaderTelemetry.h"
+
 /**
  * \class VectorFileSet
  * \brief Defines operations for handling sets of vector images.
@@ -54,5 +56,11 @@ public:
     /**
      * Get the number of vector images in this VectorFileSet.
      */
-    virtual int GetImageCount() = 0;
+    virtual int GetImageCount() = 0;    
+    /**
+     * A snapshot of the telemetry of the reads behind this VectorFileSet; see
+     * ReaderTelemetry.  Sets that keep none return empty telemetry.
+     */
+    virtual ReaderTelemetry GetTelemetry()
+    { return ReaderTelemetry(); }
 };
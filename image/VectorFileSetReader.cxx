@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <string>
 
+#include "FrameCache.h"
 #include "Logger.h"
 
 VectorFileSetReader::VectorFileSetReader()
@@ -18,6 +19,7 @@ VectorFileSetReader::~VectorFileSetReader()
 void VectorFileSetReader::SetFileSet(const FileSet& files)
 {
     this->files = files;
+    this->telemetry.Reset();
     
     // prime the reader
     this->SetImageIndex(this->index);
@@ -63,6 +65,17 @@ VectorFileSet::ImageType* VectorFileSetReader::GetOutput()
 
 VectorFileSet::ImageType* VectorFileSetReader::GetImage(unsigned int idx)
 {
+    // The current frame is already loaded
+    unsigned int previous = this->index;
     this->SetImageIndex(idx);
+    this->telemetry.RecordRequest(this->index == previous);
     return this->GetOutput();
 }
+
+ReaderTelemetry VectorFileSetReader::GetTelemetry()
+{
+    ReaderTelemetry snapshot(this->telemetry);
+    snapshot.Merge(this->reader->GetTelemetry());
+    snapshot.SetResidentBytes(FrameCache::ImageBytes(this->GetOutput()), FrameCache::Instance().GetResidentBytes());
+    return snapshot;
+}
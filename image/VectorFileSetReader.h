@@ -1,8 +1,8 @@
 #pragma once
 
 #include "itkLightObject.h"
-#include "itkImageFileReader.h"
 
+#include "CachedImageFileReader.h"
 #include "FileSet.h"
 #include "VectorFileSet.h"
 
@@ -11,7 +11,9 @@
  * \brief Implementation of VectorFileSet that reads files from disk.
  * 
  * This VectorFileSet reads image files directly from disk.
- * The output image is always VectorFileSet::VectorImageType.
+ * The output image is always VectorFileSet::VectorImageType.  Frames
+ * are read through the shared FrameCache.  Compact flow files (.itf,
+ * see FlowCodec) are read like any other vector image.
  */
 class VectorFileSetReader 
     : public itk::LightObject, 
@@ -24,7 +26,7 @@ public:
     typedef itk::SmartPointer<const Self> ConstPointer;
     itkNewMacro(Self);
     
-    typedef itk::ImageFileReader<VectorFileSet::ImageType> ReaderType;
+    typedef CachedImageFileReader<VectorFileSet::ImageType> ReaderType;
 
     /**
      * Set the file names that this VectorFileSet should read
@@ -40,6 +42,7 @@ public:
     virtual int GetImageCount();
     virtual VectorFileSet::ImageType* GetOutput();
     virtual VectorFileSet::ImageType* GetImage(unsigned int index);
+    virtual ReaderTelemetry GetTelemetry();
 
 protected:
     VectorFileSetReader();
@@ -53,4 +56,7 @@ private:
     ReaderType::Pointer reader;
     FileSet files;
     unsigned int index;
+    
+    // Requests; loads are in the reader
+    ReaderTelemetry telemetry;
 };
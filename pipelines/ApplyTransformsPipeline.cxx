@@ -7,6 +7,7 @@
 #include "itkCenteredRigid2DTransform.h"
 
 #include "ImageUtils.h"
+#include "ImageWriteQueue.h"
 #include "Logger.h"
 #include "MultiResolutionRegistrationPipeline.h"
 #include "TransformGroup.h"
@@ -62,6 +63,7 @@ void ApplyTransformsPipeline::Update()
     // output file names
     int index = 0;
     int count = this->input->GetImageCount();
+    ImageWriteQueue writer(this->GetWriterThreads(), this->GetWriteQueueLength());
     
     for (TransformVector::iterator vecIt = pTransforms->begin();
          vecIt != pTransforms->end() && 
@@ -79,12 +81,19 @@ void ApplyTransformsPipeline::Update()
         resample->SetTransform(transform);
         
         // Write the image
-        WriteImage(cast->GetOutput(), this->outputFiles[index]);
+        cast->Update();
+        
+        // Hand the result to the writer; the next update allocates anew
+        WriteImageType::Pointer output = cast->GetOutput();
+        output->DisconnectPipeline();
+        writer.Write(output.GetPointer(), this->outputFiles[index]);
         abort = this->NotifyProgress(((double) (index+1)/count));
     }
     
     // At this point, we have succeeded if we were not stopped.
-    this->SetSuccess(!abort);
+    bool written = writer.Flush();
+    writer.LogStatistics();
+    this->SetSuccess(!abort && written);
     
     Logger::verbose << function << ": Cleaning up dumb pointers" << std::endl;
     delete (pTransforms);
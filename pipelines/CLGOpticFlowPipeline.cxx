@@ -1,42 +1,146 @@
 #include "CLGOpticFlowPipeline.h"
 
+#include <algorithm>
+
+#include "FlowWarmStart.h"
+#include "FramePairScheduler.h"
 #include "Logger.h"
 
 CLGOpticFlowPipeline::CLGOpticFlowPipeline(void)
 {
-    this->input = NULL;
     this->flowFilter = FlowFilterType::New();
     this->smooth = SmoothFilterType::New();
 }
 
+namespace
+{
+    /**
+     * Computes CLG flow for the pairs given to one FramePairScheduler
+     * worker.  Each worker has its own flow filter and derivative cache;
+     * the cache still pays off when a worker gets consecutive pairs.
+     * With a warm start, each pair starts from a prediction made from
+     * the last pair's flow.
+     */
+    class CLGWorker : public FramePairScheduler::Worker
+    {
+    public:
+        typedef CLGOpticFlowPipeline::FlowFilterType FlowFilterType;
+        typedef CLGOpticFlowPipeline::FlowImageType FlowImageType;
+        typedef CLGOpticFlowPipeline::DerivativeCacheType DerivativeCacheType;
+
+        CLGWorker(FlowFilterType* filter, unsigned int count) :
+            filter(filter),
+            count(count),
+            warm(false)
+        {
+            this->derivatives.SetNumberOfThreads(filter->GetNumberOfThreads());
+        }
+
+        /**
+         * Start each pair from the previous pair's flow.
+         */
+        void SetWarmStart(double damping, bool warp)
+        {
+            this->warm = true;
+            this->warmStart.SetDamping(damping);
+            this->warmStart.SetWarp(warp);
+            this->filter->UseInitialFlowOn();
+        }
+
+        virtual itk::DataObject::Pointer Compute(unsigned int pair, ImageType* image1, ImageType* image2)
+        {
+            double sigma = this->filter->GetSpatialSigma();
+            if (this->warm)
+                this->filter->SetInitialFlow(this->warmStart.GetInitialFlow(pair));
+            this->filter->SetInput1(image1);
+            this->filter->SetInput2(image2);
+            this->filter->SetDerivatives1(this->derivatives.GetDerivatives(pair, sigma, image1));
+            this->filter->SetDerivatives2(this->derivatives.GetDerivatives(pair+1, sigma, image2));
+            this->filter->Update();
+            Logger::info << "CLGOpticFlowPipeline::Update: pair " << (pair+1) << "/" << this->count << ": "
+                << this->filter->GetElapsedIterations() << " iterations" << std::endl;
+
+            // Hand the flow field over; the next update allocates anew
+            FlowImageType::Pointer flow = this->filter->GetOutput();
+            flow->DisconnectPipeline();
+            this->filter->SetDerivatives1(NULL);
+            this->filter->SetDerivatives2(NULL);
+            if (this->warm)
+            {
+                this->filter->SetInitialFlow(NULL);
+                this->warmStart.SetFlow(pair, flow);
+            }
+            return flow.GetPointer();
+        }
+
+        virtual void LogStatistics()
+        {
+            this->derivatives.LogStatistics();
+            if (this->warm)
+                this->warmStart.LogStatistics();
+        }
+
+    private:
+        FlowFilterType::Pointer filter;
+        DerivativeCacheType derivatives;
+        unsigned int count;
+        bool warm;
+        FlowWarmStart< FlowImageType > warmStart;
+    };
+}
+
 void CLGOpticFlowPipeline::Update()
 {
     std::string function("CLGOpticFlowPipeline::Update");
     Logger::debug << function << ": Checking parameters" << std::endl;
     if (!this->input || 
-         this->input->size() < 2 ||
+         this->input->GetImageCount() < 2 ||
          this->GetOutputFiles().size() < 2)
     {
         Logger::warning << function << ": input and output not properly configured; aborting" << std::endl;
         return;
     }
     
-    bool abort = this->NotifyProgress(0.0, "Initializing");
+    if (this->NotifyProgress(0.0, "Initializing"))
+    {
+        this->SetSuccess(false);
+        return;
+    }
     
     Logger::debug << function << ": Setting up flow computation" << std::endl;
-    int count = this->input->size() - 1;
-    for (int i = 0; 
-         i < count &&
-         i < this->GetOutputFiles().size() &&
-         !abort; i++)
+    unsigned int count = this->input->GetImageCount() - 1;
+    unsigned int workers = this->GetPairWorkerCount();
+    FramePairScheduler scheduler;
+    for (unsigned int i = 0; i < workers; i++)
     {
-        this->flowFilter->SetInput1(dynamic_cast<ImageType*>(this->input->GetImage(i)));
-        this->flowFilter->SetInput2(dynamic_cast<ImageType*>(this->input->GetImage(i+1)));
-        WriteImage(this->flowFilter->GetOutput(), this->outputFiles[i]);
-        bool abort = this->NotifyProgress((double) i / count, "Computing flow");
+        FlowFilterType::Pointer filter = this->NewFlowFilter();
+        filter->SetNumberOfThreads(FramePairScheduler::GetThreadsPerWorker(workers));
+        CLGWorker* worker = new CLGWorker(filter, count);
+        if (this->GetWarmStart())
+            worker->SetWarmStart(this->GetWarmStartDamping(), this->GetWarmStartWarp());
+        scheduler.AddWorker(worker);
     }
-    
-    this->SetSuccess(!abort);
+
+    this->SetSuccess(scheduler.Run< FlowImageType >(this, "Computing flow"));
+}
+
+CLGOpticFlowPipeline::FlowFilterType::Pointer CLGOpticFlowPipeline::NewFlowFilter()
+{
+    FlowFilterType::Pointer filter = FlowFilterType::New();
+    filter->SetSpatialSigma(this->flowFilter->GetSpatialSigma());
+    filter->SetIntegrationSigma(this->flowFilter->GetIntegrationSigma());
+    filter->SetRegularization(this->flowFilter->GetRegularization());
+    filter->SetRelaxation(this->flowFilter->GetRelaxation());
+    filter->SetIterations(this->flowFilter->GetIterations());
+    filter->SetAbsoluteTolerance(this->flowFilter->GetAbsoluteTolerance());
+    filter->SetRelativeTolerance(this->flowFilter->GetRelativeTolerance());
+    filter->SetMinimumIterations(this->flowFilter->GetMinimumIterations());
+    filter->SetTileIterations(this->flowFilter->GetTileIterations());
+    filter->SetTileRows(this->flowFilter->GetTileRows());
+    filter->SetUseMultigrid(this->flowFilter->GetUseMultigrid());
+    filter->SetInitializeLocally(this->flowFilter->GetInitializeLocally());
+    filter->SetMultigridCycles(this->flowFilter->GetMultigridCycles());
+    return filter;
 }
 
 void CLGOpticFlowPipeline::SetSpatialSigma(double sigma) 
@@ -59,11 +163,43 @@ void CLGOpticFlowPipeline::SetIterations(unsigned int iter)
 { 
     this->flowFilter->SetIterations(iter);
 }
+void CLGOpticFlowPipeline::SetAbsoluteTolerance(double tolerance)
+{
+    this->flowFilter->SetAbsoluteTolerance(tolerance);
+}
+void CLGOpticFlowPipeline::SetRelativeTolerance(double tolerance)
+{
+    this->flowFilter->SetRelativeTolerance(tolerance);
+}
+void CLGOpticFlowPipeline::SetMinimumIterations(unsigned int iter)
+{
+    this->flowFilter->SetMinimumIterations(iter);
+}
+void CLGOpticFlowPipeline::SetTileIterations(unsigned int iter)
+{
+    this->flowFilter->SetTileIterations(iter);
+}
+void CLGOpticFlowPipeline::SetTileRows(unsigned int rows)
+{
+    this->flowFilter->SetTileRows(rows);
+}
+void CLGOpticFlowPipeline::SetUseMultigrid(bool multigrid)
+{
+    this->flowFilter->SetUseMultigrid(multigrid);
+}
+void CLGOpticFlowPipeline::SetInitializeLocally(bool local)
+{
+    this->flowFilter->SetInitializeLocally(local);
+}
+void CLGOpticFlowPipeline::SetMultigridCycles(unsigned int cycles)
+{
+    this->flowFilter->SetMultigridCycles(cycles);
+}
     
-void CLGOpticFlowPipeline::SetInput(ReaderType input)
+void CLGOpticFlowPipeline::SetInput(ImageFileSet* input)
 {
-    this->input = input;
-    this->smooth->SetInput(dynamic_cast<ImageTypeF2*>(this->input->GetImage(0)));
+    Superclass::SetInput(input);
+    this->smooth->SetInput(this->input->GetOutput());
 }
 
 CLGOpticFlowPipeline::ImageType::Pointer CLGOpticFlowPipeline::GetPreviewImage()
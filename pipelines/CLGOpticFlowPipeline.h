@@ -4,26 +4,26 @@
 #include "itkObject.h"
 
 #include "CLGOpticFlowImageFilter.h"
-#include "CommonTypes.h"
-#include "FileSet.h"
-#include "ImageSetReader.h"
-#include "ItkPipeline.h"
+#include "FrameDerivativeCache.h"
+#include "ImageFileSet.h"
+#include "ItkImagePipeline.h"
 
 class CLGOpticFlowPipeline : 
-    public ItkPipeline
+    public ItkImagePipeline
 {
 public:
     /** Standard itk object typedefs */
     typedef CLGOpticFlowPipeline Self;
     typedef itk::SmartPointer<Self> Pointer;
     typedef itk::SmartPointer<const Self> ConstPointer;
-    typedef ItkPipeline Superclass;
+    typedef ItkImagePipeline Superclass;
 
     /** Some helpful typedefs */
-    typedef CommonTypes::InternalImageType ImageType;
-    typedef ImageSetReaderBase* ReaderType;
+    typedef ImageFileSet::ImageType ImageType;
     typedef CLGOpticFlowImageFilter<ImageType, ImageType> FlowFilterType;
+    typedef FlowFilterType::OutputImageType FlowImageType;
     typedef itk::DiscreteGaussianImageFilter< ImageType, ImageType > SmoothFilterType;
+    typedef FrameDerivativeCache< ImageType > DerivativeCacheType;
 
     /** itk object macros */
     itkNewMacro(Self);
@@ -33,6 +33,14 @@ public:
     double GetRegularization() { return this->flowFilter->GetRegularization(); }
     double GetRelaxation() { return this->flowFilter->GetRelaxation(); }
     unsigned int GetIterations() { return this->flowFilter->GetIterations(); }
+    double GetAbsoluteTolerance() { return this->flowFilter->GetAbsoluteTolerance(); }
+    double GetRelativeTolerance() { return this->flowFilter->GetRelativeTolerance(); }
+    unsigned int GetMinimumIterations() { return this->flowFilter->GetMinimumIterations(); }
+    unsigned int GetTileIterations() { return this->flowFilter->GetTileIterations(); }
+    unsigned int GetTileRows() { return this->flowFilter->GetTileRows(); }
+    bool GetUseMultigrid() { return this->flowFilter->GetUseMultigrid(); }
+    bool GetInitializeLocally() { return this->flowFilter->GetInitializeLocally(); }
+    unsigned int GetMultigridCycles() { return this->flowFilter->GetMultigridCycles(); }
     
     ImageType::Pointer GetPreviewImage();
 
@@ -40,11 +48,17 @@ public:
     void SetRegularization(double reg);
     void SetRelaxation(double relax);
     void SetIterations(unsigned int iter);
+    void SetAbsoluteTolerance(double tolerance);
+    void SetRelativeTolerance(double tolerance);
+    void SetMinimumIterations(unsigned int iter);
+    void SetTileIterations(unsigned int iter);
+    void SetTileRows(unsigned int rows);
+    void SetUseMultigrid(bool multigrid);
+    void SetInitializeLocally(bool local);
+    void SetMultigridCycles(unsigned int cycles);
     
-    virtual void SetInput(ReaderType input);
+    virtual void SetInput(ImageFileSet* input);
 
-    bool UpdateOne();
-    void UpdateAll();
     virtual void Update();
 
 protected:
@@ -55,6 +69,13 @@ private:
     CLGOpticFlowPipeline(const Self& other);
     void operator=(const Self& other);
     
+    /**
+     * A new flow filter with the parameters set on this pipeline, for
+     * one FramePairScheduler worker.
+     */
+    FlowFilterType::Pointer NewFlowFilter();
+
+    // Holds the flow parameters; each worker computes with its own copy
     FlowFilterType::Pointer flowFilter;
     SmoothFilterType::Pointer smooth;
 };
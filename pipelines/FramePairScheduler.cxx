@@ -0,0 +1,228 @@
+#include "FramePairScheduler.h"
+
+#include <exception>
+
+#include "itkExceptionObject.h"
+#include "itkRealTimeClock.h"
+
+#include "MutexLocker.h"
+
+FramePairScheduler::FramePairScheduler(unsigned int capacity) :
+    pending(),
+    queued(),
+    workers(),
+    capacity(capacity),
+    stop(false),
+    computeCount(0),
+    failureCount(0),
+    stallCount(0),
+    stallTime(0.0)
+{
+}
+
+FramePairScheduler::~FramePairScheduler()
+{
+    {
+        MutexLocker lock(this->mutex);
+        this->queued.clear();
+        this->stop = true;
+        this->jobReady.Broadcast();
+    }
+
+    for (unsigned int i = 0; i < this->workers.size(); i++)
+    {
+        this->workers[i]->thread.Join();
+        delete this->workers[i]->worker;
+        delete this->workers[i];
+    }
+
+    for (unsigned int i = 0; i < this->pending.size(); i++)
+        delete this->pending[i];
+}
+
+void FramePairScheduler::AddWorker(Worker* worker)
+{
+    WorkerThread* thread = new WorkerThread();
+    thread->scheduler = this;
+    thread->worker = worker;
+    if (thread->thread.Start(&FramePairScheduler::RunWorker, thread))
+    {
+        MutexLocker lock(this->mutex);
+        this->workers.push_back(thread);
+    }
+    else
+    {
+        Logger::warning << "FramePairScheduler: unable to start worker thread " << this->workers.size() << std::endl;
+        delete worker;
+        delete thread;
+    }
+}
+
+void FramePairScheduler::Submit(unsigned int pair, ImageType* image1, ImageType* image2)
+{
+    Job* job = new Job();
+    job->pair = pair;
+    job->image1 = image1;
+    job->image2 = image2;
+    job->done = false;
+
+    MutexLocker lock(this->mutex);
+    this->pending.push_back(job);
+
+    // With no worker threads the pair would wait forever; fail it
+    if (this->workers.empty())
+    {
+        job->done = true;
+        this->failureCount++;
+        Logger::error << "FramePairScheduler: no worker threads to compute pair " << pair << std::endl;
+        return;
+    }
+
+    this->queued.push_back(job);
+    this->jobReady.Signal();
+}
+
+itk::DataObject::Pointer FramePairScheduler::Take()
+{
+    MutexLocker lock(this->mutex);
+    if (this->pending.empty())
+        return NULL;
+
+    Job* job = this->pending.front();
+    if (!job->done)
+    {
+        // The oldest pair is still being computed; wait for it
+        itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+        double start = clock->GetTimeStamp();
+        while (!job->done)
+            this->jobDone.Wait(this->mutex);
+        this->stallCount++;
+        this->stallTime += clock->GetTimeStamp() - start;
+    }
+
+    this->pending.pop_front();
+    itk::DataObject::Pointer result = job->result;
+    delete job;
+    return result;
+}
+
+void FramePairScheduler::Cancel()
+{
+    MutexLocker lock(this->mutex);
+    for (unsigned int i = 0; i < this->queued.size(); i++)
+    {
+        this->queued[i]->image1 = NULL;
+        this->queued[i]->image2 = NULL;
+        this->queued[i]->done = true;
+    }
+    this->queued.clear();
+}
+
+bool FramePairScheduler::IsFull()
+{
+    return this->GetPendingCount() >= this->GetCapacity();
+}
+
+unsigned int FramePairScheduler::GetPendingCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->pending.size();
+}
+
+unsigned int FramePairScheduler::GetCapacity()
+{
+    MutexLocker lock(this->mutex);
+    return this->capacity > 0 ? this->capacity : 2 * std::max(1u, (unsigned int) this->workers.size());
+}
+
+void FramePairScheduler::RunWorker(void* data)
+{
+    WorkerThread* thread = static_cast< WorkerThread* >(data);
+    thread->scheduler->ComputeJobs(thread->worker);
+}
+
+void FramePairScheduler::ComputeJobs(Worker* worker)
+{
+    this->mutex.Lock();
+    while (true)
+    {
+        while (this->queued.empty() && !this->stop)
+            this->jobReady.Wait(this->mutex);
+        if (this->queued.empty())
+            break;
+
+        Job* job = this->queued.front();
+        this->queued.pop_front();
+        this->mutex.Unlock();
+
+        itk::DataObject::Pointer result;
+        try
+        {
+            result = worker->Compute(job->pair, job->image1, job->image2);
+        }
+        catch (itk::ExceptionObject& e)
+        {
+            Logger::error << "FramePairScheduler: unable to compute pair " << job->pair << ": " << e.GetDescription() << std::endl;
+            result = NULL;
+        }
+        catch (std::exception& e)
+        {
+            // e.g. std::bad_alloc on a large frame; escaping the thread would terminate the run
+            Logger::error << "FramePairScheduler: unable to compute pair " << job->pair << ": " << e.what() << std::endl;
+            result = NULL;
+        }
+        catch (...)
+        {
+            Logger::error << "FramePairScheduler: unable to compute pair " << job->pair << ": unknown exception" << std::endl;
+            result = NULL;
+        }
+
+        this->mutex.Lock();
+        job->result = result;
+        job->image1 = NULL;
+        job->image2 = NULL;
+        job->done = true;
+        if (result)
+            this->computeCount++;
+        else
+            this->failureCount++;
+        this->jobDone.Broadcast();
+    }
+    this->mutex.Unlock();
+}
+
+unsigned long FramePairScheduler::GetComputeCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->computeCount;
+}
+
+unsigned long FramePairScheduler::GetFailureCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->failureCount;
+}
+
+unsigned long FramePairScheduler::GetStallCount()
+{
+    MutexLocker lock(this->mutex);
+    return this->stallCount;
+}
+
+double FramePairScheduler::GetStallTime()
+{
+    MutexLocker lock(this->mutex);
+    return this->stallTime;
+}
+
+void FramePairScheduler::LogStatistics()
+{
+    MutexLocker lock(this->mutex);
+    Logger::verbose << "FramePairScheduler statistics" << std::endl;
+    Logger::verbose << "\tWorkers:   \t" << this->workers.size() << std::endl;
+    Logger::verbose << "\tComputed:  \t" << this->computeCount << std::endl;
+    Logger::verbose << "\tFailed:    \t" << this->failureCount << std::endl;
+    Logger::verbose << "\tStalls:    \t" << this->stallCount << " (" << this->stallTime << " s)" << std::endl;
+    for (unsigned int i = 0; i < this->workers.size(); i++)
+        this->workers[i]->worker->LogStatistics();
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "itkDataObject.h"
+#include "itkMultiThreader.h"
+
+#include "Condition.h"
+#include "ImageFileSet.h"
+#include "ImageUtils.h"
+#include "ImageWriteQueue.h"
+#include "ItkImagePipeline.h"
+#include "Logger.h"
+#include "Mutex.h"
+#include "Thread.h"
+
+/**
+ * \class FramePairScheduler
+ * \brief Computes the frame pairs of a sequence on a pool of worker threads.
+ *
+ * The optical flow pipelines compute one result per frame pair, (0,1),
+ * (1,2), ..., and the pairs do not depend on each other.  The flow
+ * filters scale poorly past a few threads, so on a many-core machine
+ * running several pairs at once, each on a few threads, does far more
+ * work than running one pair at a time on all of them.
+ *
+ * Each worker thread owns a Worker, which holds its own filter
+ * instances; no filter is shared between threads.  The pipeline's
+ * thread reads the frames (image readers are not thread safe), copies
+ * each one once, and submits the pairs; workers take pairs in the
+ * order they were submitted.  Results are taken back in submission
+ * order too, so the output files are written in order whichever worker
+ * finishes first.  At most Capacity pairs are pending at once: queued,
+ * being computed, or finished and waiting to be taken.  That bounds the
+ * memory in use to about Capacity pairs' frames and results.
+ *
+ * Run() does all of this for an ItkImagePipeline: it computes every
+ * pair of the pipeline's input and hands the results to an
+ * ImageWriteQueue, reporting progress as each one is written.
+ */
+class FramePairScheduler
+{
+public:
+    typedef ImageFileSet::ImageType ImageType;
+
+    /**
+     * Computes one frame pair at a time on a worker thread.
+     */
+    class Worker
+    {
+    public:
+        typedef ImageFileSet::ImageType ImageType;
+
+        virtual ~Worker() {}
+
+        /**
+         * Compute the result for the given pair of frames.  Exceptions
+         * are caught and logged by the scheduler, and the pair is
+         * counted as failed.
+         */
+        virtual itk::DataObject::Pointer Compute(unsigned int pair, ImageType* image1, ImageType* image2) = 0;
+
+        /**
+         * Log whatever statistics the worker keeps.
+         */
+        virtual void LogStatistics() {}
+    };
+
+    /**
+     * Create a scheduler that holds up to capacity pending pairs.  Zero
+     * picks twice the number of workers.
+     */
+    FramePairScheduler(unsigned int capacity = 0);
+
+    /**
+     * Stops the workers, dropping any pairs that have not started, and
+     * waits for them to finish the pairs that have.
+     */
+    virtual ~FramePairScheduler();
+
+    /**
+     * Start a worker thread that computes pairs with worker.  The
+     * scheduler takes ownership of worker.
+     */
+    void AddWorker(Worker* worker);
+
+    /**
+     * Queue a pair to be computed.  The scheduler keeps a reference to
+     * both frames until the pair is done; the caller must not change
+     * them.  Take a result first if the scheduler IsFull().
+     */
+    void Submit(unsigned int pair, ImageType* image1, ImageType* image2);
+
+    /**
+     * Wait for the oldest pending pair and return its result; NULL if it
+     * failed or was cancelled.
+     */
+    itk::DataObject::Pointer Take();
+
+    /**
+     * Drop the pairs that have not started.  Take() returns NULL for
+     * them.
+     */
+    void Cancel();
+
+    bool IsFull();
+    unsigned int GetPendingCount();
+    unsigned int GetCapacity();
+    unsigned int GetWorkerCount() const
+    { return this->workers.size(); }
+
+    /**
+     * The number of threads each of the given number of workers should
+     * give its filters, so that all together they use ITK's default
+     * number of threads.
+     */
+    static unsigned int GetThreadsPerWorker(unsigned int workers)
+    {
+        return std::max(1, itk::MultiThreader::GetGlobalDefaultNumberOfThreads() / (int) std::max(1u, workers));
+    }
+
+    /**
+     * Compute every pair of the pipeline's input, up to the number of
+     * output files, and write each result, of type TOutputImage, to the
+     * corresponding output file in order.  Progress is reported with
+     * the given message as results are written, and an abort request
+     * cancels the pairs that have not started.  Returns true if every
+     * pair was computed and written.
+     */
+    template < class TOutputImage >
+    bool Run(ItkImagePipeline* pipeline, const std::string& message);
+
+    /**
+     * Statistics on the work done by this scheduler.  Stalls count the
+     * times Take() had to wait for a pair to finish; the stall time is
+     * the total time spent waiting, in seconds.
+     */
+    unsigned long GetComputeCount();
+    unsigned long GetFailureCount();
+    unsigned long GetStallCount();
+    double GetStallTime();
+    void LogStatistics();
+
+private:
+    /**
+     * A submitted pair and, once it is done, its result.
+     */
+    struct Job
+    {
+        unsigned int pair;
+        ImageType::Pointer image1;
+        ImageType::Pointer image2;
+        itk::DataObject::Pointer result;
+        bool done;
+    };
+
+    /**
+     * A worker and the thread it runs on.
+     */
+    struct WorkerThread
+    {
+        FramePairScheduler* scheduler;
+        Worker* worker;
+        Thread thread;
+    };
+
+    typedef std::deque< Job* > JobQueue;
+    typedef std::vector< WorkerThread* > WorkerVector;
+
+    // Not implemented on purpose.
+    FramePairScheduler(const FramePairScheduler& other);
+    void operator=(const FramePairScheduler& other);
+
+    /**
+     * Worker thread entry point and loop.
+     */
+    static void RunWorker(void* data);
+    void ComputeJobs(Worker* worker);
+
+    Mutex mutex;
+    Condition jobReady;     // signalled when a job is queued, or on shutdown
+    Condition jobDone;      // signalled when a job is finished
+    JobQueue pending;       // every job not yet taken, in submission order
+    JobQueue queued;        // jobs no worker has started
+    WorkerVector workers;
+    unsigned int capacity;
+    bool stop;
+
+    unsigned long computeCount;
+    unsigned long failureCount;
+    unsigned long stallCount;
+    double stallTime;
+};
+
+template < class TOutputImage >
+bool FramePairScheduler::Run(ItkImagePipeline* pipeline, const std::string& message)
+{
+    std::string function("FramePairScheduler::Run");
+    ImageFileSet* input = pipeline->GetInput();
+    const FileSet& files = pipeline->GetOutputFiles();
+    unsigned int count = std::min((unsigned int) (input->GetImageCount() - 1), files.size());
+
+    ImageWriteQueue writer(pipeline->GetWriterThreads(), pipeline->GetWriteQueueLength());
+    bool abort = false;
+    bool ok = true;
+    unsigned int submitted = 0, taken = 0;
+    ImageType::Pointer next;
+    while (taken < submitted || (submitted < count && !abort))
+    {
+        if (submitted < count && !abort && !this->IsFull())
+        {
+            // The reader may reuse its buffers, so each frame is copied,
+            // once, when its first pair is submitted; the next pair
+            // shares the copy's pixels.  ITK data objects are not safe
+            // to share between pipelines on different threads, so each
+            // pair gets its own image objects, grafted onto the copies.
+            ImageType::Pointer previous = next;
+            if (!previous)
+                previous = CopyImage(input->GetImage(submitted));
+            next = CopyImage(input->GetImage(submitted + 1));
+
+            ImageType::Pointer image1 = ImageType::New();
+            ImageType::Pointer image2 = ImageType::New();
+            image1->Graft(previous);
+            image2->Graft(next);
+            this->Submit(submitted, image1, image2);
+            submitted++;
+            continue;
+        }
+
+        itk::DataObject::Pointer result = this->Take();
+        TOutputImage* image = dynamic_cast< TOutputImage* >(result.GetPointer());
+        if (image)
+        {
+            writer.Write(image, files[taken]);
+        }
+        else if (!abort)
+        {
+            Logger::error << function << ": pair " << (taken + 1) << "/" << count << " failed" << std::endl;
+            ok = false;
+        }
+        taken++;
+
+        if (!abort && pipeline->NotifyProgress((double) taken / count, message))
+        {
+            abort = true;
+            this->Cancel();
+        }
+    }
+
+    bool written = writer.Flush();
+    writer.LogStatistics();
+    this->LogStatistics();
+    return !abort && ok && written;
+}
@@ -1,11 +1,91 @@
 #include "HornOpticalFlowPipeline.h"
 
+#include <algorithm>
 #include <string>
 
+#include "itkImageRegionIterator.h"
+
+#include "FlowWarmStart.h"
+#include "FramePairScheduler.h"
 #include "HornOpticalFlowImageFilter.h"
-#include "ImageUtils.h"
 #include "Logger.h"
 
+namespace
+{
+    typedef HornOpticalFlowImageFilter< HornOpticalFlowPipeline::ImageType, HornOpticalFlowPipeline::ImageType, float > FlowFilter;
+
+    /**
+     * Computes Horn and Schunck flow for the pairs given to one
+     * FramePairScheduler worker, with its own flow filter.  With a warm
+     * start, each pair starts from a prediction made from the last
+     * pair's flow.
+     */
+    class HornWorker : public FramePairScheduler::Worker
+    {
+    public:
+        typedef FlowFilter::OutputImageType FlowImageType;
+
+        HornWorker(FlowFilter* filter, unsigned int count) :
+            filter(filter),
+            count(count),
+            warm(false)
+        {}
+
+        /**
+         * Start each pair from the previous pair's flow.
+         */
+        void SetWarmStart(double damping, bool warp)
+        {
+            this->warm = true;
+            this->warmStart.SetDamping(damping);
+            this->warmStart.SetWarp(warp);
+        }
+
+        virtual itk::DataObject::Pointer Compute(unsigned int pair, ImageType* image1, ImageType* image2)
+        {
+            FlowImageType::Pointer initial;
+            if (this->warm)
+                initial = this->warmStart.GetInitialFlow(pair);
+            this->filter->SetInitialFlow(initial);
+            this->filter->SetInput1(image1);
+            this->filter->SetInput2(image2);
+            this->filter->Update();
+            Logger::info << "HornOpticalFlowPipeline::Update: pair " << (pair+1) << "/" << this->count << ": "
+                << this->filter->GetElapsedIterations() << " iterations" << std::endl;
+
+            FlowImageType::Pointer flow = this->filter->GetOutput();
+            flow->DisconnectPipeline();
+            if (this->warm)
+            {
+                // The filter gives the change from the initial flow
+                if (initial)
+                {
+                    typedef itk::ImageRegionIterator< FlowImageType > IteratorType;
+                    IteratorType flowIt(flow, flow->GetBufferedRegion());
+                    IteratorType initIt(initial, initial->GetBufferedRegion());
+                    for (flowIt.GoToBegin(), initIt.GoToBegin(); !flowIt.IsAtEnd(); ++flowIt, ++initIt)
+                        flowIt.Set(flowIt.Get() + initIt.Get());
+                }
+                this->filter->SetInitialFlow(NULL);
+                this->warmStart.SetFlow(pair, flow);
+            }
+            return flow.GetPointer();
+        }
+
+        virtual void LogStatistics()
+        {
+            if (this->warm)
+                this->warmStart.LogStatistics();
+        }
+
+    private:
+        FlowFilter::Pointer filter;
+        unsigned int count;
+        bool warm;
+        FlowWarmStart< FlowImageType > warmStart;
+    };
+}
+
 void HornOpticalFlowPipeline::Update()
 {
     std::string function("HornOpticalFlowPipeline::Update");
@@ -18,28 +98,36 @@ void HornOpticalFlowPipeline::Update()
         return;
     }
     
-    bool abort = this->NotifyProgress(0.0, "Initializing");
+    if (this->NotifyProgress(0.0, "Initializing"))
+    {
+        this->SetSuccess(false);
+        return;
+    }
     
     Logger::debug << function << ": Setting up flow computation" << std::endl;
-    typedef HornOpticalFlowImageFilter< ImageType, ImageType, float > FlowFilter;
-    FlowFilter::Pointer flow = FlowFilter::New();
-    flow->SetIterations(this->GetIterations());
-    flow->SetSpatialSigma(this->GetSpatialSigma());
-    flow->SetSmoothWeighting(this->GetSmoothWeighting());
-    
     unsigned int count = this->input->GetImageCount() - 1;
-    
-    Logger::debug << function << ": Computing flow" << std::endl;
-    for (unsigned int i = 0; 
-         i < count &&
-         i < this->GetOutputFiles().size() &&
-         !abort;
-         i++)
+    unsigned int workers = this->GetPairWorkerCount();
+    FramePairScheduler scheduler;
+    for (unsigned int i = 0; i < workers; i++)
     {
-        flow->SetInput1(CopyImage(this->input->GetImage(i)));
-        flow->SetInput2(this->input->GetImage(i+1));
-        flow->Update();
-        WriteImage(flow->GetOutput(), this->GetOutputFiles()[i]);
-        abort = this->NotifyProgress(((double)(i+1)/count), "Computing flow");
+        FlowFilter::Pointer flow = FlowFilter::New();
+        flow->SetIterations(this->GetIterations());
+        flow->SetSpatialSigma(this->GetSpatialSigma());
+        flow->SetSmoothWeighting(this->GetSmoothWeighting());
+        flow->SetAbsoluteTolerance(this->GetAbsoluteTolerance());
+        flow->SetRelativeTolerance(this->GetRelativeTolerance());
+        flow->SetMinimumIterations(this->GetMinimumIterations());
+        flow->SetTileIterations(this->GetTileIterations());
+        flow->SetTileRows(this->GetTileRows());
+        flow->SetUseMultigrid(this->GetUseMultigrid());
+        flow->SetMultigridCycles(this->GetMultigridCycles());
+        flow->SetNumberOfThreads(FramePairScheduler::GetThreadsPerWorker(workers));
+        HornWorker* worker = new HornWorker(flow, count);
+        if (this->GetWarmStart())
+            worker->SetWarmStart(this->GetWarmStartDamping(), this->GetWarmStartWarp());
+        scheduler.AddWorker(worker);
     }
+    
+    Logger::debug << function << ": Computing flow" << std::endl;
+    this->SetSuccess(scheduler.Run< FlowImageType >(this, "Computing flow"));
 }
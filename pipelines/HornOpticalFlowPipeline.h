@@ -32,6 +32,20 @@ public:
     itkSetMacro(SpatialSigma, float);
     itkGetMacro(SmoothWeighting, float);
     itkSetMacro(SmoothWeighting, float);
+    itkGetMacro(AbsoluteTolerance, double);
+    itkSetMacro(AbsoluteTolerance, double);
+    itkGetMacro(RelativeTolerance, double);
+    itkSetMacro(RelativeTolerance, double);
+    itkGetMacro(MinimumIterations, unsigned int);
+    itkSetMacro(MinimumIterations, unsigned int);
+    itkGetMacro(TileIterations, unsigned int);
+    itkSetMacro(TileIterations, unsigned int);
+    itkGetMacro(TileRows, unsigned int);
+    itkSetMacro(TileRows, unsigned int);
+    itkGetMacro(UseMultigrid, bool);
+    itkSetMacro(UseMultigrid, bool);
+    itkGetMacro(MultigridCycles, unsigned int);
+    itkSetMacro(MultigridCycles, unsigned int);
     
     virtual void Update();
     
@@ -39,7 +53,14 @@ protected:
     HornOpticalFlowPipeline()
     : m_Iterations(200),
       m_SpatialSigma(1.0),
-      m_SmoothWeighting(100)
+      m_SmoothWeighting(100),
+      m_AbsoluteTolerance(0.0),
+      m_RelativeTolerance(0.0),
+      m_MinimumIterations(1),
+      m_TileIterations(1),
+      m_TileRows(64),
+      m_UseMultigrid(false),
+      m_MultigridCycles(4)
     {}
     virtual ~HornOpticalFlowPipeline(){}
     
@@ -51,4 +72,11 @@ private:
     unsigned int m_Iterations;
     float m_SpatialSigma;
     float m_SmoothWeighting;
+    double m_AbsoluteTolerance;
+    double m_RelativeTolerance;
+    unsigned int m_MinimumIterations;
+    unsigned int m_TileIterations;
+    unsigned int m_TileRows;
+    bool m_UseMultigrid;
+    unsigned int m_MultigridCycles;
 };
@@ -19,3 +19,8 @@ ImageFileSet* ItkImagePipeline::GetInput()
 {
     return this->input;
 }
+
+ReaderTelemetry ItkImagePipeline::GetTelemetry()
+{
+    return this->input ? this->input->GetTelemetry() : ReaderTelemetry();
+}
@@ -15,6 +15,11 @@ public:
     virtual void SetInput(ImageFileSet* images);
     virtual ImageFileSet* GetInput();
     
+    /**
+     * The telemetry of the input ImageFileSet.
+     */
+    virtual ReaderTelemetry GetTelemetry();
+    
 protected:
     ItkImagePipeline();
     virtual ~ItkImagePipeline();
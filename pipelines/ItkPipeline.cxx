@@ -1,5 +1,7 @@
 #include "ItkPipeline.h"
 
+#include "Logger.h"
+
 void ItkPipeline::AddObserver(ItkPipelineObserver* observer)
 {
     this->observers.push_back(observer);
@@ -14,12 +16,19 @@ bool ItkPipeline::NotifyProgress(double progress, const std::string& message)
 {
     bool abort = false, abortIt = false;
     
+    ReaderTelemetry telemetry;
+    if (!this->observers.empty())
+        telemetry = this->GetTelemetry();
+    
     // Notify all observers of the progress
     ObserverList::const_iterator it;
     for (it = this->observers.begin(); it != this->observers.end(); ++it)
     {
         if (*it) // check if the object is still there
+        {
+            (*it)->UpdateTelemetry(telemetry);
             abortIt = (*it)->Update(progress, message);
+        }
         // determine if any observer has requested an abort
         abort = (abort || abortIt);
     }
@@ -27,6 +36,11 @@ bool ItkPipeline::NotifyProgress(double progress, const std::string& message)
     return abort;
 }
 
+ReaderTelemetry ItkPipeline::GetTelemetry()
+{
+    return ReaderTelemetry();
+}
+
 const FileSet& ItkPipeline::GetOutputFiles()
 {
     return this->outputFiles;
@@ -36,3 +50,14 @@ void ItkPipeline::SetOutputFiles(const FileSet &files)
 {
     this->outputFiles = files;
 }
+
+unsigned int ItkPipeline::GetPairWorkerCount()
+{
+    unsigned int workers = this->m_PairThreads > 0 ? this->m_PairThreads : 1;
+    if (this->m_WarmStart && workers > 1)
+    {
+        Logger::info << this->GetNameOfClass() << ": warm start computes frame pairs in order, one at a time" << std::endl;
+        workers = 1;
+    }
+    return workers;
+}
@@ -19,7 +19,8 @@
  *
  * An Observer pattern provides progress information for pipeline
  * execution.  Subclasses should periodically call NotifyProgress()
- * from within the Update() method.
+ * from within the Update() method.  Each notification also hands
+ * observers the telemetry of the pipeline's input reader.
  */
 class ItkPipeline :
     public itk::Object
@@ -43,6 +44,13 @@ public:
      * be aborted.
      */
     virtual bool NotifyProgress(double progress, const std::string& message = "");
+    
+    /**
+     * A snapshot of the telemetry of this pipeline's input reader.
+     * Pipelines without an input that keeps telemetry return empty
+     * telemetry.
+     */
+    virtual ReaderTelemetry GetTelemetry();
 
     virtual void SetOutputFiles(const FileSet& files);
     virtual const FileSet& GetOutputFiles();
@@ -50,16 +58,73 @@ public:
     itkGetMacro(Success, bool);
     itkSetMacro(Success, bool);
 
+    /**
+     * Get/Set how output frames are written.  Pipelines hand finished
+     * frames to an ImageWriteQueue with WriterThreads threads that holds
+     * up to WriteQueueLength frames, so computation continues while
+     * earlier frames are encoded and written.
+     */
+    itkGetMacro(WriterThreads, unsigned int);
+    itkSetMacro(WriterThreads, unsigned int);
+    itkGetMacro(WriteQueueLength, unsigned int);
+    itkSetMacro(WriteQueueLength, unsigned int);
+
+    /**
+     * Get/Set the number of frame pairs computed at once.  Pipelines
+     * whose frame pairs are independent (the optical flow pipelines)
+     * compute PairThreads pairs concurrently with a FramePairScheduler,
+     * each on its share of ITK's threads, and still write the results
+     * in order.
+     */
+    itkGetMacro(PairThreads, unsigned int);
+    itkSetMacro(PairThreads, unsigned int);
+
+    /**
+     * Get/Set whether the optical flow pipelines start each frame pair
+     * from the previous pair's flow rather than from zero (see
+     * FlowWarmStart), scaled by WarmStartDamping and, with
+     * WarmStartWarp, carried along itself.  With a convergence
+     * tolerance set, coherent motion then takes far fewer iterations per
+     * pair.  A warm start needs the pairs computed in order, so only one
+     * pair is computed at a time, whatever PairThreads is.
+     */
+    itkGetMacro(WarmStart, bool);
+    itkSetMacro(WarmStart, bool);
+    itkBooleanMacro(WarmStart);
+    itkGetMacro(WarmStartDamping, double);
+    itkSetMacro(WarmStartDamping, double);
+    itkGetMacro(WarmStartWarp, bool);
+    itkSetMacro(WarmStartWarp, bool);
+    itkBooleanMacro(WarmStartWarp);
+
 protected:
     ItkPipeline() : 
         outputFiles(),
-        m_Success(true)
+        m_Success(true),
+        m_WriterThreads(1),
+        m_WriteQueueLength(4),
+        m_PairThreads(1),
+        m_WarmStart(false),
+        m_WarmStartDamping(1.0),
+        m_WarmStartWarp(false)
     {}
     virtual ~ItkPipeline(){}
+
+    /**
+     * The number of frame pairs to compute at once: PairThreads, or one
+     * with WarmStart.
+     */
+    unsigned int GetPairWorkerCount();
     
     ObserverList observers;
     FileSet outputFiles;
     bool m_Success;
+    unsigned int m_WriterThreads;
+    unsigned int m_WriteQueueLength;
+    unsigned int m_PairThreads;
+    bool m_WarmStart;
+    double m_WarmStartDamping;
+    bool m_WarmStartWarp;
     
 private:
     // not implemented
@@ -4,6 +4,8 @@
 
 #include "itkObject.h"
 
+#include "ReaderTelemetry.h"
+
 /**
  * \class ItkPipelineObserver
  * \brief Observer/Subscriber to an ItkPipeline's progress.
@@ -14,6 +16,9 @@
  * information, and optional message, and provides this observer the opportunity
  * to notify the pipeline that it should abort execution when convenient.  The
  * progress update values should be between zero and Maximum.
+ *
+ * Before each Update(), the pipeline passes its input reader's telemetry
+ * to UpdateTelemetry(); the latest is available from GetTelemetry().
  */
 class ItkPipelineObserver :
     public itk::Object
@@ -30,6 +35,15 @@ public:
      */
     virtual bool Update(double progress, const std::string& message) = 0;
     
+    /**
+     * Receive the telemetry of the observed ItkPipeline's input reader.
+     */
+    virtual void UpdateTelemetry(const ReaderTelemetry& telemetry)
+    { this->m_Telemetry = telemetry; }
+    
+    const ReaderTelemetry& GetTelemetry() const
+    { return this->m_Telemetry; }
+    
     itkGetMacro(Progress, double);
 
     itkGetMacro(Maximum, double);
@@ -54,4 +68,5 @@ private:
     double m_Progress;
     double m_Maximum;
     bool m_Aborted;
+    ReaderTelemetry m_Telemetry;
 };
@@ -19,3 +19,8 @@ VectorFileSet* ItkVectorPipeline::GetInput()
 {
     return this->input;
 }
+
+ReaderTelemetry ItkVectorPipeline::GetTelemetry()
+{
+    return this->input ? this->input->GetTelemetry() : ReaderTelemetry();
+}
@@ -14,6 +14,11 @@ public:
     
     virtual void SetInput(VectorFileSet* images);
     virtual VectorFileSet* GetInput();
+    
+    /**
+     * The telemetry of the input VectorFileSet.
+     */
+    virtual ReaderTelemetry GetTelemetry();
 
 protected:
     ItkVectorPipeline();
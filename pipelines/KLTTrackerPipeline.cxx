@@ -0,0 +1,110 @@
+#include "KLTTrackerPipeline.h"
+
+#include <algorithm>
+
+#include "FeatureTrackFile.h"
+#include "FramePyramidCache.h"
+#include "Logger.h"
+
+KLTTrackerPipeline::KLTTrackerPipeline() :
+    m_TrackFile(""),
+    m_NumberOfLevels(3),
+    m_ReseedFrames(5),
+    tracker(TrackerType::New())
+{}
+
+namespace
+{
+    /**
+     * Write the active features of a frame, and drop the lost ones.
+     */
+    bool WriteFrame(FeatureTrackWriter& writer, KLTTrackerPipeline::TrackerType::FeatureList& features)
+    {
+        FeatureTrackFile::PointList points;
+        unsigned int kept = 0;
+        for (unsigned int f = 0; f < features.size(); f++)
+        {
+            if (!features[f].active)
+                continue;
+            FeatureTrackFile::Point point;
+            point.id = features[f].id;
+            point.x = features[f].position[0];
+            point.y = features[f].position[1];
+            points.push_back(point);
+            features[kept++] = features[f];
+        }
+        features.resize(kept);
+        return writer.AppendFrame(points);
+    }
+}
+
+void KLTTrackerPipeline::Update()
+{
+    std::string function("KLTTrackerPipeline::Update");
+    Logger::debug << function << ": Checking parameters" << std::endl;
+    if (!this->input ||
+         this->input->GetImageCount() < 2 ||
+         this->m_TrackFile == "")
+    {
+        Logger::warning << function << ": input and track file not properly configured; aborting" << std::endl;
+        return;
+    }
+
+    if (this->NotifyProgress(0.0, "Initializing"))
+    {
+        this->SetSuccess(false);
+        return;
+    }
+
+    FeatureTrackWriter writer;
+    if (!writer.Open(this->m_TrackFile))
+    {
+        this->SetSuccess(false);
+        return;
+    }
+
+    typedef FramePyramidCache< ImageType > PyramidCacheType;
+    PyramidCacheType pyramids;
+    pyramids.SetNumberOfThreads(this->tracker->GetNumberOfThreads());
+    unsigned int levels = std::max(1U, this->m_NumberOfLevels);
+
+    Logger::debug << function << ": Detecting features" << std::endl;
+    TrackerType::FeatureList features;
+    this->tracker->SetNextFeatureId(0);
+    ImageType* image = this->input->GetImage(0);
+    this->tracker->DetectFeatures(image, features);
+    PyramidCacheType::PyramidType previous = pyramids.GetPyramid(0, levels, image);
+    bool ok = WriteFrame(writer, features);
+
+    Logger::debug << function << ": Tracking features" << std::endl;
+    unsigned int count = this->input->GetImageCount();
+    unsigned int lost = 0;
+    for (unsigned int i = 1; ok && i < count; i++)
+    {
+        image = this->input->GetImage(i);
+        PyramidCacheType::PyramidType current = pyramids.GetPyramid(i, levels, image);
+        this->tracker->TrackFeatures(previous, current, features);
+        unsigned int lostNow = 0;
+        for (unsigned int f = 0; f < features.size(); f++)
+            if (!features[f].active)
+                lostNow++;
+        lost += lostNow;
+
+        unsigned int added = 0;
+        if (this->m_ReseedFrames > 0 && i % this->m_ReseedFrames == 0)
+            added = this->tracker->DetectFeatures(image, features);
+        ok = WriteFrame(writer, features);
+        Logger::verbose << function << ": frame " << i << ": " << lostNow << " features lost, "
+            << added << " added, " << features.size() << " active" << std::endl;
+        previous = current;
+
+        if (this->NotifyProgress((double) i / (count - 1), "Tracking features"))
+            ok = false;
+    }
+
+    ok = writer.Close() && ok;
+    Logger::info << function << ": " << this->tracker->GetNextFeatureId() << " features tracked, "
+        << lost << " lost" << std::endl;
+    pyramids.LogStatistics();
+    this->SetSuccess(ok);
+}
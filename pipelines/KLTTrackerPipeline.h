@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+
+#include "CommonTypes.h"
+#include "ItkImagePipeline.h"
+#include "KLTFeatureTracker.h"
+
+/**
+ * \class KLTTrackerPipeline
+ * \brief Tracks sparse features through an image sequence and writes their tracks.
+ *
+ * Seeds features in the first frame with KLTFeatureTracker's Harris
+ * detector, tracks them frame to frame through the input, and writes
+ * each frame's active features to TrackFile, a feature track file (see
+ * FeatureTrackFile).  Every ReseedFrames frames (zero never) new
+ * features are detected to replace the ones lost.  Each frame's pyramid
+ * of NumberOfLevels levels is built once, by a FramePyramidCache, and
+ * serves both of its frame pairs.
+ *
+ * Tracking a few thousand features costs a small fraction of a dense
+ * flow field and its integration (IntegrateFlowFieldPipeline), so use
+ * this when only trajectories are needed.  The tracker's own parameters
+ * are set on GetTracker().
+ */
+class KLTTrackerPipeline :
+    public ItkImagePipeline
+{
+public:
+    // Common itk typedefs
+    typedef KLTTrackerPipeline Self;
+    typedef ItkImagePipeline Superclass;
+    typedef itk::SmartPointer< Self > Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(KLTTrackerPipeline, ItkImagePipeline);
+
+    typedef CommonTypes::InternalImageType ImageType;
+    typedef KLTFeatureTracker< ImageType > TrackerType;
+
+    /**
+     * Get/Set the name of the track file to write.
+     */
+    itkGetMacro(TrackFile, std::string);
+    itkSetMacro(TrackFile, std::string);
+
+    itkGetMacro(NumberOfLevels, unsigned int);
+    itkSetMacro(NumberOfLevels, unsigned int);
+    itkGetMacro(ReseedFrames, unsigned int);
+    itkSetMacro(ReseedFrames, unsigned int);
+
+    TrackerType* GetTracker()
+    { return this->tracker; }
+
+    virtual void Update();
+
+protected:
+    KLTTrackerPipeline();
+    virtual ~KLTTrackerPipeline() {}
+
+private:
+    // Not implemented
+    KLTTrackerPipeline(const Self& other);
+    void operator=(const Self& other);
+
+    std::string m_TrackFile;
+    unsigned int m_NumberOfLevels;
+    unsigned int m_ReseedFrames;
+    TrackerType::Pointer tracker;
+};
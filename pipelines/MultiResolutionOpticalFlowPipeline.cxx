@@ -1,10 +1,13 @@
 #include "MultiResolutionOpticalFlowPipeline.h"
 
+#include <algorithm>
 #include <string>
 
 #include "CLGOpticFlowImageFilter.h"
+#include "FlowWarmStart.h"
+#include "FramePairScheduler.h"
+#include "FramePyramidCache.h"
 #include "HornOpticalFlowImageFilter.h"
-#include "ImageUtils.h"
 #include "MultiResolutionOpticalFlowMethod.h"
 #include "Logger.h"
 
@@ -43,6 +46,81 @@ MultiResolutionOpticalFlowPipeline::GetPreviewImage()
     return this->harris->GetOutput();
 }
 
+namespace
+{
+    typedef MultiResolutionOpticalFlowPipeline::ImageType ImageType;
+    typedef CLGOpticFlowImageFilter< ImageType, ImageType, float > FlowType;
+//     typedef HornOpticalFlowImageFilter< ImageType, ImageType, float > FlowType;
+    typedef MultiResolutionOpticalFlowMethod< ImageType, ImageType > MRFlowType;
+
+    /**
+     * Computes multi-resolution flow for the pairs given to one
+     * FramePairScheduler worker, with its own flow method and pyramid
+     * cache; the cache still pays off when a worker gets consecutive
+     * pairs.  With a warm start, each pair starts from a prediction made
+     * from the last pair's flow.
+     */
+    class MultiResolutionWorker : public FramePairScheduler::Worker
+    {
+    public:
+        typedef MRFlowType::OutputImageType FlowImageType;
+        typedef FramePyramidCache< ImageType > PyramidCacheType;
+
+        MultiResolutionWorker(MRFlowType* flow) :
+            flow(flow),
+            warm(false)
+        {
+            this->pyramids.SetNumberOfThreads(flow->GetNumberOfThreads());
+        }
+
+        /**
+         * Start each pair from the previous pair's flow.
+         */
+        void SetWarmStart(double damping, bool warp)
+        {
+            this->warm = true;
+            this->warmStart.SetDamping(damping);
+            this->warmStart.SetWarp(warp);
+        }
+
+        virtual itk::DataObject::Pointer Compute(unsigned int pair, ImageType* image1, ImageType* image2)
+        {
+            if (this->warm)
+                this->flow->SetInitialFlow(this->warmStart.GetInitialFlow(pair));
+            unsigned int levels = this->flow->GetNumberOfLevels();
+            this->flow->SetInput1(image1);
+            this->flow->SetInput2(image2);
+            this->flow->SetPyramid1(this->pyramids.GetPyramid(pair, levels, image1));
+            this->flow->SetPyramid2(this->pyramids.GetPyramid(pair+1, levels, image2));
+            this->flow->Update();
+
+            FlowImageType::Pointer output = this->flow->GetOutput();
+            output->DisconnectPipeline();
+            this->flow->SetPyramid1(MRFlowType::PyramidType());
+            this->flow->SetPyramid2(MRFlowType::PyramidType());
+            if (this->warm)
+            {
+                this->flow->SetInitialFlow(NULL);
+                this->warmStart.SetFlow(pair, output);
+            }
+            return output.GetPointer();
+        }
+
+        virtual void LogStatistics()
+        {
+            this->pyramids.LogStatistics();
+            if (this->warm)
+                this->warmStart.LogStatistics();
+        }
+
+    private:
+        MRFlowType::Pointer flow;
+        PyramidCacheType pyramids;
+        bool warm;
+        FlowWarmStart< FlowImageType > warmStart;
+    };
+}
+
 void MultiResolutionOpticalFlowPipeline::Update()
 {
     std::string function("MultiResolutionOpticalFlowPipeline::Update");
@@ -55,38 +133,35 @@ void MultiResolutionOpticalFlowPipeline::Update()
         return;
     }
     
-    bool abort = this->NotifyProgress(0.0, "Initializing");
+    if (this->NotifyProgress(0.0, "Initializing"))
+    {
+        this->SetSuccess(false);
+        return;
+    }
     
     Logger::debug << function << ": Setting up flow computation" << std::endl;
-    
-    typedef CLGOpticFlowImageFilter< ImageType, ImageType, float > FlowType;
-//     typedef HornOpticalFlowImageFilter< ImageType, ImageType, float > FlowType;
-    typedef MultiResolutionOpticalFlowMethod< ImageType, ImageType > MRFlowType;
-    
-    FlowType::Pointer method = FlowType::New();
-    method->SetIterations(this->GetIterations());
-    method->SetSpatialSigma(this->GetSpatialSigma());
-    method->SetIntegrationSigma(this->GetIntegrationSigma());
-    method->SetRegularization(this->GetRegularization());
-//     method->SetRelaxation(this->GetRelaxation());
-    
-    MRFlowType::Pointer flow = MRFlowType::New();
-    flow->SetNumberOfLevels(this->GetNumberOfLevels());
-    flow->SetOpticalFlow(method);
-    
-    unsigned int count = this->input->GetImageCount() - 1;
-    
-    Logger::debug << function << ": Computing flow" << std::endl;
-    for (unsigned int i = 0; 
-         i < count &&
-         i < this->GetOutputFiles().size() &&
-         !abort;
-         i++)
+    unsigned int workers = this->GetPairWorkerCount();
+    FramePairScheduler scheduler;
+    for (unsigned int i = 0; i < workers; i++)
     {
-        flow->SetInput1(CopyImage(this->input->GetImage(i)));
-        flow->SetInput2(this->input->GetImage(i+1));
-        flow->Update();
-        WriteImage(flow->GetOutput(), this->GetOutputFiles()[i]);
-        abort = this->NotifyProgress(((double)(i+1)/count), "Computing flow");
+        FlowType::Pointer method = FlowType::New();
+        method->SetIterations(this->GetIterations());
+        method->SetSpatialSigma(this->GetSpatialSigma());
+        method->SetIntegrationSigma(this->GetIntegrationSigma());
+        method->SetRegularization(this->GetRegularization());
+//         method->SetRelaxation(this->GetRelaxation());
+        method->SetNumberOfThreads(FramePairScheduler::GetThreadsPerWorker(workers));
+        
+        MRFlowType::Pointer flow = MRFlowType::New();
+        flow->SetNumberOfLevels(this->GetNumberOfLevels());
+        flow->SetOpticalFlow(method);
+        flow->SetNumberOfThreads(FramePairScheduler::GetThreadsPerWorker(workers));
+        MultiResolutionWorker* worker = new MultiResolutionWorker(flow);
+        if (this->GetWarmStart())
+            worker->SetWarmStart(this->GetWarmStartDamping(), this->GetWarmStartWarp());
+        scheduler.AddWorker(worker);
     }
+    
+    Logger::debug << function << ": Computing flow" << std::endl;
+    this->SetSuccess(scheduler.Run< FlowImageType >(this, "Computing flow"));
 }
@@ -9,6 +9,7 @@
 #include "MathUtils.h"
 #include "TransformGroup.h"
 #include "ImageUtils.h"
+#include "ImageWriteQueue.h"
 
 MultiResolutionRegistrationPipeline::MultiResolutionRegistrationPipeline()
 {
@@ -135,8 +136,11 @@ void MultiResolutionRegistrationPipeline::Update()
     Logger::info << function << ": " << 1 << "/" << total << std::endl;
 
     // Start at the beginning of the input images
-    // Write the first image, un-changed
-    WriteImage<ImageType, OutputImageType>(this->input->GetImage(0), this->outputFiles[0], false);
+    // Write the first image, un-changed.  The reader reuses its output, so
+    // queue a copy.
+    ImageWriteQueue writer(this->GetWriterThreads(), this->GetWriteQueueLength());
+    ImageType::Pointer first = CopyImage(this->input->GetImage(0));
+    writer.Write<ImageType, OutputImageType>(first.GetPointer(), this->outputFiles[0], false);
 
     abort = this->NotifyProgress(1.0 / total, "Registering...");
     
@@ -174,7 +178,10 @@ void MultiResolutionRegistrationPipeline::Update()
         this->resample->SetOutputSpacing(fixed->GetSpacing());
         this->resample->SetDefaultPixelValue(0);
         this->resample->Update();
-        WriteImage<ImageType, OutputImageType>(this->resample->GetOutput(), this->outputFiles[i+1], false);
+        
+        ImageType::Pointer output = this->resample->GetOutput();
+        output->DisconnectPipeline();
+        writer.Write<ImageType, OutputImageType>(output.GetPointer(), this->outputFiles[i+1], false);
         
         abort = this->NotifyProgress(((double) i+2) / total);
     }
@@ -186,5 +193,7 @@ void MultiResolutionRegistrationPipeline::Update()
     }
 
     // At this point, we have succeeded if we were not stopped.
-    this->SetSuccess(!abort);
+    bool written = writer.Flush();
+    writer.LogStatistics();
+    this->SetSuccess(!abort && written);
 }
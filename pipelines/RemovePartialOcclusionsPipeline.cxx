@@ -11,6 +11,7 @@
 #include "CentralDifferenceImageFilter.h"
 #include "DerivativesToSurfaceImageFilter.h"
 #include "ImageUtils.h"
+#include "ImageWriteQueue.h"
 #include "Logger.h"
 #include "NaryMeanImageFilter.h"
 #include "NaryMedianImageFilter.h"
@@ -88,15 +89,27 @@ void RemovePartialOcclusionsPipeline::Update()
     divide->SetInput2(scale->GetOutput());
     clamp->SetInput(divide->GetOutput());
     
+    // Each repaired frame is handed to the writer, so the clamp must not
+    // share its buffer with the divide filter's output.
+    clamp->InPlaceOff();
+    
+    ImageWriteQueue writer(this->GetWriterThreads(), this->GetWriteQueueLength());
     int count = this->input->GetImageCount();
     for (unsigned int i = 0; 
          i < count && i < this->GetOutputFiles().size(); 
          i++)
     {
         divide->SetInput1(this->input->GetImage(i));
-        WriteImage<ImageType, OutputImageType>(clamp->GetOutput(), this->GetOutputFiles()[i], false);
+        clamp->Update();
+        
+        ImageType::Pointer repaired = clamp->GetOutput();
+        repaired->DisconnectPipeline();
+        writer.Write<ImageType, OutputImageType>(repaired.GetPointer(), this->GetOutputFiles()[i], false);
         this->NotifyProgress(done + (1.0-done) * (double(i+1)/count));
     }
+    
+    this->SetSuccess(writer.Flush());
+    writer.LogStatistics();
 }
 
 /**
@@ -1,8 +1,12 @@
 #include "TextPipelineObserver.h"
 
+#include "itkRealTimeClock.h"
+
 #include "Logger.h"
 
-TextPipelineObserver::TextPipelineObserver()
+TextPipelineObserver::TextPipelineObserver() :
+    m_TelemetryInterval(10.0),
+    lastTelemetry(0.0)
 {
 	std::string function("TextPipelineObserver::TextPipelineObserver");
 	Logger::debug << function << ": constructed." << std::endl;
@@ -22,5 +26,24 @@ bool TextPipelineObserver::Update(double progress, const std::string& message)
             (100*progress) << "%, " << 
             message << std::endl;
     
+    if (progress >= 1.0 && this->GetTelemetry().GetRequestCount() > 0)
+        this->GetTelemetry().Print(Logger::verbose);
+    
     return false;
 }
+
+void TextPipelineObserver::UpdateTelemetry(const ReaderTelemetry& telemetry)
+{
+    std::string function("TextPipelineObserver::UpdateTelemetry");
+    Superclass::UpdateTelemetry(telemetry);
+    if (this->m_TelemetryInterval <= 0.0 || telemetry.GetRequestCount() == 0)
+        return;
+    
+    itk::RealTimeClock::Pointer clock = itk::RealTimeClock::New();
+    double now = clock->GetTimeStamp();
+    if (now - this->lastTelemetry >= this->m_TelemetryInterval)
+    {
+        Logger::info << function << ": input " << telemetry.GetSummary() << std::endl;
+        this->lastTelemetry = now;
+    }
+}
@@ -10,7 +10,9 @@
  * \brief Provides logger updates to the progress of an ItkPipeline object.
  *
  * ItkPipelineObserver that creates logger messages in response to ItkPipeline
- * progress events.
+ * progress events.  Every TelemetryInterval seconds (10 by default; zero
+ * turns it off) it also logs a summary of the input reader's telemetry,
+ * and when the pipeline finishes, the full telemetry at verbose level.
  */
 class TextPipelineObserver :
     public ItkPipelineObserver
@@ -25,6 +27,10 @@ public:
     itkTypeMacro(TextPipelineObserver, ItkPipelineObserver);
     
     virtual bool Update(double progress, const std::string& message);
+    virtual void UpdateTelemetry(const ReaderTelemetry& telemetry);
+    
+    itkGetMacro(TelemetryInterval, double);
+    itkSetMacro(TelemetryInterval, double);
     
 protected:
     TextPipelineObserver();
@@ -34,4 +40,7 @@ private:
     // not implemented
     TextPipelineObserver(const Self& other);
     void operator=(const Self& other);
+    
+    double m_TelemetryInterval;
+    double lastTelemetry;   // time of the last telemetry summary
 };
@@ -16,6 +16,7 @@
 #include "FileSet.h"
 #include "ImageTrackerController.h"
 #include "Logger.h"
+#include "SequenceManifest.h"
 #include "wxUtils.h"
 
 static const std::string IMAGE_FILE_FILTER(
@@ -23,7 +24,8 @@ static const std::string IMAGE_FILE_FILTER(
 
 
 ImageFileSetPanel::ImageFileSetPanel(wxWindow* parent, int id, const wxPoint& pos, const wxSize& size, long style):
-    FilterControlPanel(parent, id, pos, size, wxTAB_TRAVERSAL)
+    FilterControlPanel(parent, id, pos, size, wxTAB_TRAVERSAL),
+    pixelTypePicked(false)
 {
     // begin wxGlade: ImageFileSetPanel::ImageFileSetPanel
     sizer_60_staticbox = new wxStaticBox(this, -1, wxT("Image Files"));
@@ -65,18 +67,7 @@ void ImageFileSetPanel::OnApply(wxCommandEvent &event)
     }
         
     // Select the data type
-    switch (this->radioPixelType->GetSelection())
-    {
-        case 0:
-            this->reader->SetPixelType(CharPixel);
-            break;
-        case 1:
-            this->reader->SetPixelType(ShortPixel);
-            break;
-        case 2:
-            this->reader->SetPixelType(FloatPixel);
-            break;
-    }
+    this->ApplyPixelType(this->panelFileSet->GetFileSet());
     
     // Set the files in the reader
     this->reader->SetFileSet(this->panelFileSet->GetFileSet());
@@ -87,6 +78,7 @@ void ImageFileSetPanel::OnApply(wxCommandEvent &event)
 void ImageFileSetPanel::OnPixelType(wxCommandEvent& event)
 {
 //     this->buttonApply->Enable(true);
+    this->pixelTypePicked = true;
 }
 
 // wxGlade: add ImageFileSetPanel event handlers
@@ -141,6 +133,7 @@ ImageFileSetReader::Pointer ImageFileSetPanel::GetReader()
 void ImageFileSetPanel::SetFileSet(const FileSet& files)
 {
     // update the image file reader
+    this->ApplyPixelType(files);
     this->reader->SetFileSet(files);
     
     // update the file list
@@ -151,3 +144,34 @@ FileSet& ImageFileSetPanel::GetFileSet()
 {
     return this->reader->GetFileSet();
 }
+
+void ImageFileSetPanel::ApplyPixelType(const FileSet& files)
+{
+    // The manifest knows what the files hold without opening them; reading
+    // them in that type keeps cached frames at their size on disk.  A type
+    // the user picked is read as picked.
+    SequenceManifest manifest;
+    if (!this->pixelTypePicked && manifest.Build(files) && manifest.GetComponentCount() == 1)
+    {
+        std::string component = manifest.GetComponentType();
+        if (component == "unsigned_char")
+            this->radioPixelType->SetSelection(0);
+        else if (component == "unsigned_short")
+            this->radioPixelType->SetSelection(1);
+        else if (component != "")
+            this->radioPixelType->SetSelection(2);
+    }
+    
+    switch (this->radioPixelType->GetSelection())
+    {
+        case 0:
+            this->reader->SetPixelType(CharPixel);
+            break;
+        case 1:
+            this->reader->SetPixelType(ShortPixel);
+            break;
+        case 2:
+            this->reader->SetPixelType(FloatPixel);
+            break;
+    }
+}
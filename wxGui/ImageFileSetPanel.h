@@ -45,8 +45,16 @@ private:
     void set_properties();
     void do_layout();
     // end wxGlade
+    
+    /**
+     * Apply the selected pixel type to the reader.  Until the user picks
+     * a type, select the one the files hold, as recorded in their
+     * SequenceManifest.
+     */
+    void ApplyPixelType(const FileSet& files);
 
     ImageFileSetReader::Pointer reader;
+    bool pixelTypePicked;       // the user chose radioPixelType's selection
     
 protected:
     // begin wxGlade: ImageFileSetPanel::attributes
@@ -59,7 +59,8 @@ void RegionPanel::OnRegion(wxCommandEvent &event)
     region.SetIndex(start);
     region.SetSize(size);
     
-    // apply region of interest
+    // apply region of interest; the filter requests only this region
+    // upstream, so the image file reader decodes just the region
     this->roi->SetRegionOfInterest(region);
     this->roi->UpdateOutputInformation();
 }